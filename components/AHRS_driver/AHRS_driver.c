@@ -9,6 +9,7 @@
 #include "AHRS_driver.h"
 
 #define GRAVITY 9.81f
+#define GNSS_REF_FILTER 0.05f		// Ground reference of GNSS altitude - low-pass before flight
 
 static void AHRS_CalcAltitudeP(float press, float ref_press);
 static void AHRS_CalcVelocityPosition();
@@ -27,6 +28,8 @@ static AHRS_t AHRS_d;
 static uint8_t orientation_useAcc = 1;
 static uint8_t orientation_useMag = 0;
 static bool flag_in_flight = false;
+static float gnss_ref_altitude = 0.0f;
+static bool gnss_ref_valid = false;
 
 // !!!! This library is NOT thread-safe !!!!
 
@@ -35,7 +38,8 @@ esp_err_t AHRS_init(int64_t time_us){
 	AHRS_d.prev_time_us = -1;
 
 	AHRS_InitOrientation(&(AHRS_d.orientation));
-	AHRS_kalmanAltitudeAscent_init(0.1f, 0.1f);
+	AHRS_kalmanAltitudeAscent_init(1.0f, 0.1f, 0.0003f, 25.0f, 0.25f);
+	gnss_ref_valid = false;
 
 	return ESP_OK;
 }
@@ -69,6 +73,32 @@ esp_err_t AHRS_compute(int64_t time_us, Sensors_t * sensors){
 	return ESP_OK;
 }
 
+void AHRS_updateGNSS(int64_t rx_time_us, float altitude, float velocity, bool valid){
+	if(!valid)
+		return;
+
+	if(flag_in_flight == false){
+		// Same reference as barometric altitude - ground level at launch
+		gnss_ref_altitude = gnss_ref_valid ? (GNSS_REF_FILTER*altitude + (1.0f - GNSS_REF_FILTER)*gnss_ref_altitude) : altitude;
+		gnss_ref_valid = true;
+		return;
+	}
+
+	if(gnss_ref_valid == false)
+		return;
+
+	int64_t meas_time_us = rx_time_us - (int64_t)CONFIG_KPPTR_GNSS_LATENCY_MS * 1000;
+	float altitude_prev = AHRS_d.altitude;
+	AHRS_kalmanAltitudeAscent_delayedUpdate(meas_time_us, altitude - gnss_ref_altitude, velocity,
+											&(AHRS_d.altitude), &AHRS_d.ascent_rate);
+
+	// The correction shifts the whole estimated trajectory - keep max_altitude on the same reference,
+	// otherwise a downward step looks like an altitude drop after apogee
+	if(AHRS_d.altitude < altitude_prev)
+		AHRS_d.max_altitude += AHRS_d.altitude - altitude_prev;
+	AHRS_d.baro_bias = AHRS_kalmanAltitudeAscent_get()->b;
+}
+
 void AHRS_orientationSettings(uint8_t enableAcc, uint8_t enableMag){
 	orientation_useAcc = enableAcc;
 	orientation_useMag = enableMag;
@@ -129,17 +159,16 @@ static void AHRS_CalcAltitudeP(float press, float ref_press){
 	//ALTITUDE CALCULATIONS
 	float alti_new =  (1.0-powf(kalman_post/ref_press, 0.190295f)) * 44330.0f;
 
-
-	//wykrycie maksymalnego pułapu
-	if((AHRS_d.max_altitude) < alti_new)
-		AHRS_d.max_altitude = alti_new;
-
 	AHRS_d.velocityP = 0.9f*AHRS_d.velocityP + 0.1f*(((alti_new) - AHRS_d.altitudeP) / AHRS_d.dt);
 	AHRS_d.altitudeP = alti_new;
 }
 
 static void AHRS_CalcVelocityPosition(){
-	AHRS_kalmanAltitudeAscent_step(AHRS_d.dt, AHRS_d.altitudeP, AHRS_d.acc_up, &(AHRS_d.altitude), &AHRS_d.ascent_rate);
+	AHRS_kalmanAltitudeAscent_step(AHRS_d.prev_time_us, AHRS_d.dt, AHRS_d.altitudeP, AHRS_d.acc_up, &(AHRS_d.altitude), &AHRS_d.ascent_rate);
+
+	//wykrycie maksymalnego pułapu - z tej samej estymaty co altitude (altitudeP zawiera bias barometru)
+	if((AHRS_d.max_altitude) < AHRS_d.altitude)
+		AHRS_d.max_altitude = AHRS_d.altitude;
 }
 
 static void AHRS_CalcOrientation(Sensors_t * sensors, bool useGyro){
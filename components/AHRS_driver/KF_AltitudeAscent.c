@@ -6,38 +6,142 @@
  */
 
 #include <stdio.h>
-#include "esp_attr.h"
+#include <string.h>
 #include <math.h>
 #include "common.h"
 #include "KF_AltitudeAscent.h"
 
+// Baro bias variance set when GNSS is fused for the first time [m^2]
+#define KF_BIAS_INIT_VARIANCE	(100.0f)
+
 static void AHRS_kalmanAltitudeAscent_propagate (KF_AltitudeAscent_t * KF, float acc, float dt);
-static void AHRS_kalmanAltitudeAscent_update	(KF_AltitudeAscent_t * KF, float altitudeP);
+static bool AHRS_kalmanAltitudeAscent_update	(KF_AltitudeAscent_t * KF, const float H[KF_STATES], float z, float R, float gate);
+static void AHRS_kalmanAltitudeAscent_baroUpdate(KF_AltitudeAscent_t * KF, float altitudeP);
+static void AHRS_kalmanAltitudeAscent_store		(KF_AltitudeAscent_history_t * entry, const KF_AltitudeAscent_t * KF);
 
 KF_AltitudeAscent_t KF_data;
 
-void AHRS_kalmanAltitudeAscent_init(float Q_accel, float R_altitude){
+void AHRS_kalmanAltitudeAscent_init(float Q_accel, float R_altitude, float Q_bias, float R_gnss_altitude, float R_gnss_velocity){
+	memset(KF_data.P, 0, sizeof(KF_data.P));
 	KF_data.P[0][0] = 1.0f;
-	KF_data.P[0][1] = 0.0f;
-	KF_data.P[1][0] = 0.0f;
 	KF_data.P[1][1] = 1.0f;
 
 	KF_data.h = 0.0f;
 	KF_data.v = 0.0f;
+	KF_data.b = 0.0f;
+	KF_data.bias_enabled = false;
 
 	KF_data.Q_accel 	= Q_accel;
+	KF_data.Q_bias		= Q_bias;
 	KF_data.R_altitude 	= R_altitude;
+	KF_data.R_gnss_altitude = R_gnss_altitude;
+	KF_data.R_gnss_velocity = R_gnss_velocity;
+
+	KF_data.history_head  = 0;
+	KF_data.history_count = 0;
+	KF_data.gnss_fused    = 0;
+	KF_data.gnss_rejected = 0;
+	KF_data.gnss_gate_run = 0;
 }
 
-void AHRS_kalmanAltitudeAscent_step(float dt, float altitudeP, float acc_up, float * altitude_result, float * ascentrate_result){
-	AHRS_kalmanAltitudeAscent_propagate(&KF_data, acc_up, dt);
-	AHRS_kalmanAltitudeAscent_update   (&KF_data, altitudeP);
+void AHRS_kalmanAltitudeAscent_step(int64_t time_us, float dt, float altitudeP, float acc_up, float * altitude_result, float * ascentrate_result){
+	AHRS_kalmanAltitudeAscent_propagate (&KF_data, acc_up, dt);
+	AHRS_kalmanAltitudeAscent_baroUpdate(&KF_data, altitudeP);
+
+	// Store the step for delayed measurements
+	KF_data.history_head = (KF_data.history_head + 1) % KF_HISTORY_SIZE;
+	if(KF_data.history_count < KF_HISTORY_SIZE)
+		KF_data.history_count++;
+
+	KF_AltitudeAscent_history_t * entry = &KF_data.history[KF_data.history_head];
+	entry->time_us   = time_us;
+	entry->acc_up    = acc_up;
+	entry->dt        = dt;
+	entry->altitudeP = altitudeP;
+	AHRS_kalmanAltitudeAscent_store(entry, &KF_data);
 
 	*altitude_result   = KF_data.h;
 	*ascentrate_result = KF_data.v;
 }
 
+bool AHRS_kalmanAltitudeAscent_delayedUpdate(int64_t time_us, float altitude, float velocity, float * altitude_result, float * ascentrate_result){
+	static const float H_altitude[KF_STATES] = {1.0f, 0.0f, 0.0f};
+	static const float H_velocity[KF_STATES] = {0.0f, 1.0f, 0.0f};
+	KF_AltitudeAscent_t * KF = &KF_data;
+	uint8_t back;
+
+	// Find the newest step not later than the measurement
+	for(back = 0; back < KF->history_count; back++){
+		if(KF->history[(KF->history_head + KF_HISTORY_SIZE - back) % KF_HISTORY_SIZE].time_us <= time_us)
+			break;
+	}
+	if(back == KF->history_count){
+		KF->gnss_rejected++;
+		return false;
+	}
+
+	// Rewind
+	uint8_t idx = (KF->history_head + KF_HISTORY_SIZE - back) % KF_HISTORY_SIZE;
+	memcpy(KF->x, KF->history[idx].x, sizeof(KF->x));
+	memcpy(KF->P, KF->history[idx].P, sizeof(KF->P));
+
+	if(!KF->bias_enabled){
+		KF->bias_enabled = true;
+		KF->P[2][2] = KF_BIAS_INIT_VARIANCE;
+	}
+
+	// A long run of gate rejections means the filter has drifted away (transonic baro error, atmosphere different
+	// from standard, accelerometer offset under chute), not that every GNSS fix is an outlier. Then GNSS is fused
+	// ungated until the innovation is back inside the gate.
+	bool open = (KF->gnss_gate_run >= KF_GNSS_GATE_LIMIT);
+	bool gated = false, fused = false;
+	if(!isnan(altitude)){
+		gated |= AHRS_kalmanAltitudeAscent_update(KF, H_altitude, altitude, KF->R_gnss_altitude, KF_GNSS_GATE);
+		if(!gated && open)
+			fused |= AHRS_kalmanAltitudeAscent_update(KF, H_altitude, altitude, KF->R_gnss_altitude, 0.0f);
+	}
+	if(!isnan(velocity)){
+		bool ok = AHRS_kalmanAltitudeAscent_update(KF, H_velocity, velocity, KF->R_gnss_velocity, KF_GNSS_GATE);
+		if(!ok && open)
+			fused |= AHRS_kalmanAltitudeAscent_update(KF, H_velocity, velocity, KF->R_gnss_velocity, 0.0f);
+		gated |= ok;
+	}
+	fused |= gated;
+
+	if(fused)
+		KF->gnss_fused++;
+	else
+		KF->gnss_rejected++;
+
+	if(gated)
+		KF->gnss_gate_run = 0;
+	else if(KF->gnss_gate_run < KF_GNSS_GATE_LIMIT)
+		KF->gnss_gate_run++;
+
+	// Replay stored steps with corrected state, history is overwritten so the next delayed measurement starts from it
+	AHRS_kalmanAltitudeAscent_store(&KF->history[idx], KF);
+	for(; back > 0; back--){
+		idx = (idx + 1) % KF_HISTORY_SIZE;
+		KF_AltitudeAscent_history_t * entry = &KF->history[idx];
+
+		AHRS_kalmanAltitudeAscent_propagate (KF, entry->acc_up, entry->dt);
+		AHRS_kalmanAltitudeAscent_baroUpdate(KF, entry->altitudeP);
+		AHRS_kalmanAltitudeAscent_store(entry, KF);
+	}
+
+	*altitude_result   = KF->h;
+	*ascentrate_result = KF->v;
+	return fused;
+}
+
+const KF_AltitudeAscent_t * AHRS_kalmanAltitudeAscent_get(void){
+	return &KF_data;
+}
 
+static void AHRS_kalmanAltitudeAscent_store(KF_AltitudeAscent_history_t * entry, const KF_AltitudeAscent_t * KF){
+	memcpy(entry->x, KF->x, sizeof(entry->x));
+	memcpy(entry->P, KF->P, sizeof(entry->P));
+}
 
 // https://github.com/rblilja/AltitudeKF/blob/master/altitude_kf.cpp
 static void AHRS_kalmanAltitudeAscent_propagate(KF_AltitudeAscent_t * KF, float acc_up, float dt){
@@ -46,6 +150,7 @@ static void AHRS_kalmanAltitudeAscent_propagate(KF_AltitudeAscent_t * KF, float
 
 	// The state vector is defined as x = [h v]' where  'h' is altitude above ground and 'v' velocity, both
 	// aligned with the vertical direction of the Earth NED frame, but positive direction being upwards to zenith.
+	// It is extended by 'b' - bias of the barometric altitude (transonic flight, high altitude), see below.
 
 	// State-space system model 'x_k = A*x_k-1 + B*u_k is given by:
 	//
@@ -76,6 +181,11 @@ static void AHRS_kalmanAltitudeAscent_propagate(KF_AltitudeAscent_t * KF, float
 	//
 	// * I only get half of the math showing 'Q = G * G' * σ^2', so I hide myself behind 'by definition'.
 
+	// The third state 'b' (barometric bias) is a random walk: it is not changed by propagation, its variance grows by
+	// Q_bias*v^2*dT. The baro error comes from dynamic pressure, so the bias is held on the pad and near apogee and
+	// follows the GNSS during the fast part of the flight.
+	// A = [1 dT 0; 0 1 0; 0 0 1], so only the first row/column of 'P' picks up the velocity terms.
+
 	// Calculate the state estimate covariance
 	//
 	// Repeated arithmetics
@@ -85,53 +195,58 @@ static void AHRS_kalmanAltitudeAscent_propagate(KF_AltitudeAscent_t * KF, float
 	KF->P[0][1] = KF->P[0][1] + (KF->P[1][1] + 0.5f*_Q_accel_dtdt) * dt;
 	KF->P[1][0] = KF->P[1][0] + (KF->P[1][1] + 0.5f*_Q_accel_dtdt) * dt;
 	KF->P[1][1] = KF->P[1][1] + _Q_accel_dtdt;
-}
 
-static void AHRS_kalmanAltitudeAscent_update(KF_AltitudeAscent_t * KF, float altitudeP){
-	// Observation vector 'zhat' from the current state estimate:
-	//
-	// zhat_k = [ 1 0 ] * [ h_k ]
-	//                    [ v_k ]
-	//             H
-
-	// 'H' is constant, so its time instance I'm using below is a bit ambitious.
-
-	// The innovation (or residual) is given by 'y = z - zhat', where 'z' is the actual observation i.e. measured state.
+	if(KF->bias_enabled){
+		KF->P[0][2] = KF->P[0][2] + KF->P[1][2] * dt;
+		KF->P[2][0] = KF->P[0][2];
+		KF->P[2][2] = KF->P[2][2] + KF->Q_bias * KF->v * KF->v * dt;
+	}
+}
 
-	// Calculate innovation, in this particular case we observe the altitude state directly by an altitude measurement
-	float y = altitudeP - KF->h;
+static void AHRS_kalmanAltitudeAscent_baroUpdate(KF_AltitudeAscent_t * KF, float altitudeP){
+	// Barometric altitude observes altitude plus bias. Until the bias is enabled its row/column of 'P' is zero
+	// and this is exactly the original 2-state altitude update.
+	static const float H_baro[KF_STATES] = {1.0f, 0.0f, 1.0f};
 
-	// The innovation covariance is defined as 'S_k = H_k * P_k|k-1 * H'_k + R_k', for this particular case
-	// 'H_k * P_k|k-1 * H'_k' is equal to the first row first column element of 'P_k|k-1' i.e. P_00.
+	AHRS_kalmanAltitudeAscent_update(KF, H_baro, altitudeP, KF->R_altitude, 0.0f);
+}
 
-	// The Kalman gain equals 'K_k = P_k|k-1 * H'_k * S_k^-1', where
+static bool AHRS_kalmanAltitudeAscent_update(KF_AltitudeAscent_t * KF, const float H[KF_STATES], float z, float R, float gate){
+	// Observation 'zhat = H * x' of the current state estimate, for the measurements used here 'H' is one of
 	//
-	// P_k|k-1 * H'_k = [ P_00 ]
-	//                  [ P_10 ]
+	//   baro:          [ 1 0 1 ]
+	//   GNSS altitude: [ 1 0 0 ]
+	//   GNSS velocity: [ 0 1 0 ]
 	//
-	// and 'S_k^-1' equals '1/S_k' since 'S_k^-1' is being a scalar (that is a good thing!).
+	// Every measurement is a scalar, so the innovation covariance 'S_k = H_k * P_k|k-1 * H'_k + R_k' is a scalar
+	// and its inverse is a division.
+
+	// P_k|k-1 * H'_k
+	float PHt[KF_STATES];
+	for(uint8_t i=0; i<KF_STATES; i++)
+		PHt[i] = KF->P[i][0]*H[0] + KF->P[i][1]*H[1] + KF->P[i][2]*H[2];
 
-	// Calculate the inverse of the innovation covariance
-	float Sinv = 1.0f / (KF->P[0][0] + KF->R_altitude);
+	// Innovation and its covariance
+	float y = z - (H[0]*KF->x[0] + H[1]*KF->x[1] + H[2]*KF->x[2]);
+	float S = H[0]*PHt[0] + H[1]*PHt[1] + H[2]*PHt[2] + R;
 
-	// Calculate the Kalman gain
-	float K[2] = { KF->P[0][0] * Sinv, KF->P[1][0] * Sinv };
+	// Reject outliers (gate = 0 -> always accept)
+	if((gate > 0.0f) && (y*y > gate*S))
+		return false;
+
+	// Calculate the Kalman gain 'K_k = P_k|k-1 * H'_k * S_k^-1'
+	float Sinv = 1.0f / S;
+	float K[KF_STATES] = { PHt[0] * Sinv, PHt[1] * Sinv, PHt[2] * Sinv };
 
 	// Update the state estimate
-	KF->h += K[0] * y;
-	KF->v += K[1] * y;
+	for(uint8_t i=0; i<KF_STATES; i++)
+		KF->x[i] += K[i] * y;
 
-	// The "a posteriori" state estimate error covariance equals 'P_k|k = (I - K_k * H_k) * P_k|k-1', where
-	//
-	//  (I - K_k * H_k) = ( [ 1 0 ] - [ K_0 ] * [ 1 0 ] ) = [ (1-K_0) 0  ] , thus
-	//                    ( [ 0 1 ]   [ K_1 ]           )   [ -K_1    1  ]
-	//
-	//  P_k|k = (I - K_k * H_k) * P_k+1|k = [ (1-K_0) 0 ] * [ P_00 P_01 ] = [ (1-K_0)*P_00       (1-K_0)*P_01       ]
-	//					[ -K_1    1 ]   [ P_10 P_11 ]   [ (-K_1*P_00 + P_10) (-K_1*P_01 + P_11) ]
+	// The "a posteriori" state estimate error covariance equals 'P_k|k = (I - K_k * H_k) * P_k|k-1', which can be
+	// written as 'P_k|k-1 - K_k * (P_k|k-1 * H'_k)'' - 'P' is symmetric so 'H_k * P_k|k-1 = (P_k|k-1 * H'_k)''
+	for(uint8_t i=0; i<KF_STATES; i++)
+		for(uint8_t j=0; j<KF_STATES; j++)
+			KF->P[i][j] -= K[i] * PHt[j];
 
-	// Calculate the state estimate covariance
-	KF->P[0][0] = KF->P[0][0] - (K[0] * KF->P[0][0]);
-	KF->P[0][1] = KF->P[0][1] - (K[0] * KF->P[0][1]);
-	KF->P[1][0] = KF->P[1][0] - (K[1] * KF->P[0][0]);
-	KF->P[1][1] = KF->P[1][1] - (K[1] * KF->P[0][1]);
+	return true;
 }
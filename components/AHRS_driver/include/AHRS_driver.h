@@ -54,6 +54,7 @@ typedef struct{
 
 	float altitudeP;				/*!< Altitude above a reference point calculated from pressure. [m] */
 	float velocityP;				/*!< Vertical velocity calculated from pressure. [m/s] */
+	float baro_bias;				/*!< Barometric altitude bias estimated from GNSS. [m] */
 
 	uint64_t prev_time_us;			/*!< Previous time stamp (in microseconds). */
 	float dt;						/*!< Time step (in seconds). */
@@ -80,6 +81,16 @@ AHRS_t * AHRS_getData();
  */
 esp_err_t AHRS_compute(int64_t time_us, Sensors_t * sensors);
 
+/**
+ * @brief Passes new GNSS data to the vertical filter. Before flight it sets the GNSS altitude reference,
+ * in flight the measurement is fused at its time of validity (rx_time_us - CONFIG_KPPTR_GNSS_LATENCY_MS).
+ * @param[in] rx_time_us The time the GNSS data was received.
+ * @param[in] altitude GNSS altitude. [m]
+ * @param[in] velocity GNSS vertical velocity (NAN if not available). [m/s]
+ * @param[in] valid True if the receiver has a fix.
+ */
+void AHRS_updateGNSS(int64_t rx_time_us, float altitude, float velocity, bool valid);
+
 /**
  * @brief Configures the orientation settings for the AHRS module.
  * @param[in] enableAcc True to enable acceleration data for orientation calculations, false to disable.
@@ -1,32 +1,91 @@
 #ifndef COMPONENTS_AHRS_DRIVER_INCLUDE_KF_ALTITUDEASCENT_H_
 #define COMPONENTS_AHRS_DRIVER_INCLUDE_KF_ALTITUDEASCENT_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KF_STATES			(3)		/*!< h, v, baro bias */
+#define KF_HISTORY_SIZE		(32)	/*!< Filter steps kept for delayed measurements (320 ms at 100 Hz) */
+#define KF_GNSS_GATE		(25.0f)	/*!< Innovation gate for GNSS measurements (5 sigma squared) */
+#define KF_GNSS_GATE_LIMIT	(10)	/*!< Consecutive gate rejections after which GNSS is fused ungated until it passes the gate again */
+
+/**
+ * @brief Filter state and inputs of one step, used to replay the filter from a delayed measurement.
+ */
+typedef struct {
+	int64_t time_us;			/*!< Step timestamp. */
+	float x[KF_STATES];			/*!< State after the step. */
+	float P[KF_STATES][KF_STATES];	/*!< Covariance after the step. */
+	float acc_up;				/*!< Step input - vertical acceleration. */
+	float dt;					/*!< Step input - time step. */
+	float altitudeP;			/*!< Step input - barometric altitude. */
+} KF_AltitudeAscent_history_t;
+
 /**
  * @brief Structure representing the variables for a Kalman filter used for altitude ascent estimation.
  */
 typedef struct {
-	float h;
-	float v;
-	float P[2][2];
+	union{
+		struct{
+			float h;			/*!< Altitude. [m] */
+			float v;			/*!< Vertical velocity. [m/s] */
+			float b;			/*!< Barometric altitude bias. [m] */
+		};
+		float x[KF_STATES];
+	};
+	float P[KF_STATES][KF_STATES];
 	float Q_accel;
+	float Q_bias;
 	float R_altitude;
+	float R_gnss_altitude;
+	float R_gnss_velocity;
+	bool bias_enabled;			/*!< Bias is estimated after first GNSS measurement, it is unobservable before. */
+
+	KF_AltitudeAscent_history_t history[KF_HISTORY_SIZE];
+	uint8_t history_head;		/*!< Index of the newest entry. */
+	uint8_t history_count;		/*!< Number of valid entries. */
+
+	uint32_t gnss_fused;		/*!< Statistics - GNSS measurements fused. */
+	uint32_t gnss_rejected;		/*!< Statistics - GNSS measurements too old or outside of the gate. */
+	uint8_t gnss_gate_run;		/*!< Consecutive GNSS measurements rejected by the gate. */
 } KF_AltitudeAscent_t;
 
 /**
  * @brief Initializes the Kalman filter for altitude ascent estimation.
  * @param[in] Q_accel The process noise variance for acceleration.
  * @param[in] R_altitude The measurement noise variance for altitude.
+ * @param[in] Q_bias The random walk variance of barometric bias, scaled by velocity squared. [m^2/s per (m/s)^2]
+ * @param[in] R_gnss_altitude The measurement noise variance for GNSS altitude.
+ * @param[in] R_gnss_velocity The measurement noise variance for GNSS vertical velocity.
  */
-void AHRS_kalmanAltitudeAscent_init(float Q_accel, float R_altitude);
+void AHRS_kalmanAltitudeAscent_init(float Q_accel, float R_altitude, float Q_bias, float R_gnss_altitude, float R_gnss_velocity);
 
 /**
  * @brief Performs a step in the Kalman filter for altitude ascent estimation.
+ * @param[in] time_us The step timestamp.
  * @param[in] dt The time step.
  * @param[in] altitudeP The measured altitude.
  * @param[in] accZ The measured acceleration in the Z axis.
  * @param[out] altitude_result The estimated altitude.
  * @param[out] ascentrate_result The estimated vertical velocity.
  */
-void AHRS_kalmanAltitudeAscent_step(float dt, float altitudeP, float acc_up, float * altitude_result, float * ascentrate_result);
+void AHRS_kalmanAltitudeAscent_step(int64_t time_us, float dt, float altitudeP, float acc_up, float * altitude_result, float * ascentrate_result);
+
+/**
+ * @brief Fuses a delayed GNSS measurement. The filter is rewound to the measurement time and replayed up to the newest step.
+ * @param[in] time_us The time of validity of the measurement (same clock as step timestamps).
+ * @param[in] altitude GNSS altitude relative to the same reference as barometric altitude, NAN if not available.
+ * @param[in] velocity GNSS vertical velocity, NAN if not available.
+ * @param[out] altitude_result The estimated altitude.
+ * @param[out] ascentrate_result The estimated vertical velocity.
+ * @return true if the measurement was fused, false if it is older than the history or was rejected by the gate.
+ */
+bool AHRS_kalmanAltitudeAscent_delayedUpdate(int64_t time_us, float altitude, float velocity, float * altitude_result, float * ascentrate_result);
+
+/**
+ * @brief Gets the filter data (for bias and statistics).
+ * @return A pointer to the filter structure.
+ */
+const KF_AltitudeAscent_t * AHRS_kalmanAltitudeAscent_get(void);
 
 #endif /* COMPONENTS_AHRS_DRIVER_INCLUDE_KF_ALTITUDEASCENT_H_ */
@@ -4,6 +4,7 @@
 #include "freertos/task.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "driver/adc.h"
 #include "driver/temp_sensor.h"
@@ -17,12 +18,15 @@
 #include "esp32s3/ulp_riscv_adc.h"
 #include "hal/adc_ll.h"
 #include "hal/adc_hal.h"
+#include "soc/rtc.h"
+#include "esp_private/esp_clk.h"
 #include "main_ulp_adc.h"
+#include "ulp/ulp_adc.h"
 extern const uint8_t ulp_main_bin_start[] asm("_binary_main_ulp_adc_bin_start");
 extern const uint8_t ulp_main_bin_end[]   asm("_binary_main_ulp_adc_bin_end");
 static esp_err_t ulp_init_analog();
 static esp_err_t ulp_run_analog();
-static esp_err_t ulp_execute_and_wait();
+static uint16_t ulp_read_ring(Analog_meas_t * meas);
 static void ulp_riscv_reset();
 
 #define GET_UNIT(x)        ((x>>3) & 0x1)
@@ -39,6 +43,9 @@ static uint32_t voltage_ign[IGN_NUM] = {0};
 static uint32_t voltage_vbat = 0;
 static float	mcu_temp	 = 0.0f;
 static uint32_t vbat_mV_raw = 0;
+static uint32_t adc_raw[ADC_CHANNELS_NUM] = {0};	// Mean of the ULP samples since the previous update
+static uint32_t ring_tail = 0;						// ULP samples read so far
+static bool     adc_ready = false;					// ADC1 handed over to the ULP
 
 
 uint32_t Analog_getIGN(uint32_t ign_num, uint32_t vbat);
@@ -73,19 +80,34 @@ esp_err_t Analog_init(uint32_t ign_det_thr_val, float filter)
 	esp_adc_cal_value_t val_type = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_2_5, ADC_WIDTH_BIT_12, 1100, &adc_chars);
 	ESP_LOGI(TAG, "ADC calibration type: %i, Vref: %u", (int)val_type, adc_chars.vref);
 
-	// Init ADC for ULP
-	if(ulp_init_analog() != ESP_OK){
-		ESP_LOGE(TAG, "ULP ADC init failed!");
+	// Init ADC for ULP - once, the RTC mode of ADC1 is held until reboot and a retry would block on it
+	if(!adc_ready){
+		if(ulp_init_analog() != ESP_OK){
+			ESP_LOGE(TAG, "ULP ADC init failed!");
+			return ESP_FAIL;
+		}
+		adc_ready = true;
+	}
+
+	// ULP samples on its own timer from now on
+	ulp_riscv_reset();
+	if(ulp_run_analog() != ESP_OK){
+		ESP_LOGE(TAG, "ULP start failed!");
 		return ESP_FAIL;
 	}
+	ring_tail = ulp_HEAD;
 
 	//temp_sensor_read_celsius(&mcu_temp);	// Not implemented for ULP yet
 
 	return ESP_OK;
 }
 
+static uint32_t Analog_rawToVBAT(uint32_t raw){
+	return esp_adc_cal_raw_to_voltage(raw, &adc_chars) * 11.0f * 1.024f;
+}
+
 uint32_t Analog_getIGN(uint32_t ign_num, uint32_t vbat){
-	uint32_t voltage = esp_adc_cal_raw_to_voltage((&ulp_IGN_RAW)[ign_num], &adc_chars);
+	uint32_t voltage = esp_adc_cal_raw_to_voltage(adc_raw[ign_num + 1], &adc_chars);
 	ESP_LOGV(TAG, "IGN1 voltage: %dmV", voltage);
 
     voltage_ign[ign_num] = filter_coeff_ign * voltage + (1-filter_coeff_ign) * voltage_ign[ign_num];
@@ -94,12 +116,11 @@ uint32_t Analog_getIGN(uint32_t ign_num, uint32_t vbat){
 }
 
 uint32_t Analog_getVBAT(){
-	uint32_t voltage = esp_adc_cal_raw_to_voltage(ulp_VBAT_RAW, &adc_chars);
-	vbat_mV_raw = voltage * 11.0f * 1.024f;
+	vbat_mV_raw = Analog_rawToVBAT(adc_raw[0]);
 
     voltage_vbat = filter_coeff * vbat_mV_raw + (1-filter_coeff) * voltage_vbat;
 
-    ESP_LOGV(TAG, "Raw: %i,   voltage: %i	Vbat: %imV", ulp_VBAT_RAW, voltage, voltage_vbat);
+    ESP_LOGV(TAG, "Raw: %i,   Vbat: %imV", adc_raw[0], voltage_vbat);
     return voltage_vbat;
 }
 
@@ -113,8 +134,12 @@ float Analog_getTempMCU(){
 }
 
 void Analog_update(Analog_meas_t * meas){
-	// Execute ULP program and wait for results
-	ulp_execute_and_wait();
+	// Samples of the ULP since the previous update, nothing to wait for
+	if(ulp_read_ring(meas) == 0){
+		meas->samples = 0;
+		ESP_LOGW(TAG, "No ULP samples since the last update");
+		return;
+	}
 
 	meas->vbat_mV = Analog_getVBAT();
 
@@ -186,31 +211,56 @@ static esp_err_t ulp_run_analog(){
 	// Load ULP RISCV program
 	ESP_LOGV(TAG, "Load ULP code. Program size: %i B", (ulp_main_bin_end - ulp_main_bin_start));
 	esp_err_t err = ulp_riscv_load_binary(ulp_main_bin_start, (ulp_main_bin_end - ulp_main_bin_start));
-	ESP_ERROR_CHECK(err);
-
-	/* Start the program */
-	ulp_set_wakeup_period(0, 20000);
-	err = ulp_riscv_run();
-	ESP_ERROR_CHECK(err);
+	if(err != ESP_OK)
+		return err;
 
-	return err;
+	/* Start the program, the wake timer repeats it */
+	ulp_set_wakeup_period(0, ULP_ADC_PERIOD_US);
+	return ulp_riscv_run();
 }
 
-static esp_err_t ulp_execute_and_wait(){
-	//Run ADC ULP program
-	ulp_riscv_reset();
-	ulp_run_analog();
+// Reads the samples published since the previous call - ADC means, VBAT extremes and time of the newest sample
+static uint16_t ulp_read_ring(Analog_meas_t * meas){
+	volatile ulp_adc_sample_t * ring = (volatile ulp_adc_sample_t *)&ulp_RING;
+	uint32_t head = ulp_HEAD;
+	uint32_t count = head - ring_tail;
+	uint32_t sum[ADC_CHANNELS_NUM] = {0};
+	uint16_t raw_min = UINT16_MAX, raw_max = 0;
+
+	if(count == 0)
+		return 0;
+
+	// Slot at head is being written - keep one spare slot in case the ULP publishes during the read
+	if(count > (ULP_ADC_RING_LEN - 2)){
+		ESP_LOGD(TAG, "%u ULP samples overwritten before read", count - (ULP_ADC_RING_LEN - 2));
+		count = ULP_ADC_RING_LEN - 2;
+	}
+
+	for(uint32_t n=head-count; n!=head; n++){
+		volatile ulp_adc_sample_t * sample = &ring[n % ULP_ADC_RING_LEN];
 
-	// Wait max 1000 ticks for ADC results
-	for(uint8_t i=0; i<5; i++){
-		if(ulp_READY == 1){
-			return ESP_OK;
+		for(uint8_t i=0; i<ADC_CHANNELS_NUM; i++){
+			sum[i] += sample->raw[i];
 		}
-		vTaskDelay(10);
+		if(sample->raw[0] < raw_min)
+			raw_min = sample->raw[0];
+		if(sample->raw[0] > raw_max)
+			raw_max = sample->raw[0];
 	}
+	ring_tail = head;
+
+	for(uint8_t i=0; i<ADC_CHANNELS_NUM; i++){
+		adc_raw[i] = sum[i] / count;
+	}
+	meas->vbat_min_mV = Analog_rawToVBAT(raw_min);
+	meas->vbat_max_mV = Analog_rawToVBAT(raw_max);
+	meas->samples     = count;
+
+	// RTC slow clock ticks of the newest sample to esp_timer time
+	uint32_t age = (uint32_t)rtc_time_get() - ring[(head - 1) % ULP_ADC_RING_LEN].time;
+	meas->time_us = esp_timer_get_time() - (int64_t)rtc_time_slowclk_to_us(age, esp_clk_slowclk_cal_get());
 
-	ESP_LOGW(TAG, "ULP to slow...");
-	return ESP_FAIL;
+	return count;
 }
 
 static void ulp_riscv_reset()
@@ -6,6 +6,10 @@
 typedef struct{
 	int8_t IGN_det[IGN_NUM];
 	uint32_t vbat_mV;
+	uint32_t vbat_min_mV;	/*!< Lowest VBAT sample since the previous update - sag during igniter firing. */
+	uint32_t vbat_max_mV;	/*!< Highest VBAT sample since the previous update. */
+	uint16_t samples;		/*!< ULP samples since the previous update, 0 - no new data. */
+	int64_t time_us;		/*!< Time of the newest sample (esp_timer). */
 	float temp;
 } Analog_meas_t;
 
@@ -24,7 +28,8 @@ esp_err_t Analog_init(uint32_t ign_det_thr_val, float filter);
 float Analog_getTempMCU();
 
 /**
- * @brief Update the analog measurements.
+ * @brief Update the analog measurements from the samples the ULP took since the previous call. Never waits -
+ * the ULP samples VBAT and the igniter channels on its own timer into a ring in RTC memory.
  * @param[out] analog Pointer to a ::Analog_meas_t structure where the measurements will be stored.
  */
 void Analog_update(Analog_meas_t *);
@@ -1,10 +1,7 @@
-/* ULP-RISC-V example
+/* ULP-RISC-V ADC sampling
 
-   This example code is in the Public Domain (or CC0 licensed, at your option.)
-
-   Unless required by applicable law or agreed to in writing, this
-   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
-   CONDITIONS OF ANY KIND, either express or implied.
+   Runs on the ULP wake timer, independent of the main CPU. Every wake writes one timestamped sample of VBAT
+   and the igniter channels into RING and then increments HEAD - the main CPU reads only published samples.
 
    This code runs on ULP-RISC-V  coprocessor
 */
@@ -20,49 +17,43 @@
 #include "hal/adc_types.h"
 #include "hal/adc_ll.h"
 #include "BOARD.h"
+#include "ulp_adc.h"
 
 /* this variables will be exported as a public symbol, visible from main CPU: */
-volatile uint32_t VBAT_RAW 	= 0;
-volatile uint32_t IGN_RAW[IGN_NUM] 	= {0};
-volatile uint32_t READY		= 0;
-volatile uint32_t ERROR		= 0;
-
-#define VBAT_OVERSAMPLE 128
+volatile ulp_adc_sample_t RING[ULP_ADC_RING_LEN];
+volatile uint32_t HEAD	= 0;		/* Samples written since start, RING[(HEAD - 1) % ULP_ADC_RING_LEN] is the newest */
+volatile uint32_t WARM	= 0;		/* ADC settled after the first wake */
 
 int main (void)
 {
-	uint32_t ADC_RAW[ADC_CHANNELS_NUM]	= {0};
 	uint32_t ADC_CHANNELS[ADC_CHANNELS_NUM] = {ADC_CHANNELS_LIST};
+	volatile ulp_adc_sample_t * sample = &RING[HEAD % ULP_ADC_RING_LEN];
 
-	for(uint8_t i=0; i<8; i++){
-		ERROR = 1;
-		ulp_riscv_adc_read_channel(ADC_NUM_1, ADC_CHANNELS[0]);
-		ERROR = 0;
+	// First reads after start are off - once, variables keep their values between wakes
+	if(WARM == 0){
+		for(uint8_t i=0; i<8; i++){
+			ulp_riscv_adc_read_channel(ADC_NUM_1, ADC_CHANNELS[0]);
+		}
+		WARM = 1;
 	}
 
+	SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+	sample->time = READ_PERI_REG(RTC_CNTL_TIME0_REG);
 
 	//----------------- ADC MEAS--------------------------
-	ERROR = 1;
 	for(uint8_t i=0; i<ADC_CHANNELS_NUM; i++){
-		ADC_RAW[i] = 0;
-		for(uint16_t j=0; j<VBAT_OVERSAMPLE; j++){
-			ADC_RAW[i] += ulp_riscv_adc_read_channel(ADC_NUM_1, ADC_CHANNELS[i]);
-		}
-		ADC_RAW[i] = ADC_RAW[i] / VBAT_OVERSAMPLE;
-	}
-	ERROR = 0;
-
-	//------ Rewrite Measurements to dedicated external variables ----
-	VBAT_RAW = ADC_RAW[0];
+		uint32_t oversample = (i == 0) ? ULP_ADC_VBAT_OVERSAMPLE : ULP_ADC_IGN_OVERSAMPLE;
+		uint32_t sum = 0;
 
-	for(uint8_t i=0; i<IGN_NUM; i++){
-		IGN_RAW[i] = ADC_RAW[i+1];
+		for(uint32_t j=0; j<oversample; j++){
+			sum += ulp_riscv_adc_read_channel(ADC_NUM_1, ADC_CHANNELS[i]);
+		}
+		sample->raw[i] = sum / oversample;
 	}
 
-	//----------------- ULP ADC ready ------------------
-	READY = 1;
+	//----------------- Publish the sample ------------------
+	HEAD++;
 
-	CLEAR_PERI_REG_MASK(RTC_CNTL_ULP_CP_TIMER_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
-    /* ulp_riscv_shutdown() is called automatically when main exits */
+    /* ulp_riscv_shutdown() is called automatically when main exits, the wake timer starts the next sample */
     return 0;
 }
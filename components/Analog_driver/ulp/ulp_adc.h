@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include "BOARD.h"
+
+/* Shared by the ULP program and Analog_driver.c - the ring lives in RTC slow memory (CONFIG_ESP32S3_ULP_COPROC_RESERVE_MEM) */
+
+#define ULP_ADC_PERIOD_US		10000		/* ULP wake timer, one sample per wake */
+#define ULP_ADC_RING_LEN		64			/* 640 ms of samples - covers the slowest Analog_update() (500 ms in flight) */
+#define ULP_ADC_VBAT_OVERSAMPLE	16
+#define ULP_ADC_IGN_OVERSAMPLE	4
+
+typedef struct{
+	uint32_t time;						/* RTC slow clock ticks, low 32 bits */
+	uint16_t raw[ADC_CHANNELS_NUM];		/* VBAT, IGN1..n - mean of the oversampled reads */
+} ulp_adc_sample_t;
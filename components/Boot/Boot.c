@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include "Boot.h"
+
+#define BOOT_STACK			(1024*4)
+#define BOOT_PRIORITY		(configMAX_PRIORITIES - 15)		// Below the application tasks - a running loop is never delayed by an init
+
+typedef struct{
+	Boot_stageConfig_t config;
+	Boot_stats_t stats;
+} boot_stage_t;
+
+static const char *TAG = "Boot";
+
+static boot_stage_t boot_stages[BOOT_MAX_STAGES];
+static uint8_t boot_stages_num = 0;
+static uint8_t boot_done_num = 0;			// Ready or failed
+static bool boot_started = false;
+static EventGroupHandle_t boot_events;		// Bit per ready stage
+static StaticEventGroup_t boot_events_struct;
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t Boot_init(void){
+	boot_events = xEventGroupCreateStatic(&boot_events_struct);
+	if(boot_events == NULL){
+		ESP_LOGE(TAG, "Failed to create event group -> boot_events");
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+Boot_stage_t Boot_addStage(const Boot_stageConfig_t * config){
+	if(boot_started || (boot_stages_num >= BOOT_MAX_STAGES) || (config->init == NULL)){
+		ESP_LOGE(TAG, "Stage %s rejected", config->name);
+		return -1;
+	}
+
+	// Only stages registered earlier - no cycles, no dependency on a failed registration
+	if(config->depends & ~((1UL << boot_stages_num) - 1)){
+		ESP_LOGE(TAG, "Stage %s depends on an unknown stage", config->name);
+		return -1;
+	}
+
+	boot_stage_t * stage = &boot_stages[boot_stages_num];
+	memset(stage, 0, sizeof(boot_stage_t));
+	stage->config = *config;
+	stage->stats.state = BOOT_WAITING;
+	return boot_stages_num++;
+}
+
+static void boot_summary(void){
+	int64_t last_us = 0;
+
+	for(uint8_t i=0; i<boot_stages_num; i++){
+		Boot_stats_t * stats = &boot_stages[i].stats;
+
+		if(stats->state == BOOT_READY){
+			ESP_LOGI(TAG, "%-10s ready %5lld ms (init %4u ms, %u attempts)", boot_stages[i].config.name,
+					stats->ready_us/1000, stats->init_us/1000, stats->attempts);
+			if(stats->ready_us > last_us)
+				last_us = stats->ready_us;
+		} else {
+			ESP_LOGE(TAG, "%-10s failed", boot_stages[i].config.name);
+		}
+	}
+	ESP_LOGI(TAG, "Boot finished in %lld ms", last_us/1000);
+}
+
+static void boot_task(void *pvParameter){
+	Boot_stage_t id = (Boot_stage_t)(intptr_t)pvParameter;
+	boot_stage_t * stage = &boot_stages[id];
+	uint32_t retry_ms = stage->config.retry_ms;
+
+	if(stage->config.depends)
+		xEventGroupWaitBits(boot_events, stage->config.depends, pdFALSE, pdTRUE, portMAX_DELAY);
+
+	stage->stats.start_us = esp_timer_get_time();
+	stage->stats.state = BOOT_INIT;
+	while(1){
+		int64_t time_us = esp_timer_get_time();
+
+		stage->stats.attempts++;
+		if(stage->config.init(stage->config.ctx) == ESP_OK){
+			stage->stats.ready_us = esp_timer_get_time();
+			stage->stats.init_us = stage->stats.ready_us - time_us;
+			stage->stats.state = BOOT_READY;
+			xEventGroupSetBits(boot_events, BOOT_BIT(id));
+			break;
+		}
+
+		if(retry_ms == 0){
+			ESP_LOGE(TAG, "%s - init failed", stage->config.name);
+			stage->stats.state = BOOT_FAILED;
+			break;
+		}
+
+		ESP_LOGW(TAG, "%s - init failed, retry in %u ms", stage->config.name, retry_ms);
+		vTaskDelay(pdMS_TO_TICKS( retry_ms ));
+		retry_ms = (retry_ms * 2 < BOOT_RETRY_MAX_MS) ? (retry_ms * 2) : BOOT_RETRY_MAX_MS;
+	}
+
+	portENTER_CRITICAL(&boot_lock);
+	bool last = (++boot_done_num == boot_stages_num);
+	portEXIT_CRITICAL(&boot_lock);
+
+	if(last)
+		boot_summary();
+	vTaskDelete(NULL);
+}
+
+esp_err_t Boot_start(void){
+	char name[configMAX_TASK_NAME_LEN];
+
+	boot_started = true;
+	for(uint8_t i=0; i<boot_stages_num; i++){
+		snprintf(name, sizeof(name), "boot_%s", boot_stages[i].config.name);
+		if(xTaskCreatePinnedToCore(&boot_task, name, BOOT_STACK, (void *)(intptr_t)i, BOOT_PRIORITY,
+										NULL, boot_stages[i].config.core) != pdPASS){
+			ESP_LOGE(TAG, "Failed to create task of stage %s", boot_stages[i].config.name);
+			return ESP_FAIL;
+		}
+	}
+
+	ESP_LOGI(TAG, "%u stages started", boot_stages_num);
+	return ESP_OK;
+}
+
+esp_err_t Boot_wait(uint32_t stages, TickType_t wait){
+	EventBits_t bits = xEventGroupWaitBits(boot_events, stages, pdFALSE, pdTRUE, wait);
+	return ((bits & stages) == stages) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+bool Boot_isReady(Boot_stage_t stage){
+	if((stage < 0) || (stage >= boot_stages_num))
+		return false;
+
+	return (xEventGroupGetBits(boot_events) & BOOT_BIT(stage)) != 0;
+}
+
+Boot_stats_t Boot_getStats(Boot_stage_t stage){
+	Boot_stats_t stats;
+
+	memset(&stats, 0, sizeof(stats));
+	if((stage < 0) || (stage >= boot_stages_num))
+		return stats;
+
+	return boot_stages[stage].stats;
+}
+
+char * Boot_statsCreateJSON(void){
+	static const char * state_name[] = {"waiting", "init", "ready", "failed"};
+	char *string = NULL;
+	cJSON *json = cJSON_CreateObject();
+	int64_t last_us = 0;
+
+	cJSON *list = cJSON_CreateArray();
+	for(uint8_t i=0; i<boot_stages_num; i++){
+		Boot_stats_t stats = Boot_getStats(i);
+		cJSON *stage = cJSON_CreateObject();
+
+		cJSON_AddStringToObject(stage, "name", boot_stages[i].config.name);
+		cJSON_AddStringToObject(stage, "state", state_name[stats.state]);
+		cJSON_AddNumberToObject(stage, "depends", boot_stages[i].config.depends);
+		cJSON_AddNumberToObject(stage, "attempts", stats.attempts);
+		cJSON_AddNumberToObject(stage, "start_ms", stats.start_us/1000);
+		cJSON_AddNumberToObject(stage, "ready_ms", stats.ready_us/1000);
+		cJSON_AddNumberToObject(stage, "init_ms", stats.init_us/1000);
+		cJSON_AddItemToArray(list, stage);
+
+		if(stats.ready_us > last_us)
+			last_us = stats.ready_us;
+	}
+	cJSON_AddBoolToObject(json, "done", boot_done_num == boot_stages_num);
+	cJSON_AddNumberToObject(json, "ready_ms", last_us/1000);
+	cJSON_AddItemToObject(json, "stages", list);
+
+	string = cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return string;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define BOOT_MAX_STAGES		16
+#define BOOT_BIT(stage)		(((stage) >= 0) ? (1UL << (stage)) : (1UL << 31))	/*!< Mask of one stage, a failed registration gives a bit ::Boot_addStage rejects */
+#define BOOT_RETRY_MAX_MS	2000		/*!< Retry delay doubles up to this */
+
+typedef int8_t Boot_stage_t;	/*!< Stage handle, negative - not registered */
+
+/**
+ * @brief Stage initialization.
+ * @return ESP_OK once the stage is ready - the return value is its readiness condition.
+ */
+typedef esp_err_t (*Boot_init_t)(void * ctx);
+
+typedef struct{
+	const char * name;			/*!< Name in logs and statistics. */
+	Boot_init_t init;
+	void * ctx;					/*!< Passed to init. */
+	uint32_t depends;			/*!< ::BOOT_BIT mask of stages that must be ready before init starts, registered earlier. */
+	uint16_t retry_ms;			/*!< First retry delay, 0 - one attempt only (init not safe to repeat). */
+	uint8_t core;				/*!< Core of the init task - interrupts installed by init are serviced on it. */
+} Boot_stageConfig_t;
+
+typedef enum{
+	BOOT_WAITING,				/*!< Dependencies not ready. */
+	BOOT_INIT,					/*!< Init running or waiting for a retry. */
+	BOOT_READY,
+	BOOT_FAILED,				/*!< Single attempt failed, stages depending on it never start. */
+} Boot_state_t;
+
+/**
+ * @brief Per-stage boot metrics, times from the start of the application (esp_timer, bootloader not included).
+ */
+typedef struct{
+	Boot_state_t state;
+	uint16_t attempts;			/*!< Init calls. */
+	int64_t start_us;			/*!< Dependencies ready, first init call. */
+	int64_t ready_us;			/*!< Init succeeded, 0 - not yet. */
+	uint32_t init_us;			/*!< Duration of the successful init call. */
+} Boot_stats_t;
+
+/**
+ * @brief Initialize the boot sequencer.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ */
+esp_err_t Boot_init(void);
+
+/**
+ * @brief Register a stage. Call before ::Boot_start. A stage can depend only on stages registered before it,
+ * so the dependency graph has no cycles.
+ * @param[in] config Stage configuration, copied.
+ * @return Stage handle, negative if the table is full or a dependency is not registered.
+ */
+Boot_stage_t Boot_addStage(const Boot_stageConfig_t * config);
+
+/**
+ * @brief Start all stages. Every stage gets its own init task below the priority of the periodic tasks,
+ * it waits for the dependencies, calls init until it succeeds and deletes itself. Stages without a
+ * dependency path between them initialize concurrently.
+ * @return ESP_OK on success, ESP_FAIL if a task could not be created.
+ */
+esp_err_t Boot_start(void);
+
+/**
+ * @brief Wait until all selected stages are ready.
+ * @param stages ::BOOT_BIT mask.
+ * @param wait Maximum wait in ticks.
+ * @return ESP_OK if ready, ESP_ERR_TIMEOUT otherwise.
+ */
+esp_err_t Boot_wait(uint32_t stages, TickType_t wait);
+
+/**
+ * @brief Check a stage without waiting.
+ * @param stage Stage handle.
+ * @return true if the stage is ready.
+ */
+bool Boot_isReady(Boot_stage_t stage);
+
+/**
+ * @brief Get metrics of one stage.
+ * @param stage Stage handle.
+ * @return Boot_stats_t, zeroed for a wrong handle.
+ */
+Boot_stats_t Boot_getStats(Boot_stage_t stage);
+
+/**
+ * @brief Create json string with metrics of all stages.
+ * @return string* with json, must be freed by caller. NULL on error.
+ */
+char * Boot_statsCreateJSON(void);
@@ -4,104 +4,285 @@
 #include "esp_err.h"
 #include "BOARD.h"
 #include "DataManager.h"
-#define DA_MAIN_QUEUE_SIZE 100
+#include "DataManager_preview.h"
+#include "DataManager_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#define DA_HIGH_WATERMARK  (DM_STORAGE_DEPTH * 3 / 4)	// Start of burst drain
+#define DA_LOW_WATERMARK   (DM_STORAGE_DEPTH / 4)		// End of burst drain
+
+//--------------- Storage pipeline ----------------------
+static portMUX_TYPE dm_lock = portMUX_INITIALIZER_UNLOCKED;	// Gap and statistics - updated from both cores
+static DataGap_t dm_gap;					// Pending gap, lost = 0 - none
+static DM_storageStats_t dm_stats;
+static bool dm_draining = false;			// Storage task writes the queue, before it drops are the pre-launch history rotating
+static bool dm_burst = false;
+static int64_t dm_window_start_us = 0;
+static uint32_t dm_window_bytes = 0;
+
+//--------------- Logging policy ----------------------
+static DM_logPolicy_t dm_policy = {
+	.ascent_hz 	= CONFIG_KPPTR_MEAS_RATE_HZ,
+	.descent_hz = CONFIG_KPPTR_MEAS_RATE_HZ,
+	.landed_hz 	= CONFIG_KPPTR_LOG_RATE_HZ,
+};
+static uint8_t dm_log_state = 0xFF;		// Flight state of the open window
+static uint16_t dm_log_divider = 0;		// Samples per window, 0 - no window open
+static bool dm_log_envelope = false;
+static DataEnvelope_t dm_envelope;
 
-//--------------- Main Data Buffer ----------------
-static DataPackage_t DataPackage_rb[DA_MAIN_QUEUE_SIZE] __attribute__((aligned(4)));
+//--------------- Misc variables ----------------------
+static const char *TAG = "Data ag.";
+static uint16_t packet_counter = 0;
 
-//--------------- QUEUE variables ------------------
-QueueHandle_t  queue_StorageFree;
-QueueHandle_t  queue_StorageUsed;
+esp_err_t DM_init(){
+	memset(&dm_gap, 0, sizeof(dm_gap));
+	memset(&dm_stats, 0, sizeof(dm_stats));
 
-static StaticQueue_t  queue_StorageFree_struct;
-static StaticQueue_t  queue_StorageUsed_struct;
+	ESP_LOGI(TAG, "Init done");
+	return ESP_OK;
+}
 
-static uint8_t queue_StorageFree_buf[ DA_MAIN_QUEUE_SIZE * sizeof(&DataPackage_rb) ];
-static uint8_t queue_StorageUsed_buf[ DA_MAIN_QUEUE_SIZE * sizeof(&DataPackage_rb) ];
+#define DM_STATS_ADD(field, n)	do{ portENTER_CRITICAL(&dm_lock); dm_stats.field += (n); portEXIT_CRITICAL(&dm_lock); }while(0)
+
+//--------------------------- Lost records --------------------------
+static void IRAM_ATTR DM_addToGap(uint32_t sys_time, uint32_t * counter){
+	portENTER_CRITICAL(&dm_lock);
+	(*counter)++;
+	if(dm_gap.lost == 0)
+		dm_gap.sys_time = sys_time;
+	dm_gap.last_time = sys_time;
+	dm_gap.lost++;
+	dm_gap.lost_total++;
+	portEXIT_CRITICAL(&dm_lock);
+}
 
+void IRAM_ATTR DM_overwriteRecord(const DataPackage_t * package){
+	if(dm_draining)
+		DM_addToGap(package->sys_time, &dm_stats.overwritten);
+}
 
-//--------------- Misc variables ----------------------
-static const char *TAG = "Data ag.";
-static uint16_t packet_counter = 0;
+//--------------------------- Storage pipeline --------------------------
+void DM_storageStart(){
+	if(dm_draining)
+		return;
 
-esp_err_t DM_init(){
-	memset(DataPackage_rb, 0, sizeof(DataPackage_rb));
-
-	//----- Create queues ----------
-	queue_StorageFree = xQueueCreateStatic( DA_MAIN_QUEUE_SIZE,
-							sizeof(&DataPackage_rb[0]),
-							queue_StorageFree_buf,
-							&queue_StorageFree_struct);
-	queue_StorageUsed = xQueueCreateStatic( DA_MAIN_QUEUE_SIZE,
-							sizeof(&DataPackage_rb[0]),
-							queue_StorageUsed_buf,
-							&queue_StorageUsed_struct);
-
-	//----- Check queues -----------
-	if(queue_StorageFree == 0){
-		ESP_LOGE(TAG, "Failed to create queue -> queue_StorageFree");
-		return ESP_FAIL;
-	}
-	if(queue_StorageUsed == 0){
-		ESP_LOGE(TAG, "Failed to create queue -> queue_StorageUsed");
-		return ESP_FAIL;
+	dm_draining = true;
+	ESP_LOGI(TAG, "Storage drain started");
+}
+
+uint16_t DM_storageBurstSize(uint16_t depth){
+	portENTER_CRITICAL(&dm_lock);
+	dm_stats.depth = depth;
+	if(depth > dm_stats.depth_max)
+		dm_stats.depth_max = depth;
+	portEXIT_CRITICAL(&dm_lock);
+
+	if(!dm_burst && (depth >= DA_HIGH_WATERMARK)){
+		dm_burst = true;
+		DM_STATS_ADD(bursts, 1);
+		ESP_LOGW(TAG, "Storage queue above high watermark (%i) - burst write", depth);
 	}
 
-	//----- Init queue -------------
-	for(uint8_t i=0; i<DA_MAIN_QUEUE_SIZE; i++){
-		DataPackage_t * DataPackage_ptr = &(DataPackage_rb[i]);
-		if(xQueueSend(queue_StorageFree, &DataPackage_ptr, 100) != pdTRUE){
-			ESP_LOGE(TAG, "Failed to add to Main RB!");
-			return ESP_FAIL;
-		}
+	if(dm_burst){
+		if(depth > DA_LOW_WATERMARK)
+			return depth - DA_LOW_WATERMARK;
+		dm_burst = false;
 	}
 
-	ESP_LOGI(TAG, "RB init done");
-	return ESP_OK;
+	return 1;
+}
+
+static void DM_countWritten(uint32_t bytes){
+	int64_t now = esp_timer_get_time();
+
+	if(dm_window_start_us == 0)
+		dm_window_start_us = now;
+
+	dm_window_bytes += bytes;
+	if((now - dm_window_start_us) >= 1000000){
+		uint32_t throughput = ((uint64_t)dm_window_bytes * 1000000) / (now - dm_window_start_us);
+		portENTER_CRITICAL(&dm_lock);
+		dm_stats.throughput_Bps = throughput;
+		portEXIT_CRITICAL(&dm_lock);
+		dm_window_start_us = now;
+		dm_window_bytes = 0;
+	}
 }
 
-uint16_t DM_checkWaitingElementsNumber(){
-	return DA_MAIN_QUEUE_SIZE-uxQueueSpacesAvailable(queue_StorageUsed);
+// One record of the storage queue to the log - v2 encodes it into the current chunk, bytes are counted when a chunk is written
+static esp_err_t DM_writeRecord(const DataPackage_t * package, DM_write_t write){
+#if CONFIG_KPPTR_LOG_V2
+	uint32_t flushed = 0;
+	esp_err_t status = DM_logEncode(package, write, &flushed);
+
+	if(flushed > 0)
+		DM_countWritten(flushed);
+	return status;
+#else
+	esp_err_t status = write((void *)package, sizeof(DataPackage_t));
+
+	if(status == ESP_OK)
+		DM_countWritten(sizeof(DataPackage_t));
+	return status;
+#endif
 }
 
-//-------------------------- Unload from Main RB ---------------------------
-esp_err_t DM_getUsedPointerFromMainRB(DataPackage_t ** ptr){
-	if(xQueueReceive(queue_StorageUsed, ptr, 0) != pdTRUE)
-		return ESP_FAIL;
+esp_err_t DM_storeFlush(DM_write_t write){
+#if CONFIG_KPPTR_LOG_V2
+	uint32_t flushed = 0;
+	esp_err_t status = DM_logFlush(write, &flushed);
 
+	if(flushed > 0)
+		DM_countWritten(flushed);
+	return status;
+#else
 	return ESP_OK;
+#endif
+}
+
+esp_err_t DM_storeRecord(const DataPackage_t * package, DM_write_t write){
+	DataGap_t gap;
+
+	portENTER_CRITICAL(&dm_lock);
+	gap = dm_gap;
+	dm_gap.lost = 0;
+	portEXIT_CRITICAL(&dm_lock);
+
+	if(gap.lost > 0){
+		memset(gap.reserved, 0, sizeof(gap.reserved));
+		memset(gap.reserved_end, 0, sizeof(gap.reserved_end));
+		gap.flightstate = DM_GAP_MARKER;
+
+		if(DM_writeRecord((DataPackage_t *)&gap, write) == ESP_OK){
+			DM_STATS_ADD(gaps, 1);
+			ESP_LOGW(TAG, "Gap of %u records stored (%u total)", gap.lost, gap.lost_total);
+		} else {
+			// Put back, merged with anything lost in the meantime
+			portENTER_CRITICAL(&dm_lock);
+			if(dm_gap.lost > 0)
+				gap.last_time = dm_gap.last_time;
+			gap.lost += dm_gap.lost;
+			gap.lost_total = dm_gap.lost_total;
+			dm_gap = gap;
+			portEXIT_CRITICAL(&dm_lock);
+		}
+	}
+
+	esp_err_t status = DM_writeRecord(package, write);
+	if(status == ESP_OK){
+		DM_STATS_ADD(written, 1);
+		DM_previewAdd(package);
+	} else {
+		DM_dropRecord(package);
+	}
+
+	return status;
 }
 
-esp_err_t DM_getUsedPointerFromMainRB_wait(DataPackage_t ** ptr){
-	if(xQueueReceive(queue_StorageUsed, ptr, pdMS_TO_TICKS( 100 )) != pdTRUE)
-		return ESP_FAIL;
+void DM_dropRecord(const DataPackage_t * package){
+	DM_addToGap(package->sys_time, &dm_stats.dropped);
+}
 
-	return ESP_OK;
+DM_storageStats_t DM_getStorageStats(){
+	DM_storageStats_t stats;
+
+	portENTER_CRITICAL(&dm_lock);
+	stats = dm_stats;
+	portEXIT_CRITICAL(&dm_lock);
+	return stats;
+}
+
+//--------------------------- Logging policy --------------------------
+static uint16_t DM_clampRate(uint16_t rate_hz){
+	if(rate_hz < 1)
+		return 1;
+	if(rate_hz > CONFIG_KPPTR_MEAS_RATE_HZ)
+		return CONFIG_KPPTR_MEAS_RATE_HZ;
+	return rate_hz;
 }
 
-esp_err_t DM_returnUsedPointerToMainRB(DataPackage_t ** ptr){
-	if(xQueueSend(queue_StorageFree, ptr, 0) != pdTRUE)
-			return ESP_FAIL;
+void DM_setLogPolicy(const DM_logPolicy_t * policy){
+	dm_policy.ascent_hz  = DM_clampRate(policy->ascent_hz);
+	dm_policy.descent_hz = DM_clampRate(policy->descent_hz);
+	dm_policy.landed_hz  = DM_clampRate(policy->landed_hz);
 
-	return ESP_OK;
+	ESP_LOGI(TAG, "Log rate: ascent %u Hz, descent %u Hz, landed %u Hz",
+			dm_policy.ascent_hz, dm_policy.descent_hz, dm_policy.landed_hz);
 }
 
-//--------------------------- Loading to Main RB --------------------------
-esp_err_t IRAM_ATTR DM_getFreePointerToMainRB(DataPackage_t ** ptr){
-	if(xQueueReceive(queue_StorageFree, ptr, 0) != pdTRUE){
-		//no free item in Free Queue get oldest from Used Queue
-		if(xQueueReceive(queue_StorageUsed, ptr, 0) != pdTRUE)
-				return ESP_FAIL;
+static uint16_t DM_logRate(uint8_t flightstate){
+	switch(flightstate){
+	case FLIGHTSTATE_ME_ACCELERATING:
+	case FLIGHTSTATE_FREEFLIGHT:
+		return dm_policy.ascent_hz;
+	case FLIGHTSTATE_FREEFALL:
+	case FLIGHTSTATE_DRAGCHUTE_FALL:
+	case FLIGHTSTATE_MAINSHUTE_FALL:
+		return dm_policy.descent_hz;
+	case FLIGHTSTATE_LANDING:
+		return dm_policy.landed_hz;
+	default:
+		return CONFIG_KPPTR_MEAS_RATE_HZ;
 	}
+}
 
-	return ESP_OK;
+void DM_envelopeValues(const DataPackage_t * package, float * values){
+	values[DM_ENV_ACC_X] 		= package->sensors.accX;
+	values[DM_ENV_ACC_Y] 		= package->sensors.accY;
+	values[DM_ENV_ACC_Z] 		= package->sensors.accZ;
+	values[DM_ENV_GYRO_X] 		= package->sensors.gyroX;
+	values[DM_ENV_GYRO_Y] 		= package->sensors.gyroY;
+	values[DM_ENV_GYRO_Z] 		= package->sensors.gyroZ;
+	values[DM_ENV_PRESSURE] 	= package->sensors.pressure;
+	values[DM_ENV_ALTITUDE] 	= package->ahrs.altitude_kalman;
+	values[DM_ENV_ASCENT_RATE] 	= package->ahrs.ascent_rate_kalman;
 }
 
-esp_err_t DM_addToMainRB(DataPackage_t ** ptr){
-	if(xQueueSend(queue_StorageUsed, ptr, 0) != pdTRUE)
-		return ESP_FAIL;
+uint8_t DM_logDecimate(const DataPackage_t * package, DataEnvelope_t * envelope){
+	uint8_t action = 0;
+	float values[DM_ENV_CHANNELS];
 
-	return ESP_OK;
+	DM_envelopeValues(package, values);
+
+	// Close the window when full or when the flight phase changes
+	if((dm_log_divider > 0) && ((dm_envelope.samples >= dm_log_divider) || (package->flightstate != dm_log_state))){
+		if(dm_log_envelope && (dm_envelope.samples > 1)){
+			*envelope = dm_envelope;
+			DM_STATS_ADD(envelopes, 1);
+			action |= DM_LOG_ENVELOPE;
+		}
+		dm_log_divider = 0;
+	}
+
+	if(dm_log_divider == 0){
+		uint16_t rate_hz = DM_logRate(package->flightstate);
+
+		dm_log_state 	= package->flightstate;
+		dm_log_divider 	= (CONFIG_KPPTR_MEAS_RATE_HZ + rate_hz / 2) / rate_hz;
+		dm_log_envelope = (dm_log_divider > 1) && (package->flightstate != FLIGHTSTATE_LANDING);
+
+		memset(&dm_envelope, 0, sizeof(dm_envelope));
+		dm_envelope.flightstate = DM_ENVELOPE_MARKER;
+		dm_envelope.sys_time 	= package->sys_time;
+		memcpy(dm_envelope.min, values, sizeof(values));
+		memcpy(dm_envelope.max, values, sizeof(values));
+
+		action |= DM_LOG_RECORD;
+	} else {
+		for(uint8_t i=0; i<DM_ENV_CHANNELS; i++){
+			if(values[i] < dm_envelope.min[i])
+				dm_envelope.min[i] = values[i];
+			if(values[i] > dm_envelope.max[i])
+				dm_envelope.max[i] = values[i];
+		}
+		DM_STATS_ADD(decimated, 1);
+	}
+
+	dm_envelope.last_time = package->sys_time;
+	dm_envelope.samples++;
+
+	return action;
 }
 
 void IRAM_ATTR DM_collectFlash(DataPackage_t * package, int64_t time_us, Sensors_t * sensors, gps_t * gps, AHRS_t * ahrs,
@@ -157,37 +338,39 @@ void IRAM_ATTR DM_collectFlash(DataPackage_t * package, int64_t time_us, Sensors
 #endif
 
 	package->vbat_mV 			= (uint16_t)analog->vbat_mV;
+	package->vbat_min_mV 		= (uint16_t)analog->vbat_min_mV;
 
-	package->blank[0]			= 0;
-	package->blank[1]			= 0;
-	package->blank[2]			= 0;
-	package->blank[3]			= 0;
-	package->blank[4]			= 0;
+	for(uint8_t i=0; i<SYSMGR_TASKMON_NUM; i++){
+		package->deadline_miss[i] = (uint8_t)SysMgr_getTaskMonitor(i)->deadline_miss;
+	}
 
 	package->flightstate = (uint8_t)flightstate;
 }
 
-void IRAM_ATTR DM_collectRF(DataPackageRF_t * package, int64_t time_us, Sensors_t * sensors, gps_t * gps, AHRS_t * ahrs, flightstate_t flightstate, IGN_t * ign){
-	package->id           = 1024;
+void DM_packRF(DataPackageRF_t * package, const DataPackage_t * sample, int64_t time_us){
+	memset(package, 0, sizeof(DataPackageRF_t));
+
+	package->id           = CONFIG_KPPTR_RF_DEVICE_ID;
 	package->packet_no    = packet_counter++;
-	package->packet_id    = 0x00AA;	//packet_id - 0x0001 -> first type of test frame
+	package->packet_id    = DM_RF_PACKET_ID;	//packet_id - 0x0001 -> first type of test frame
 	package->timestamp_ms = (uint32_t)(time_us/1000);
 
 	package->vbat_10  = 0;						// 1mV/LSB -> 100mV/LSB
-	package->accX_100 = (int16_t)(sensors->LSM6DSO32.accX * 100.0f);
-	package->accY_100 = (int16_t)(sensors->LSM6DSO32.accY * 100.0f);
-	package->accZ_100 = (int16_t)(sensors->LSM6DSO32.accZ * 100.0f);
+	package->accX_100 = (int16_t)(sample->sensors.accX * 100.0f);
+	package->accY_100 = (int16_t)(sample->sensors.accY * 100.0f);
+	package->accZ_100 = (int16_t)(sample->sensors.accZ * 100.0f);
 
-	package->gyroX_10 = (int16_t)(sensors->LSM6DSO32.gyroX * 100.0f);
-	package->gyroY_10 = (int16_t)(sensors->LSM6DSO32.gyroY * 100.0f);
-	package->gyroZ_10 = (int16_t)(sensors->LSM6DSO32.gyroZ * 100.0f);
+	package->gyroX_10 = (int16_t)(sample->sensors.gyroX * 100.0f);
+	package->gyroY_10 = (int16_t)(sample->sensors.gyroY * 100.0f);
+	package->gyroZ_10 = (int16_t)(sample->sensors.gyroZ * 100.0f);
 
-	package->pressure = sensors->MS5607.press;
+	package->pressure = sample->sensors.pressure;
 
-	package->lat      = (int32_t)(gps->latitude  * 10000000.0f);
-	package->lon      = (int32_t)(gps->longitude * 10000000.0f);
-	package->alti_gps = (int32_t)(gps->altitude);
-	package->sats_fix     = ((gps->sats_in_use) & 0x3F) | (((uint8_t)(gps->fix)) << 6);
+	package->lat      = sample->sensors.latitude;
+	package->lon      = sample->sensors.longitude;
+	package->alti_gps = (int32_t)(sample->sensors.altitude_gnss * 1000.0f);
+	package->sats_fix = (uint8_t)sample->sensors.gnss_fix;
 
-	package->state = flightstate;
+	package->state = sample->flightstate;
+	package->flags = SysMgr_getFaults();
 }
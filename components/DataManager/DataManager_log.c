@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "DataManager_log.h"
+
+#define LOG_RECORD_HDR_B	2				// tag + len
+
+/**
+ * @brief Last recorded data of every source - a source is recorded again only when its data changed.
+ */
+typedef struct{
+	DM_logIMU_t imu;
+	DM_logVector_t acc_high;
+	DM_logVector_t mag;
+	DM_logBaro_t baro;
+	DM_logGNSS_t gnss;
+	DM_logAHRS_t ahrs;
+	DM_logStatus_t status;
+	uint16_t vbat_mV;
+	uint16_t vbat_min_mV;
+} log_sources_t;
+
+static const struct{
+	uint8_t tag;
+	uint8_t offset;
+	uint8_t size;
+} log_source_map[] = {
+	{ DM_LOG_TAG_IMU,      offsetof(log_sources_t, imu),      sizeof(DM_logIMU_t) },
+	{ DM_LOG_TAG_ACC_HIGH, offsetof(log_sources_t, acc_high), sizeof(DM_logVector_t) },
+	{ DM_LOG_TAG_MAG,      offsetof(log_sources_t, mag),      sizeof(DM_logVector_t) },
+	{ DM_LOG_TAG_BARO,     offsetof(log_sources_t, baro),     sizeof(DM_logBaro_t) },
+	{ DM_LOG_TAG_GNSS,     offsetof(log_sources_t, gnss),     sizeof(DM_logGNSS_t) },
+	{ DM_LOG_TAG_AHRS,     offsetof(log_sources_t, ahrs),     sizeof(DM_logAHRS_t) },
+	{ DM_LOG_TAG_STATUS,   offsetof(log_sources_t, status),   sizeof(DM_logStatus_t) },
+	{ DM_LOG_TAG_POWER,    offsetof(log_sources_t, vbat_mV),  2*sizeof(uint16_t) },
+};
+
+#define LOG_SOURCES		(sizeof(log_source_map) / sizeof(log_source_map[0]))
+
+// Schema texts, "%u" is the array length of envelope channels and deadline counters
+static const struct{
+	uint8_t tag;
+	const char * text;
+} log_schema[] = {
+	{ DM_LOG_TAG_TIME,       "time:Q:time_us" },
+	{ DM_LOG_TAG_TIME_DELTA, "time_delta:I:delta_us" },
+	{ DM_LOG_TAG_UTC,        "utc:Qq:time_us,utc_us" },
+	{ DM_LOG_TAG_GAP,        "gap:QQII:first_us,last_us,lost,lost_total" },
+	{ DM_LOG_TAG_ENVELOPE,   "envelope:QIH%uf%uf:first_us,span_us,samples,min,max" },
+	{ DM_LOG_TAG_IMU,        "imu:ffffff:acc_x,acc_y,acc_z,gyro_x,gyro_y,gyro_z" },
+	{ DM_LOG_TAG_ACC_HIGH,   "acc_high:fff:x,y,z" },
+	{ DM_LOG_TAG_MAG,        "mag:fff:x,y,z" },
+	{ DM_LOG_TAG_BARO,       "baro:fb:pressure,temp" },
+	{ DM_LOG_TAG_GNSS,       "gnss:iifB:lat,lon,alt,sats_fix" },
+	{ DM_LOG_TAG_AHRS,       "ahrs:fffBffff:alt_press,alt_kalman,ascent_rate,tilt,q0,q1,q2,q3" },
+	{ DM_LOG_TAG_STATUS,     "status:BB4bB%uB:flightstate,ign,servo,servo_en,deadline_miss" },
+	{ DM_LOG_TAG_POWER,      "power:HH:vbat_mV,vbat_min_mV" },
+};
+
+static uint8_t log_chunk[DM_LOG_CHUNK_B] __attribute__((aligned(4)));
+static uint8_t log_len = 0;
+static bool log_chunk_time = false;			// Chunk has a time record, the next one can be a delta
+static bool log_started = false;			// Header and schema are in the stream
+static int64_t log_time_us = -1;			// Last sample, unwrapped DataPackage_t::sys_time
+static log_sources_t log_last;
+static bool log_last_valid = false;
+
+static portMUX_TYPE log_utc_lock = portMUX_INITIALIZER_UNLOCKED;
+static DM_logUTC_t log_utc;
+static bool log_utc_new = false;
+static int64_t log_utc_written_us = -1;		// time_us of the last DM_LOG_TAG_UTC record
+
+static const char *TAG = "Log v2";
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static int32_t DM_logDaysFromCivil(int32_t y, uint32_t m, uint32_t d){
+	y -= (m <= 2);
+	int32_t era  = ((y >= 0) ? y : (y - 399)) / 400;
+	uint32_t yoe = (uint32_t)(y - era * 400);
+	uint32_t doy = (153 * ((m > 2) ? (m - 3) : (m + 9)) + 2) / 5 + d - 1;
+	uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + (int32_t)doe - 719468;
+}
+
+void DM_logSetUTC(int64_t time_us, const gps_t * gps){
+	// RMC valid flag - time and date are from a fix, not from the receiver RTC
+	if(!gps->valid || (gps->date.month < 1) || (gps->date.month > 12) || (gps->date.day < 1)){
+		return;
+	}
+
+	int64_t days = DM_logDaysFromCivil(2000 + gps->date.year, gps->date.month, gps->date.day);
+	int64_t ms = ((days * 24 + gps->tim.hour) * 60 + gps->tim.minute) * 60 + gps->tim.second;
+
+	portENTER_CRITICAL(&log_utc_lock);
+	log_utc.time_us = time_us;
+	log_utc.utc_us  = (ms * 1000 + gps->tim.thousand) * 1000;
+	log_utc_new = true;
+	portEXIT_CRITICAL(&log_utc_lock);
+}
+
+/* 64-bit time of a record - sys_time is the low 32 bits of the boot time, records are much closer than 71 minutes */
+static int64_t DM_logUnwrap(uint32_t sys_time){
+	if(log_time_us < 0){
+		int64_t now = esp_timer_get_time();
+		return now - (uint32_t)((uint32_t)now - sys_time);
+	}
+
+	return log_time_us + (int32_t)(sys_time - (uint32_t)log_time_us);
+}
+
+esp_err_t DM_logFlush(DM_write_t write, uint32_t * flushed){
+	if(log_len == 0)
+		return ESP_OK;
+
+	esp_err_t err = write(log_chunk, log_len);
+	if(err != ESP_OK)
+		return err;
+
+	*flushed += log_len;
+	log_len = 0;
+	log_chunk_time = false;
+
+	return ESP_OK;
+}
+
+static esp_err_t DM_logPut(uint8_t tag, const void * payload, uint8_t len, DM_write_t write, uint32_t * flushed){
+	if((log_len + LOG_RECORD_HDR_B + len) > DM_LOG_CHUNK_B){
+		esp_err_t err = DM_logFlush(write, flushed);
+		if(err != ESP_OK)
+			return err;
+	}
+
+	log_chunk[log_len++] = tag;
+	log_chunk[log_len++] = len;
+	memcpy(&log_chunk[log_len], payload, len);
+	log_len += len;
+
+	return ESP_OK;
+}
+
+/* Record 'num' of the stream preamble - header, then one schema per record type. Returns the payload length, 0 after the last one */
+static uint8_t DM_logPreambleRecord(uint8_t num, uint8_t * tag, uint8_t payload[DM_LOG_CHUNK_B - LOG_RECORD_HDR_B]){
+	const uint8_t size = DM_LOG_CHUNK_B - LOG_RECORD_HDR_B;
+
+	if(num == 0){
+		DM_logHeader_t header = {
+			.magic 			= DM_LOG_MAGIC,
+			.version 		= DM_LOG_VERSION,
+			.device_id 		= CONFIG_KPPTR_RF_DEVICE_ID,
+			.meas_rate_hz 	= CONFIG_KPPTR_MEAS_RATE_HZ,
+		};
+		*tag = DM_LOG_TAG_HEADER;
+		memcpy(payload, &header, sizeof(header));
+		return sizeof(header);
+	}
+
+	uint8_t i = num - 1;
+	if(i >= (sizeof(log_schema) / sizeof(log_schema[0])))
+		return 0;
+
+	DM_logSchema_t * schema = (DM_logSchema_t *)payload;
+	uint32_t count = (log_schema[i].tag == DM_LOG_TAG_STATUS) ? SYSMGR_TASKMON_NUM : DM_ENV_CHANNELS;
+	int len = snprintf(schema->text, size - sizeof(DM_logSchema_t), log_schema[i].text, count, count);
+
+	schema->tag = log_schema[i].tag;
+	*tag = DM_LOG_TAG_SCHEMA;
+	return sizeof(DM_logSchema_t) + MIN(len, size - sizeof(DM_logSchema_t) - 1);
+}
+
+static esp_err_t DM_logStart(DM_write_t write, uint32_t * flushed){
+	uint8_t buf[DM_LOG_CHUNK_B - LOG_RECORD_HDR_B];
+	uint8_t tag, len;
+	esp_err_t err = ESP_OK;
+
+	for(uint8_t i=0; (err == ESP_OK) && ((len = DM_logPreambleRecord(i, &tag, buf)) > 0); i++){
+		err = DM_logPut(tag, buf, len, write, flushed);
+	}
+
+	if(err == ESP_OK){
+		log_started = true;
+		ESP_LOGI(TAG, "Stream header written");
+	}
+
+	return err;
+}
+
+uint8_t DM_logPreamble(uint8_t chunk, uint8_t buf[DM_LOG_CHUNK_B]){
+	uint8_t payload[DM_LOG_CHUNK_B - LOG_RECORD_HDR_B];
+	uint8_t num = 0;
+	uint8_t pos = 0;
+	uint8_t used = 0;
+	uint8_t tag, len;
+
+	// Packed the same way as DM_logStart() - a record that does not fit starts the next chunk
+	memset(buf, 0, DM_LOG_CHUNK_B);
+	for(uint8_t i=0; (len = DM_logPreambleRecord(i, &tag, payload)) > 0; i++){
+		if((pos + LOG_RECORD_HDR_B + len) > DM_LOG_CHUNK_B){
+			num++;
+			pos = 0;
+		}
+		if(num > chunk)
+			break;
+		if(num == chunk){
+			buf[pos] = tag;
+			buf[pos + 1] = len;
+			memcpy(&buf[pos + LOG_RECORD_HDR_B], payload, len);
+			used = pos + LOG_RECORD_HDR_B + len;
+		}
+		pos += LOG_RECORD_HDR_B + len;
+	}
+
+	return used;
+}
+
+static void DM_logSources(const DataPackage_t * package, log_sources_t * s){
+	memset(s, 0, sizeof(log_sources_t));
+
+	s->imu.accX  = package->sensors.accX;
+	s->imu.accY  = package->sensors.accY;
+	s->imu.accZ  = package->sensors.accZ;
+	s->imu.gyroX = package->sensors.gyroX;
+	s->imu.gyroY = package->sensors.gyroY;
+	s->imu.gyroZ = package->sensors.gyroZ;
+
+	s->acc_high.x = package->sensors.accHX;
+	s->acc_high.y = package->sensors.accHY;
+	s->acc_high.z = package->sensors.accHZ;
+
+	s->mag.x = package->sensors.magX;
+	s->mag.y = package->sensors.magY;
+	s->mag.z = package->sensors.magZ;
+
+	s->baro.pressure = package->sensors.pressure;
+	s->baro.temp     = package->sensors.temp;
+
+	s->gnss.latitude  = package->sensors.latitude;
+	s->gnss.longitude = package->sensors.longitude;
+	s->gnss.altitude  = package->sensors.altitude_gnss;
+	s->gnss.sats_fix  = package->sensors.gnss_fix;
+
+	s->ahrs.altitude_press     = package->ahrs.altitude_press;
+	s->ahrs.altitude_kalman    = package->ahrs.altitude_kalman;
+	s->ahrs.ascent_rate_kalman = package->ahrs.ascent_rate_kalman;
+	s->ahrs.tilt = package->ahrs.tilt;
+	s->ahrs.q0   = package->ahrs.q0;
+	s->ahrs.q1   = package->ahrs.q1;
+	s->ahrs.q2   = package->ahrs.q2;
+	s->ahrs.q3   = package->ahrs.q3;
+
+	s->status.flightstate = package->flightstate;
+	memcpy(&s->status.ign, &package->ign, sizeof(s->status.ign));
+	s->status.servo[0] = package->servo.servo_1;
+	s->status.servo[1] = package->servo.servo_2;
+	s->status.servo[2] = package->servo.servo_3;
+	s->status.servo[3] = package->servo.servo_4;
+	s->status.servo_en = package->servo.servo_en;
+	memcpy(s->status.deadline_miss, package->deadline_miss, sizeof(s->status.deadline_miss));
+
+	s->vbat_mV = package->vbat_mV;
+	s->vbat_min_mV = package->vbat_min_mV;
+}
+
+static esp_err_t DM_logSample(const DataPackage_t * package, DM_write_t write, uint32_t * flushed){
+	log_sources_t now;
+	DM_logUTC_t utc;
+	bool changed[LOG_SOURCES];
+	bool utc_put = false;
+	esp_err_t err = ESP_OK;
+
+	int64_t time_us = DM_logUnwrap(package->sys_time);
+	uint32_t size = LOG_RECORD_HDR_B + sizeof(uint64_t);	// Full time, if a new chunk is needed
+
+	DM_logSources(package, &now);
+	for(uint8_t i=0; i<LOG_SOURCES; i++){
+		changed[i] = !log_last_valid || (memcmp((uint8_t *)&now + log_source_map[i].offset,
+				(uint8_t *)&log_last + log_source_map[i].offset, log_source_map[i].size) != 0);
+		if(changed[i])
+			size += LOG_RECORD_HDR_B + log_source_map[i].size;
+	}
+
+	portENTER_CRITICAL(&log_utc_lock);
+	if(log_utc_new && ((log_utc_written_us < 0) || ((log_utc.time_us - log_utc_written_us) >= DM_LOG_UTC_EVERY_S * 1000000LL))){
+		utc = log_utc;
+		utc_put = true;
+	}
+	portEXIT_CRITICAL(&log_utc_lock);
+	if(utc_put)
+		size += LOG_RECORD_HDR_B + sizeof(DM_logUTC_t);
+
+	// Keep a sample in one chunk when it fits - nothing is put if this write fails
+	if(((log_len + size) > DM_LOG_CHUNK_B) && (size <= DM_LOG_CHUNK_B)){
+		err = DM_logFlush(write, flushed);
+		if(err != ESP_OK)
+			return err;
+	}
+
+	int64_t delta = time_us - log_time_us;
+	if(log_chunk_time && (log_time_us >= 0) && (delta >= 0) && (delta <= UINT32_MAX)){
+		uint32_t delta_us = (uint32_t)delta;
+		err = DM_logPut(DM_LOG_TAG_TIME_DELTA, &delta_us, sizeof(delta_us), write, flushed);
+	} else {
+		uint64_t full_us = (uint64_t)time_us;
+		err = DM_logPut(DM_LOG_TAG_TIME, &full_us, sizeof(full_us), write, flushed);
+	}
+	if(err != ESP_OK)
+		return err;
+
+	log_chunk_time = true;
+	log_time_us = time_us;
+
+	if(utc_put){
+		err = DM_logPut(DM_LOG_TAG_UTC, &utc, sizeof(utc), write, flushed);
+		if(err == ESP_OK){
+			portENTER_CRITICAL(&log_utc_lock);
+			log_utc_written_us = utc.time_us;
+			log_utc_new = (log_utc.time_us != utc.time_us);
+			portEXIT_CRITICAL(&log_utc_lock);
+		}
+	}
+
+	for(uint8_t i=0; (err == ESP_OK) && (i<LOG_SOURCES); i++){
+		if(changed[i]){
+			err = DM_logPut(log_source_map[i].tag, (uint8_t *)&now + log_source_map[i].offset, log_source_map[i].size, write, flushed);
+		}
+	}
+
+	// A failed write in a sample bigger than a chunk leaves it partly recorded - record all sources again next time
+	log_last = now;
+	log_last_valid = (err == ESP_OK);
+
+	return err;
+}
+
+esp_err_t DM_logEncode(const DataPackage_t * package, DM_write_t write, uint32_t * flushed){
+	esp_err_t err = ESP_OK;
+
+	if(!log_started){
+		err = DM_logStart(write, flushed);
+		if(err != ESP_OK)
+			return err;
+	}
+
+	if(package->flightstate == DM_GAP_MARKER){
+		const DataGap_t * gap = (const DataGap_t *)package;
+		DM_logGap_t record = {
+			.first_us 	= DM_logUnwrap(gap->sys_time),
+			.last_us 	= DM_logUnwrap(gap->last_time),
+			.lost 		= gap->lost,
+			.lost_total = gap->lost_total,
+		};
+		err = DM_logPut(DM_LOG_TAG_GAP, &record, sizeof(record), write, flushed);
+	}
+	else if(package->flightstate == DM_ENVELOPE_MARKER){
+		const DataEnvelope_t * envelope = (const DataEnvelope_t *)package;
+		DM_logEnvelope_t record = {
+			.first_us 	= DM_logUnwrap(envelope->sys_time),
+			.span_us 	= envelope->last_time - envelope->sys_time,
+			.samples 	= envelope->samples,
+		};
+		memcpy(record.min, envelope->min, sizeof(record.min));
+		memcpy(record.max, envelope->max, sizeof(record.max));
+		err = DM_logPut(DM_LOG_TAG_ENVELOPE, &record, sizeof(record), write, flushed);
+	}
+	else {
+		err = DM_logSample(package, write, flushed);
+	}
+
+	return err;
+}
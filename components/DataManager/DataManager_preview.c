@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "sdkconfig.h"
+#include "DataManager_preview.h"
+
+#define PREVIEW_PATH		"/www/preview.bin"
+#define PREVIEW_MAGIC		0x31565250		// "PRV1" - change with DM_previewBucket_t, scales or level sizes
+
+/**
+ * @brief Stored preview header, followed by num[] buckets of every level and esp_crc32_le of everything before.
+ * Written in place like the flight summary, a torn write fails the CRC.
+ */
+typedef struct{
+	uint32_t magic;
+	uint32_t start_ms;
+	uint16_t num[DM_PREVIEW_LEVELS];
+} preview_file_t;
+
+/**
+ * @brief Bucket being filled, in physical units.
+ */
+typedef struct{
+	float min[DM_ENV_CHANNELS];
+	float max[DM_ENV_CHANNELS];
+	float sum[DM_ENV_CHANNELS];
+	uint32_t records;				/*!< Records in sum */
+	bool used;						/*!< Any record or envelope */
+} preview_acc_t;
+
+typedef struct{
+	uint16_t width_s;
+	uint16_t capacity;
+	DM_previewBucket_t * buckets;
+	uint16_t num;					/*!< Closed buckets - never changed afterwards, so readers do not lock them */
+	preview_acc_t open;				/*!< Bucket num */
+} preview_level_t;
+
+typedef struct{
+	DM_previewWrite_t write;
+	void * ctx;
+	esp_err_t err;
+	size_t len;
+	char buf[256];
+} preview_out_t;
+
+static const char *TAG = "Preview";
+
+static const char * const channel_names[DM_ENV_CHANNELS] = {
+	[DM_ENV_ACC_X]       = "acc_x",
+	[DM_ENV_ACC_Y]       = "acc_y",
+	[DM_ENV_ACC_Z]       = "acc_z",
+	[DM_ENV_GYRO_X]      = "gyro_x",
+	[DM_ENV_GYRO_Y]      = "gyro_y",
+	[DM_ENV_GYRO_Z]      = "gyro_z",
+	[DM_ENV_PRESSURE]    = "pressure",
+	[DM_ENV_ALTITUDE]    = "altitude",
+	[DM_ENV_ASCENT_RATE] = "ascent_rate",
+};
+
+// Quantization like DataPackageRF_t - g*100, deg/s*10, Pa/10, m, m/s*10
+static const float channel_scale[DM_ENV_CHANNELS] = {
+	[DM_ENV_ACC_X]       = 100.0f,
+	[DM_ENV_ACC_Y]       = 100.0f,
+	[DM_ENV_ACC_Z]       = 100.0f,
+	[DM_ENV_GYRO_X]      = 10.0f,
+	[DM_ENV_GYRO_Y]      = 10.0f,
+	[DM_ENV_GYRO_Z]      = 10.0f,
+	[DM_ENV_PRESSURE]    = 0.1f,
+	[DM_ENV_ALTITUDE]    = 1.0f,
+	[DM_ENV_ASCENT_RATE] = 10.0f,
+};
+
+static DM_previewBucket_t buckets_1s[CONFIG_KPPTR_PREVIEW_S];
+static DM_previewBucket_t buckets_10s[DM_PREVIEW_SPAN_S / 10];
+static DM_previewBucket_t buckets_100s[DM_PREVIEW_SPAN_S / 100];
+
+static preview_level_t levels[DM_PREVIEW_LEVELS] = {
+	{ .width_s = 1,   .capacity = CONFIG_KPPTR_PREVIEW_S,    .buckets = buckets_1s },
+	{ .width_s = 10,  .capacity = DM_PREVIEW_SPAN_S / 10,    .buckets = buckets_10s },
+	{ .width_s = 100, .capacity = DM_PREVIEW_SPAN_S / 100,   .buckets = buckets_100s },
+};
+
+static portMUX_TYPE preview_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool live = false;					// Filled by this flight, written only by the storage task
+static bool stored = false;					// Loaded from flash
+static uint32_t start_us = 0;				// DataPackage_t::sys_time of the first record
+static bool full = false;					// DM_PREVIEW_SPAN_S passed - sys_time wraps after 71.6 min into the first buckets
+static uint8_t persisted = 0;				// Last persisted stage - 1 landing, 2 shutdown
+
+static void preview_accReset(preview_acc_t * acc){
+	memset(acc, 0, sizeof(preview_acc_t));
+	for(uint8_t i=0; i<DM_ENV_CHANNELS; i++){
+		acc->min[i] = INFINITY;
+		acc->max[i] = -INFINITY;
+	}
+}
+
+static int16_t preview_quantize(float value, uint8_t channel){
+	float q = roundf(value * channel_scale[channel]);
+
+	if(!isfinite(q))
+		return DM_PREVIEW_EMPTY;
+	if(q > INT16_MAX)
+		return INT16_MAX;
+	if(q < (INT16_MIN + 1))
+		return INT16_MIN + 1;
+	return (int16_t)q;
+}
+
+static void preview_close(const preview_acc_t * acc, DM_previewBucket_t * bucket){
+	for(uint8_t i=0; i<DM_ENV_CHANNELS; i++){
+		bucket->min[i]  = preview_quantize(acc->min[i], i);
+		bucket->max[i]  = preview_quantize(acc->max[i], i);
+		bucket->mean[i] = (acc->records > 0) ? preview_quantize(acc->sum[i] / acc->records, i) : DM_PREVIEW_EMPTY;
+	}
+}
+
+esp_err_t DM_previewInit(void){
+	preview_file_t file;
+	uint32_t crc = 0;
+	bool valid = true;
+
+	for(uint8_t l=0; l<DM_PREVIEW_LEVELS; l++){
+		levels[l].num = 0;
+		preview_accReset(&levels[l].open);
+	}
+
+	FILE* f = fopen(PREVIEW_PATH, "rb");
+	if(f == NULL){
+		ESP_LOGI(TAG, "No stored preview");
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	valid = (fread(&file, sizeof(file), 1, f) == 1) && (file.magic == PREVIEW_MAGIC);
+	crc = esp_crc32_le(0, (uint8_t const *)&file, sizeof(file));
+
+	for(uint8_t l=0; valid && (l<DM_PREVIEW_LEVELS); l++){
+		size_t len = file.num[l] * sizeof(DM_previewBucket_t);
+
+		valid = (file.num[l] <= levels[l].capacity) && (fread(levels[l].buckets, 1, len, f) == len);
+		crc = esp_crc32_le(crc, (uint8_t const *)levels[l].buckets, len);
+	}
+
+	uint32_t file_crc = 0;
+	valid = valid && (fread(&file_crc, sizeof(file_crc), 1, f) == 1) && (file_crc == crc);
+	fclose(f);
+
+	if(!valid){
+		ESP_LOGW(TAG, "Stored preview damaged or of other version");
+		return ESP_ERR_INVALID_CRC;
+	}
+
+	for(uint8_t l=0; l<DM_PREVIEW_LEVELS; l++){
+		levels[l].num = file.num[l];
+	}
+	start_us = file.start_ms * 1000;
+	stored = true;
+
+	ESP_LOGI(TAG, "Last flight preview: %u s", levels[0].num);
+	return ESP_OK;
+}
+
+void DM_previewAdd(const DataPackage_t * package){
+	float lo[DM_ENV_CHANNELS];
+	float hi[DM_ENV_CHANNELS];
+	bool record = true;
+
+	if((package->flightstate == DM_GAP_MARKER) || (live && full))
+		return;
+
+	if(package->flightstate == DM_ENVELOPE_MARKER){
+		const DataEnvelope_t * envelope = (const DataEnvelope_t *)package;
+
+		memcpy(lo, envelope->min, sizeof(lo));
+		memcpy(hi, envelope->max, sizeof(hi));
+		record = false;
+	} else {
+		DM_envelopeValues(package, lo);
+		memcpy(hi, lo, sizeof(hi));
+	}
+
+	// First record of a flight replaces the stored preview
+	if(!live){
+		portENTER_CRITICAL(&preview_lock);
+		for(uint8_t l=0; l<DM_PREVIEW_LEVELS; l++){
+			levels[l].num = 0;
+			preview_accReset(&levels[l].open);
+		}
+		start_us  = package->sys_time;
+		live      = true;
+		full      = false;
+		stored    = false;
+		persisted = 0;
+		portEXIT_CRITICAL(&preview_lock);
+	}
+
+	uint32_t elapsed_s = (uint32_t)(package->sys_time - start_us) / 1000000;
+	if(elapsed_s >= DM_PREVIEW_SPAN_S){
+		full = true;	// Every level is full, latched before the wrap brings elapsed_s back to 0
+		return;
+	}
+
+	for(uint8_t l=0; l<DM_PREVIEW_LEVELS; l++){
+		preview_level_t * level = &levels[l];
+		uint32_t index = elapsed_s / level->width_s;
+		uint16_t num = level->num;
+		preview_acc_t acc = level->open;
+
+		if(index >= level->capacity)
+			continue;	// Level full - the flight is in the first part, coarser levels go on
+
+		// Close the open bucket and mark the buckets without records - above num, readers do not see them yet
+		if(index > num){
+			preview_close(&acc, &level->buckets[num++]);
+			while(num < index){
+				for(uint8_t i=0; i<DM_ENV_CHANNELS; i++){
+					level->buckets[num].min[i]  = DM_PREVIEW_EMPTY;
+					level->buckets[num].max[i]  = DM_PREVIEW_EMPTY;
+					level->buckets[num].mean[i] = DM_PREVIEW_EMPTY;
+				}
+				num++;
+			}
+			preview_accReset(&acc);
+		}
+
+		for(uint8_t i=0; i<DM_ENV_CHANNELS; i++){
+			if(lo[i] < acc.min[i])
+				acc.min[i] = lo[i];
+			if(hi[i] > acc.max[i])
+				acc.max[i] = hi[i];
+			if(record)
+				acc.sum[i] += lo[i];
+		}
+		acc.records += record;
+		acc.used = true;
+
+		portENTER_CRITICAL(&preview_lock);
+		level->num  = num;
+		level->open = acc;
+		portEXIT_CRITICAL(&preview_lock);
+	}
+}
+
+/* Closed buckets and the open one, quantized - a consistent view of one level */
+static uint16_t preview_snapshot(uint8_t l, DM_previewBucket_t * open){
+	preview_acc_t acc;
+	uint16_t num;
+
+	portENTER_CRITICAL(&preview_lock);
+	num = levels[l].num;
+	acc = levels[l].open;
+	portEXIT_CRITICAL(&preview_lock);
+
+	if(!acc.used)
+		return num;
+
+	preview_close(&acc, open);
+	return num + 1;
+}
+
+esp_err_t DM_previewPersist(flightstate_t flightstate){
+	DM_previewBucket_t open[DM_PREVIEW_LEVELS];
+	preview_file_t file;
+	uint8_t stage = 0;
+	bool ok = true;
+
+	if(flightstate >= FLIGHTSTATE_SHUTDOWN)
+		stage = 2;
+	else if(flightstate == FLIGHTSTATE_LANDING)
+		stage = 1;
+
+	if(!live || (stage <= persisted))
+		return ESP_OK;
+
+	memset(&file, 0, sizeof(file));
+	file.magic    = PREVIEW_MAGIC;
+	file.start_ms = start_us / 1000;
+	for(uint8_t l=0; l<DM_PREVIEW_LEVELS; l++){
+		file.num[l] = preview_snapshot(l, &open[l]);
+	}
+
+	FILE* f = fopen(PREVIEW_PATH, "wb");
+	if(f == NULL){
+		ESP_LOGE(TAG, "Failed to open file for writing");
+		return ESP_FAIL;
+	}
+
+	ok = (fwrite(&file, sizeof(file), 1, f) == 1);
+	uint32_t crc = esp_crc32_le(0, (uint8_t const *)&file, sizeof(file));
+
+	for(uint8_t l=0; ok && (l<DM_PREVIEW_LEVELS); l++){
+		size_t len = MIN(file.num[l], levels[l].num) * sizeof(DM_previewBucket_t);
+
+		ok = (fwrite(levels[l].buckets, 1, len, f) == len);
+		crc = esp_crc32_le(crc, (uint8_t const *)levels[l].buckets, len);
+		if(ok && (file.num[l] > levels[l].num)){
+			ok = (fwrite(&open[l], sizeof(DM_previewBucket_t), 1, f) == 1);
+			crc = esp_crc32_le(crc, (uint8_t const *)&open[l], sizeof(DM_previewBucket_t));
+		}
+	}
+
+	ok = ok && (fwrite(&crc, sizeof(crc), 1, f) == 1);
+	fclose(f);
+
+	if(!ok){
+		ESP_LOGE(TAG, "Failed to store preview");
+		return ESP_FAIL;
+	}
+
+	persisted = stage;
+	ESP_LOGI(TAG, "Preview stored: %u s", file.num[0]);
+	return ESP_OK;
+}
+
+static void preview_flush(preview_out_t * out){
+	if((out->err == ESP_OK) && (out->len > 0))
+		out->err = out->write(out->ctx, out->buf, out->len);
+	out->len = 0;
+}
+
+/* Every call prints less than 64 characters */
+static void preview_print(preview_out_t * out, const char * fmt, ...){
+	va_list args;
+
+	if(out->len > (sizeof(out->buf) - 64))
+		preview_flush(out);
+	if(out->err != ESP_OK)
+		return;
+
+	va_start(args, fmt);
+	out->len += vsnprintf(&out->buf[out->len], sizeof(out->buf) - out->len, fmt, args);
+	va_end(args);
+}
+
+static void preview_printValues(preview_out_t * out, const preview_level_t * level, const DM_previewBucket_t * open,
+		uint16_t num, size_t offset, uint8_t channel){
+	for(uint16_t b=0; b<num; b++){
+		const DM_previewBucket_t * bucket = (b < level->num) ? &level->buckets[b] : open;
+		int16_t value = ((const int16_t *)((const uint8_t *)bucket + offset))[channel];
+
+		if(value == DM_PREVIEW_EMPTY)
+			preview_print(out, b ? ",null" : "null");
+		else
+			preview_print(out, b ? ",%d" : "%d", value);
+	}
+}
+
+esp_err_t DM_previewExport(uint8_t level_num, DM_previewWrite_t write, void * ctx){
+	static preview_out_t out;		// Only the web server exports, one request at a time
+	DM_previewBucket_t open;
+
+	if(level_num >= DM_PREVIEW_LEVELS)
+		return ESP_ERR_INVALID_ARG;
+
+	const preview_level_t * level = &levels[level_num];
+	uint16_t num = preview_snapshot(level_num, &open);
+
+	out.write = write;
+	out.ctx   = ctx;
+	out.err   = ESP_OK;
+	out.len   = 0;
+
+	preview_print(&out, "{\"level\":%u,\"bucket_s\":%u,\"start_ms\":%u,", level_num, level->width_s, start_us / 1000);
+	preview_print(&out, "\"stored\":%s,\"buckets\":%u,\"channels\":{", stored ? "true" : "false", num);
+	for(uint8_t i=0; i<DM_ENV_CHANNELS; i++){
+		preview_print(&out, "%s\"%s\":{\"scale\":%g,\"min\":[", i ? "," : "", channel_names[i], channel_scale[i]);
+		preview_printValues(&out, level, &open, num, offsetof(DM_previewBucket_t, min), i);
+		preview_print(&out, "],\"max\":[");
+		preview_printValues(&out, level, &open, num, offsetof(DM_previewBucket_t, max), i);
+		preview_print(&out, "],\"mean\":[");
+		preview_printValues(&out, level, &open, num, offsetof(DM_previewBucket_t, mean), i);
+		preview_print(&out, "]}");
+	}
+	preview_print(&out, "}}");
+	preview_flush(&out);
+
+	return out.err;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 #include "IGN_driver.h"
 #include "Sensors.h"
 #include "Servo_driver.h"
@@ -7,10 +9,15 @@
 #include "Analog_driver.h"
 #include "AHRS_driver.h"
 #include "FlightStateDetector.h"
+#include "SysMgr.h"
+
+#define DM_RF_PACKET_ID		0x00AA		/*!< DataPackageRF_t frame type identifier */
+#define DM_STORAGE_DEPTH	100			/*!< Records queued for the storage task - also the pre-launch history */
 
 /**
  * @brief Data structure representing a data package.
  * A data package contains sensor readings, AHRS data, flight state information, and other data.
+ * It is also the v1 log record (114 B). Logs of firmware before vbat_min_mV have 112 B records.
  */
 typedef struct __attribute__((__packed__)){
 	uint32_t sys_time;
@@ -34,8 +41,8 @@ typedef struct __attribute__((__packed__)){
 		float pressure;			/*!< Barometric pressure. */
 		int8_t temp;			/*!< Temperature. */
 
-		float latitude;			/*!< Latitude (in degrees). */
-		float longitude;		/*!< Longitude (in degrees). */
+		int32_t latitude;		/*!< Latitude (in 1e-7 degrees). */
+		int32_t longitude;		/*!< Longitude (in 1e-7 degrees). */
 		float altitude_gnss;	/*!< Altitude from GNSS (Global Navigation Satellite System). */
 		int8_t gnss_fix;		/*!< GNSS fix status (0 = no fix, 1 = fix). */
 	} sensors;					/*!< Sensor readings. */
@@ -64,6 +71,7 @@ typedef struct __attribute__((__packed__)){
 	} ign;								/*!< Ignition system information. */
 
 	uint16_t vbat_mV;	/*!< Battery voltage (in millivolts). */
+	uint16_t vbat_min_mV;	/*!< Lowest battery voltage since the previous sample (in millivolts) - igniter sag. */
 
 	struct __attribute__((__packed__)){
 		int8_t servo_1;			/*!< Position of servo 1 (in %). */
@@ -73,9 +81,97 @@ typedef struct __attribute__((__packed__)){
 		uint8_t servo_en;		/*!< Servo enable flag. */
 	} servo;					/*!< Servo status information. */
 
-	uint8_t blank[4];
+	uint8_t deadline_miss[SYSMGR_TASKMON_NUM];	/*!< Deadline miss counters (mod 256) of main, storage, utils and analog task - see ::SysMgr_taskMonitorEnd. */
 } DataPackage_t;
 
+#define DM_GAP_MARKER		0xFF		/*!< DataPackage_t::flightstate of a gap marker record (::DataGap_t) */
+
+/**
+ * @brief Gap marker stored in the log in place of one DataPackage_t, before the first record that follows lost records.
+ * Records are lost when the storage queue drops its oldest record for a new one or when a write fails.
+ */
+typedef struct __attribute__((__packed__)){
+	uint32_t sys_time;			/*!< Time of the first lost record. */
+	uint32_t last_time;			/*!< Time of the last lost record. */
+	uint32_t lost;				/*!< Records lost in this gap. */
+	uint32_t lost_total;		/*!< Records lost since boot. */
+	uint8_t reserved[offsetof(DataPackage_t, flightstate) - 16];
+	uint8_t flightstate;		/*!< Always ::DM_GAP_MARKER. */
+	uint8_t reserved_end[sizeof(DataPackage_t) - offsetof(DataPackage_t, flightstate) - 1];
+} DataGap_t;
+
+_Static_assert(sizeof(DataGap_t) == sizeof(DataPackage_t), "Gap marker must take exactly one record");
+
+#define DM_ENVELOPE_MARKER	0xFE		/*!< DataPackage_t::flightstate of an envelope record (::DataEnvelope_t) */
+
+/**
+ * @brief Channels of ::DataEnvelope_t.
+ */
+typedef enum{
+	DM_ENV_ACC_X,
+	DM_ENV_ACC_Y,
+	DM_ENV_ACC_Z,
+	DM_ENV_GYRO_X,
+	DM_ENV_GYRO_Y,
+	DM_ENV_GYRO_Z,
+	DM_ENV_PRESSURE,
+	DM_ENV_ALTITUDE,			/*!< DataPackage_t::ahrs.altitude_kalman */
+	DM_ENV_ASCENT_RATE,			/*!< DataPackage_t::ahrs.ascent_rate_kalman */
+	DM_ENV_CHANNELS
+} DM_envChannel_t;
+
+/**
+ * @brief Min/max envelope of a decimation window, stored in place of one DataPackage_t.
+ * A window starts with a stored record, the envelope is stored when the window closes - just before the record
+ * of the next window - and covers the first record and all samples skipped after it.
+ */
+typedef struct __attribute__((__packed__)){
+	uint32_t sys_time;			/*!< Time of the first sample (the stored record). */
+	uint32_t last_time;			/*!< Time of the last sample. */
+	uint16_t samples;			/*!< Samples in the window, the stored record included. */
+	float min[DM_ENV_CHANNELS];	/*!< Minimum of every ::DM_envChannel_t. */
+	float max[DM_ENV_CHANNELS];	/*!< Maximum of every ::DM_envChannel_t. */
+	uint8_t reserved[offsetof(DataPackage_t, flightstate) - 10 - 2 * DM_ENV_CHANNELS * sizeof(float)];
+	uint8_t flightstate;		/*!< Always ::DM_ENVELOPE_MARKER. */
+	uint8_t reserved_end[sizeof(DataPackage_t) - offsetof(DataPackage_t, flightstate) - 1];
+} DataEnvelope_t;
+
+_Static_assert(sizeof(DataEnvelope_t) == sizeof(DataPackage_t), "Envelope must take exactly one record");
+
+/**
+ * @brief Logging rate of every flight phase, in Hz. Rates are clamped to 1 Hz ... CONFIG_KPPTR_MEAS_RATE_HZ.
+ * Records are kept at the main task rate in other states, the storage task does not store them anyway.
+ */
+typedef struct{
+	uint16_t ascent_hz;			/*!< ME_ACCELERATING and FREEFLIGHT. */
+	uint16_t descent_hz;		/*!< FREEFALL, DRAGCHUTE_FALL and MAINSHUTE_FALL, decimated windows carry an envelope. */
+	uint16_t landed_hz;			/*!< LANDING, without envelopes. */
+} DM_logPolicy_t;
+
+#define DM_LOG_RECORD		0x01		/*!< ::DM_logDecimate - store the sample */
+#define DM_LOG_ENVELOPE		0x02		/*!< ::DM_logDecimate - store the envelope of the closed window, before the sample */
+
+/**
+ * @brief Storage pipeline statistics.
+ */
+typedef struct{
+	uint16_t depth;				/*!< Records waiting in the storage queue. */
+	uint16_t depth_max;			/*!< Highest depth since boot. */
+	uint32_t written;			/*!< Records stored. */
+	uint32_t overwritten;		/*!< Records overwritten by the main task before they were stored, counted from ::DM_storageStart. */
+	uint32_t dropped;			/*!< Records lost on write errors. */
+	uint32_t gaps;				/*!< Gap markers stored. */
+	uint32_t bursts;			/*!< High watermark crossings. */
+	uint32_t decimated;			/*!< Samples skipped by the logging policy - not a loss, see ::DataEnvelope_t. */
+	uint32_t envelopes;			/*!< Envelope records produced. */
+	uint32_t throughput_Bps;	/*!< Write throughput over the last second. */
+} DM_storageStats_t;
+
+/**
+ * @brief Log write function, Storage_writePacket() compatible.
+ */
+typedef esp_err_t (*DM_write_t)(void * buf, uint16_t len);
+
 /**
  * @brief Data structure representing a data package for radio frequency (RF) transmission.
  * This data structure is packed to reduce the size of the transmitted data.
@@ -86,7 +182,7 @@ typedef struct __attribute__((__packed__)){
 	uint16_t packet_no;				/*!< Packet number. */
 	uint32_t timestamp_ms;			/*!< Timestamp (in milliseconds). */
 	uint8_t state;					/*!< Device state. */
-	uint8_t flags;					/*!< Flags. */
+	uint8_t flags;					/*!< Components in heartbeat fault, bit per ::sysmgr_checkout_component_t - see ::SysMgr_getFaults. */
 
 	uint8_t vbat_10;				/*!< Battery voltage (in decivolts [V*10]). *///
 
@@ -115,43 +211,75 @@ typedef struct __attribute__((__packed__)){
  */
 esp_err_t DM_init();
 
-uint16_t DM_checkWaitingElementsNumber();
+/**
+ * @brief Mark the start of the storage drain (liftoff). Before it the full storage queue keeps the newest records
+ * as pre-launch history and the records it rotates out are neither counted as overwritten nor reported as a gap.
+ */
+void DM_storageStart();
+
+/**
+ * @brief Number of records the storage task should write in this loop.
+ * One record normally. Above the high watermark the queue is drained in a burst down to the low watermark.
+ * @param depth Records waiting for the storage task.
+ * @return uint16_t Records to write.
+ */
+uint16_t DM_storageBurstSize(uint16_t depth);
+
+/**
+ * @brief Store one record, preceded by a gap marker if records were lost since the previous one.
+ * A failed write is counted and the record becomes part of the next gap.
+ * @param[in] package Record from the storage queue.
+ * @param[in] write Log write function.
+ * @return Result of the record write.
+ */
+esp_err_t DM_storeRecord(const DataPackage_t * package, DM_write_t write);
+
+/**
+ * @brief Write records buffered by the log encoder (format v2), called by the storage task when the storage queue is idle.
+ * @param[in] write Log write function.
+ * @return ESP_OK if written or nothing buffered, error of the write otherwise.
+ */
+esp_err_t DM_storeFlush(DM_write_t write);
 
 /**
- * @brief Get a used data pointer from the main ring buffer (RB).
- * @param[out] ptr Pointer to a ::DataPackage_t pointer where the address of the used data will be stored.
- * @return ESP_OK if a used data pointer was obtained, ESP_FAIL otherwise.
+ * @brief Account a record that is discarded without a write attempt.
+ * @param[in] package Record from the storage queue.
  */
-esp_err_t DM_getUsedPointerFromMainRB(DataPackage_t ** ptr);
+void DM_dropRecord(const DataPackage_t * package);
 
 /**
- * @brief Get a used data pointer from the main ring buffer (RB), with wait.
- * This function will wait until a used data pointer is available.
- * @param[out] ptr Pointer to a ::DataPackage_t pointer where the address of the used data will be stored.
- * @return ESP_OK if a used data pointer was obtained, ESP_FAIL otherwise.
+ * @brief Account a record the producer overwrote before it was stored - called for records dropped from the storage queue.
+ * @param[in] package Overwritten record.
  */
-esp_err_t DM_getUsedPointerFromMainRB_wait(DataPackage_t ** ptr);
+void DM_overwriteRecord(const DataPackage_t * package);
 
 /**
- * @brief Return a used data pointer to the main ring buffer (RB).
- * @param[in] ptr Pointer to a ::DataPackage_t pointer containing the address of the used data.
- * @return ESP_OK if the used data pointer was returned, ESP_FAIL otherwise.
+ * @brief Set the logging rate of every flight phase. Call before the main task starts.
+ * @param[in] policy Rates in Hz.
  */
-esp_err_t DM_returnUsedPointerToMainRB(DataPackage_t ** ptr);
+void DM_setLogPolicy(const DM_logPolicy_t * policy);
 
 /**
- * @brief Get a free data pointer from the main ring buffer (RB).
- * @param[out] ptr Pointer to a ::DataPackage_t pointer where the address of the free data will be stored.
- * @return ESP_OK if a free data pointer was obtained, ESP_FAIL otherwise.
+ * @brief Decide which records of this sample go to the storage queue, called by the main task for every sample.
+ * A flight phase change always closes the window, so the first sample of a phase is stored.
+ * @param[in] package Sample from ::DM_collectFlash.
+ * @param[out] envelope Envelope of the closed window, valid with ::DM_LOG_ENVELOPE.
+ * @return uint8_t ::DM_LOG_RECORD and ::DM_LOG_ENVELOPE flags, 0 - skip the sample.
  */
-esp_err_t DM_getFreePointerToMainRB(DataPackage_t ** ptr);
+uint8_t DM_logDecimate(const DataPackage_t * package, DataEnvelope_t * envelope);
 
 /**
- * @brief Add a data pointer to the main ring buffer (RB).
- * @param[in] ptr Pointer to a ::DataPackage_t pointer containing the address of the data to be added.
- * @return ESP_OK if the data pointer was added, ESP_FAIL otherwise.
+ * @brief Get the ::DM_envChannel_t values of a record.
+ * @param[in] package Record.
+ * @param[out] values DM_ENV_CHANNELS values.
  */
-esp_err_t DM_addToMainRB(DataPackage_t ** ptr);
+void DM_envelopeValues(const DataPackage_t * package, float * values);
+
+/**
+ * @brief Get storage pipeline statistics.
+ * @return DM_storageStats_t
+ */
+DM_storageStats_t DM_getStorageStats();
 
 /**
  * @brief Collect data for storage in flash memory.
@@ -167,13 +295,9 @@ esp_err_t DM_addToMainRB(DataPackage_t ** ptr);
 void DM_collectFlash(DataPackage_t * package, int64_t time_us, Sensors_t * sensors, gps_t * gps, AHRS_t * ahrs, flightstate_t flightstate, IGN_t * ign, Analog_meas_t * analog);
 
 /**
- * @brief Collect data from various sources and store them in a data package for RF transmission.
- * @param[out] package Pointer to a ::DataPackageRF_t structure where the collected data will be stored.
- * @param[in] time_us Timestamp (in microseconds).
- * @param[in] sensors Pointer to a ::Sensors_t structure containing sensor data.
- * @param[in] gps Pointer to a ::gps_t structure containing GPS data.
- * @param[in] ahrs Pointer to an ::AHRS_t structure containing AHRS data.
- * @param[in] flightstate Pointer to a ::FlightState_t structure containing flight state data.
- * @param[in] ign Pointer to an ::IGN_t structure containing IGN data.
+ * @brief Pack a sample into a data package for RF transmission.
+ * @param[out] package Pointer to a ::DataPackageRF_t structure where the packed data will be stored.
+ * @param[in] sample Sample from ::DM_collectFlash.
+ * @param[in] time_us Full timestamp of the sample (in microseconds).
  */
-void DM_collectRF(DataPackageRF_t * package, int64_t time_us, Sensors_t * sensors, gps_t * gps, AHRS_t * ahrs, flightstate_t flightstate, IGN_t * ign);
+void DM_packRF(DataPackageRF_t * package, const DataPackage_t * sample, int64_t time_us);
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "DataManager.h"
+
+/*
+ * Log format v2 - a stream of tagged records.
+ *
+ * Every record is {uint8_t tag, uint8_t len, payload[len]}, little endian, packed. The stream is written in
+ * chunks of at most DM_LOG_CHUNK_B - one SimpleFS packet payload or one append to meas.bin - and a record never
+ * crosses a chunk. DM_LOG_TAG_PAD ends a chunk (SimpleFS pads the payload with zeros).
+ *
+ * The stream starts with DM_LOG_TAG_HEADER and one DM_LOG_TAG_SCHEMA per record type, so a decoder does not need
+ * this file. A time window of the log is sent with the same preamble in front (DM_logPreamble). Sources are recorded only when their data changed, so a slow source (GNSS) does not repeat in
+ * every sample. Records belong to the last DM_LOG_TAG_TIME / DM_LOG_TAG_TIME_DELTA. The first time record of
+ * every chunk is a full DM_LOG_TAG_TIME, a reader starting at any chunk skips records until it.
+ *
+ * Compatibility: unknown tags are skipped by len. Fields are only ever appended to a record - a decoder reads
+ * the fields it knows and skips the rest, a shorter record of an older writer leaves the new fields unknown.
+ * DM_LOG_VERSION changes only with a change a v2 decoder can not handle.
+ */
+
+#define DM_LOG_VERSION		2
+#define DM_LOG_MAGIC		"KPLG"
+#define DM_LOG_CHUNK_B		122			/*!< sizeof(sfs_packet_t::payload) */
+#define DM_LOG_UTC_EVERY_S	10			/*!< Minimum interval of DM_LOG_TAG_UTC records */
+
+typedef enum{
+	DM_LOG_TAG_PAD			= 0x00,		/*!< Rest of the chunk is padding */
+	DM_LOG_TAG_HEADER		= 0x01,		/*!< DM_logHeader_t */
+	DM_LOG_TAG_SCHEMA		= 0x02,		/*!< DM_logSchema_t */
+	DM_LOG_TAG_TIME			= 0x03,		/*!< uint64_t - monotonic time since boot [us] */
+	DM_LOG_TAG_TIME_DELTA	= 0x04,		/*!< uint32_t - time since the previous time record [us] */
+	DM_LOG_TAG_UTC			= 0x05,		/*!< DM_logUTC_t */
+	DM_LOG_TAG_GAP			= 0x06,		/*!< DM_logGap_t */
+	DM_LOG_TAG_ENVELOPE		= 0x07,		/*!< DM_logEnvelope_t */
+
+	DM_LOG_TAG_IMU			= 0x10,		/*!< DM_logIMU_t */
+	DM_LOG_TAG_ACC_HIGH		= 0x11,		/*!< DM_logVector_t [g] */
+	DM_LOG_TAG_MAG			= 0x12,		/*!< DM_logVector_t */
+	DM_LOG_TAG_BARO			= 0x13,		/*!< DM_logBaro_t */
+	DM_LOG_TAG_GNSS			= 0x14,		/*!< DM_logGNSS_t */
+	DM_LOG_TAG_AHRS			= 0x15,		/*!< DM_logAHRS_t */
+	DM_LOG_TAG_STATUS		= 0x16,		/*!< DM_logStatus_t */
+	DM_LOG_TAG_POWER		= 0x17,		/*!< uint16_t - battery voltage [mV] */
+} DM_logTag_t;
+
+typedef struct __attribute__((__packed__)){
+	char magic[4];				/*!< DM_LOG_MAGIC */
+	uint8_t version;			/*!< DM_LOG_VERSION */
+	uint16_t device_id;			/*!< CONFIG_KPPTR_RF_DEVICE_ID */
+	uint16_t meas_rate_hz;		/*!< Main task rate */
+} DM_logHeader_t;
+
+/**
+ * @brief Description of one record type: "name:format:field,field,..." - format in Python struct codes
+ * (b/B int8, h/H int16, i/I int32, q/Q int64, f float), one code per field - a count before the code ("9f") makes an array field.
+ */
+typedef struct __attribute__((__packed__)){
+	uint8_t tag;
+	char text[];				/*!< Not terminated, ends with the record */
+} DM_logSchema_t;
+
+/**
+ * @brief GNSS UTC of a monotonic time. A pair close to the samples maps them to UTC, several pairs give the clock drift.
+ */
+typedef struct __attribute__((__packed__)){
+	uint64_t time_us;			/*!< Monotonic time of the GNSS update */
+	int64_t utc_us;				/*!< UTC of the fix [us since 1970-01-01] */
+} DM_logUTC_t;
+
+typedef struct __attribute__((__packed__)){
+	uint64_t first_us;			/*!< Time of the first lost sample */
+	uint64_t last_us;			/*!< Time of the last lost sample */
+	uint32_t lost;				/*!< Samples lost in this gap */
+	uint32_t lost_total;		/*!< Samples lost since boot */
+} DM_logGap_t;
+
+typedef struct __attribute__((__packed__)){
+	uint64_t first_us;			/*!< Time of the first sample of the window */
+	uint32_t span_us;			/*!< Last sample time - first sample time */
+	uint16_t samples;
+	float min[DM_ENV_CHANNELS];	/*!< ::DM_envChannel_t */
+	float max[DM_ENV_CHANNELS];
+} DM_logEnvelope_t;
+
+typedef struct __attribute__((__packed__)){
+	float accX, accY, accZ;		/*!< [g] */
+	float gyroX, gyroY, gyroZ;	/*!< [deg/s] */
+} DM_logIMU_t;
+
+typedef struct __attribute__((__packed__)){
+	float x, y, z;
+} DM_logVector_t;
+
+typedef struct __attribute__((__packed__)){
+	float pressure;				/*!< [Pa] */
+	int8_t temp;				/*!< [C] */
+} DM_logBaro_t;
+
+typedef struct __attribute__((__packed__)){
+	int32_t latitude;			/*!< [1e-7 deg] */
+	int32_t longitude;			/*!< [1e-7 deg] */
+	float altitude;				/*!< Above the ellipsoid [m] */
+	uint8_t sats_fix;			/*!< 6b satellites + 2b fix */
+} DM_logGNSS_t;
+
+typedef struct __attribute__((__packed__)){
+	float altitude_press;		/*!< [m] */
+	float altitude_kalman;		/*!< [m] */
+	float ascent_rate_kalman;	/*!< [m/s] */
+	uint8_t tilt;				/*!< [deg] */
+	float q0, q1, q2, q3;
+} DM_logAHRS_t;
+
+typedef struct __attribute__((__packed__)){
+	uint8_t flightstate;
+	uint8_t ign;				/*!< Bits 0-3 continuity, 4-7 state of IGN1-4 */
+	int8_t servo[4];			/*!< [%] */
+	uint8_t servo_en;
+	uint8_t deadline_miss[SYSMGR_TASKMON_NUM];
+} DM_logStatus_t;
+
+/**
+ * @brief Set the GNSS UTC anchor, called by the main task with every GNSS update with a valid time.
+ * @param time_us Monotonic receive time of the GNSS data.
+ * @param gps GNSS data.
+ */
+void DM_logSetUTC(int64_t time_us, const gps_t * gps);
+
+/**
+ * @brief Encode one record of the storage queue (sample, gap marker or envelope) into the current chunk.
+ * The full chunk is written first. Written bytes are added to flushed.
+ * @param[in] package Record.
+ * @param[in] write Log write function.
+ * @param[out] flushed Bytes written.
+ * @return ESP_OK if the record is in the chunk, error of the write otherwise - the chunk is kept for the next call.
+ */
+esp_err_t DM_logEncode(const DataPackage_t * package, DM_write_t write, uint32_t * flushed);
+
+/**
+ * @brief One chunk of the stream preamble (header and schema records), as at the start of the log.
+ * Prepended to a part of the log sent without its start, so it decodes on its own.
+ * @param[in] chunk Chunk number, from 0.
+ * @param[out] buf Chunk, zero padded.
+ * @return Bytes of records in the chunk, 0 after the last chunk.
+ */
+uint8_t DM_logPreamble(uint8_t chunk, uint8_t buf[DM_LOG_CHUNK_B]);
+
+/**
+ * @brief Write the current chunk, if any.
+ * @param[in] write Log write function.
+ * @param[out] flushed Bytes written.
+ * @return ESP_OK if written or empty, error of the write otherwise.
+ */
+esp_err_t DM_logFlush(DM_write_t write, uint32_t * flushed);
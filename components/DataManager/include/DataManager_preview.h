@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "DataManager.h"
+
+#define DM_PREVIEW_LEVELS	3			/*!< 1 s, 10 s and 100 s buckets */
+#define DM_PREVIEW_SPAN_S	3600		/*!< Time covered by the 10 s and 100 s levels, the 1 s level covers CONFIG_KPPTR_PREVIEW_S */
+#define DM_PREVIEW_EMPTY	INT16_MIN	/*!< DM_previewBucket_t::mean of a bucket without records */
+
+/**
+ * @brief Min, max and mean of every ::DM_envChannel_t over one bucket, quantized - see scales in DataManager_preview.c.
+ * Min and max include the envelopes of decimated windows, the mean only the stored records.
+ */
+typedef struct __attribute__((__packed__)){
+	int16_t min[DM_ENV_CHANNELS];
+	int16_t max[DM_ENV_CHANNELS];
+	int16_t mean[DM_ENV_CHANNELS];
+} DM_previewBucket_t;
+
+/**
+ * @brief Output callback of the exporter.
+ * @return ESP_OK to continue, anything else aborts the export.
+ */
+typedef esp_err_t (*DM_previewWrite_t)(void * ctx, const char * buf, size_t len);
+
+/**
+ * @brief Load the preview of the last flight from flash. Call after the www partition is mounted.
+ * It is served until the first record of a new flight is stored.
+ * @return
+ *  - ESP_OK: Preview loaded
+ *  - ESP_ERR_NOT_FOUND: No stored preview
+ *  - ESP_ERR_INVALID_CRC: Stored preview is damaged
+ */
+esp_err_t DM_previewInit(void);
+
+/**
+ * @brief Add a stored record to all levels - O(1), called by the storage path after a successful write.
+ * Gap markers are skipped, envelopes only extend min and max. Records after DM_PREVIEW_SPAN_S of the flight are ignored.
+ * @param[in] package Record, gap marker or envelope.
+ */
+void DM_previewAdd(const DataPackage_t * package);
+
+/**
+ * @brief Store the preview to flash once after landing and once more at shutdown. Blocks on flash, call from a low priority task.
+ * @param flightstate Current flight state.
+ * @return
+ *  - ESP_OK: Stored or nothing to store
+ *  - ESP_FAIL: Write failed, retried on the next call
+ */
+esp_err_t DM_previewPersist(flightstate_t flightstate);
+
+/**
+ * @brief Write one level as JSON - {"level","bucket_s","start_ms","stored","buckets","channels":{name:{"scale","min","max","mean"}}}.
+ * Values are the quantized integers, value / scale gives the physical unit. Empty buckets are null.
+ * @param level 0 - 1 s, 1 - 10 s, 2 - 100 s buckets.
+ * @param write Output callback, called many times with parts of the document.
+ * @param ctx Passed to the callback.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a wrong level, error of the callback otherwise.
+ */
+esp_err_t DM_previewExport(uint8_t level, DM_previewWrite_t write, void * ctx);
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "sdkconfig.h"
+#include "SPI_driver.h"
+#include "FLASH_driver.h"
+
+#if defined (SPI_SLAVE_FLASH_PIN)
+
+#ifndef CONFIG_KPPTR_EXT_FLASH_SPI_MHZ
+#define CONFIG_KPPTR_EXT_FLASH_SPI_MHZ	SPI_SCK_10MHZ
+#endif
+
+#define FLASH_CMD_WRSR			0x01
+#define FLASH_CMD_PP			0x02
+#define FLASH_CMD_READ			0x03
+#define FLASH_CMD_RDSR			0x05
+#define FLASH_CMD_WREN			0x06
+#define FLASH_CMD_SE			0x20	// 4 kB sector erase
+#define FLASH_CMD_RDID			0x9F
+#define FLASH_CMD_RDP			0xAB	// Release from deep power down
+#define FLASH_CMD_BE			0xD8	// 64 kB block erase
+
+#define FLASH_SR_WIP			0x01
+#define FLASH_SR_BP_MASK		0x3C
+
+#define FLASH_READ_CHUNK_B		4064	// Below the 4092 B DMA limit of the bus
+#define FLASH_SPIN_US			5000	// Busy wait covers a page program, erase sleeps
+#define FLASH_TIMEOUT_MS		4000	// Block erase max. is about 2 s
+
+static const char *TAG = "FLASH";
+
+static spi_dev_handle_t flash_handle = NULL;
+static SemaphoreHandle_t flash_lock = NULL;
+static uint32_t flash_size_B = 0;
+static uint8_t flash_pending = 0;		// Queued transactions without result
+static bool flash_busy = false;			// Program or erase started, WIP not seen clear yet
+
+//--------------- Queued page program ----------------------
+static spi_transaction_ext_t flash_trans_wren;
+static spi_transaction_t flash_trans_prog;
+static uint8_t flash_page_buf[FLASH_PAGE_B] __attribute__((aligned(4)));	// DMA source, owned by the queued program
+
+static esp_err_t flash_cmd(uint8_t cmd, uint32_t address, uint8_t address_bits, const void * tx_buf, void * rx_buf, uint32_t size){
+	spi_transaction_ext_t trans;
+
+	memset(&trans, 0, sizeof(trans));
+	trans.base.flags 	= SPI_TRANS_VARIABLE_ADDR;
+	trans.base.cmd 		= cmd;
+	trans.base.addr 	= address;
+	trans.base.length 	= 8 * size;
+	trans.base.rxlength = (rx_buf != NULL) ? (8 * size) : 0;
+	trans.address_bits 	= address_bits;
+
+	// Status and ID fit in the transaction itself, no DMA for a few bytes
+	if(size <= 4){
+		if(tx_buf != NULL){
+			trans.base.flags |= SPI_TRANS_USE_TXDATA;
+			memcpy(trans.base.tx_data, tx_buf, size);
+		}
+		if(rx_buf != NULL)
+			trans.base.flags |= SPI_TRANS_USE_RXDATA;
+	} else {
+		trans.base.tx_buffer = tx_buf;
+		trans.base.rx_buffer = rx_buf;
+	}
+
+	if(spi_device_polling_transmit(flash_handle, &trans.base) != ESP_OK){
+		ESP_LOGE(TAG, "Command 0x%02X failed", cmd);
+		return ESP_FAIL;
+	}
+
+	if((rx_buf != NULL) && (size <= 4))
+		memcpy(rx_buf, trans.base.rx_data, size);
+
+	return ESP_OK;
+}
+
+// Results of the queued program - polling transactions can not be mixed with queued ones
+static esp_err_t flash_collect(TickType_t wait){
+	spi_transaction_t *done;
+
+	while(flash_pending){
+		if(spi_device_get_trans_result(flash_handle, &done, wait) != ESP_OK)
+			return ESP_ERR_TIMEOUT;
+		flash_pending--;
+	}
+
+	return ESP_OK;
+}
+
+// Caller holds flash_lock
+static esp_err_t flash_waitIdle(TickType_t timeout){
+	uint8_t status = 0;
+	int64_t start_us = esp_timer_get_time();
+	TickType_t start = xTaskGetTickCount();
+
+	if(flash_collect(timeout) != ESP_OK){
+		ESP_LOGE(TAG, "Program transfer timeout");
+		return ESP_ERR_TIMEOUT;
+	}
+
+	while(flash_busy){
+		if(flash_cmd(FLASH_CMD_RDSR, 0, 0, NULL, &status, 1) != ESP_OK)
+			return ESP_FAIL;
+
+		if((status & FLASH_SR_WIP) == 0){
+			flash_busy = false;
+			break;
+		}
+
+		if((xTaskGetTickCount() - start) >= timeout)
+			return ESP_ERR_TIMEOUT;
+
+		if((esp_timer_get_time() - start_us) < FLASH_SPIN_US)
+			esp_rom_delay_us(20);
+		else
+			vTaskDelay(1);
+	}
+
+	return ESP_OK;
+}
+
+static esp_err_t flash_writeEnable(){
+	return flash_cmd(FLASH_CMD_WREN, 0, 0, NULL, NULL, 0);
+}
+
+esp_err_t FLASH_init(FLASH_info_t * info){
+	uint8_t id[3] = {0};
+	uint8_t status = 0;
+
+	if(SPI_checkInit() != ESP_OK){
+		ESP_LOGE(TAG, "SPI not initialized");
+		return ESP_FAIL;
+	}
+
+	if(flash_handle == NULL){
+		flash_lock = xSemaphoreCreateMutex();
+		if((flash_lock == NULL)
+				|| (SPI_registerDevice(&flash_handle, SPI_SLAVE_FLASH_PIN, CONFIG_KPPTR_EXT_FLASH_SPI_MHZ, 2, 8, 24) != ESP_OK)){
+			ESP_LOGE(TAG, "Failed to register device");
+			return ESP_FAIL;
+		}
+	}
+
+	xSemaphoreTake(flash_lock, portMAX_DELAY);
+	flash_cmd(FLASH_CMD_RDP, 0, 0, NULL, NULL, 0);
+	esp_rom_delay_us(50);	// tRES1
+
+	esp_err_t err = flash_cmd(FLASH_CMD_RDID, 0, 0, NULL, id, sizeof(id));
+	if((err == ESP_OK) && (((id[0] == 0x00) && (id[1] == 0x00)) || ((id[0] == 0xFF) && (id[1] == 0xFF)))){
+		ESP_LOGE(TAG, "No chip on CS %i", SPI_SLAVE_FLASH_PIN);
+		err = ESP_ERR_NOT_FOUND;
+	}
+
+	// Capacity code is log2 of the size on all common parts
+	if((err == ESP_OK) && ((id[2] < 16) || (id[2] > 31))){
+		ESP_LOGE(TAG, "Unknown capacity code 0x%02X", id[2]);
+		err = ESP_ERR_NOT_FOUND;
+	}
+
+	if(err == ESP_OK){
+		flash_size_B = ((id[2] > 24) ? FLASH_MAX_SIZE_B : (1UL << id[2]));
+
+		// Some parts power up write protected
+		if((flash_cmd(FLASH_CMD_RDSR, 0, 0, NULL, &status, 1) == ESP_OK) && (status & FLASH_SR_BP_MASK)){
+			uint8_t clear = 0;
+
+			flash_writeEnable();
+			flash_cmd(FLASH_CMD_WRSR, 0, 0, &clear, NULL, 1);
+			flash_busy = true;
+			err = flash_waitIdle(pdMS_TO_TICKS( FLASH_TIMEOUT_MS ));
+		}
+	}
+	xSemaphoreGive(flash_lock);
+
+	if(err != ESP_OK)
+		return err;
+
+	info->manufacturer = id[0];
+	info->device 	   = (id[1] << 8) | id[2];
+	info->size_B 	   = flash_size_B;
+
+	ESP_LOGI(TAG, "JEDEC %02X %04X, %i kB", info->manufacturer, info->device, info->size_B / 1024);
+	return ESP_OK;
+}
+
+esp_err_t FLASH_read(uint32_t address, void * buffer, uint32_t size){
+	if((flash_size_B == 0) || (buffer == NULL) || (size == 0) || (address >= flash_size_B) || (size > (flash_size_B - address)))
+		return ESP_ERR_INVALID_ARG;
+
+	xSemaphoreTake(flash_lock, portMAX_DELAY);
+	esp_err_t err = flash_waitIdle(pdMS_TO_TICKS( FLASH_TIMEOUT_MS ));
+
+	while((err == ESP_OK) && (size > 0)){
+		uint32_t len = (size > FLASH_READ_CHUNK_B) ? FLASH_READ_CHUNK_B : size;
+
+		err = flash_cmd(FLASH_CMD_READ, address, 24, NULL, buffer, len);
+		address += len;
+		buffer 	 = (uint8_t *)buffer + len;
+		size 	-= len;
+	}
+	xSemaphoreGive(flash_lock);
+
+	return err;
+}
+
+esp_err_t FLASH_progStart(uint32_t address, const void * buffer, uint32_t size){
+	if((flash_size_B == 0) || (buffer == NULL) || (size == 0) || (size > FLASH_PAGE_B)
+			|| ((address % FLASH_PAGE_B) + size > FLASH_PAGE_B) || (address >= flash_size_B)){
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake(flash_lock, portMAX_DELAY);
+	esp_err_t err = flash_waitIdle(pdMS_TO_TICKS( FLASH_TIMEOUT_MS ));	// Also frees flash_page_buf
+
+	if(err == ESP_OK){
+		memcpy(flash_page_buf, buffer, size);
+
+		memset(&flash_trans_wren, 0, sizeof(flash_trans_wren));
+		flash_trans_wren.base.flags = SPI_TRANS_VARIABLE_ADDR;
+		flash_trans_wren.base.cmd 	= FLASH_CMD_WREN;
+
+		memset(&flash_trans_prog, 0, sizeof(flash_trans_prog));
+		flash_trans_prog.cmd 		= FLASH_CMD_PP;
+		flash_trans_prog.addr 		= address;
+		flash_trans_prog.length 	= 8 * size;
+		flash_trans_prog.tx_buffer 	= flash_page_buf;
+
+		// Queue keeps the order, the SPI ISR sends both while the caller goes on
+		if(spi_device_queue_trans(flash_handle, &flash_trans_wren.base, 0) == ESP_OK){
+			flash_pending++;
+			if(spi_device_queue_trans(flash_handle, &flash_trans_prog, 0) == ESP_OK){
+				flash_pending++;
+				flash_busy = true;
+			} else {
+				err = ESP_FAIL;
+			}
+		} else {
+			err = ESP_FAIL;
+		}
+	}
+	xSemaphoreGive(flash_lock);
+
+	if(err != ESP_OK)
+		ESP_LOGE(TAG, "Program start failed at %i", address);
+	return err;
+}
+
+esp_err_t FLASH_eraseStart(uint32_t address, uint32_t size){
+	uint8_t cmd;
+
+	if(size == FLASH_SECTOR_B)
+		cmd = FLASH_CMD_SE;
+	else if(size == FLASH_BLOCK_B)
+		cmd = FLASH_CMD_BE;
+	else
+		return ESP_ERR_INVALID_ARG;
+
+	if((flash_size_B == 0) || (address % size) || (address >= flash_size_B))
+		return ESP_ERR_INVALID_ARG;
+
+	xSemaphoreTake(flash_lock, portMAX_DELAY);
+	esp_err_t err = flash_waitIdle(pdMS_TO_TICKS( FLASH_TIMEOUT_MS ));
+
+	if(err == ESP_OK)
+		err = flash_writeEnable();
+	if(err == ESP_OK)
+		err = flash_cmd(cmd, address, 24, NULL, NULL, 0);
+	if(err == ESP_OK)
+		flash_busy = true;
+	xSemaphoreGive(flash_lock);
+
+	return err;
+}
+
+esp_err_t FLASH_erase(uint32_t address, uint32_t size){
+	if((address % FLASH_SECTOR_B) || (size % FLASH_SECTOR_B) || (address >= flash_size_B) || (size > (flash_size_B - address)))
+		return ESP_ERR_INVALID_ARG;
+
+	while(size > 0){
+		uint32_t len = (((address % FLASH_BLOCK_B) == 0) && (size >= FLASH_BLOCK_B)) ? FLASH_BLOCK_B : FLASH_SECTOR_B;
+
+		esp_err_t err = FLASH_eraseStart(address, len);
+		if(err == ESP_OK)
+			err = FLASH_waitReady(pdMS_TO_TICKS( FLASH_TIMEOUT_MS ));
+		if(err != ESP_OK){
+			ESP_LOGE(TAG, "Erase failed at %i", address);
+			return err;
+		}
+
+		address += len;
+		size 	-= len;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t FLASH_waitReady(TickType_t timeout){
+	if(flash_lock == NULL)
+		return ESP_FAIL;
+
+	xSemaphoreTake(flash_lock, portMAX_DELAY);
+	esp_err_t err = flash_waitIdle(timeout);
+	xSemaphoreGive(flash_lock);
+
+	return err;
+}
+
+bool FLASH_isBusy(void){
+	uint8_t status = FLASH_SR_WIP;
+
+	if((flash_lock == NULL) || (xSemaphoreTake(flash_lock, 0) != pdTRUE))
+		return true;
+
+	if(flash_busy && (flash_collect(0) == ESP_OK) && (flash_cmd(FLASH_CMD_RDSR, 0, 0, NULL, &status, 1) == ESP_OK)){
+		if((status & FLASH_SR_WIP) == 0)
+			flash_busy = false;
+	}
+	bool busy = flash_busy;
+	xSemaphoreGive(flash_lock);
+
+	return busy;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "BOARD.h"
+
+#define FLASH_PAGE_B		256				/*!< Program unit, a program must not cross a page */
+#define FLASH_SECTOR_B		4096UL			/*!< Smallest erase unit */
+#define FLASH_BLOCK_B		(64*1024UL)		/*!< Largest erase unit */
+#define FLASH_MAX_SIZE_B	(16*1024*1024UL)	/*!< 3 byte addressing, bigger chips are used up to this size */
+
+/**
+ * @brief External flash identification.
+ */
+typedef struct{
+	uint8_t manufacturer;			/*!< JEDEC manufacturer ID */
+	uint16_t device;				/*!< JEDEC memory type and capacity */
+	uint32_t size_B;				/*!< Usable size */
+} FLASH_info_t;
+
+/**
+ * @brief Initialize the external SPI NOR flash on SPI_SLAVE_FLASH_PIN. SPI_init() must be done.
+ * Reads the JEDEC ID and clears the block protection.
+ * @param[out] info Chip identification.
+ * @return
+ *  - ESP_OK: Success
+ *  - ESP_ERR_NOT_FOUND: No chip answers
+ *  - ESP_FAIL: SPI error
+ */
+esp_err_t FLASH_init(FLASH_info_t * info);
+
+/**
+ * @brief Read. Waits for a program or erase in progress.
+ * @param address Chip address.
+ * @param[out] buffer Data.
+ * @param size Bytes to read.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG out of range, ESP_FAIL otherwise.
+ */
+esp_err_t FLASH_read(uint32_t address, void * buffer, uint32_t size);
+
+/**
+ * @brief Start a page program and return. Data is copied, the transfer runs by DMA and the chip
+ * programs on its own - the next call of the driver waits for it.
+ * @param address Chip address.
+ * @param[in] buffer Data.
+ * @param size Bytes, the range must not cross a FLASH_PAGE_B page.
+ * @return ESP_OK if the program was started, ESP_ERR_INVALID_ARG for a wrong range, ESP_FAIL otherwise.
+ */
+esp_err_t FLASH_progStart(uint32_t address, const void * buffer, uint32_t size);
+
+/**
+ * @brief Start an erase of one sector or block and return. The next call of the driver waits for it.
+ * @param address Chip address, aligned to size.
+ * @param size FLASH_SECTOR_B or FLASH_BLOCK_B.
+ * @return ESP_OK if the erase was started, ESP_ERR_INVALID_ARG for a wrong range, ESP_FAIL otherwise.
+ */
+esp_err_t FLASH_eraseStart(uint32_t address, uint32_t size);
+
+/**
+ * @brief Erase a range with the largest units that fit. Sleeps while the chip is busy, do not call in the hot path.
+ * @param address Chip address, aligned to FLASH_SECTOR_B.
+ * @param size Bytes, multiple of FLASH_SECTOR_B.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a wrong range, ESP_FAIL otherwise.
+ */
+esp_err_t FLASH_erase(uint32_t address, uint32_t size);
+
+/**
+ * @brief Wait for the end of a started program or erase.
+ * @param timeout Maximum wait in ticks.
+ * @return ESP_OK if the chip is ready, ESP_ERR_TIMEOUT if still busy, ESP_FAIL on SPI error.
+ */
+esp_err_t FLASH_waitReady(TickType_t timeout);
+
+/**
+ * @brief Check if a started program or erase is still running. Does not wait for the SPI bus if locked.
+ * @return true if busy or unknown.
+ */
+bool FLASH_isBusy(void);
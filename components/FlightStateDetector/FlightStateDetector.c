@@ -1,12 +1,19 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <math.h>
 #include "esp_log.h"
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include "AHRS_driver.h"
+#include "KF_AltitudeAscent.h"
 #include "FlightStateDetector.h"
 
 #define TIME_ELAPSED(start_ms, now_ms, wait_ms) (start_ms <= (now_ms - wait_ms))
 
+#define APOGEE_GRAVITY		(9.81f)
+#define APOGEE_KSIGMA		(3.0f)		// Upper bound of the velocity estimate, see FSD_apogeePredicted()
+#define APOGEE_CONFIRM		(3)			// Consecutive samples
+
 //------ Private fun -----
 static void FlightState_STARTUP				(uint64_t time_ms, FlightState_t * currentState, AHRS_t * ahrs);
 static void FlightState_PREFLIGHT			(uint64_t time_ms, FlightState_t * currentState, AHRS_t * ahrs);
@@ -16,6 +23,7 @@ static void FlightState_FREEFALL			(uint64_t time_ms, FlightState_t * currentSta
 static void FlightState_DRAGCHUTE_FALL		(uint64_t time_ms, FlightState_t * currentState, AHRS_t * ahrs);
 static void FlightState_MAINSHUTE_FALL		(uint64_t time_ms, FlightState_t * currentState, AHRS_t * ahrs);
 static void FlightState_LANDING				(uint64_t time_ms, FlightState_t * currentState, AHRS_t * ahrs);
+static bool FSD_apogeePredicted				(AHRS_t * ahrs);
 
 //----- Private var -----
 static FlightState_t flightState_d;
@@ -23,6 +31,7 @@ static AHRS_t * 	 AHRS_ptr;
 static const char *TAG = "FSD";
 
 static uint64_t stateChangeTime = 0;
+static uint8_t apogeeConfirm = 0;
 static armingstatus_t armstatus_d = DISARMED;
 
 void FSD_arming(){
@@ -170,13 +179,15 @@ static void FlightState_FREEFLIGHT			(uint64_t time_ms, FlightState_t * currentS
 	if(!(currentState->state_ready)) {
 		currentState->state_ready = true;
 		stateChangeTime = time_ms;
+		apogeeConfirm = 0;
 	}
 
 	//------ Komendy wykonywane co pętlę ------
-
+	bool apogee = FSD_apogeePredicted(ahrs);
 
 	//------ Warunki przejścia dalej ------
-	if ((TIME_ELAPSED(stateChangeTime, time_ms, 200))  && ((ahrs->max_altitude - ahrs->altitude) > 10.0f) ) {
+	// Predicted apogee, altitude drop as backup (velocity estimate broken)
+	if ((TIME_ELAPSED(stateChangeTime, time_ms, 200))  && (apogee || ((ahrs->max_altitude - ahrs->altitude) > 10.0f)) ) {
 		currentState->state = FLIGHTSTATE_FREEFALL;
 		currentState->state_ready = false;
 	}
@@ -271,4 +282,25 @@ static void FlightState_LANDING	(uint64_t time_ms, FlightState_t * currentState,
 	}
 }
 
+static bool FSD_apogeePredicted(AHRS_t * ahrs){
+	// Short-horizon ballistic prediction: near apogee drag is small and the rocket decelerates with gravity
+	// (drag only brings apogee sooner), so apogee is less than 'lead' away once ascent_rate < g*lead.
+	// ascent_rate is the Kalman estimate with variance P[1][1], over the lead time the acceleration error adds
+	// Q_accel*lead^2. The upper KSIGMA bound below g*lead keeps the detection after 'lead' before apogee only as far
+	// as P is consistent with the real error - measure changes of the filter tuning with tools/sil.
+	// lead compensates the confirmation samples and deployment delay.
+	const KF_AltitudeAscent_t * KF = AHRS_kalmanAltitudeAscent_get();
+	const float lead = CONFIG_KPPTR_APOGEE_LEAD_MS / 1000.0f;
+
+	float sigma = sqrtf(KF->P[1][1] + KF->Q_accel*lead*lead);
+
+	if((ahrs->ascent_rate + APOGEE_KSIGMA*sigma) < (APOGEE_GRAVITY*lead)) {
+		if(apogeeConfirm < APOGEE_CONFIRM)
+			apogeeConfirm++;
+	}
+	else {
+		apogeeConfirm = 0;
+	}
 
+	return (apogeeConfirm >= APOGEE_CONFIRM);
+}
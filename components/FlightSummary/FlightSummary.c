@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "cJSON.h"
+#include "sdkconfig.h"
+#include "FlightSummary.h"
+
+#define SUMMARY_PATH		"/www/summary.bin"
+#define SUMMARY_MAGIC		0x314D5553		// "SUM1" - change with Summary_t layout
+
+/**
+ * @brief Stored summary. Written in place (SPIFFS cannot rename over an existing file), a torn write
+ * fails the CRC and the summary is reported as damaged instead of being served.
+ */
+typedef struct{
+	uint32_t magic;
+	Summary_t summary;
+	uint32_t crc;					/*!< esp_crc32_le of all previous bytes */
+} summary_file_t;
+
+static const char *TAG = "Summary";
+
+static const char * const event_names[SUMMARY_EVENTS] = {
+	[FLIGHTSTATE_ME_ACCELERATING] = "liftoff",
+	[FLIGHTSTATE_FREEFLIGHT]      = "burnout",
+	[FLIGHTSTATE_FREEFALL]        = "apogee",
+	[FLIGHTSTATE_DRAGCHUTE_FALL]  = "drogue",
+	[FLIGHTSTATE_MAINSHUTE_FALL]  = "main",
+	[FLIGHTSTATE_LANDING]         = "landing",
+	[FLIGHTSTATE_SHUTDOWN]        = "shutdown",
+};
+
+static portMUX_TYPE summary_lock = portMUX_INITIALIZER_UNLOCKED;
+static Summary_t summary;					// This flight, written only by the main task
+static Summary_t summary_stored;			// Last flight from flash
+static bool stored_valid = false;
+static bool persist_pending = false;
+static int64_t last_fix_us = 0;				// rx_time_us of the last fix taken
+
+static void summary_reset(Summary_t * s){
+	memset(s, 0, sizeof(Summary_t));
+	for(uint8_t i=0; i<SUMMARY_EVENTS; i++){
+		s->event_ms[i]  = UINT32_MAX;
+		s->event_alt[i] = NAN;
+	}
+}
+
+esp_err_t Summary_init(void){
+	summary_file_t file;
+
+	summary_reset(&summary);
+
+	FILE* f = fopen(SUMMARY_PATH, "rb");
+	if(f == NULL){
+		ESP_LOGI(TAG, "No stored summary");
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	size_t read = fread(&file, sizeof(file), 1, f);
+	fclose(f);
+
+	if((read != 1) || (file.magic != SUMMARY_MAGIC)
+			|| (file.crc != esp_crc32_le(0, (uint8_t const *)&file, offsetof(summary_file_t, crc)))){
+		ESP_LOGW(TAG, "Stored summary damaged or of other version");
+		return ESP_ERR_INVALID_CRC;
+	}
+
+	memcpy(&summary_stored, &file.summary, sizeof(Summary_t));
+	summary_stored.flags |= SUMMARY_FLAG_STORED;
+	stored_valid = true;
+
+	ESP_LOGI(TAG, "Last flight: apogee %.1f m, max velocity %.1f m/s", summary_stored.apogee, summary_stored.velocity_max);
+	return ESP_OK;
+}
+
+void Summary_update(int64_t time_us, const Sensors_t * sensors, const gps_t * gps, const AHRS_t * ahrs, flightstate_t flightstate){
+	if(!summary.liftoff && ((flightstate < FLIGHTSTATE_ME_ACCELERATING) || (flightstate >= FLIGHTSTATE_LANDING)))
+		return;
+
+	uint32_t time_ms = (uint32_t)(time_us/1000);
+	bool new_fix = (gps->fix != GPS_FIX_INVALID) && (gps->rx_time_us != last_fix_us);
+
+	// Squared magnitudes - sqrtf only for a new maximum
+	float acc_sq  = sensors->LSM6DSO32.accX * sensors->LSM6DSO32.accX + sensors->LSM6DSO32.accY * sensors->LSM6DSO32.accY
+			+ sensors->LSM6DSO32.accZ * sensors->LSM6DSO32.accZ;
+	float accH_sq = sensors->LIS331.accX * sensors->LIS331.accX + sensors->LIS331.accY * sensors->LIS331.accY
+			+ sensors->LIS331.accZ * sensors->LIS331.accZ;
+	if(accH_sq > acc_sq)
+		acc_sq = accH_sq;	// Saturated sensor reads low, the other one is right
+
+	portENTER_CRITICAL(&summary_lock);
+	if(!summary.liftoff){
+		summary_reset(&summary);
+		summary.liftoff 		= true;
+		summary.liftoff_boot_ms = time_ms;
+		summary.apogee 			= ahrs->altitude;
+	}
+
+	uint32_t t_ms = time_ms - summary.liftoff_boot_ms;
+
+	if(flightstate != summary.flightstate){
+		if((flightstate < SUMMARY_EVENTS) && (summary.event_ms[flightstate] == UINT32_MAX)){
+			summary.event_ms[flightstate]  = t_ms;
+			summary.event_alt[flightstate] = ahrs->altitude;
+		}
+		summary.flightstate = flightstate;
+
+		if((flightstate >= FLIGHTSTATE_LANDING) && !(summary.flags & SUMMARY_FLAG_LANDED)){
+			summary.flags |= SUMMARY_FLAG_LANDED;
+			persist_pending = true;
+		}
+	}
+
+	// Maxima of the flight only, touchdown shock is not a flight value
+	if(!(summary.flags & SUMMARY_FLAG_LANDED)){
+		if(ahrs->altitude > summary.apogee){
+			summary.apogee 	  = ahrs->altitude;
+			summary.apogee_ms = t_ms;
+		}
+		if(acc_sq > summary.acc_max * summary.acc_max){
+			summary.acc_max    = sqrtf(acc_sq);
+			summary.acc_max_ms = t_ms;
+		}
+		if(ahrs->ascent_rate > summary.velocity_max){
+			summary.velocity_max 	= ahrs->ascent_rate;
+			summary.velocity_max_ms = t_ms;
+		}
+		if(-ahrs->ascent_rate > summary.descent_max){
+			summary.descent_max = -ahrs->ascent_rate;
+		}
+	}
+
+	// Landing position - every fix in flight, frozen at the first fix after touchdown
+	if(new_fix && !(summary.flags & SUMMARY_FLAG_FIX)){
+		last_fix_us 	 = gps->rx_time_us;
+		summary.lat 	 = gps->latitude;
+		summary.lon 	 = gps->longitude;
+		summary.alt_gnss = gps->altitude;
+		summary.sats 	 = gps->sats_in_use;
+
+		if(summary.flags & SUMMARY_FLAG_LANDED){
+			summary.flags |= SUMMARY_FLAG_FIX;
+			persist_pending = true;
+		}
+	}
+	portEXIT_CRITICAL(&summary_lock);
+}
+
+esp_err_t Summary_persist(void){
+	summary_file_t file;
+
+	if(!persist_pending)
+		return ESP_OK;
+
+	memset(&file, 0, sizeof(file));
+	portENTER_CRITICAL(&summary_lock);
+	memcpy(&file.summary, &summary, sizeof(Summary_t));
+	persist_pending = false;
+	portEXIT_CRITICAL(&summary_lock);
+
+	file.magic = SUMMARY_MAGIC;
+	file.crc   = esp_crc32_le(0, (uint8_t const *)&file, offsetof(summary_file_t, crc));
+
+	FILE* f = fopen(SUMMARY_PATH, "wb");
+	if(f == NULL){
+		ESP_LOGE(TAG, "Failed to open file for writing");
+		persist_pending = true;
+		return ESP_FAIL;
+	}
+
+	size_t written = fwrite(&file, sizeof(file), 1, f);
+	fclose(f);
+
+	if(written != 1){
+		ESP_LOGE(TAG, "Failed to store summary");
+		persist_pending = true;
+		return ESP_FAIL;
+	}
+
+	ESP_LOGI(TAG, "Summary stored: apogee %.1f m, landing fix %s", file.summary.apogee,
+			(file.summary.flags & SUMMARY_FLAG_FIX) ? "after touchdown" : "from flight");
+	return ESP_OK;
+}
+
+Summary_t Summary_get(void){
+	Summary_t s;
+
+	portENTER_CRITICAL(&summary_lock);
+	if(summary.liftoff || !stored_valid){
+		s = summary;
+	} else {
+		s = summary_stored;
+	}
+	portEXIT_CRITICAL(&summary_lock);
+
+	return s;
+}
+
+bool Summary_isLanded(void){
+	return summary.liftoff && (summary.flags & SUMMARY_FLAG_LANDED);
+}
+
+static int16_t summary_clamp16(float value){
+	if(value > INT16_MAX)
+		return INT16_MAX;
+	if(value < INT16_MIN)
+		return INT16_MIN;
+	return (int16_t)value;
+}
+
+void Summary_collectRF(SummaryRF_t * frame){
+	Summary_t s = Summary_get();
+
+	frame->packet_id 	   = SUMMARY_RF_PACKET_ID;
+	frame->id 			   = CONFIG_KPPTR_RF_DEVICE_ID;
+	frame->flags 		   = s.flags;
+	frame->apogee 		   = s.apogee;
+	frame->apogee_ms 	   = s.apogee_ms;
+	frame->burn_ms 		   = (s.event_ms[FLIGHTSTATE_FREEFLIGHT] > UINT16_MAX) ? UINT16_MAX : s.event_ms[FLIGHTSTATE_FREEFLIGHT];
+	frame->flight_ms 	   = s.event_ms[FLIGHTSTATE_LANDING];
+	frame->acc_max_100 	   = summary_clamp16(s.acc_max * 100.0f);
+	frame->velocity_max_10 = summary_clamp16(s.velocity_max * 10.0f);
+	frame->drogue_alt 	   = s.event_alt[FLIGHTSTATE_DRAGCHUTE_FALL];
+	frame->main_alt 	   = s.event_alt[FLIGHTSTATE_MAINSHUTE_FALL];
+	frame->lat 			   = s.lat;
+	frame->lon 			   = s.lon;
+}
+
+static void summary_addFlight(cJSON *json, const Summary_t * s){
+	cJSON_AddNumberToObject(json, "state", 			s->flightstate);
+
+	cJSON_AddNumberToObject(json, "apogee", 		s->apogee);
+	cJSON_AddNumberToObject(json, "apogee_t", 		s->apogee_ms / 1000.0);
+	cJSON_AddNumberToObject(json, "acc_max", 		s->acc_max);
+	cJSON_AddNumberToObject(json, "acc_max_t", 		s->acc_max_ms / 1000.0);
+	cJSON_AddNumberToObject(json, "velocity_max", 	s->velocity_max);
+	cJSON_AddNumberToObject(json, "velocity_max_t", s->velocity_max_ms / 1000.0);
+	cJSON_AddNumberToObject(json, "descent_max", 	s->descent_max);
+	if(s->event_ms[FLIGHTSTATE_FREEFLIGHT] != UINT32_MAX)
+		cJSON_AddNumberToObject(json, "burn_time", 	s->event_ms[FLIGHTSTATE_FREEFLIGHT] / 1000.0);
+	if(s->event_ms[FLIGHTSTATE_LANDING] != UINT32_MAX)
+		cJSON_AddNumberToObject(json, "flight_time",s->event_ms[FLIGHTSTATE_LANDING] / 1000.0);
+
+	// Time since liftoff and Kalman altitude of every event reached
+	cJSON *events = cJSON_CreateObject();
+	for(uint8_t i=FLIGHTSTATE_ME_ACCELERATING; i<SUMMARY_EVENTS; i++){
+		if(s->event_ms[i] == UINT32_MAX)
+			continue;
+
+		cJSON *event = cJSON_CreateObject();
+		cJSON_AddNumberToObject(event, "t", 	s->event_ms[i] / 1000.0);
+		cJSON_AddNumberToObject(event, "alt", 	s->event_alt[i]);
+		cJSON_AddItemToObject(events, event_names[i], event);
+	}
+	cJSON_AddItemToObject(json, "events", events);
+
+	if(s->sats > 0){
+		cJSON *landing = cJSON_CreateObject();
+		cJSON_AddNumberToObject(landing, "lat", 		s->lat / 10000000.0);
+		cJSON_AddNumberToObject(landing, "lon", 		s->lon / 10000000.0);
+		cJSON_AddNumberToObject(landing, "alt_gnss", 	s->alt_gnss);
+		cJSON_AddNumberToObject(landing, "sats", 		s->sats);
+		cJSON_AddBoolToObject  (landing, "after_touchdown", (s->flags & SUMMARY_FLAG_FIX) != 0);
+		cJSON_AddItemToObject(json, "landing", landing);
+	}
+}
+
+char* Summary_createJSON(void){
+	char *string = NULL;
+	Summary_t s = Summary_get();
+	cJSON *json = cJSON_CreateObject();
+
+	cJSON_AddStringToObject(json, "source", !s.liftoff ? "none" : ((s.flags & SUMMARY_FLAG_STORED) ? "flash" : "flight"));
+	cJSON_AddBoolToObject  (json, "landed", (s.flags & SUMMARY_FLAG_LANDED) != 0);
+	if(s.liftoff){
+		summary_addFlight(json, &s);
+	}
+
+	string = cJSON_PrintUnformatted(json);
+	if(string == NULL){
+		ESP_LOGE(TAG, "Cannot create JSON string");
+	}
+
+	cJSON_Delete(json);
+	return string;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "Sensors.h"
+#include "GNSS_driver.h"
+#include "AHRS_driver.h"
+#include "FlightStateDetector.h"
+
+#define SUMMARY_RF_PACKET_ID	0x00AB		/*!< SummaryRF_t frame type identifier */
+#define SUMMARY_EVENTS			(FLIGHTSTATE_SHUTDOWN + 1)
+
+#define SUMMARY_FLAG_LANDED		0x01		/*!< Summary is final */
+#define SUMMARY_FLAG_FIX		0x02		/*!< Landing position from a fix after touchdown */
+#define SUMMARY_FLAG_STORED		0x04		/*!< Summary loaded from flash, not from this boot */
+
+/**
+ * @brief Flight statistics, updated every main task tick. Times are in ms since liftoff.
+ */
+typedef struct{
+	bool liftoff;						/*!< ME_ACCELERATING was reached, the rest is valid */
+	uint8_t flags;						/*!< SUMMARY_FLAG_* */
+	uint8_t flightstate;				/*!< Last flight state */
+	uint32_t liftoff_boot_ms;			/*!< Liftoff in ms since boot */
+	uint32_t event_ms[SUMMARY_EVENTS];	/*!< Entry time of every flight state, UINT32_MAX - not reached */
+	float event_alt[SUMMARY_EVENTS];	/*!< Kalman altitude at the entry of every flight state [m] */
+
+	float apogee;						/*!< Highest Kalman altitude [m] */
+	uint32_t apogee_ms;
+	float acc_max;						/*!< Highest acceleration magnitude of both accelerometers [g] */
+	uint32_t acc_max_ms;
+	float velocity_max;					/*!< Highest Kalman vertical velocity [m/s] */
+	uint32_t velocity_max_ms;
+	float descent_max;					/*!< Highest Kalman descent rate [m/s] */
+
+	int32_t lat;						/*!< Landing latitude (1e-7 degrees), last fix if no fix after touchdown */
+	int32_t lon;						/*!< Landing longitude (1e-7 degrees) */
+	float alt_gnss;						/*!< Landing GNSS altitude [m] */
+	uint8_t sats;						/*!< Satellites of the landing fix, 0 - no fix during the flight */
+} Summary_t;
+
+/**
+ * @brief Compact LoRa frame with the summary, sent after landing in place of some DataPackageRF_t frames.
+ * Does not take a DataPackageRF_t packet number.
+ */
+typedef struct __attribute__((__packed__)){
+	uint16_t packet_id;				/*!< SUMMARY_RF_PACKET_ID */
+	uint16_t id;					/*!< Device identifier. */
+	uint8_t flags;					/*!< SUMMARY_FLAG_* */
+	float apogee;					/*!< Apogee [m] */
+	uint32_t apogee_ms;				/*!< Apogee time since liftoff [ms] */
+	uint16_t burn_ms;				/*!< Burn time [ms] */
+	uint32_t flight_ms;				/*!< Liftoff to landing [ms] */
+	int16_t acc_max_100;			/*!< Max acceleration [g*100] */
+	int16_t velocity_max_10;		/*!< Max vertical velocity [m/s*10] */
+	float drogue_alt;				/*!< Altitude at drogue deployment [m], NAN if not deployed */
+	float main_alt;					/*!< Altitude at main deployment [m], NAN if not deployed */
+	int32_t lat;					/*!< Landing latitude (1e-7 degrees) */
+	int32_t lon;					/*!< Landing longitude (1e-7 degrees) */
+} SummaryRF_t;
+
+/**
+ * @brief Load the summary of the last flight from flash. Call after the www partition is mounted.
+ * @return
+ *  - ESP_OK: Summary loaded
+ *  - ESP_ERR_NOT_FOUND: No stored summary
+ *  - ESP_ERR_INVALID_CRC: Stored summary is damaged
+ */
+esp_err_t Summary_init(void);
+
+/**
+ * @brief Update the statistics with one sample - O(1), called by the main task every tick.
+ * @param time_us Sample time.
+ * @param sensors Sensor data.
+ * @param gps Last GNSS data.
+ * @param ahrs AHRS data.
+ * @param flightstate Current flight state.
+ */
+void Summary_update(int64_t time_us, const Sensors_t * sensors, const gps_t * gps, const AHRS_t * ahrs, flightstate_t flightstate);
+
+/**
+ * @brief Store the summary to flash if it changed at landing. Blocks on flash, call from a low priority task.
+ * @return
+ *  - ESP_OK: Stored or nothing to store
+ *  - ESP_FAIL: Write failed, retried on the next call
+ */
+esp_err_t Summary_persist(void);
+
+/**
+ * @brief Get the summary of this flight, or the stored one before liftoff.
+ * @return Summary_t
+ */
+Summary_t Summary_get(void);
+
+/**
+ * @brief Check if the landing summary is ready to be sent.
+ * @return true after landing.
+ */
+bool Summary_isLanded(void);
+
+/**
+ * @brief Fill the compact LoRa frame.
+ * @param[out] frame Frame to fill.
+ */
+void Summary_collectRF(SummaryRF_t * frame);
+
+/**
+ * @brief Create the /json/summary document.
+ * @return JSON string (free after use), NULL on error.
+ */
+char* Summary_createJSON(void);
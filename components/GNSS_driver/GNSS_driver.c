@@ -3,10 +3,11 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "GNSS_driver.h"
 #include <string.h>
-#include <ctype.h>
-#include <math.h>
+#include <sys/param.h>
+#include <inttypes.h>
 static const char *TAG = "GNSS";
 
 
@@ -23,25 +24,35 @@ static uint8_t xMessageBuffer_GNSS2Storage_buffer[1 + (4 + sizeof(gps_t)) * 10];
 static StaticMessageBuffer_t  xMessageBuffer_GNSS2Storage_struct;
 static char txMessageBuffer[64];
 static uint64_t last_msg_timestamp = 0;
+static nmea_parser_handle_t nmea_hdl = NULL;
+static bool handler_added = false;
 
 esp_err_t GPS_init(void)
 {
+	// Safe to call again after a failure - the buffer, parser and handler are created only once
+	if(handler_added)
+		return ESP_OK;
+
 	//--------- Init ESP task & queue -------------
-	xMessageBuffer_GNSS2Storage = xMessageBufferCreateStatic(
-	                                    sizeof(xMessageBuffer_GNSS2Storage_buffer),
-	                                    xMessageBuffer_GNSS2Storage_buffer,
-	                                    &xMessageBuffer_GNSS2Storage_struct);
-
-	ESP_LOGI(TAG, "New queue created - size %i B, free spaces %i", sizeof(xMessageBuffer_GNSS2Storage_buffer),
-								xMessageBufferSpacesAvailable(xMessageBuffer_GNSS2Storage)/(4+sizeof(gps_t)));
-
-    /* NMEA parser configuration */
-    nmea_parser_config_t config = NMEA_PARSER_CONFIG_DEFAULT();
-    /* init NMEA parser library */
-    vTaskDelay(pdMS_TO_TICKS( 2000 ));
-    nmea_parser_handle_t nmea_hdl = nmea_parser_init(&config);
-    if(nmea_hdl == NULL)
-    	return ESP_FAIL;
+	if(xMessageBuffer_GNSS2Storage == NULL){
+		xMessageBuffer_GNSS2Storage = xMessageBufferCreateStatic(
+		                                    sizeof(xMessageBuffer_GNSS2Storage_buffer),
+		                                    xMessageBuffer_GNSS2Storage_buffer,
+		                                    &xMessageBuffer_GNSS2Storage_struct);
+
+		ESP_LOGI(TAG, "New queue created - size %i B, free spaces %i", sizeof(xMessageBuffer_GNSS2Storage_buffer),
+									xMessageBufferSpacesAvailable(xMessageBuffer_GNSS2Storage)/(4+sizeof(gps_t)));
+	}
+
+	if(nmea_hdl == NULL){
+	    /* NMEA parser configuration */
+	    nmea_parser_config_t config = NMEA_PARSER_CONFIG_DEFAULT();
+	    /* init NMEA parser library */
+	    vTaskDelay(pdMS_TO_TICKS( 2000 ));
+	    nmea_hdl = nmea_parser_init(&config);
+	    if(nmea_hdl == NULL)
+	    	return ESP_FAIL;
+	}
 
     //--------- Init GNSS receiver ----------------
 	GPS_baud_rate_set_extra(115200);		vTaskDelay(pdMS_TO_TICKS( 100 ));
@@ -52,6 +63,7 @@ esp_err_t GPS_init(void)
     /* register event handler for NMEA parser library */
     if(nmea_parser_add_handler(nmea_hdl, gps_event_handler, NULL) != ESP_OK)
     	return ESP_FAIL;
+    handler_added = true;
 
     ESP_LOGI(TAG, "Init ready");
 
@@ -59,7 +71,7 @@ esp_err_t GPS_init(void)
 }
 
 
-uint32_t GPS_getData(gps_t * data, uint16_t ms){
+uint32_t IRAM_ATTR GPS_getData(gps_t * data, uint16_t ms){
 	return xMessageBufferReceive( xMessageBuffer_GNSS2Storage,
 								 ( void * ) data,
 								 sizeof( gps_t ),
@@ -82,551 +94,49 @@ uint8_t GNSS_message_size(void)
 	return sizeof(gps_t);
 }
 
-static float parse_lat_long(esp_gps_t *esp_gps)
-{
-    float ll = strtof(esp_gps->item_str, NULL);
-    int deg = ((int)ll) / 100;
-    float min = ll - (deg * 100);
-    ll = deg + min / 60.0f;
-    return ll;
-}
-
-/**
- * @brief Converter two continuous numeric character into a uint8_t number
- *
- * @param digit_char numeric character
- * @return uint8_t result of converting
- */
-static inline uint8_t convert_two_digit2number(const char *digit_char)
-{
-    return 10 * (digit_char[0] - '0') + (digit_char[1] - '0');
-}
-
-/**
- * @brief Parse UTC time in GPS statements
- *
- * @param esp_gps esp_gps_t type object
- */
-
-
-static void parse_utc_time(esp_gps_t *esp_gps)
-{
-    esp_gps->parent.tim.hour = convert_two_digit2number(esp_gps->item_str + 0);
-    esp_gps->parent.tim.minute = convert_two_digit2number(esp_gps->item_str + 2);
-    esp_gps->parent.tim.second = convert_two_digit2number(esp_gps->item_str + 4);
-    if (esp_gps->item_str[6] == '.') {
-        uint16_t tmp = 0;
-        uint8_t i = 7;
-        while (esp_gps->item_str[i]) {
-            tmp = 10 * tmp + esp_gps->item_str[i] - '0';
-            i++;
-        }
-        esp_gps->parent.tim.thousand = tmp;
-    }
-}
-
-
-
-
-
-#if CONFIG_NMEA_STATEMENT_GGA
-/**
- * @brief Parse GGA statements
- *
- * @param esp_gps esp_gps_t type object
- */
-static void parse_gga(esp_gps_t *esp_gps)
-{
-    /* Process GGA statement */
-    switch (esp_gps->item_num) {
-    case 1: /* Process UTC time */
-        parse_utc_time(esp_gps);
-        break;
-    case 2: /* Latitude */
-        esp_gps->parent.latitude = parse_lat_long(esp_gps);
-        break;
-    case 3: /* Latitude north(1)/south(-1) information */
-        if (esp_gps->item_str[0] == 'S' || esp_gps->item_str[0] == 's') {
-            esp_gps->parent.latitude *= -1;
-        }
-        break;
-    case 4: /* Longitude */
-        esp_gps->parent.longitude = parse_lat_long(esp_gps);
-        break;
-    case 5: /* Longitude east(1)/west(-1) information */
-        if (esp_gps->item_str[0] == 'W' || esp_gps->item_str[0] == 'w') {
-            esp_gps->parent.longitude *= -1;
-        }
-        break;
-    case 6: /* Fix status */
-        esp_gps->parent.fix = (gps_fix_t)strtol(esp_gps->item_str, NULL, 10);
-        break;
-    case 7: /* Satellites in use */
-        esp_gps->parent.sats_in_use = (uint8_t)strtol(esp_gps->item_str, NULL, 10);
-        break;
-    case 8: /* HDOP */
-        esp_gps->parent.dop_h = strtof(esp_gps->item_str, NULL);
-        break;
-    case 9: /* Altitude */
-        esp_gps->parent.altitude = strtof(esp_gps->item_str, NULL);
-        break;
-    case 11: /* Altitude above ellipsoid */
-        esp_gps->parent.altitude += strtof(esp_gps->item_str, NULL);
-        break;
-    default:
-        break;
-    }
-}
-#endif
-
-#if CONFIG_NMEA_STATEMENT_GSA
-/**
- * @brief Parse GSA statements
- *
- * @param esp_gps esp_gps_t type object
- */
-static void parse_gsa(esp_gps_t *esp_gps)
-{
-    /* Process GSA statement */
-    switch (esp_gps->item_num) {
-    case 2: /* Process fix mode */
-        esp_gps->parent.fix_mode = (gps_fix_mode_t)strtol(esp_gps->item_str, NULL, 10);
-        break;
-    case 15: /* Process PDOP */
-        esp_gps->parent.dop_p = strtof(esp_gps->item_str, NULL);
-        break;
-    case 16: /* Process HDOP */
-        esp_gps->parent.dop_h = strtof(esp_gps->item_str, NULL);
-        break;
-    case 17: /* Process VDOP */
-        esp_gps->parent.dop_v = strtof(esp_gps->item_str, NULL);
-        break;
-    default:
-        /* Parse satellite IDs */
-        if (esp_gps->item_num >= 3 && esp_gps->item_num <= 14) {
-            esp_gps->parent.sats_id_in_use[esp_gps->item_num - 3] = (uint8_t)strtol(esp_gps->item_str, NULL, 10);
-        }
-        break;
-    }
-}
-#endif
-
-#if CONFIG_NMEA_STATEMENT_GSV
-/**
- * @brief Parse GSV statements
- *
- * @param esp_gps esp_gps_t type object
- */
-static void parse_gsv(esp_gps_t *esp_gps)
-{
-    /* Process GSV statement */
-    switch (esp_gps->item_num) {
-    case 1: /* total GSV numbers */
-        esp_gps->sat_count = (uint8_t)strtol(esp_gps->item_str, NULL, 10);
-        break;
-    case 2: /* Current GSV statement number */
-        esp_gps->sat_num = (uint8_t)strtol(esp_gps->item_str, NULL, 10);
-        break;
-    case 3: /* Process satellites in view */
-        esp_gps->parent.sats_in_view = (uint8_t)strtol(esp_gps->item_str, NULL, 10);
-        break;
-    default:
-        if (esp_gps->item_num >= 4 && esp_gps->item_num <= 19) {
-            uint8_t item_num = esp_gps->item_num - 4; /* Normalize item number from 4-19 to 0-15 */
-            uint8_t index;
-            uint32_t value;
-            index = 4 * (esp_gps->sat_num - 1) + item_num / 4; /* Get array index */
-            if (index < GPS_MAX_SATELLITES_IN_VIEW) {
-                value = strtol(esp_gps->item_str, NULL, 10);
-                switch (item_num % 4) {
-                case 0:
-                    esp_gps->parent.sats_desc_in_view[index].num = (uint8_t)value;
-                    break;
-                case 1:
-                    esp_gps->parent.sats_desc_in_view[index].elevation = (uint8_t)value;
-                    break;
-                case 2:
-                    esp_gps->parent.sats_desc_in_view[index].azimuth = (uint16_t)value;
-                    break;
-                case 3:
-                    esp_gps->parent.sats_desc_in_view[index].snr = (uint8_t)value;
-                    break;
-                default:
-                    break;
-                }
-            }
-        }
-        break;
-    }
-}
-#endif
-
-#if CONFIG_NMEA_STATEMENT_RMC
-/**
- * @brief Parse RMC statements
- *
- * @param esp_gps esp_gps_t type object
- */
-static void parse_rmc(esp_gps_t *esp_gps)
-{
-    /* Process GPRMC statement */
-    switch (esp_gps->item_num) {
-    case 1:/* Process UTC time */
-        parse_utc_time(esp_gps);
-        break;
-    case 2: /* Process valid status */
-        esp_gps->parent.valid = (esp_gps->item_str[0] == 'A');
-        break;
-    case 3:/* Latitude */
-        esp_gps->parent.latitude = parse_lat_long(esp_gps);
-        break;
-    case 4: /* Latitude north(1)/south(-1) information */
-        if (esp_gps->item_str[0] == 'S' || esp_gps->item_str[0] == 's') {
-            esp_gps->parent.latitude *= -1;
-        }
-        break;
-    case 5: /* Longitude */
-        esp_gps->parent.longitude = parse_lat_long(esp_gps);
-        break;
-    case 6: /* Longitude east(1)/west(-1) information */
-        if (esp_gps->item_str[0] == 'W' || esp_gps->item_str[0] == 'w') {
-            esp_gps->parent.longitude *= -1;
-        }
-        break;
-    case 7: /* Process ground speed in unit m/s */
-        esp_gps->parent.speed = strtof(esp_gps->item_str, NULL) * 1.852;
-        break;
-    case 8: /* Process true course over ground */
-        esp_gps->parent.cog = strtof(esp_gps->item_str, NULL);
-        break;
-    case 9: /* Process date */
-        esp_gps->parent.date.day = convert_two_digit2number(esp_gps->item_str + 0);
-        esp_gps->parent.date.month = convert_two_digit2number(esp_gps->item_str + 2);
-        esp_gps->parent.date.year = convert_two_digit2number(esp_gps->item_str + 4);
-        break;
-    case 10: /* Process magnetic variation */
-        esp_gps->parent.variation = strtof(esp_gps->item_str, NULL);
-        break;
-    default:
-        break;
-    }
-}
-#endif
-
-#if CONFIG_NMEA_STATEMENT_GLL
 /**
- * @brief Parse GLL statements
+ * @brief Called by the parser when all enabled statements were received
  *
- * @param esp_gps esp_gps_t type object
+ * @param gps parsed data
+ * @param ctx esp_gps_t type object
  */
-static void parse_gll(esp_gps_t *esp_gps)
+static void gps_update(const gps_t *parsed, void *ctx)
 {
-    /* Process GPGLL statement */
-    switch (esp_gps->item_num) {
-    case 1:/* Latitude */
-        esp_gps->parent.latitude = parse_lat_long(esp_gps);
-        break;
-    case 2: /* Latitude north(1)/south(-1) information */
-        if (esp_gps->item_str[0] == 'S' || esp_gps->item_str[0] == 's') {
-            esp_gps->parent.latitude *= -1;
-        }
-        break;
-    case 3: /* Longitude */
-        esp_gps->parent.longitude = parse_lat_long(esp_gps);
-        break;
-    case 4: /* Longitude east(1)/west(-1) information */
-        if (esp_gps->item_str[0] == 'W' || esp_gps->item_str[0] == 'w') {
-            esp_gps->parent.longitude *= -1;
-        }
-        break;
-    case 5:/* Process UTC time */
-        parse_utc_time(esp_gps);
-        break;
-    case 6: /* Process valid status */
-        esp_gps->parent.valid = (esp_gps->item_str[0] == 'A');
-        break;
-    default:
-        break;
-    }
-}
-#endif
+	gps_t msg = *parsed;
+	const gps_t *gps = &msg;
 
-#if CONFIG_NMEA_STATEMENT_VTG
-/**
- * @brief Parse VTG statements
- *
- * @param esp_gps esp_gps_t type object
- */
-static void parse_vtg(esp_gps_t *esp_gps)
-{
-    /* Process GPVGT statement */
-    switch (esp_gps->item_num) {
-    case 1: /* Process true course over ground */
-        esp_gps->parent.cog = strtof(esp_gps->item_str, NULL);
-        break;
-    case 3:/* Process magnetic variation */
-        esp_gps->parent.variation = strtof(esp_gps->item_str, NULL);
-        break;
-    case 5:/* Process ground speed in unit m/s */
-        esp_gps->parent.speed = strtof(esp_gps->item_str, NULL) * 1.852;//knots to m/s
-        break;
-    case 7:/* Process ground speed in unit m/s */
-        esp_gps->parent.speed = strtof(esp_gps->item_str, NULL) / 3.6;//km/h to m/s
-        break;
-    default:
-        break;
-    }
-}
-#endif
+	last_msg_timestamp = esp_timer_get_time();	//store current timestamp
+	msg.rx_time_us = last_msg_timestamp;
 
-/**
- * @brief Parse received item
- *
- * @param esp_gps esp_gps_t type object
- * @return esp_err_t ESP_OK on success, ESP_FAIL on error
- */
-static esp_err_t parse_item(esp_gps_t *esp_gps)
-{
-    esp_err_t err = ESP_OK;
-    /* start of a statement */
-    if (esp_gps->item_num == 0 && esp_gps->item_str[0] == '$') {
-        if (0) {
-        }
-#if CONFIG_NMEA_STATEMENT_GGA
-        else if (strstr(esp_gps->item_str, "GGA")) {
-            esp_gps->cur_statement = STATEMENT_GGA;
-        }
-#endif
-#if CONFIG_NMEA_STATEMENT_GSA
-        else if (strstr(esp_gps->item_str, "GSA")) {
-            esp_gps->cur_statement = STATEMENT_GSA;
-        }
-#endif
-#if CONFIG_NMEA_STATEMENT_RMC
-        else if (strstr(esp_gps->item_str, "RMC")) {
-            esp_gps->cur_statement = STATEMENT_RMC;
-        }
-#endif
-#if CONFIG_NMEA_STATEMENT_GSV
-        else if (strstr(esp_gps->item_str, "GSV")) {
-            esp_gps->cur_statement = STATEMENT_GSV;
-        }
-#endif
-#if CONFIG_NMEA_STATEMENT_GLL
-        else if (strstr(esp_gps->item_str, "GLL")) {
-            esp_gps->cur_statement = STATEMENT_GLL;
-        }
-#endif
-#if CONFIG_NMEA_STATEMENT_VTG
-        else if (strstr(esp_gps->item_str, "VTG")) {
-            esp_gps->cur_statement = STATEMENT_VTG;
-        }
-#endif
-        else {
-            esp_gps->cur_statement = STATEMENT_UNKNOWN;
-        	}
-        goto out;
-    }
-    /* Parse each item, depend on the type of the statement */
-    if (esp_gps->cur_statement == STATEMENT_UNKNOWN) {
-        goto out;
-    }
-#if CONFIG_NMEA_STATEMENT_GGA
-    else if (esp_gps->cur_statement == STATEMENT_GGA) {
-        parse_gga(esp_gps);
-    }
-#endif
-#if CONFIG_NMEA_STATEMENT_GSA
-    else if (esp_gps->cur_statement == STATEMENT_GSA) {
-        parse_gsa(esp_gps);
-    }
-#endif
-#if CONFIG_NMEA_STATEMENT_GSV
-    else if (esp_gps->cur_statement == STATEMENT_GSV) {
-        parse_gsv(esp_gps);
-    }
-#endif
-#if CONFIG_NMEA_STATEMENT_RMC
-    else if (esp_gps->cur_statement == STATEMENT_RMC) {
-        parse_rmc(esp_gps);
-    }
-#endif
-#if CONFIG_NMEA_STATEMENT_GLL
-    else if (esp_gps->cur_statement == STATEMENT_GLL) {
-        parse_gll(esp_gps);
-    }
-#endif
-#if CONFIG_NMEA_STATEMENT_VTG
-    else if (esp_gps->cur_statement == STATEMENT_VTG) {
-        parse_vtg(esp_gps);
-    }
-#endif
-    else {
-        err =  ESP_FAIL;
-    }
-out:
-    return err;
+	ESP_LOGV(TAG, "New data parsed! Add to queue");
+	if(xMessageBufferSpacesAvailable(xMessageBuffer_GNSS2Storage) < (4+sizeof(gps_t))){
+		ESP_LOGV(TAG, "Oldest packet removed");
+		gps_t tmp_gps;
+		xMessageBufferReceive( xMessageBuffer_GNSS2Storage, (void*) &tmp_gps, sizeof( gps_t ), 0);
+	}
+	xMessageBufferSend(xMessageBuffer_GNSS2Storage, (void *)gps, sizeof(gps_t), 0);
+	ESP_LOGV(TAG, "%"PRIi32", %"PRIi32", %i", gps->latitude, gps->longitude, gps->fix);
 }
 
 /**
- * @brief Parse NMEA statements from GPS receiver
+ * @brief Feed all bytes waiting in UART ring to the parser
  *
  * @param esp_gps esp_gps_t type object
- * @param len number of bytes to decode
- * @return esp_err_t ESP_OK on success, ESP_FAIL on error
  */
-static esp_err_t gps_decode(esp_gps_t *esp_gps, int len)
+static void esp_handle_uart_data(esp_gps_t *esp_gps)
 {
-	ESP_LOGV(TAG, "New frame");
-    const uint8_t *d = esp_gps->buffer;
-    while (*d) {
-        /* Start of a statement */
-        if (*d == '$') {
-            /* Reset runtime information */
-            esp_gps->asterisk = 0;
-            esp_gps->item_num = 0;
-            esp_gps->item_pos = 0;
-            esp_gps->cur_statement = 0;
-            esp_gps->crc = 0;
-            esp_gps->sat_count = 0;
-            esp_gps->sat_num = 0;
-            /* Add character to item */
-            esp_gps->item_str[esp_gps->item_pos++] = *d;
-            esp_gps->item_str[esp_gps->item_pos] = '\0';
-        }
-        /* Detect item separator character */
-        else if (*d == ',') {
-            /* Parse current item */
-            parse_item(esp_gps);
-            /* Add character to CRC computation */
-            esp_gps->crc ^= (uint8_t)(*d);
-            /* Start with next item */
-            esp_gps->item_pos = 0;
-            esp_gps->item_str[0] = '\0';
-            esp_gps->item_num++;
-        }
-        /* End of CRC computation */
-        else if (*d == '*') {
-            /* Parse current item */
-            parse_item(esp_gps);
-            /* Asterisk detected */
-            esp_gps->asterisk = 1;
-            /* Start with next item */
-            esp_gps->item_pos = 0;
-            esp_gps->item_str[0] = '\0';
-            esp_gps->item_num++;
-        }
-        /* End of statement */
-        else if (*d == '\r') {
-            /* Convert received CRC from string (hex) to number */
-            uint8_t crc = (uint8_t)strtol(esp_gps->item_str, NULL, 16);
-            /* CRC passed */
-            if (esp_gps->crc == crc) {
-            	ESP_LOGV(TAG, "Frame type %i", (int)(esp_gps->cur_statement));
-                switch (esp_gps->cur_statement) {
-#if CONFIG_NMEA_STATEMENT_GGA
-                case STATEMENT_GGA:
-                    esp_gps->parsed_statement |= 1 << STATEMENT_GGA;
-                    break;
-#endif
-#if CONFIG_NMEA_STATEMENT_GSA
-                case STATEMENT_GSA:
-                    esp_gps->parsed_statement |= 1 << STATEMENT_GSA;
-                    break;
-#endif
-#if CONFIG_NMEA_STATEMENT_RMC
-                case STATEMENT_RMC:
-                    esp_gps->parsed_statement |= 1 << STATEMENT_RMC;
-                    break;
-#endif
-#if CONFIG_NMEA_STATEMENT_GSV
-                case STATEMENT_GSV:
-                    if (esp_gps->sat_num == esp_gps->sat_count) {
-                        esp_gps->parsed_statement |= 1 << STATEMENT_GSV;
-                    }
-                    break;
-#endif
-#if CONFIG_NMEA_STATEMENT_GLL
-                case STATEMENT_GLL:
-                    esp_gps->parsed_statement |= 1 << STATEMENT_GLL;
-                    break;
-#endif
-#if CONFIG_NMEA_STATEMENT_VTG
-                case STATEMENT_VTG:
-                    esp_gps->parsed_statement |= 1 << STATEMENT_VTG;
-                    break;
-#endif
-                default:
-                    break;
-                }
-                /* Check if all statements have been parsed */
-                if (((esp_gps->parsed_statement) & esp_gps->all_statements) == esp_gps->all_statements) {
-					esp_gps->parsed_statement = 0;
-					/* Send signal to notify that GPS information has been updated */
-					/*esp_event_post_to(esp_gps->event_loop_hdl, ESP_NMEA_EVENT, GPS_UPDATE,
-									  &(esp_gps->parent), sizeof(gps_t), 100 / portTICK_PERIOD_MS);
-				   */
-					last_msg_timestamp = esp_timer_get_time();	//store current timestamp
-
-					ESP_LOGV(TAG, "New data parsed! Add to queue");
-					if(xMessageBufferSpacesAvailable(xMessageBuffer_GNSS2Storage) < (4+sizeof(gps_t))){
-						ESP_LOGV(TAG, "Oldest packet removed");
-						gps_t tmp_gps;
-						xMessageBufferReceive( xMessageBuffer_GNSS2Storage, (void*) &tmp_gps, sizeof( gps_t ), 0);
-					}
-					xMessageBufferSend(xMessageBuffer_GNSS2Storage, (void *)&(esp_gps->parent), sizeof(gps_t), 0);
-					ESP_LOGV(TAG, "%f, %f, %i", esp_gps->parent.latitude, esp_gps->parent.longitude, esp_gps->parent.fix);
-				}
-            } else {
-                ESP_LOGD(TAG, "CRC Error for statement:%s", esp_gps->buffer);
-            }
-            if (esp_gps->cur_statement == STATEMENT_UNKNOWN) {
-                /* Send signal to notify that one unknown statement has been met */
-            	/*
-                esp_event_post_to(esp_gps->event_loop_hdl, ESP_NMEA_EVENT, GPS_UNKNOWN,
-                                  esp_gps->buffer, len, 100 / portTICK_PERIOD_MS);
-                */
-            }
-        }
-        /* Other non-space character */
-        else {
-            if (!(esp_gps->asterisk)) {
-                /* Add to CRC */
-                esp_gps->crc ^= (uint8_t)(*d);
-            }
-            /* Add character to item */
-            esp_gps->item_str[esp_gps->item_pos++] = *d;
-            esp_gps->item_str[esp_gps->item_pos] = '\0';
-        }
-        /* Process next character */
-        d++;
-    }
-    return ESP_OK;
-}
+	size_t available = 0;
+	uart_get_buffered_data_len(esp_gps->uart_port, &available);
 
+	while(available > 0){
+		size_t chunk = MIN(available, NMEA_PARSER_RUNTIME_BUFFER_SIZE);
+		int read_len = uart_read_bytes(esp_gps->uart_port, esp_gps->buffer, chunk, 0);
+		if(read_len <= 0)
+			break;
 
-/**
- * @brief Handle when a pattern has been detected by uart
- *
- * @param esp_gps esp_gps_t type object
- */
-static void esp_handle_uart_pattern(esp_gps_t *esp_gps)
-{
-    int pos = uart_pattern_pop_pos(esp_gps->uart_port);
-    if (pos != -1) {
-        /* read one line(include '\n') */
-        int read_len = uart_read_bytes(esp_gps->uart_port, esp_gps->buffer, pos + 1, 100 / portTICK_PERIOD_MS);
-        /* make sure the line is a standard string */
-        esp_gps->buffer[read_len] = '\0';
-        //ESP_LOGE(TAG, "%s\n", esp_gps->buffer);
-        /* Send new line to handle */
-        if (gps_decode(esp_gps, read_len + 1) != ESP_OK) {
-        	ESP_LOGE(TAG, "GPS decode line failed");
-        }
-    } else {
-    	ESP_LOGI(TAG, "Pattern Queue Size too small");
-        uart_flush_input(esp_gps->uart_port);
-    }
+		nmea_parser_feed(&esp_gps->parser, esp_gps->buffer, read_len);
+		available -= read_len;
+	}
 }
 
 /**
@@ -642,6 +152,7 @@ static void nmea_parser_task_entry(void *arg)
         if (xQueueReceive(esp_gps->event_queue, &event, pdMS_TO_TICKS(200))) {
         	switch (event.type) {
             case UART_DATA:
+                esp_handle_uart_data(esp_gps);
                 break;
             case UART_FIFO_OVF:
             	ESP_LOGE(TAG, "HW FIFO Overflow");
@@ -662,10 +173,6 @@ static void nmea_parser_task_entry(void *arg)
             case UART_FRAME_ERR:
             	ESP_LOGV(TAG, "Frame Error");
                 break;
-            case UART_PATTERN_DET:
-            	ESP_LOGV(TAG, "New line!");
-                esp_handle_uart_pattern(esp_gps);
-                break;
             default:
                 printf( "unknown uart event type: %d", event.type);
                 break;
@@ -695,27 +202,28 @@ nmea_parser_handle_t nmea_parser_init(const nmea_parser_config_t *config)
     	ESP_LOGE(TAG, "calloc memory for runtime buffer failed");
         goto err_buffer;
     }
+    uint32_t statements = 0;
 #if CONFIG_NMEA_STATEMENT_GSA
-    esp_gps->all_statements |= (1 << STATEMENT_GSA);
+    statements |= (1 << STATEMENT_GSA);
 #endif
 #if CONFIG_NMEA_STATEMENT_GSV
-    esp_gps->all_statements |= (1 << STATEMENT_GSV);
+    statements |= (1 << STATEMENT_GSV);
 #endif
 #if CONFIG_NMEA_STATEMENT_GGA
-    esp_gps->all_statements |= (1 << STATEMENT_GGA);
+    statements |= (1 << STATEMENT_GGA);
 #endif
 #if CONFIG_NMEA_STATEMENT_RMC
-    esp_gps->all_statements |= (1 << STATEMENT_RMC);
+    statements |= (1 << STATEMENT_RMC);
 #endif
 #if CONFIG_NMEA_STATEMENT_GLL
-    esp_gps->all_statements |= (1 << STATEMENT_GLL);
+    statements |= (1 << STATEMENT_GLL);
 #endif
 #if CONFIG_NMEA_STATEMENT_VTG
-    esp_gps->all_statements |= (1 << STATEMENT_VTG);
+    statements |= (1 << STATEMENT_VTG);
 #endif
+    nmea_parser_reset(&esp_gps->parser, statements, gps_update, esp_gps);
     /* Set attributes */
     esp_gps->uart_port = config->uart.uart_port;
-    esp_gps->all_statements &= 0xFE;
     /* Install UART friver */
     uart_config_t uart_config = {
         .baud_rate = config->uart.baud_rate,
@@ -739,10 +247,7 @@ nmea_parser_handle_t nmea_parser_init(const nmea_parser_config_t *config)
     	ESP_LOGE(TAG, "config uart gpio failed");
         goto err_uart_config;
     }
-    /* Set pattern interrupt, used to detect the end of a line */
-    uart_enable_pattern_det_baud_intr(esp_gps->uart_port, '\n', 1, 9, 0, 0);
-    /* Set pattern queue size */
-    uart_pattern_queue_reset(esp_gps->uart_port, config->uart.event_queue_size);
+    /* No pattern detection - parser works on raw stream, sentences may be split between reads */
     uart_flush(esp_gps->uart_port);
     /* Create Event loop */
     esp_event_loop_args_t loop_args = {
@@ -6,11 +6,9 @@
 #include "driver/uart.h"
 #include "freertos/message_buffer.h"
 #include "BOARD.h"
+#include "nmea_parser.h"
 
 
-#define GPS_MAX_SATELLITES_IN_USE (12)
-#define GPS_MAX_SATELLITES_IN_VIEW (16)
-#define NMEA_MAX_STATEMENT_ITEM_LENGTH 16
 #define NMEA_EVENT_LOOP_QUEUE_SIZE 16
 #define TIME_ZONE (+1)   //Warsaw Time
 #define YEAR_BASE (2000) //date in GPS starts from 2000
@@ -33,116 +31,6 @@ typedef enum {
  */
 ESP_EVENT_DECLARE_BASE(ESP_NMEA_EVENT);
 
-/**
- * @brief GPS fix type
- *
- */
-typedef enum {
-    GPS_FIX_INVALID, /*!< Not fixed */
-    GPS_FIX_GPS,     /*!< GPS */
-    GPS_FIX_DGPS,    /*!< Differential GPS */
-} gps_fix_t;
-
-/**
- * @brief GPS fix mode
- *
- */
-typedef enum {
-    GPS_MODE_INVALID = 1, /*!< Not fixed */
-    GPS_MODE_2D,          /*!< 2D GPS */
-    GPS_MODE_3D           /*!< 3D GPS */
-} gps_fix_mode_t;
-
-/**
- * @brief GPS satellite information
- *
- */
-typedef struct {
-    uint8_t num;       /*!< Satellite number */
-    uint8_t elevation; /*!< Satellite elevation */
-    uint16_t azimuth;  /*!< Satellite azimuth */
-    uint8_t snr;       /*!< Satellite signal noise ratio */
-} gps_satellite_t;
-
-/**
- * @brief GPS time
- *
- */
-typedef struct {
-    uint8_t hour;      /*!< Hour */
-    uint8_t minute;    /*!< Minute */
-    uint8_t second;    /*!< Second */
-    uint16_t thousand; /*!< Thousand */
-} gps_time_t;
-
-/**
- * @brief GPS date
- *
- */
-typedef struct {
-    uint8_t day;   /*!< Day (start from 1) */
-    uint8_t month; /*!< Month (start from 1) */
-    uint16_t year; /*!< Year (start from 2000) */
-} gps_date_t;
-
-/**
- * @brief NMEA Statement
- *
- */
-typedef enum {
-    STATEMENT_UNKNOWN = 0, /*!< Unknown statement */
-    STATEMENT_GGA,         /*!< GGA */
-    STATEMENT_GSA,         /*!< GSA */
-    STATEMENT_RMC,         /*!< RMC */
-    STATEMENT_GSV,         /*!< GSV */
-    STATEMENT_GLL,         /*!< GLL */
-    STATEMENT_VTG          /*!< VTG */
-} nmea_statement_t;
-
-/**
- * @brief GPS object
- *
- */
-typedef struct {
-#if (CONFIG_NMEA_STATEMENT_GGA || CONFIG_NMEA_STATEMENT_GLL)
-	float latitude;                                                /*!< Latitude (degrees) */
-    float longitude;                                               /*!< Longitude (degrees) */
-    gps_time_t tim;                                               /*!< time in UTC */
-#endif
-
-#if (CONFIG_NMEA_STATEMENT_GGA)
-    float altitude;                                                /*!< Altitude (meters) */
-    gps_fix_t fix;                                                 /*!< Fix status */
-    uint8_t sats_in_use;                                           /*!< Number of satellites in use */
-#endif
-
-#if (CONFIG_NMEA_STATEMENT_GGA || CONFIG_NMEA_STATEMENT_GSA)
-    float dop_h;                                                   /*!< Horizontal dilution of precision */
-#endif
-
-#if (CONFIG_NMEA_STATEMENT_GSA)
-    gps_fix_mode_t fix_mode;                                       /*!< Fix mode */
-    uint8_t sats_id_in_use[GPS_MAX_SATELLITES_IN_USE];             /*!< ID list of satellite in use */
-    float dop_p;                                                   /*!< Position dilution of precision  */
-    float dop_v;                                                   /*!< Vertical dilution of precision  */
-#endif
-
-#if (CONFIG_NMEA_STATEMENT_GSV)
-    uint8_t sats_in_view;                                          /*!< Number of satellites in view */
-    gps_satellite_t sats_desc_in_view[GPS_MAX_SATELLITES_IN_VIEW]; /*!< Information of satellites in view */
-#endif
-
-#if (CONFIG_NMEA_STATEMENT_RMC)
-    gps_date_t date;                                               /*!< Fix date */
-    bool valid;                                                    /*!< GPS validity */
-    float speed;                                                   /*!< Ground speed, unit: m/s */
-#endif
-#if (CONFIG_NMEA_STATEMENT_RMC || CONFIG_NMEA_STATEMENT_VTG)
-    float cog;                                                     /*!< Course over ground */
-    float variation;                                               /*!< Magnetic variation */
-#endif
-} gps_t;
-
 /**
  * @brief Configuration of NMEA Parser
  *
@@ -166,19 +54,9 @@ typedef struct {
 typedef void *nmea_parser_handle_t;
 
 typedef struct {
-    uint8_t item_pos;                              /*!< Current position in item */
-    uint8_t item_num;                              /*!< Current item number */
-    uint8_t asterisk;                              /*!< Asterisk detected flag */
-    uint8_t crc;                                   /*!< Calculated CRC value */
-    uint8_t parsed_statement;                      /*!< OR'd of statements that have been parsed */
-    uint8_t sat_num;                               /*!< Satellite number */
-    uint8_t sat_count;                             /*!< Satellite count */
-    uint8_t cur_statement;                         /*!< Current statement ID */
-    uint32_t all_statements;                       /*!< All statements mask */
-    char item_str[NMEA_MAX_STATEMENT_ITEM_LENGTH]; /*!< Current item */
-    gps_t parent;                                  /*!< Parent class */
+    nmea_parser_t parser;                          /*!< NMEA parser state */
     uart_port_t uart_port;                         /*!< Uart port number */
-    uint8_t *buffer;                               /*!< Runtime buffer */
+    uint8_t *buffer;                               /*!< Runtime buffer - chunk read from UART ring */
     esp_event_loop_handle_t event_loop_hdl;        /*!< Event loop handle */
     TaskHandle_t tsk_hdl;                          /*!< NMEA Parser task handle */
     QueueHandle_t event_queue;                     /*!< UART event queue handle */
@@ -0,0 +1,189 @@
+#pragma once
+
+/*
+ * Single-pass NMEA 0183 parser.
+ *
+ * Bytes are fed straight from the UART ring, every field is accumulated as a fixed-point number
+ * while it is received (no per-field string copy, no strtol/strtof) and dispatched through a
+ * per-statement field table. Coordinates are kept as int32 in 1e-7 degrees.
+ *
+ * This file and nmea_parser.c do not depend on ESP-IDF, so the parser can be built and fuzzed on host.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define GPS_MAX_SATELLITES_IN_USE (12)
+#define GPS_MAX_SATELLITES_IN_VIEW (16)
+#define NMEA_MAX_FIELDS (20)				/*!< Fields above this number are ignored */
+#define NMEA_COORD_SCALE (10000000L)		/*!< Coordinates unit: 1e-7 degree */
+
+/**
+ * @brief GPS fix type
+ *
+ */
+typedef enum {
+    GPS_FIX_INVALID, /*!< Not fixed */
+    GPS_FIX_GPS,     /*!< GPS */
+    GPS_FIX_DGPS,    /*!< Differential GPS */
+} gps_fix_t;
+
+/**
+ * @brief GPS fix mode
+ *
+ */
+typedef enum {
+    GPS_MODE_INVALID = 1, /*!< Not fixed */
+    GPS_MODE_2D,          /*!< 2D GPS */
+    GPS_MODE_3D           /*!< 3D GPS */
+} gps_fix_mode_t;
+
+/**
+ * @brief GPS satellite information
+ *
+ */
+typedef struct {
+    uint8_t num;       /*!< Satellite number */
+    uint8_t elevation; /*!< Satellite elevation */
+    uint16_t azimuth;  /*!< Satellite azimuth */
+    uint8_t snr;       /*!< Satellite signal noise ratio */
+} gps_satellite_t;
+
+/**
+ * @brief GPS time
+ *
+ */
+typedef struct {
+    uint8_t hour;      /*!< Hour */
+    uint8_t minute;    /*!< Minute */
+    uint8_t second;    /*!< Second */
+    uint16_t thousand; /*!< Thousand */
+} gps_time_t;
+
+/**
+ * @brief GPS date
+ *
+ */
+typedef struct {
+    uint8_t day;   /*!< Day (start from 1) */
+    uint8_t month; /*!< Month (start from 1) */
+    uint16_t year; /*!< Year (start from 2000) */
+} gps_date_t;
+
+/**
+ * @brief NMEA Statement
+ *
+ */
+typedef enum {
+    STATEMENT_UNKNOWN = 0, /*!< Unknown statement */
+    STATEMENT_GGA,         /*!< GGA */
+    STATEMENT_GSA,         /*!< GSA */
+    STATEMENT_RMC,         /*!< RMC */
+    STATEMENT_GSV,         /*!< GSV */
+    STATEMENT_GLL,         /*!< GLL */
+    STATEMENT_VTG,         /*!< VTG */
+    STATEMENT_NUM
+} nmea_statement_t;
+
+/**
+ * @brief GPS object. Fields of statements which are not enabled stay 0.
+ *
+ */
+typedef struct {
+    int32_t latitude;                                              /*!< Latitude (1e-7 degrees) */
+    int32_t longitude;                                             /*!< Longitude (1e-7 degrees) */
+    gps_time_t tim;                                                /*!< time in UTC */
+
+    float altitude;                                                /*!< Altitude above ellipsoid (meters) */
+    gps_fix_t fix;                                                 /*!< Fix status */
+    uint8_t sats_in_use;                                           /*!< Number of satellites in use */
+    float dop_h;                                                   /*!< Horizontal dilution of precision */
+
+    gps_fix_mode_t fix_mode;                                       /*!< Fix mode */
+    uint8_t sats_id_in_use[GPS_MAX_SATELLITES_IN_USE];             /*!< ID list of satellite in use */
+    float dop_p;                                                   /*!< Position dilution of precision  */
+    float dop_v;                                                   /*!< Vertical dilution of precision  */
+
+    uint8_t sats_in_view;                                          /*!< Number of satellites in view */
+    gps_satellite_t sats_desc_in_view[GPS_MAX_SATELLITES_IN_VIEW]; /*!< Information of satellites in view */
+
+    gps_date_t date;                                               /*!< Fix date */
+    bool valid;                                                    /*!< GPS validity */
+    float speed;                                                   /*!< Ground speed, unit: m/s */
+    float cog;                                                     /*!< Course over ground */
+    float variation;                                               /*!< Magnetic variation */
+    int64_t rx_time_us;                                            /*!< Receive timestamp, set by the driver (parser leaves 0) */
+} gps_t;
+
+/**
+ * @brief Called every time all enabled statements have been received with correct checksum.
+ */
+typedef void (*nmea_update_cb_t)(const gps_t *gps, void *ctx);
+
+/**
+ * @brief Parser state. All members are private, use nmea_parser_* functions.
+ */
+typedef struct {
+    uint8_t state;                 /*!< Sentence state (idle, body, checksum) */
+    uint8_t statement;             /*!< Current statement ID */
+    uint8_t item_num;              /*!< Current field number */
+    uint8_t crc;                   /*!< Calculated checksum */
+    uint8_t crc_rx;                /*!< Received checksum */
+    uint8_t crc_digits;            /*!< Received checksum digits */
+    uint8_t sat_num;               /*!< GSV sentence number */
+    uint8_t sat_count;             /*!< GSV sentences in group */
+    uint8_t length;                /*!< Current sentence length */
+
+    /* Field accumulator */
+    uint32_t acc_int;              /*!< Digits before decimal point */
+    uint32_t acc_frac;             /*!< Digits after decimal point */
+    uint8_t acc_frac_digits;       /*!< Number of digits in acc_frac */
+    uint8_t acc_int_digits;        /*!< Number of digits in acc_int */
+    uint8_t acc_flags;             /*!< Dot / minus / empty flags */
+    char acc_char;                 /*!< First character of the field */
+    uint32_t acc_tag;              /*!< Last 3 characters of the address field */
+
+    uint32_t parsed_statements;    /*!< OR'd statements received since last update */
+    uint32_t all_statements;       /*!< Statements required for update */
+
+    gps_t work;                    /*!< Sentence being parsed, committed after checksum check */
+    gps_t parent;                  /*!< Last valid data */
+
+    nmea_update_cb_t update_cb;    /*!< Update callback */
+    void *update_ctx;              /*!< Update callback context */
+
+    uint32_t updates;              /*!< Statistics - callback calls */
+    uint32_t sentences_ok;         /*!< Statistics - sentences with valid checksum */
+    uint32_t sentences_crc_err;    /*!< Statistics - checksum errors */
+    uint32_t sentences_unknown;    /*!< Statistics - unknown/disabled statements */
+    uint32_t sentences_overflow;   /*!< Statistics - sentences too long or broken */
+} nmea_parser_t;
+
+/**
+ * @brief Reset parser state and statistics.
+ *
+ * @param parser parser object
+ * @param statements mask of statements to parse ((1 << STATEMENT_GGA) | ...), all of them are required for update
+ * @param cb callback called on update, may be NULL
+ * @param ctx callback context
+ */
+void nmea_parser_reset(nmea_parser_t *parser, uint32_t statements, nmea_update_cb_t cb, void *ctx);
+
+/**
+ * @brief Feed received bytes. Sentences may be split between calls at any position.
+ *
+ * @param parser parser object
+ * @param data received bytes
+ * @param len number of bytes
+ * @return uint32_t number of updates (callback calls) triggered by this chunk
+ */
+uint32_t nmea_parser_feed(nmea_parser_t *parser, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get last valid data.
+ *
+ * @param parser parser object
+ * @return const gps_t* pointer to data inside parser
+ */
+const gps_t *nmea_parser_get(const nmea_parser_t *parser);
@@ -0,0 +1,382 @@
+#include <string.h>
+#include "nmea_parser.h"
+
+#define NMEA_MAX_SENTENCE_LEN	120		// Standard says 82, leave margin for proprietary receivers
+
+// Parser states
+#define NMEA_ST_IDLE	0
+#define NMEA_ST_BODY	1
+#define NMEA_ST_CRC		2
+
+// Accumulator flags
+#define NMEA_ACC_DOT		(1 << 0)
+#define NMEA_ACC_NEG		(1 << 1)
+#define NMEA_ACC_NOT_EMPTY	(1 << 2)
+#define NMEA_ACC_OVERFLOW	(1 << 3)
+
+#define NMEA_TAG(a, b, c)	(((uint32_t)(a) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(c))
+
+/**
+ * @brief Field actions, selected by nmea_field_map[statement][field number]
+ */
+typedef enum {
+	ACT_NONE = 0,
+	ACT_TIME,
+	ACT_LAT,
+	ACT_NS,
+	ACT_LON,
+	ACT_EW,
+	ACT_FIX,
+	ACT_SATS_IN_USE,
+	ACT_DOP_H,
+	ACT_ALT,
+	ACT_ALT_GEOID,
+	ACT_FIX_MODE,
+	ACT_SAT_ID,
+	ACT_DOP_P,
+	ACT_DOP_V,
+	ACT_GSV_COUNT,
+	ACT_GSV_NUM,
+	ACT_SATS_IN_VIEW,
+	ACT_GSV_SAT,
+	ACT_VALID,
+	ACT_SPEED_KN,
+	ACT_SPEED_KMH,
+	ACT_COG,
+	ACT_DATE,
+	ACT_VARIATION,
+} nmea_action_t;
+
+static const uint8_t nmea_field_map[STATEMENT_NUM][NMEA_MAX_FIELDS] = {
+	[STATEMENT_GGA] = {
+		[1] = ACT_TIME, [2] = ACT_LAT, [3] = ACT_NS, [4] = ACT_LON, [5] = ACT_EW, [6] = ACT_FIX,
+		[7] = ACT_SATS_IN_USE, [8] = ACT_DOP_H, [9] = ACT_ALT, [11] = ACT_ALT_GEOID,
+	},
+	[STATEMENT_GSA] = {
+		[2] = ACT_FIX_MODE,
+		[3] = ACT_SAT_ID, [4] = ACT_SAT_ID, [5] = ACT_SAT_ID, [6] = ACT_SAT_ID, [7] = ACT_SAT_ID, [8] = ACT_SAT_ID,
+		[9] = ACT_SAT_ID, [10] = ACT_SAT_ID, [11] = ACT_SAT_ID, [12] = ACT_SAT_ID, [13] = ACT_SAT_ID, [14] = ACT_SAT_ID,
+		[15] = ACT_DOP_P, [16] = ACT_DOP_H, [17] = ACT_DOP_V,
+	},
+	[STATEMENT_RMC] = {
+		[1] = ACT_TIME, [2] = ACT_VALID, [3] = ACT_LAT, [4] = ACT_NS, [5] = ACT_LON, [6] = ACT_EW,
+		[7] = ACT_SPEED_KN, [8] = ACT_COG, [9] = ACT_DATE, [10] = ACT_VARIATION,
+	},
+	[STATEMENT_GSV] = {
+		[1] = ACT_GSV_COUNT, [2] = ACT_GSV_NUM, [3] = ACT_SATS_IN_VIEW,
+		[4]  = ACT_GSV_SAT, [5]  = ACT_GSV_SAT, [6]  = ACT_GSV_SAT, [7]  = ACT_GSV_SAT,
+		[8]  = ACT_GSV_SAT, [9]  = ACT_GSV_SAT, [10] = ACT_GSV_SAT, [11] = ACT_GSV_SAT,
+		[12] = ACT_GSV_SAT, [13] = ACT_GSV_SAT, [14] = ACT_GSV_SAT, [15] = ACT_GSV_SAT,
+		[16] = ACT_GSV_SAT, [17] = ACT_GSV_SAT, [18] = ACT_GSV_SAT, [19] = ACT_GSV_SAT,
+	},
+	[STATEMENT_GLL] = {
+		[1] = ACT_LAT, [2] = ACT_NS, [3] = ACT_LON, [4] = ACT_EW, [5] = ACT_TIME, [6] = ACT_VALID,
+	},
+	[STATEMENT_VTG] = {
+		[1] = ACT_COG, [5] = ACT_SPEED_KN, [7] = ACT_SPEED_KMH,	// [3] magnetic course - not used
+	},
+};
+
+static const uint32_t pow10_tab[10] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+static uint8_t nmea_statement_from_tag(uint32_t tag);
+static void nmea_field_end(nmea_parser_t *p);
+static void nmea_sentence_end(nmea_parser_t *p);
+
+void nmea_parser_reset(nmea_parser_t *parser, uint32_t statements, nmea_update_cb_t cb, void *ctx){
+	memset(parser, 0, sizeof(nmea_parser_t));
+	parser->all_statements = statements & ~(1UL << STATEMENT_UNKNOWN);
+	parser->update_cb = cb;
+	parser->update_ctx = ctx;
+}
+
+const gps_t *nmea_parser_get(const nmea_parser_t *parser){
+	return &parser->parent;
+}
+
+//---------------------------------- Accumulator ---------------------------------
+static inline void acc_reset(nmea_parser_t *p){
+	p->acc_int = 0;
+	p->acc_frac = 0;
+	p->acc_frac_digits = 0;
+	p->acc_int_digits = 0;
+	p->acc_flags = 0;
+	p->acc_char = 0;
+}
+
+/**
+ * @brief Field value as fixed point with given number of decimal digits (frac is truncated or padded)
+ */
+static int32_t acc_fixed(const nmea_parser_t *p, uint8_t digits){
+	uint32_t frac = p->acc_frac;
+	if(p->acc_frac_digits > digits){
+		frac /= pow10_tab[p->acc_frac_digits - digits];
+	} else {
+		frac *= pow10_tab[digits - p->acc_frac_digits];
+	}
+
+	int64_t val = (int64_t)p->acc_int * pow10_tab[digits] + frac;
+	if(val > INT32_MAX)
+		val = INT32_MAX;
+
+	return (p->acc_flags & NMEA_ACC_NEG) ? -(int32_t)val : (int32_t)val;
+}
+
+static float acc_float(const nmea_parser_t *p){
+	float val = (float)p->acc_int + (float)p->acc_frac / (float)pow10_tab[p->acc_frac_digits];
+	return (p->acc_flags & NMEA_ACC_NEG) ? -val : val;
+}
+
+/**
+ * @brief (d)ddmm.mmmmmm -> 1e-7 degree. Minutes are kept with 6 decimal digits (~2mm).
+ */
+static int32_t acc_coord(const nmea_parser_t *p){
+	if(!(p->acc_flags & NMEA_ACC_NOT_EMPTY) || (p->acc_int_digits > 5))
+		return 0;
+
+	uint32_t deg = p->acc_int / 100;
+	if(deg > 180)
+		return 0;
+
+	uint32_t frac = p->acc_frac;
+	if(p->acc_frac_digits > 6){
+		frac /= pow10_tab[p->acc_frac_digits - 6];
+	} else {
+		frac *= pow10_tab[6 - p->acc_frac_digits];
+	}
+
+	uint32_t min_e6 = (p->acc_int % 100) * 1000000UL + frac;
+	// 1e7 / 60 / 1e6 = 1/6, rounded
+	return (int32_t)(deg * NMEA_COORD_SCALE + (min_e6 + 3) / 6);
+}
+
+//---------------------------------- Parser ---------------------------------
+uint32_t nmea_parser_feed(nmea_parser_t *p, const uint8_t *data, size_t len){
+	uint32_t updates_before = p->updates;
+
+	for(size_t i=0; i<len; i++){
+		const uint8_t c = data[i];
+
+		// Start of sentence always restarts the machine
+		if(c == '$'){
+			if(p->state != NMEA_ST_IDLE)
+				p->sentences_overflow++;
+
+			p->state = NMEA_ST_BODY;
+			p->statement = STATEMENT_UNKNOWN;
+			p->item_num = 0;
+			p->crc = 0;
+			p->crc_rx = 0;
+			p->crc_digits = 0;
+			p->acc_tag = 0;
+			p->length = 0;
+			acc_reset(p);
+			continue;
+		}
+
+		if(p->state == NMEA_ST_IDLE)
+			continue;
+
+		if(++p->length > NMEA_MAX_SENTENCE_LEN){
+			p->sentences_overflow++;
+			p->state = NMEA_ST_IDLE;
+			continue;
+		}
+
+		switch(p->state){
+		case NMEA_ST_BODY:
+			if(c == ','){
+				p->crc ^= c;
+				nmea_field_end(p);
+			} else if(c == '*'){
+				nmea_field_end(p);
+				if(p->state == NMEA_ST_BODY)
+					p->state = NMEA_ST_CRC;
+			} else if((c == '\r') || (c == '\n') || (c < 0x20) || (c > 0x7E)){
+				// Sentence without checksum or binary garbage
+				p->sentences_overflow++;
+				p->state = NMEA_ST_IDLE;
+			} else {
+				p->crc ^= c;
+				if(p->item_num == 0){
+					p->acc_tag = ((p->acc_tag << 8) | c) & 0x00FFFFFF;
+				} else if((c >= '0') && (c <= '9')){
+					if(!(p->acc_flags & NMEA_ACC_DOT)){
+						if(p->acc_int_digits < 9){
+							p->acc_int = p->acc_int * 10 + (c - '0');
+							p->acc_int_digits++;
+						} else {
+							p->acc_flags |= NMEA_ACC_OVERFLOW;
+						}
+					} else if(p->acc_frac_digits < 7){
+						p->acc_frac = p->acc_frac * 10 + (c - '0');
+						p->acc_frac_digits++;
+					}
+					p->acc_flags |= NMEA_ACC_NOT_EMPTY;
+				} else if(c == '.'){
+					p->acc_flags |= NMEA_ACC_DOT;
+				} else if(c == '-'){
+					p->acc_flags |= NMEA_ACC_NEG;
+				} else {
+					if(p->acc_char == 0)
+						p->acc_char = c;
+					p->acc_flags |= NMEA_ACC_NOT_EMPTY;
+				}
+			}
+			break;
+
+		case NMEA_ST_CRC:
+			if(p->crc_digits < 2){
+				uint8_t nibble;
+				if((c >= '0') && (c <= '9'))		nibble = c - '0';
+				else if((c >= 'A') && (c <= 'F'))	nibble = c - 'A' + 10;
+				else if((c >= 'a') && (c <= 'f'))	nibble = c - 'a' + 10;
+				else {
+					p->sentences_overflow++;
+					p->state = NMEA_ST_IDLE;
+					break;
+				}
+				p->crc_rx = (p->crc_rx << 4) | nibble;
+				p->crc_digits++;
+			} else if((c == '\r') || (c == '\n')){
+				nmea_sentence_end(p);
+				p->state = NMEA_ST_IDLE;
+			} else {
+				p->sentences_overflow++;
+				p->state = NMEA_ST_IDLE;
+			}
+			break;
+
+		default:
+			p->state = NMEA_ST_IDLE;
+			break;
+		}
+	}
+
+	return p->updates - updates_before;
+}
+
+static uint8_t nmea_statement_from_tag(uint32_t tag){
+	switch(tag){
+	case NMEA_TAG('G','G','A'): return STATEMENT_GGA;
+	case NMEA_TAG('G','S','A'): return STATEMENT_GSA;
+	case NMEA_TAG('R','M','C'): return STATEMENT_RMC;
+	case NMEA_TAG('G','S','V'): return STATEMENT_GSV;
+	case NMEA_TAG('G','L','L'): return STATEMENT_GLL;
+	case NMEA_TAG('V','T','G'): return STATEMENT_VTG;
+	default: return STATEMENT_UNKNOWN;
+	}
+}
+
+static void nmea_field_end(nmea_parser_t *p){
+	gps_t *w = &p->work;
+
+	if(p->item_num == 0){
+		p->statement = nmea_statement_from_tag(p->acc_tag);
+		if((p->statement == STATEMENT_UNKNOWN) || !(p->all_statements & (1UL << p->statement))){
+			// Not interesting - skip rest of the sentence
+			p->sentences_unknown++;
+			p->state = NMEA_ST_IDLE;
+			return;
+		}
+		// Work on a copy, committed only if checksum is correct
+		p->work = p->parent;
+		if(p->statement == STATEMENT_GSV){
+			p->sat_count = 0;
+			p->sat_num = 0;
+		}
+	} else if(p->acc_flags & NMEA_ACC_OVERFLOW){
+		// More integer digits than any NMEA field has - corrupted, drop the sentence instead of a clipped value
+		p->sentences_overflow++;
+		p->state = NMEA_ST_IDLE;
+		return;
+	} else if(p->item_num < NMEA_MAX_FIELDS){
+		switch((nmea_action_t)nmea_field_map[p->statement][p->item_num]){
+		case ACT_TIME: {
+			uint32_t t = p->acc_int;
+			w->tim.hour   = t / 10000;
+			w->tim.minute = (t / 100) % 100;
+			w->tim.second = t % 100;
+			w->tim.thousand = (uint16_t)(acc_fixed(p, 3) % 1000);
+			break;
+		}
+		case ACT_LAT:			w->latitude  = acc_coord(p);	break;
+		case ACT_LON:			w->longitude = acc_coord(p);	break;
+		case ACT_NS:
+			if((p->acc_char == 'S') || (p->acc_char == 's'))
+				w->latitude = -w->latitude;
+			break;
+		case ACT_EW:
+			if((p->acc_char == 'W') || (p->acc_char == 'w'))
+				w->longitude = -w->longitude;
+			break;
+		case ACT_FIX:			w->fix = (gps_fix_t)p->acc_int;					break;
+		case ACT_SATS_IN_USE:	w->sats_in_use = (uint8_t)p->acc_int;			break;
+		case ACT_DOP_H:			w->dop_h = acc_float(p);						break;
+		case ACT_ALT:			w->altitude = acc_fixed(p, 3) / 1000.0f;		break;
+		case ACT_ALT_GEOID:		w->altitude += acc_fixed(p, 3) / 1000.0f;		break;
+		case ACT_FIX_MODE:		w->fix_mode = (gps_fix_mode_t)p->acc_int;		break;
+		case ACT_SAT_ID:		w->sats_id_in_use[p->item_num - 3] = (uint8_t)p->acc_int;	break;
+		case ACT_DOP_P:			w->dop_p = acc_float(p);						break;
+		case ACT_DOP_V:			w->dop_v = acc_float(p);						break;
+		case ACT_GSV_COUNT:		p->sat_count = (uint8_t)p->acc_int;				break;
+		case ACT_GSV_NUM:		p->sat_num = (uint8_t)p->acc_int;				break;
+		case ACT_SATS_IN_VIEW:	w->sats_in_view = (uint8_t)p->acc_int;			break;
+		case ACT_GSV_SAT: {
+			uint8_t item = p->item_num - 4;		// Normalize item number from 4-19 to 0-15
+			if(p->sat_num == 0)
+				break;
+			uint32_t index = 4 * (p->sat_num - 1) + item / 4;
+			if(index >= GPS_MAX_SATELLITES_IN_VIEW)
+				break;
+			switch(item % 4){
+			case 0: w->sats_desc_in_view[index].num       = (uint8_t)p->acc_int;	break;
+			case 1: w->sats_desc_in_view[index].elevation = (uint8_t)p->acc_int;	break;
+			case 2: w->sats_desc_in_view[index].azimuth   = (uint16_t)p->acc_int;	break;
+			case 3: w->sats_desc_in_view[index].snr       = (uint8_t)p->acc_int;	break;
+			}
+			break;
+		}
+		case ACT_VALID:			w->valid = (p->acc_char == 'A');				break;
+		case ACT_SPEED_KN:		w->speed = acc_float(p) * 0.514444f;			break;	// knots to m/s
+		case ACT_SPEED_KMH:		w->speed = acc_float(p) / 3.6f;					break;	// km/h to m/s
+		case ACT_COG:			w->cog = acc_float(p);							break;
+		case ACT_DATE: {
+			uint32_t d = p->acc_int;
+			w->date.day   = d / 10000;
+			w->date.month = (d / 100) % 100;
+			w->date.year  = d % 100;
+			break;
+		}
+		case ACT_VARIATION:		w->variation = acc_float(p);					break;
+		case ACT_NONE:
+		default:
+			break;
+		}
+	}
+
+	acc_reset(p);
+	p->item_num++;
+}
+
+static void nmea_sentence_end(nmea_parser_t *p){
+	if((p->crc_digits != 2) || (p->crc != p->crc_rx)){
+		p->sentences_crc_err++;
+		return;
+	}
+
+	p->sentences_ok++;
+	p->parent = p->work;
+
+	if((p->statement != STATEMENT_GSV) || (p->sat_num == p->sat_count)){
+		p->parsed_statements |= 1UL << p->statement;
+	}
+
+	// Check if all statements have been parsed
+	if((p->parsed_statements & p->all_statements) == p->all_statements){
+		p->parsed_statements = 0;
+		p->updates++;
+		if(p->update_cb != NULL)
+			p->update_cb(&p->parent, p->update_ctx);
+	}
+}
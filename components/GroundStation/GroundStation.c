@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "cJSON.h"
+#include "BOARD.h"
+#include "GroundStation.h"
+
+#define GS_UART_PORT		UART_NUM_1
+#define GS_UART_TX_BUF		(sizeof(GS_uartFrame_t) * GS_RX_QUEUE_SIZE)
+#define GS_RSSI_FILTER		0.2f
+#define GS_RESTART_GAP		64			// packet_no jump back treated as a vehicle restart, not a late frame
+#define GS_RESTART_MS		2000		// Vehicle timestamp regression treated as a restart
+
+static const char *TAG = "Ground st.";
+
+//--------------- RX queue (radio -> fan-out) ----------------
+static QueueHandle_t queue_RadioToGS;
+static StaticQueue_t queue_RadioToGS_struct;
+static uint8_t queue_RadioToGS_buf[ GS_RX_QUEUE_SIZE * sizeof(GS_rxFrame_t) ];
+
+//--------------- Per-vehicle statistics ---------------------
+static GS_vehicle_t vehicles[GS_MAX_VEHICLES];
+static uint8_t vehicles_num = 0;
+static uint32_t frames_dropped = 0;		// fan-out queue full
+static uint32_t frames_rx_error = 0;	// CRC/header error
+static uint32_t frames_unknown = 0;		// wrong size or packet_id
+static SemaphoreHandle_t vehicles_mutex;
+
+static bool uart_ready = false;
+static TaskHandle_t gs_task_handle = NULL;
+
+static void gs_task(void *pvParameter);
+static void gs_uartInit(void);
+static GS_vehicle_t * gs_findVehicle(uint16_t id);
+static void gs_updateStats(GS_vehicle_t * vehicle, const GS_rxFrame_t * rx);
+static void gs_uartSend(const GS_rxFrame_t * rx);
+
+esp_err_t GS_init(void){
+	static bool uart_done = false;
+
+	// Safe to call again after a failure - every step runs until it succeeds once
+	if(gs_task_handle != NULL)
+		return ESP_OK;
+
+	if(vehicles_mutex == NULL){
+		memset(vehicles, 0, sizeof(vehicles));
+		vehicles_num = 0;
+		vehicles_mutex = xSemaphoreCreateMutex();
+	}
+	if(queue_RadioToGS == NULL){
+		queue_RadioToGS = xQueueCreateStatic( GS_RX_QUEUE_SIZE,
+								sizeof(GS_rxFrame_t),
+								queue_RadioToGS_buf,
+								&queue_RadioToGS_struct);
+	}
+
+	if((vehicles_mutex == NULL) || (queue_RadioToGS == NULL)){
+		ESP_LOGE(TAG, "Failed to create queue/mutex");
+		return ESP_FAIL;
+	}
+
+	if(!uart_done)
+		gs_uartInit();
+	uart_done = true;
+
+	if(xTaskCreatePinnedToCore(&gs_task, "task_kpptr_gs", 1024*4, NULL, configMAX_PRIORITIES - 5, &gs_task_handle, 0) != pdPASS){
+		gs_task_handle = NULL;
+		ESP_LOGE(TAG, "Failed to create fan-out task");
+		return ESP_FAIL;
+	}
+
+	ESP_LOGI(TAG, "Ground station ready");
+	return ESP_OK;
+}
+
+// Binary stream on external UART, optional - the web interface works without it
+static void gs_uartInit(void){
+	uart_config_t uart_config = {
+		.baud_rate = GS_UART_BAUDRATE,
+		.data_bits = UART_DATA_8_BITS,
+		.parity    = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+		.source_clk = UART_SCLK_APB,
+	};
+
+	if((uart_driver_install(GS_UART_PORT, 256, GS_UART_TX_BUF, 0, NULL, 0) == ESP_OK) &&
+	   (uart_param_config(GS_UART_PORT, &uart_config) == ESP_OK) &&
+	   (uart_set_pin(GS_UART_PORT, UART_EXT_OUT, UART_EXT_IN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) == ESP_OK)){
+		uart_ready = true;
+	} else {
+		ESP_LOGW(TAG, "UART stream not available - web only");
+	}
+}
+
+esp_err_t GS_pushFrame(const uint8_t *buf, uint8_t len, int8_t rssi, int8_t snr, int64_t rx_time_us){
+	GS_rxFrame_t rx;
+
+	if((len != sizeof(DataPackageRF_t)) && (len != sizeof(SummaryRF_t))){
+		frames_unknown++;
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	rx.rx_time_us = rx_time_us;
+	rx.rssi = rssi;
+	rx.snr  = snr;
+	rx.len  = len;
+	memcpy(&rx.frame, buf, len);
+
+	if(xQueueSend(queue_RadioToGS, &rx, 0) != pdTRUE){
+		frames_dropped++;
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+void GS_reportRxError(void){
+	frames_rx_error++;
+}
+
+char* GS_statsCreateJSON(void){
+	char *string = NULL;
+	cJSON *json = cJSON_CreateObject();
+
+	cJSON_AddNumberToObject(json, "dropped", frames_dropped);
+	cJSON_AddNumberToObject(json, "rx_error", frames_rx_error);
+	cJSON_AddNumberToObject(json, "unknown", frames_unknown);
+
+	cJSON *list = cJSON_CreateArray();
+
+	xSemaphoreTake(vehicles_mutex, portMAX_DELAY);
+	for(uint8_t i=0; i<vehicles_num; i++){
+		GS_vehicle_t *v = &vehicles[i];
+		cJSON *vehicle = cJSON_CreateObject();
+
+		cJSON *link = cJSON_CreateObject();
+		cJSON_AddNumberToObject(link, "received", v->received);
+		cJSON_AddNumberToObject(link, "lost", v->lost);
+		cJSON_AddNumberToObject(link, "duplicated", v->duplicated);
+		cJSON_AddNumberToObject(link, "restarts", v->restarts);
+		cJSON_AddNumberToObject(link, "loss_percent", (v->received + v->lost) ? (100.0f * v->lost / (v->received + v->lost)) : 0.0f);
+		cJSON_AddNumberToObject(link, "rssi", v->rssi_last);
+		cJSON_AddNumberToObject(link, "rssi_min", v->rssi_min);
+		cJSON_AddNumberToObject(link, "rssi_avg", v->rssi_avg);
+		cJSON_AddNumberToObject(link, "snr", v->snr_last);
+		cJSON_AddNumberToObject(link, "latency_ms", v->latency_ms);
+		cJSON_AddNumberToObject(link, "latency_max_ms", v->latency_max_ms);
+		cJSON_AddNumberToObject(link, "interval_ms", v->interval_ms);
+		cJSON_AddNumberToObject(link, "age_ms", (esp_timer_get_time() - v->last_rx_time_us)/1000);
+
+		const DataPackageRF_t *f = &v->last_frame;
+		cJSON *data = cJSON_CreateObject();
+		cJSON_AddNumberToObject(data, "packet_no", f->packet_no);
+		cJSON_AddNumberToObject(data, "timestamp_ms", f->timestamp_ms);
+		cJSON_AddNumberToObject(data, "state", f->state);
+		cJSON_AddNumberToObject(data, "flags", f->flags);
+		cJSON_AddNumberToObject(data, "vbat", f->vbat_10 / 10.0f);
+		cJSON_AddNumberToObject(data, "accX", f->accX_100 / 100.0f);
+		cJSON_AddNumberToObject(data, "accY", f->accY_100 / 100.0f);
+		cJSON_AddNumberToObject(data, "accZ", f->accZ_100 / 100.0f);
+		cJSON_AddNumberToObject(data, "tilt", f->tilt_100 / 100.0f);
+		cJSON_AddNumberToObject(data, "pressure", f->pressure);
+		cJSON_AddNumberToObject(data, "velocity", f->velocity_10 / 10.0f);
+		cJSON_AddNumberToObject(data, "altitude", f->altitude);
+		cJSON_AddNumberToObject(data, "lat", f->lat / 10000000.0);
+		cJSON_AddNumberToObject(data, "lon", f->lon / 10000000.0);
+		cJSON_AddNumberToObject(data, "alti_gps", f->alti_gps);
+		cJSON_AddNumberToObject(data, "sats", f->sats_fix & 0x3F);
+		cJSON_AddNumberToObject(data, "fix", f->sats_fix >> 6);
+
+		cJSON_AddNumberToObject(vehicle, "id", v->id);
+		cJSON_AddItemToObject(vehicle, "link", link);
+		cJSON_AddItemToObject(vehicle, "data", data);
+
+		if(v->summary_valid){
+			const SummaryRF_t *s = &v->summary;
+			cJSON *summary = cJSON_CreateObject();
+			cJSON_AddNumberToObject(summary, "flags", s->flags);
+			cJSON_AddNumberToObject(summary, "apogee", s->apogee);
+			cJSON_AddNumberToObject(summary, "apogee_t", s->apogee_ms / 1000.0f);
+			cJSON_AddNumberToObject(summary, "burn_time", s->burn_ms / 1000.0f);
+			cJSON_AddNumberToObject(summary, "flight_time", s->flight_ms / 1000.0f);
+			cJSON_AddNumberToObject(summary, "acc_max", s->acc_max_100 / 100.0f);
+			cJSON_AddNumberToObject(summary, "velocity_max", s->velocity_max_10 / 10.0f);
+			cJSON_AddNumberToObject(summary, "drogue_alt", s->drogue_alt);
+			cJSON_AddNumberToObject(summary, "main_alt", s->main_alt);
+			cJSON_AddNumberToObject(summary, "lat", s->lat / 10000000.0);
+			cJSON_AddNumberToObject(summary, "lon", s->lon / 10000000.0);
+			cJSON_AddItemToObject(vehicle, "summary", summary);
+		}
+		cJSON_AddItemToArray(list, vehicle);
+	}
+	xSemaphoreGive(vehicles_mutex);
+
+	cJSON_AddItemToObject(json, "vehicles", list);
+
+	string = cJSON_PrintUnformatted(json);
+	if(string == NULL){
+		ESP_LOGE(TAG, "Cannot create JSON string");
+	}
+
+	cJSON_Delete(json);
+	return string;
+}
+
+//---------------------------------- Fan-out ---------------------------------
+static void gs_task(void *pvParameter){
+	GS_rxFrame_t rx;
+
+	while(1){
+		if(xQueueReceive(queue_RadioToGS, &rx, portMAX_DELAY) != pdTRUE)
+			continue;
+
+		// Summary has no packet number and is not forwarded to the fixed size UART stream
+		if((rx.frame.packet_id == SUMMARY_RF_PACKET_ID) && (rx.len == sizeof(SummaryRF_t))){
+			xSemaphoreTake(vehicles_mutex, portMAX_DELAY);
+			GS_vehicle_t * vehicle = gs_findVehicle(rx.summary.id);
+			if(vehicle != NULL){
+				vehicle->summary = rx.summary;
+				vehicle->summary_valid = true;
+			} else {
+				frames_unknown++;
+			}
+			xSemaphoreGive(vehicles_mutex);
+			continue;
+		}
+
+		if((rx.frame.packet_id != DM_RF_PACKET_ID) || (rx.len != sizeof(DataPackageRF_t))){
+			frames_unknown++;
+			continue;
+		}
+
+		// UART first - latency critical for the tracker, stats can wait
+		gs_uartSend(&rx);
+
+		xSemaphoreTake(vehicles_mutex, portMAX_DELAY);
+		GS_vehicle_t * vehicle = gs_findVehicle(rx.frame.id);
+		if(vehicle != NULL){
+			gs_updateStats(vehicle, &rx);
+		} else {
+			frames_unknown++;
+		}
+		xSemaphoreGive(vehicles_mutex);
+	}
+	vTaskDelete(NULL);
+}
+
+static GS_vehicle_t * gs_findVehicle(uint16_t id){
+	for(uint8_t i=0; i<vehicles_num; i++){
+		if(vehicles[i].id == id)
+			return &vehicles[i];
+	}
+
+	if(vehicles_num >= GS_MAX_VEHICLES){
+		ESP_LOGW(TAG, "Vehicle table full, ignoring ID %u", id);
+		return NULL;
+	}
+
+	GS_vehicle_t * vehicle = &vehicles[vehicles_num++];
+	memset(vehicle, 0, sizeof(GS_vehicle_t));
+	vehicle->id = id;
+	ESP_LOGI(TAG, "New vehicle ID %u", id);
+
+	return vehicle;
+}
+
+static void gs_updateStats(GS_vehicle_t * v, const GS_rxFrame_t * rx){
+	int64_t rx_time_ms = rx->rx_time_us/1000;
+	int64_t offset_ms  = rx_time_ms - rx->frame.timestamp_ms;
+
+	if(v->received == 0){
+		v->rssi_min = rx->rssi;
+		v->rssi_avg = rx->rssi;
+		v->clock_offset_ms = offset_ms;
+	} else {
+		uint16_t expected = v->last_packet_no + 1;
+		int16_t gap = (int16_t)(rx->frame.packet_no - expected);	// uint16 wrap-around safe
+		int64_t time_back_ms = (int64_t)v->last_frame.timestamp_ms - rx->frame.timestamp_ms;
+
+		// Vehicle rebooted - counter and clock start over, the old sequence and clock offset no longer apply
+		if((gap < -GS_RESTART_GAP) || (time_back_ms > GS_RESTART_MS)){
+			uint16_t restarts = v->restarts + 1;
+			uint16_t id = v->id;
+			bool summary_valid = v->summary_valid;
+			SummaryRF_t summary = v->summary;
+
+			ESP_LOGI(TAG, "Vehicle ID %u restarted", id);
+			memset(v, 0, sizeof(GS_vehicle_t));
+			v->id = id;
+			v->restarts = restarts;
+			v->summary_valid = summary_valid;
+			v->summary = summary;
+			gs_updateStats(v, rx);
+			return;
+		}
+
+		if(gap > 0){
+			v->lost += gap;
+		} else if(gap < 0){
+			v->duplicated++;
+			return;		// Old frame - keep newest data and timing
+		}
+
+		v->interval_ms = (rx->rx_time_us - v->last_rx_time_us)/1000;
+		v->rssi_avg = GS_RSSI_FILTER * rx->rssi + (1 - GS_RSSI_FILTER) * v->rssi_avg;
+		if(rx->rssi < v->rssi_min)
+			v->rssi_min = rx->rssi;
+
+		// Clocks are not synchronized - the fastest frame defines zero latency
+		if(offset_ms < v->clock_offset_ms)
+			v->clock_offset_ms = offset_ms;
+	}
+
+	v->received++;
+	v->last_packet_no = rx->frame.packet_no;
+	v->last_rx_time_us = rx->rx_time_us;
+	v->rssi_last = rx->rssi;
+	v->snr_last = rx->snr;
+	v->latency_ms = offset_ms - v->clock_offset_ms;
+	if(v->latency_ms > v->latency_max_ms)
+		v->latency_max_ms = v->latency_ms;
+	v->last_frame = rx->frame;
+}
+
+static void gs_uartSend(const GS_rxFrame_t * rx){
+	GS_uartFrame_t out;
+
+	if(!uart_ready)
+		return;
+
+	out.sync = GS_UART_SYNC;
+	out.len  = sizeof(DataPackageRF_t);
+	out.rssi = rx->rssi;
+	out.snr  = rx->snr;
+	out.rx_time_ms = (uint32_t)(rx->rx_time_us/1000);
+	out.frame = rx->frame;
+	out.crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)&out, sizeof(GS_uartFrame_t) - sizeof(out.crc));
+
+	// TX ring buffer holds GS_RX_QUEUE_SIZE frames - at GS_UART_BAUDRATE it does not fill up at LoRa rates
+	if(uart_write_bytes(GS_UART_PORT, (const char *)&out, sizeof(GS_uartFrame_t)) < 0){
+		ESP_LOGW(TAG, "UART write fail");
+	}
+}
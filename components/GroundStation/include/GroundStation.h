@@ -0,0 +1,93 @@
+#pragma once
+
+#include "esp_err.h"
+#include "DataManager.h"
+#include "FlightSummary.h"
+
+#define GS_MAX_VEHICLES		8		/*!< Number of vehicles tracked at the same time */
+#define GS_RX_QUEUE_SIZE	16		/*!< Frames buffered between radio and fan-out task */
+#define GS_UART_BAUDRATE	921600
+#define GS_UART_SYNC		0x55AA	/*!< Binary stream frame preamble (little endian: AA 55) */
+
+/**
+ * @brief Frame received by the radio, passed from RX loop to the fan-out task.
+ */
+typedef struct{
+	int64_t rx_time_us;				/*!< Local receive time */
+	int8_t rssi;					/*!< RSSI of the packet in dBm */
+	int8_t snr;						/*!< SNR of the packet in dB */
+	uint8_t len;					/*!< Payload length */
+	union{
+		DataPackageRF_t frame;		/*!< Payload - DM_RF_PACKET_ID */
+		SummaryRF_t summary;		/*!< Payload - SUMMARY_RF_PACKET_ID */
+	};
+} GS_rxFrame_t;
+
+/**
+ * @brief Binary UART stream frame: header + DataPackageRF_t + CRC16 of header and payload.
+ */
+typedef struct __attribute__((__packed__)){
+	uint16_t sync;					/*!< GS_UART_SYNC */
+	uint8_t len;					/*!< sizeof(DataPackageRF_t) */
+	int8_t rssi;					/*!< RSSI of the packet in dBm */
+	int8_t snr;						/*!< SNR of the packet in dB */
+	uint32_t rx_time_ms;			/*!< Ground station receive time */
+	DataPackageRF_t frame;			/*!< Received frame */
+	uint16_t crc;					/*!< CRC16 (esp_crc16_le) of all previous bytes */
+} GS_uartFrame_t;
+
+/**
+ * @brief Per-vehicle link statistics.
+ */
+typedef struct{
+	uint16_t id;					/*!< Vehicle ID (DataPackageRF_t.id) */
+	uint32_t received;				/*!< Frames received */
+	uint32_t lost;					/*!< Frames missing in packet_no sequence */
+	uint32_t duplicated;			/*!< Repeated or out of order frames */
+	uint16_t restarts;				/*!< Vehicle reboots detected, link statistics restart from zero on each */
+	uint16_t last_packet_no;		/*!< Last received packet number */
+	int8_t rssi_last;				/*!< RSSI of last frame [dBm] */
+	int8_t rssi_min;				/*!< Worst RSSI [dBm] */
+	int8_t snr_last;				/*!< SNR of last frame [dB] */
+	float rssi_avg;					/*!< Filtered RSSI [dBm] */
+	int64_t clock_offset_ms;		/*!< Minimum (rx_time - timestamp) seen, reference for latency */
+	uint32_t latency_ms;			/*!< Latency of last frame relative to the fastest one */
+	uint32_t latency_max_ms;		/*!< Worst relative latency */
+	uint32_t interval_ms;			/*!< Time between two last frames */
+	int64_t last_rx_time_us;		/*!< Local time of last frame */
+	DataPackageRF_t last_frame;		/*!< Last decoded frame */
+	bool summary_valid;				/*!< Flight summary received */
+	SummaryRF_t summary;			/*!< Last flight summary, not counted in link statistics */
+} GS_vehicle_t;
+
+/**
+ * @brief Initialize ground station: stats table, binary UART stream and fan-out task.
+ *        Can be called again after a failure, steps that already succeeded are skipped.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ */
+esp_err_t GS_init(void);
+
+/**
+ * @brief Pass received frame to the fan-out task. Never blocks, safe to call from the radio loop.
+ * @param buf Payload received by the radio.
+ * @param len Payload length.
+ * @param rssi RSSI in dBm.
+ * @param snr SNR in dB.
+ * @param rx_time_us Local receive time.
+ * @return
+ *  - ESP_OK: Frame queued
+ *  - ESP_ERR_INVALID_SIZE: Not a DataPackageRF_t or SummaryRF_t frame
+ *  - ESP_ERR_NO_MEM: Queue full, frame dropped
+ */
+esp_err_t GS_pushFrame(const uint8_t *buf, uint8_t len, int8_t rssi, int8_t snr, int64_t rx_time_us);
+
+/**
+ * @brief Count frame rejected by the radio (CRC/header error).
+ */
+void GS_reportRxError(void);
+
+/**
+ * @brief Create json string with link statistics and last frame of every vehicle.
+ * @return string* with json, must be freed by caller. NULL on error.
+ */
+char* GS_statsCreateJSON(void);
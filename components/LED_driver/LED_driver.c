@@ -274,6 +274,25 @@ esp_err_t LED_setRF(led_colour_t colour, uint8_t brightness_percent, uint16_t t_
 #endif
 }
 
+esp_err_t LED_setInterval(uint32_t interval_ms){
+	if(interval_ms == 0)
+		return ESP_ERR_INVALID_ARG;
+
+	if(xSemaphoreTake(mutex_LED, pdMS_TO_TICKS(1000)) != pdTRUE)
+		return ESP_FAIL;
+
+	// Running blinks keep their time in ms
+	for (uint8_t i = 0; i < (LED_ARRAY_SIZE); i++) {
+		led_array[i].on_time_tics  = (led_array[i].on_time_tics * loop_interval_ms) / interval_ms;
+		led_array[i].off_time_tics = (led_array[i].off_time_tics * loop_interval_ms) / interval_ms;
+		led_array[i].counter 	   = (led_array[i].counter * loop_interval_ms) / interval_ms;
+	}
+	loop_interval_ms = interval_ms;
+	xSemaphoreGive(mutex_LED);
+
+	return ESP_OK;
+}
+
 esp_err_t LED_setBrigthnessGlobal(uint8_t percentage){
 	if(LED_brightness_percentage > 100)
 		LED_brightness_percentage = 100;
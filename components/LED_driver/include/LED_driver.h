@@ -99,6 +99,13 @@ esp_err_t LED_srv(void); //Update LED status task should be run in SRV_CLOCK int
  */
 esp_err_t LED_init(uint32_t interval_ms); 	
 
+/**
+ * @brief Change the interval of LED_srv() calls, running blinks keep their timing.
+ * @param[in] interval_ms New interval (in milliseconds) of the LED status task.
+ * @return esp_err_t indicating success or error.
+ */
+esp_err_t LED_setInterval(uint32_t interval_ms);
+
 /**
  * @brief Set normal LED on or off.
  * @param[in] led_no Number of the LED to set.
@@ -158,3 +158,68 @@ esp_err_t LORA_sendPacketLoRa(uint8_t *txbuffer, uint16_t size, uint32_t txtimeo
 
 	return ESP_OK;
 }
+
+esp_err_t LORA_startReceiveLoRa() {
+	sx126x_status_t status = sx126x_set_standby(0, SX126X_STANDBY_CFG_RC);
+
+	if(status == SX126X_STATUS_OK)
+		status = sx126x_set_buffer_base_address(0, 0, 0);
+
+	sx126x_pkt_params_lora_t sx126x_pkt_params_lora_d;
+	sx126x_pkt_params_lora_d.crc_is_on 				= true;
+	sx126x_pkt_params_lora_d.header_type 			= SX126X_LORA_PKT_EXPLICIT;
+	sx126x_pkt_params_lora_d.invert_iq_is_on 		= false;
+	sx126x_pkt_params_lora_d.pld_len_in_bytes 		= 255;
+	sx126x_pkt_params_lora_d.preamble_len_in_symb 	= 8;
+	if(status == SX126X_STATUS_OK)
+		status = sx126x_set_lora_pkt_params(0, &sx126x_pkt_params_lora_d);
+
+	if(status == SX126X_STATUS_OK)
+		status = sx126x_clear_irq_status(0, SX126X_IRQ_ALL);
+
+	if(status == SX126X_STATUS_OK)
+		status = sx126x_set_rx_with_timeout_in_rtc_step(0, SX126X_RX_CONTINUOUS);	//this starts the RX
+
+	if(status == SX126X_STATUS_OK)
+		return ESP_OK;
+
+	return ESP_FAIL;
+}
+
+esp_err_t LORA_receivePacketLoRa(uint8_t *rxbuffer, uint16_t *size, int8_t *rssi, int8_t *snr) {
+	sx126x_irq_mask_t irq = SX126X_IRQ_NONE;
+	sx126x_rx_buffer_status_t rx_buffer_status;
+	sx126x_pkt_status_lora_t pkt_status;
+
+	if(sx126x_get_irq_status(0, &irq) != SX126X_STATUS_OK)
+		return ESP_FAIL;
+
+	if(!(irq & SX126X_IRQ_RX_DONE))
+		return ESP_ERR_NOT_FOUND;
+
+	// Clear only RX flags - radio stays in continuous RX
+	sx126x_clear_irq_status(0, SX126X_IRQ_RX_DONE | SX126X_IRQ_CRC_ERROR | SX126X_IRQ_HEADER_ERROR |
+							   SX126X_IRQ_HEADER_VALID | SX126X_IRQ_PREAMBLE_DETECTED | SX126X_IRQ_SYNC_WORD_VALID);
+
+	if(irq & (SX126X_IRQ_CRC_ERROR | SX126X_IRQ_HEADER_ERROR))
+		return ESP_ERR_INVALID_CRC;
+
+	if(sx126x_get_rx_buffer_status(0, &rx_buffer_status) != SX126X_STATUS_OK)
+		return ESP_FAIL;
+
+	if(rx_buffer_status.pld_len_in_bytes > *size)
+		return ESP_ERR_INVALID_SIZE;
+
+	// In continuous RX the start pointer moves with every packet
+	if(sx126x_read_buffer(0, rx_buffer_status.buffer_start_pointer, rxbuffer, rx_buffer_status.pld_len_in_bytes) != SX126X_STATUS_OK)
+		return ESP_FAIL;
+
+	if(sx126x_get_lora_pkt_status(0, &pkt_status) != SX126X_STATUS_OK)
+		return ESP_FAIL;
+
+	*size = rx_buffer_status.pld_len_in_bytes;
+	*rssi = pkt_status.rssi_pkt_in_dbm;
+	*snr  = pkt_status.snr_pkt_in_db;
+
+	return ESP_OK;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #define LORA_TX_NO_WAIT 0
+#define LORA_RX_BUFFER_SIZE 256
 
 
 /**
@@ -33,3 +34,27 @@ esp_err_t LORA_setupLoRaTX(uint32_t frequency, int32_t offset, uint8_t modParam1
 * the function returns true. If the transmission fails or times out, the function returns false.
 */
 esp_err_t LORA_sendPacketLoRa(uint8_t *txbuffer, uint16_t size, uint32_t txtimeout);
+
+
+/**
+* @brief Puts the LORA module into continuous RX mode.
+* @details The radio stays in RX after every received packet, so this has to be called only once
+* (or after a TX). The buffer base address is reset to 0 and the payload length set to maximum.
+* @return ESP_OK on success, ESP_FAIL otherwise.
+*/
+esp_err_t LORA_startReceiveLoRa();
+
+/**
+* @brief Fetches a packet received in continuous RX mode (non-blocking).
+* @param[out] rxbuffer Buffer for the payload, should be at least LORA_RX_BUFFER_SIZE bytes long.
+* @param[in,out] size Size of the rxbuffer on input, received payload length on output (a LoRa payload is at most 255 B).
+* @param[out] rssi RSSI of the received packet in dBm.
+* @param[out] snr SNR of the received packet in dB.
+* @return
+*  - ESP_OK: Packet copied to the rxbuffer
+*  - ESP_ERR_NOT_FOUND: No new packet
+*  - ESP_ERR_INVALID_CRC: Packet received with CRC/header error and dropped
+*  - ESP_ERR_INVALID_SIZE: Packet longer than the rxbuffer
+*  - ESP_FAIL: Communication error
+*/
+esp_err_t LORA_receivePacketLoRa(uint8_t *rxbuffer, uint16_t *size, int8_t *rssi, int8_t *snr);
@@ -12,6 +12,7 @@
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "esp_event.h"
+#include "sdkconfig.h"
 
 #include "esp_vfs.h"
 #include "esp_spiffs.h"
@@ -34,6 +35,12 @@ Preferences_data_t Preferences_default;
 
 uint32_t calculate_CRC32(const char* input);
 
+//Fields added after the first release are optional - config files written by older firmware still load
+static int Preferences_getInt(cJSON *json, const char *name, int fallback){
+	cJSON *item = cJSON_GetObjectItem(json, name);
+	return (item != NULL) ? item->valueint : fallback;
+}
+
 esp_err_t Preferences_init(Preferences_data_t * data){
 	esp_err_t ret = ESP_FAIL;
 	char buf[400];
@@ -47,6 +54,9 @@ esp_err_t Preferences_init(Preferences_data_t * data){
 	Preferences_default.auto_arming = true;
 	Preferences_default.auto_arming_time_s = 60;
 	Preferences_default.lora_freq = 433125;
+	Preferences_default.log_ascent_hz = CONFIG_KPPTR_MEAS_RATE_HZ;
+	Preferences_default.log_descent_hz = 10;
+	Preferences_default.log_landed_hz = CONFIG_KPPTR_LOG_RATE_HZ;
 
 	*data = Preferences_default;
 
@@ -105,6 +115,9 @@ esp_err_t Preferences_init(Preferences_data_t * data){
 	Preferences_data_d.auto_arming = cJSON_GetObjectItem(json, "auto_arming")->valueint;
 	Preferences_data_d.auto_arming_time_s = cJSON_GetObjectItem(json, "auto_arming_time_s")->valueint;
 	Preferences_data_d.lora_freq = cJSON_GetObjectItem(json, "lora_freq")->valueint;
+	Preferences_data_d.log_ascent_hz = Preferences_getInt(json, "log_ascent_hz", Preferences_default.log_ascent_hz);
+	Preferences_data_d.log_descent_hz = Preferences_getInt(json, "log_descent_hz", Preferences_default.log_descent_hz);
+	Preferences_data_d.log_landed_hz = Preferences_getInt(json, "log_landed_hz", Preferences_default.log_landed_hz);
 	cJSON_Delete(json);
 
 	*data = Preferences_data_d;
@@ -141,6 +154,9 @@ esp_err_t Preferences_update(Preferences_data_t config){
 	cJSON_AddNumberToObject(json, "auto_arming", Preferences_data_d.auto_arming);
 	cJSON_AddNumberToObject(json, "lora_freq", Preferences_data_d.lora_freq);
 	cJSON_AddNumberToObject(json, "lora_mode", 0);
+	cJSON_AddNumberToObject(json, "log_ascent_hz", Preferences_data_d.log_ascent_hz);
+	cJSON_AddNumberToObject(json, "log_descent_hz", Preferences_data_d.log_descent_hz);
+	cJSON_AddNumberToObject(json, "log_landed_hz", Preferences_data_d.log_landed_hz);
 	cJSON_AddNumberToObject(json, "key", 2137);
 	
 	
@@ -208,6 +224,9 @@ esp_err_t Prefences_update_web(char *buf){
 	temp.auto_arming = cJSON_GetObjectItem(json, "auto_arming")->valueint;
 	temp.key = cJSON_GetObjectItem(json, "key")->valueint;
 	temp.lora_freq = cJSON_GetObjectItem(json, "lora_freq")->valueint;
+	temp.log_ascent_hz = Preferences_getInt(json, "log_ascent_hz", temp.log_ascent_hz);
+	temp.log_descent_hz = Preferences_getInt(json, "log_descent_hz", temp.log_descent_hz);
+	temp.log_landed_hz = Preferences_getInt(json, "log_landed_hz", temp.log_landed_hz);
 	
 	return Preferences_update(temp);
 }
@@ -227,6 +246,9 @@ char* Preferences_send_config_web(){
 	cJSON_AddNumberToObject(json, "auto_arming", Preferences_data_d.auto_arming);
 	cJSON_AddNumberToObject(json, "lora_freq", Preferences_data_d.lora_freq);
 	cJSON_AddNumberToObject(json, "lora_mode", 0);
+	cJSON_AddNumberToObject(json, "log_ascent_hz", Preferences_data_d.log_ascent_hz);
+	cJSON_AddNumberToObject(json, "log_descent_hz", Preferences_data_d.log_descent_hz);
+	cJSON_AddNumberToObject(json, "log_landed_hz", Preferences_data_d.log_landed_hz);
 	cJSON_AddNumberToObject(json, "key", 2137);
 	
 	
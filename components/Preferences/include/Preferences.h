@@ -23,6 +23,10 @@ typedef struct{
 	int lora_freq;		//kHz
 	bool lora_network_mode;
 
+	int log_ascent_hz;	//ME_ACCELERATING, FREEFLIGHT
+	int log_descent_hz;	//FREEFALL, parachute descent
+	int log_landed_hz;	//LANDING
+
 
 	uint32_t key;
 
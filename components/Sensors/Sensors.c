@@ -5,6 +5,7 @@
 #include "MMC5983MA_driver.h"
 #include "LSM6DSO32_driver.h"
 #include "esp_log.h"
+#include "Trace.h"
 #include "Sensors.h"
 
 static const char *TAG = "Sensors";
@@ -30,10 +31,21 @@ esp_err_t Sensors_init(){
 esp_err_t  Sensors_update(){
 	//get new data from sensors
 
+	TRACE_BEGIN(t_ms);
 	MS5607_getReloadSmart();
+	TRACE_END(TRACE_MS5607_READ, t_ms);
+
+	TRACE_BEGIN(t_lis);
 	LIS331_readMeas();
+	TRACE_END(TRACE_LIS331_READ, t_lis);
+
+	TRACE_BEGIN(t_lsm);
 	LSM6DSO32_readMeasAll();
+	TRACE_END(TRACE_LSM6DSO32_READ, t_lsm);
+
+	TRACE_BEGIN(t_mmc);
 	MMC5983MA_readMeas();
+	TRACE_END(TRACE_MMC5983MA_READ, t_mmc);
 
 	MS5607_getMeas	 (0, &(Sensors_d.MS5607));
 	LIS331_getMeas	 (0, &(Sensors_d.LIS331));
@@ -3,13 +3,34 @@
 #include "esp_log.h"
 #include "sfs_api.h"
 #include <string.h>
+#include <sys/param.h>
 #include "esp_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 #include "SimpleFS_driver.h"
 
+#define SFS_ERASE_BLOCK_B	(64*1024UL)		// Background erase unit
+#define SFS_ERASE_IDLE_US	1000000			// No background erase for this time after a write
+#define SFS_SCAN_CHUNK_B	4096UL			// Read size of blank check and data end search
+#define SFS_INDEX_GROUP_B	(SFS_INDEX_EVERY * sizeof(sfs_packet_t))
+#define SFS_INDEX_ENTRIES	(SFS_INDEX_SIZE_B / sizeof(sfs_index_t))
+
 static sfs_info_t partition_info;
+static uint32_t data_size_B = 0;			// Partition without the index area
 static uint8_t curr_filename = 0;
 static uint32_t read_ptr = 0;
 static uint32_t write_ptr = 0;
+static volatile uint32_t erased_ptr = 0;	// Everything from write_ptr to erased_ptr is erased
+static volatile int64_t last_write_us = 0;
+static volatile bool erase_enabled = true;
+static SemaphoreHandle_t erase_lock = NULL;	// Guards erased_ptr updates and scan_buf
+static uint32_t index_num = 0;				// Valid entries, contiguous from entry 0
+static uint32_t index_flash = 0;			// Entries below are programmed, the rest is in index_batch
+static sfs_index_t index_batch[SFS_INDEX_BATCH];
+static uint8_t scan_buf[SFS_SCAN_CHUNK_B] __attribute__((aligned(4)));
 static bool access_locked_r = false;
 static bool access_locked_w = false;
 
@@ -19,6 +40,11 @@ static bool component_init_done = false;
 const char ESP_SIMPLEFS_TAG[] = "SimpleFS";
 
 static esp_err_t SimpleFS_findDataEnd();
+static void SimpleFS_indexAdd(uint32_t offset);
+static bool SimpleFS_isErased(uint32_t start, uint32_t end);
+static void SimpleFS_indexLoad();
+static void SimpleFS_indexReset();
+static void SimpleFS_eraseTask(void *pvParameter);
 
 esp_err_t SimpleFS_init(const char * label){
 	esp_err_t err = ESP_OK;
@@ -31,10 +57,25 @@ esp_err_t SimpleFS_init(const char * label){
 		err = simplefs_api_init(&partition_info, label);
 		component_init_done = true;
 
+		if(partition_info.partition_size_B < 2 * SFS_INDEX_SIZE_B){
+			ESP_LOGE(ESP_SIMPLEFS_TAG, "Partition too small for the index");
+			return ESP_FAIL;
+		}
+		data_size_B = partition_info.partition_size_B - SFS_INDEX_SIZE_B;
+		SimpleFS_indexReset();
+
 		// Reset Read and Write Pointers
 		read_ptr  = 0;
 		write_ptr = 0;
 
+		// Erased window is built in background, no blocking format before flight
+		erase_lock = xSemaphoreCreateMutex();
+		if((erase_lock == NULL)
+				|| (xTaskCreatePinnedToCore(&SimpleFS_eraseTask, "task_sfs_erase", 1024*3, NULL, tskIDLE_PRIORITY + 1, NULL, 0) != pdPASS)){
+			ESP_LOGE(ESP_SIMPLEFS_TAG, "Failed to start background erase");
+			return ESP_FAIL;
+		}
+
 	} else {
 		ESP_LOGI(ESP_SIMPLEFS_TAG, "SimpleFS already mounted. Skip API init.");
 	}
@@ -45,9 +86,28 @@ esp_err_t SimpleFS_init(const char * label){
 	if(SimpleFS_readMemoryLL(0, sizeof(tmp_buff), &tmp_buff) > 0){
 		if(tmp_buff != 0xFF){
 			ESP_LOGE(ESP_SIMPLEFS_TAG, "File present and not empty!");
-			SimpleFS_findDataEnd();
+			if(write_ptr == 0){			// Scanned once - boot retries until the flight is downloaded and erased
+				SimpleFS_findDataEnd();
+				SimpleFS_indexLoad();
+			}
 			err = ESP_FAIL;
 		}
+		else if((write_ptr == 0) && (index_num == 0)){
+			// No data - the index must be blank too, the area could hold packets of an older layout
+			xSemaphoreTake(erase_lock, portMAX_DELAY);
+			if(!SimpleFS_isErased(data_size_B, partition_info.partition_size_B)
+					&& (simplefs_api_eraseBlock(data_size_B, SFS_INDEX_SIZE_B) != ESP_OK)){
+				err = ESP_FAIL;
+			}
+			xSemaphoreGive(erase_lock);
+		}
+	}
+
+	// Ready when the erased window can take a flight (or the rest of the partition)
+	uint32_t ready_B = MIN((uint32_t)CONFIG_KPPTR_SFS_READY_ERASED_KB * 1024, data_size_B - write_ptr);
+	if((err == ESP_OK) && (SimpleFS_getErasedAhead() < ready_B)){
+		ESP_LOGI(ESP_SIMPLEFS_TAG, "Pre-erase in progress: %i of %i kB", SimpleFS_getErasedAhead() / 1024, ready_B / 1024);
+		err = ESP_ERR_INVALID_STATE;
 	}
 
 	return err;
@@ -68,28 +128,49 @@ esp_err_t IRAM_ATTR SimpleFS_formatMemory(uint32_t key, sfs_format_type_e type){
 
 	access_locked_r = true;
 	access_locked_w = true;
+	xSemaphoreTake(erase_lock, portMAX_DELAY);
 
 	esp_err_t err = ESP_OK;
+	uint32_t erased = 0;
 
 	if(type == SFS_FORMAT_ALL){
 		err = simplefs_api_erase(0);
+		erased = partition_info.partition_size_B;
 	}
 	else if(type == SFS_FORMAT_RANGE) {
-		err = simplefs_api_erase(write_ptr);
+		// Only the first block - the data end is found there after reboot, background task erases the rest
+		erased = MIN(SFS_ERASE_BLOCK_B, data_size_B);
+		err = simplefs_api_eraseBlock(0, erased);
+		if(err == ESP_OK)
+			err = simplefs_api_eraseBlock(data_size_B, SFS_INDEX_SIZE_B);
 	}
 	else {
 		err = ESP_FAIL;
 	}
 
+	if(err == ESP_OK){
+		write_ptr  = 0;
+		erased_ptr = MIN(erased, data_size_B);
+		SimpleFS_indexReset();
+	}
+
+	xSemaphoreGive(erase_lock);
 	access_locked_r = false;
 	access_locked_w = false;
 
-	if(err == ESP_OK){
-		write_ptr = 0;
-	}
 	return err;
 }
 
+void IRAM_ATTR SimpleFS_framePacket(const void * buffer, uint32_t size, sfs_packet_t * packet){
+	memset(packet, 0, sizeof(sfs_packet_t));
+	memcpy(&(packet->payload), buffer, MIN(size, sizeof(packet->payload)));
+
+	packet->header.pre = SFS_HEADER_PRE;
+	packet->header.filenum = curr_filename;
+	packet->header.packet_len = sizeof(sfs_packet_t)/sizeof(uint32_t);
+	packet->CRC16 = crc16((void*)packet, sizeof(sfs_packet_t) - sizeof((sfs_packet_t*)0)->CRC16);
+}
+
 esp_err_t IRAM_ATTR SimpleFS_appendPacket(void * buffer, uint32_t size){
 	if(!component_init_done){
 		ESP_LOGE(ESP_SIMPLEFS_TAG, "SimpleFS not initialized");
@@ -105,20 +186,24 @@ esp_err_t IRAM_ATTR SimpleFS_appendPacket(void * buffer, uint32_t size){
 		return ESP_FAIL;
 	}
 
+	// At least one erased packet must follow the data - it marks the data end after reboot
+	if((write_ptr + 2 * sizeof(sfs_packet_t)) > erased_ptr){
+		ESP_LOGV(ESP_SIMPLEFS_TAG, "Erased window full");
+		return ESP_ERR_NO_MEM;
+	}
+	last_write_us = esp_timer_get_time();
+
 	ESP_LOGV(ESP_SIMPLEFS_TAG, "Write size (payload): %i", size);
 
 	sfs_packet_t new_packet  __attribute__((aligned(4)));
-	memset(&new_packet, 0, sizeof(sfs_packet_t));
-	memcpy(&(new_packet.payload), buffer, size);
-
-	new_packet.header.pre = SFS_HEADER_PRE;
-	new_packet.header.filenum = curr_filename;
-	new_packet.header.packet_len = sizeof(sfs_packet_t)/sizeof(uint32_t);
-	new_packet.CRC16 = crc16((void*)&new_packet, sizeof(sfs_packet_t) - sizeof((sfs_packet_t*)0)->CRC16);
+	SimpleFS_framePacket(buffer, size, &new_packet);
 
 	esp_err_t err = simplefs_api_prog(write_ptr, &new_packet, sizeof(sfs_packet_t));
 
 	if(err == ESP_OK){
+		if((write_ptr % SFS_INDEX_GROUP_B) == 0){
+			SimpleFS_indexAdd(write_ptr);
+		}
 		write_ptr += sizeof(sfs_packet_t);
 	}
 
@@ -128,7 +213,26 @@ esp_err_t IRAM_ATTR SimpleFS_appendPacket(void * buffer, uint32_t size){
 }
 
 uint8_t SimpleFS_memoryUsedPercentage(){
-	return (100*write_ptr) / partition_info.partition_size_B;
+	return (100*write_ptr) / data_size_B;
+}
+
+uint32_t SimpleFS_getErasedAhead(){
+	uint32_t erased = erased_ptr;
+
+	return (erased > write_ptr) ? (erased - write_ptr) : 0;
+}
+
+uint8_t SimpleFS_erasedPercentage(){
+	uint32_t free_B = data_size_B - write_ptr;
+
+	if(free_B == 0)
+		return 100;
+
+	return ((uint64_t)SimpleFS_getErasedAhead() * 100) / free_B;
+}
+
+void SimpleFS_setBackgroundErase(bool enable){
+	erase_enabled = enable;
 }
 
 esp_err_t SimpleFS_readMode(){
@@ -143,7 +247,7 @@ esp_err_t SimpleFS_writeMode(){
 
 int32_t IRAM_ATTR SimpleFS_readMemory(uint32_t chunk_size, void * buffer){
 	if((chunk_size == 0)
-			|| ((chunk_size + read_ptr) > partition_info.partition_size_B)
+			|| ((chunk_size + read_ptr) > data_size_B)
 			|| (chunk_size > SFS_MAX_CHUNK_SIZE_B)
 			|| (chunk_size < sizeof(sfs_packet_t))){
 		return -1;
@@ -216,7 +320,7 @@ int32_t IRAM_ATTR SimpleFS_dumpMemory(uint32_t chunk_size, void * buffer){
 
 int32_t IRAM_ATTR SimpleFS_readMemoryLL(uint32_t position, uint32_t chunk_size, void * buffer){
 	if((chunk_size == 0)
-			|| ((chunk_size + read_ptr) > partition_info.partition_size_B)
+			|| ((chunk_size + position) > partition_info.partition_size_B)
 			|| (chunk_size > SFS_MAX_CHUNK_SIZE_B)){
 		return ESP_FAIL;
 	}
@@ -247,6 +351,120 @@ uint32_t SimpleFS_getFileSize(){
 	return write_ptr;
 }
 
+static esp_err_t SimpleFS_indexGet(uint32_t i, sfs_index_t * entry){
+	if(i >= index_num)
+		return ESP_FAIL;
+
+	if(i >= index_flash){
+		*entry = index_batch[i % SFS_INDEX_BATCH];
+		return ESP_OK;
+	}
+
+	return simplefs_api_read(data_size_B + i * sizeof(sfs_index_t), entry, sizeof(sfs_index_t));
+}
+
+/*
+ * Offset to start (after == false) or stop (after == true) reading records around time_ms. Starts at the
+ * last entry written at or before time_ms, stops at the first entry written after it. Binary search over
+ * the index - at most a dozen small reads. Without a matching entry the data start or end is returned.
+ */
+uint32_t SimpleFS_findOffset(uint32_t time_ms, bool after){
+	uint32_t lo = 0;
+	uint32_t hi = index_num;
+	sfs_index_t entry;
+
+	// Entries are in write order - first entry later than time_ms
+	while(lo < hi){
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(SimpleFS_indexGet(mid, &entry) != ESP_OK)
+			return after ? write_ptr : 0;
+
+		if(entry.time_ms <= time_ms)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if(after)
+		return (SimpleFS_indexGet(lo, &entry) == ESP_OK) ? MIN(entry.offset, write_ptr) : write_ptr;
+
+	return ((lo > 0) && (SimpleFS_indexGet(lo - 1, &entry) == ESP_OK)) ? MIN(entry.offset, write_ptr) : 0;
+}
+
+uint32_t SimpleFS_readIndex(uint32_t first, sfs_index_t * buffer, uint32_t num){
+	uint32_t i = 0;
+
+	for(i=0; (i<num) && (SimpleFS_indexGet(first + i, &buffer[i]) == ESP_OK); i++);
+
+	return i;
+}
+
+static void IRAM_ATTR SimpleFS_indexAdd(uint32_t offset){
+	uint32_t slot = offset / SFS_INDEX_GROUP_B;
+
+	if(slot >= SFS_INDEX_ENTRIES)
+		return;
+
+	index_batch[slot % SFS_INDEX_BATCH].time_ms = esp_timer_get_time() / 1000;
+	index_batch[slot % SFS_INDEX_BATCH].offset  = offset;
+	if(slot == index_num)
+		index_num++;	// A gap (index tail lost at reboot) leaves later entries unsearchable, never wrong
+
+	// Batches fill one program unit, so the index area is programmed only once
+	if((slot % SFS_INDEX_BATCH) == (SFS_INDEX_BATCH - 1)){
+		uint32_t first = slot - (SFS_INDEX_BATCH - 1);
+
+		if(simplefs_api_prog(data_size_B + first * sizeof(sfs_index_t), index_batch, sizeof(index_batch)) == ESP_OK){
+			index_flash = MIN(slot + 1, index_num);
+		}
+		else {
+			ESP_LOGE(ESP_SIMPLEFS_TAG, "Index write failed at entry %i", first);
+			index_num = MIN(index_num, first);
+		}
+		memset(index_batch, 0xFF, sizeof(index_batch));
+	}
+}
+
+static void SimpleFS_indexReset(){
+	index_num   = 0;
+	index_flash = 0;
+	memset(index_batch, 0xFF, sizeof(index_batch));
+}
+
+/* Valid entries point to their own packet group and to data. The last batch may be torn by a power loss. */
+static void SimpleFS_indexLoad(){
+	uint32_t lo = 0;
+	uint32_t hi = MIN(SFS_INDEX_ENTRIES, (write_ptr + SFS_INDEX_GROUP_B - 1) / SFS_INDEX_GROUP_B);
+	sfs_index_t entry;
+
+	SimpleFS_indexReset();
+
+	// Entries are programmed in order - first erased entry
+	while(lo < hi){
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(simplefs_api_read(data_size_B + mid * sizeof(sfs_index_t), &entry, sizeof(entry)) != ESP_OK)
+			return;
+
+		if(entry.offset != UINT32_MAX)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for(index_num = lo - (lo % SFS_INDEX_BATCH); index_num < lo; index_num++){
+		if((simplefs_api_read(data_size_B + index_num * sizeof(sfs_index_t), &entry, sizeof(entry)) != ESP_OK)
+				|| (entry.offset != index_num * SFS_INDEX_GROUP_B)
+				|| (entry.time_ms == UINT32_MAX)){
+			break;
+		}
+	}
+	index_flash = index_num;
+
+	ESP_LOGI(ESP_SIMPLEFS_TAG, "Index: %i entries", index_num);
+}
+
 static esp_err_t SimpleFS_findDataEnd(){
 	if(access_locked_w == true){
 		ESP_LOGE(ESP_SIMPLEFS_TAG, "Find Data End - access locked!");
@@ -254,83 +472,100 @@ static esp_err_t SimpleFS_findDataEnd(){
 	}
 
 	access_locked_w = true;
+	xSemaphoreTake(erase_lock, portMAX_DELAY);
 
 	esp_err_t err 		  = ESP_OK;
-	uint8_t   tmp         = 0x00;
-	uint32_t  packet_size = sizeof(sfs_packet_t);
-	uint32_t  packet_max  = partition_info.partition_size_B / packet_size;
-	uint32_t  curr_packet = 0;
+	uint32_t  position    = 0;
+	bool      end_found   = false;
 
-	ESP_LOGI(ESP_SIMPLEFS_TAG, "Max packet count: %i, packet size: %i, Flash size: %i", packet_max, packet_size, partition_info.partition_size_B);
+	ESP_LOGI(ESP_SIMPLEFS_TAG, "Packet size: %i, Data size: %i", sizeof(sfs_packet_t), data_size_B);
 
-	// Check first page
-	curr_packet = 0;
-	err = SimpleFS_readMemoryLL(curr_packet * packet_size, 1, (void *)(&tmp));
-	if(err == ESP_FAIL){
-		ESP_LOGE(ESP_SIMPLEFS_TAG, "Read failed");
-		return err;
-	}
+	// Data is contiguous from the partition start and followed by at least one erased packet. Space behind
+	// the erased window can still hold data of an older flight, so a binary search would find a wrong end.
+	while(!end_found && (position < data_size_B)){
+		uint32_t len = MIN(data_size_B - position, SFS_SCAN_CHUNK_B);
 
-	if(tmp == 0xFF){
-		write_ptr = curr_packet * packet_size;
-		ESP_LOGV(ESP_SIMPLEFS_TAG, "Flash empty");
-		return ESP_OK;
-	}
+		if(simplefs_api_read(position, scan_buf, len) != ESP_OK){
+			ESP_LOGE(ESP_SIMPLEFS_TAG, "Read failed");
+			err = ESP_FAIL;
+			break;
+		}
 
-	// Check packet at 50% of memory
-	curr_packet = packet_max >> 1;
-	err = SimpleFS_readMemoryLL(curr_packet * packet_size, 1, (void *)(&tmp));
-	if(err == ESP_FAIL){
-		ESP_LOGE(ESP_SIMPLEFS_TAG, "Read failed");
-		return err;
+		uint32_t i = 0;
+		for(i=0; i<len; i+=sizeof(sfs_packet_t)){
+			if(((sfs_packet_t*)(&scan_buf[i]))->header.pre != SFS_HEADER_PRE){
+				end_found = true;
+				break;
+			}
+		}
+		position += i;
 	}
 
-	if(tmp != 0xFF){
-		write_ptr = curr_packet * packet_size;
-		ESP_LOGI(ESP_SIMPLEFS_TAG, "Flash too full >50%%");
+	if(err == ESP_OK){
+		write_ptr = MIN(position, data_size_B);
+		if(erased_ptr < write_ptr)
+			erased_ptr = write_ptr;		// Background task verifies the rest of the block
 		ESP_LOGI(ESP_SIMPLEFS_TAG, "Data end: %iB", write_ptr);
-		return ESP_OK;
 	}
 
-	// Init search algorithm - look for data end between second page and 50% of the memory
-	uint32_t curr_packet_min = 1;
-	uint32_t curr_packet_max = packet_max >> 1;
+	xSemaphoreGive(erase_lock);
+	access_locked_w = false;
 
-	while(1){
-		// Check in the middle of search range
-		curr_packet = (curr_packet_max + curr_packet_min)>>1;
+	return err;
+}
 
-		// Check if search range has more than 2 packets
-		if((curr_packet_max-curr_packet_min) <= 1 ){
-			ESP_LOGV(ESP_SIMPLEFS_TAG, "End found");
-			break;
+static bool SimpleFS_isErased(uint32_t start, uint32_t end){
+	while(start < end){
+		uint32_t len = MIN(end - start, SFS_SCAN_CHUNK_B);
+
+		if(simplefs_api_read(start, scan_buf, len) != ESP_OK)
+			return false;
+
+		for(uint32_t i=0; i<len/sizeof(uint32_t); i++){
+			if(((uint32_t*)scan_buf)[i] != UINT32_MAX)
+				return false;
 		}
+		start += len;
+	}
 
-		// Read selected packet (first byte only) and check if it is empty (0xFF)
-		SimpleFS_readMemoryLL(curr_packet*packet_size, 1, (void *)(&tmp));
-		if(err == ESP_FAIL){
-			ESP_LOGE(ESP_SIMPLEFS_TAG, "Read failed");
-			return err;
+	return true;
+}
+
+/*
+ * Keeps erasing 64 kB blocks ahead of the write pointer while there are no writes. Blocks that are
+ * already blank are only verified, so after reboot the window is rebuilt quickly.
+ */
+static void SimpleFS_eraseTask(void *pvParameter){
+	while(1){
+		if(!erase_enabled || (erased_ptr >= data_size_B)
+				|| ((esp_timer_get_time() - last_write_us) < SFS_ERASE_IDLE_US)){
+			vTaskDelay(pdMS_TO_TICKS( 100 ));
+			continue;
 		}
-		ESP_LOGV(ESP_SIMPLEFS_TAG, "Ptr: %i, val: 0x%x", curr_packet*packet_size, tmp);
 
-		if(tmp == 0xFF)
-			curr_packet_max = curr_packet;	// Byte cleared - move upper search boundry to this position
-		else
-			curr_packet_min = curr_packet;	// Byte written - move lower search boundry to this position
-	}
+		xSemaphoreTake(erase_lock, portMAX_DELAY);
+		uint32_t start = erased_ptr;
+		uint32_t end   = MIN(start - (start % SFS_ERASE_BLOCK_B) + SFS_ERASE_BLOCK_B, data_size_B);
+		esp_err_t err  = ESP_OK;
 
-	SimpleFS_readMemoryLL(curr_packet*packet_size, 1, (void *)(&tmp));
-	if(tmp != 0xFF)
-		write_ptr = (curr_packet + 1) * packet_size;
-	else
-		write_ptr = curr_packet * packet_size;
+		if(!SimpleFS_isErased(start, end)){
+			if(start % SFS_ERASE_BLOCK_B)
+				err = ESP_FAIL;		// Block holds the last packets, it can not be erased
+			else
+				err = simplefs_api_eraseBlock(start, end - start);
+		}
 
-	access_locked_w = false;
+		if(err == ESP_OK)
+			erased_ptr = end;
+		xSemaphoreGive(erase_lock);
 
-	ESP_LOGI(ESP_SIMPLEFS_TAG, "Data end: %iB", write_ptr);
+		if(err != ESP_OK){
+			ESP_LOGE(ESP_SIMPLEFS_TAG, "Background erase failed at %iB", start);
+			vTaskDelay(pdMS_TO_TICKS( 5000 ));
+		}
 
-	return ESP_OK;
+		vTaskDelay(1);	// Flash access for other tasks between blocks
+	}
 }
 
 static uint16_t IRAM_ATTR crc16(uint8_t *buf, uint32_t len){
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include "esp_err.h"
 #include "esp_log.h"
 
@@ -7,6 +8,11 @@
 #define SFS_MAGIC_KEY 0x08102023
 #define SFS_MAX_CHUNK_SIZE_B 16384UL
 
+// Seek index in the last SFS_INDEX_SIZE_B of the partition - data never reaches it
+#define SFS_INDEX_SIZE_B	(64*1024UL)
+#define SFS_INDEX_EVERY		64			// Packets per index entry
+#define SFS_INDEX_BATCH		8			// Entries programmed at once (one 64 B program unit)
+
 typedef struct __attribute__((__packed__)){
 	struct __attribute__((__packed__)){
 		uint16_t pre;
@@ -23,6 +29,16 @@ typedef struct{
 	uint32_t size;
 } sfs_file_stat_t;
 
+/*
+ * Index entry i points to packet i*SFS_INDEX_EVERY. Entries are stored in order, an erased (0xFF) or
+ * misplaced entry ends the index. time_ms is the write time of that packet in ms since boot - every
+ * packet before offset was written, so also sampled, before time_ms.
+ */
+typedef struct __attribute__((__packed__)){
+	uint32_t time_ms;
+	uint32_t offset;
+} sfs_index_t;
+
 typedef enum{
 	SFS_FORMAT_ALL,
 	SFS_FORMAT_RANGE
@@ -31,7 +47,11 @@ typedef enum{
 esp_err_t 	SimpleFS_init(const char * label);
 esp_err_t 	SimpleFS_formatMemory(uint32_t key, sfs_format_type_e type);
 esp_err_t 	SimpleFS_appendPacket(void * buffer, uint32_t size);
+void 		SimpleFS_framePacket(const void * buffer, uint32_t size, sfs_packet_t * packet);	// Packet as written by SimpleFS_appendPacket
 uint8_t 	SimpleFS_memoryUsedPercentage();
+uint32_t 	SimpleFS_getErasedAhead();
+uint8_t 	SimpleFS_erasedPercentage();
+void 		SimpleFS_setBackgroundErase(bool enable);
 esp_err_t 	SimpleFS_readMode();
 esp_err_t 	SimpleFS_writeMode();
 int32_t 	SimpleFS_readMemory(uint32_t chunk_size, void * buffer);
@@ -39,3 +59,5 @@ int32_t 	SimpleFS_dumpMemory(uint32_t chunk_size, void * buffer);
 int32_t 	SimpleFS_readMemoryLL(uint32_t position, uint32_t chunk_size, void * buffer);
 void 		SimpleFS_resetReadPointer();
 uint32_t 	SimpleFS_getFileSize();
+uint32_t 	SimpleFS_findOffset(uint32_t time_ms, bool after);
+uint32_t 	SimpleFS_readIndex(uint32_t first, sfs_index_t * buffer, uint32_t num);
@@ -27,6 +27,7 @@ esp_err_t simplefs_api_init (sfs_info_t * partition_info, const char * label);
 esp_err_t simplefs_api_read (uint32_t position, void *buffer, uint32_t size);
 esp_err_t simplefs_api_prog (uint32_t position, void *buffer, uint32_t size);
 esp_err_t simplefs_api_erase(uint32_t range_end_B);
+esp_err_t simplefs_api_eraseBlock(uint32_t position, uint32_t size);
 
 #ifdef __cplusplus
 }
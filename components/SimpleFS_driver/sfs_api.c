@@ -9,7 +9,18 @@
 #include "esp_partition.h"
 #include "esp_vfs.h"
 #include "esp_flash.h"
+#include "sdkconfig.h"
 #include "sfs_api.h"
+#include "Trace.h"
+
+#if defined (CONFIG_KPPTR_SFS_EXT_MIRROR) || defined (CONFIG_KPPTR_SFS_EXT_STRIPE)
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "FLASH_driver.h"
+#define SFS_EXT_FLASH	1
+#endif
 
 #define SFS_PAGE_SIZE 256
 #define SFS_CHUNK_SIZE 64
@@ -17,6 +28,21 @@
 #error "Chunk size is not aligned!"
 #endif
 
+/*
+ * External flash on SPI_SLAVE_FLASH_PIN (CONFIG_KPPTR_SFS_EXT_*). SimpleFS sees one logical device:
+ *  - mirror: both chips hold the same data, reads come from the internal one (external if it fails),
+ *  - stripe: SFS_STRIPE_B units alternate between the chips - internal, external, internal, ...
+ * A program of the external chip is only started, it runs during the program of the next unit on the
+ * internal chip, which stalls the cache. Erase of both chips runs in parallel as well.
+ */
+#define SFS_STRIPE_B		128			// One SimpleFS packet, divides SFS_PAGE_SIZE
+#define SFS_EXT_ALIGN_B		(64*1024UL)	// Logical size granularity, SimpleFS erases 64 kB blocks
+#ifdef CONFIG_KPPTR_SFS_EXT_STRIPE
+#define SFS_ERASE_ALIGN_B	(2*4096UL)	// A sector on each chip
+#else
+#define SFS_ERASE_ALIGN_B	4096UL
+#endif
+
 const char ESP_SFS_TAG[] = "SFS";
 
 esp_partition_t *partition = NULL;
@@ -24,6 +50,202 @@ uint32_t partition_size_B = 0;
 uint32_t partition_blocks = 0;
 uint32_t partition_block_size_B = 0;
 
+#ifdef SFS_EXT_FLASH
+static bool ext_ok = false;				// External chip in use
+#endif
+
+//---------------------------------- Internal partition ----------------------------------
+static esp_err_t IRAM_ATTR int_read(uint32_t position, void *buffer, uint32_t size){
+	esp_err_t err = esp_flash_read(partition->flash_chip, buffer, partition->address+position, size);
+
+	if (err) {
+		ESP_LOGE(ESP_SFS_TAG, "Storage read error = %i", err);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t IRAM_ATTR int_prog(uint32_t position, void *buffer, uint32_t size){
+	// Low level write - cache of both cores is disabled for its whole duration, trace shows the stall of the main loop
+	TRACE_BEGIN(t_prog);
+	esp_err_t err = esp_flash_write(partition->flash_chip, buffer, partition->address+position, size);
+	TRACE_END(TRACE_FLASH_PROG, t_prog);
+
+	if (err) {
+		ESP_LOGE(ESP_SFS_TAG, "Storage write error = %i", err);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t int_erase(uint32_t position, uint32_t size){
+	TRACE_BEGIN(t_erase);
+	esp_err_t err = esp_partition_erase_range(partition, position, size);
+	TRACE_END(TRACE_FLASH_ERASE, t_erase);
+
+	if (err) {
+		ESP_LOGE(ESP_SFS_TAG, "Storage erase error = %i", err);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+#ifdef SFS_EXT_FLASH
+//---------------------------------- External chip ----------------------------------
+static esp_err_t ext_prog(uint32_t position, void *buffer, uint32_t size){
+	TRACE_BEGIN(t_prog);
+	esp_err_t err = FLASH_progStart(position, buffer, size);
+	TRACE_END(TRACE_EXT_FLASH_PROG, t_prog);
+
+	return err;
+}
+
+/* Same range on both chips, the external erase runs during the internal one */
+static esp_err_t both_erase(uint32_t position, uint32_t size){
+	esp_err_t err = ESP_OK;
+
+	while((err == ESP_OK) && (size > 0)){
+		uint32_t len = (((position % FLASH_BLOCK_B) == 0) && (size >= FLASH_BLOCK_B)) ? FLASH_BLOCK_B : FLASH_SECTOR_B;
+		esp_err_t ext_err = ESP_OK;
+
+		if(ext_ok)
+			ext_err = FLASH_eraseStart(position, len);
+		err = int_erase(position, len);
+		if(ext_ok && (ext_err == ESP_OK))
+			ext_err = FLASH_waitReady(pdMS_TO_TICKS( 4000 ));
+
+		if(ext_ok && (ext_err != ESP_OK)){
+			ESP_LOGE(ESP_SFS_TAG, "External erase error = %i at %i", ext_err, position);
+#ifdef CONFIG_KPPTR_SFS_EXT_STRIPE
+			err = ESP_FAIL;
+#else
+			ext_ok = false;		// Mirror goes on with the internal copy
+#endif
+		}
+
+		position += len;
+		size 	 -= len;
+	}
+
+	return err;
+}
+#endif
+
+#ifdef CONFIG_KPPTR_SFS_EXT_STRIPE
+//---------------------------------- Stripe ----------------------------------
+// Units of one chip are contiguous on it - even units are internal, odd ones external
+static inline uint32_t stripe_phys(uint32_t position){
+	return (position / (2 * SFS_STRIPE_B)) * SFS_STRIPE_B + (position % SFS_STRIPE_B);
+}
+
+static esp_err_t stripe_read(uint32_t position, uint8_t *buffer, uint32_t size){
+	uint32_t end = position + size;
+	uint32_t lo[2] = {UINT32_MAX, UINT32_MAX};
+	uint32_t hi[2] = {0, 0};
+
+	// Span of each chip, one read per chip and interleave in RAM
+	for(uint32_t pos = position; pos < end; pos = pos - (pos % SFS_STRIPE_B) + SFS_STRIPE_B){
+		uint8_t chip = (pos / SFS_STRIPE_B) % 2;
+		uint32_t len = MIN(SFS_STRIPE_B - (pos % SFS_STRIPE_B), end - pos);
+
+		lo[chip] = MIN(lo[chip], stripe_phys(pos));
+		hi[chip] = MAX(hi[chip], stripe_phys(pos) + len);
+	}
+
+	uint32_t len0 = (hi[0] > lo[0]) ? (hi[0] - lo[0]) : 0;
+	uint32_t len1 = (hi[1] > lo[1]) ? (hi[1] - lo[1]) : 0;
+	uint8_t *tmp = heap_caps_malloc(len0 + len1, MALLOC_CAP_DMA);
+	if(tmp == NULL){
+		ESP_LOGE(ESP_SFS_TAG, "Storage read - no memory");
+		return ESP_FAIL;
+	}
+
+	esp_err_t err = ESP_OK;
+	if(len0)
+		err = int_read(lo[0], tmp, len0);
+	if((err == ESP_OK) && len1)
+		err = FLASH_read(lo[1], tmp + len0, len1);
+
+	for(uint32_t pos = position; (err == ESP_OK) && (pos < end); pos = pos - (pos % SFS_STRIPE_B) + SFS_STRIPE_B){
+		uint8_t chip = (pos / SFS_STRIPE_B) % 2;
+		uint32_t len = MIN(SFS_STRIPE_B - (pos % SFS_STRIPE_B), end - pos);
+
+		memcpy(buffer + (pos - position), tmp + (chip ? len0 : 0) + (stripe_phys(pos) - lo[chip]), len);
+	}
+
+	free(tmp);
+	return err;
+}
+
+static esp_err_t IRAM_ATTR stripe_prog(uint32_t position, uint8_t *buffer, uint32_t size){
+	esp_err_t err = ESP_OK;
+
+	while((err == ESP_OK) && (size > 0)){
+		uint32_t len = MIN(SFS_STRIPE_B - (position % SFS_STRIPE_B), size);
+
+		if((position / SFS_STRIPE_B) % 2)
+			err = ext_prog(stripe_phys(position), buffer, len);
+		else
+			err = int_prog(stripe_phys(position), buffer, len);
+
+		position += len;
+		buffer 	 += len;
+		size 	 -= len;
+	}
+
+	return err;
+}
+#endif
+
+//---------------------------------- Logical device ----------------------------------
+static esp_err_t IRAM_ATTR sfs_read(uint32_t position, void *buffer, uint32_t size){
+#ifdef CONFIG_KPPTR_SFS_EXT_STRIPE
+	if(ext_ok)
+		return stripe_read(position, buffer, size);
+#endif
+	esp_err_t err = int_read(position, buffer, size);
+#ifdef CONFIG_KPPTR_SFS_EXT_MIRROR
+	if((err != ESP_OK) && ext_ok){
+		ESP_LOGW(ESP_SFS_TAG, "Storage read from the external copy");
+		err = FLASH_read(position, buffer, size);
+	}
+#endif
+	return err;
+}
+
+static esp_err_t IRAM_ATTR sfs_prog(uint32_t position, void *buffer, uint32_t size){
+#if defined (CONFIG_KPPTR_SFS_EXT_STRIPE)
+	if(ext_ok)
+		return stripe_prog(position, buffer, size);
+#elif defined (CONFIG_KPPTR_SFS_EXT_MIRROR)
+	if(ext_ok){
+		// External copy first - it is programmed while the internal write stalls the cache
+		for(uint32_t done = 0; ext_ok && (done < size); ){
+			uint32_t len = MIN(FLASH_PAGE_B - ((position + done) % FLASH_PAGE_B), size - done);
+
+			if(ext_prog(position + done, (uint8_t *)buffer + done, len) != ESP_OK){
+				ESP_LOGE(ESP_SFS_TAG, "External copy lost at %i", position + done);
+				ext_ok = false;
+			}
+			done += len;
+		}
+	}
+#endif
+	return int_prog(position, buffer, size);
+}
+
+static esp_err_t sfs_erase(uint32_t position, uint32_t size){
+#if defined (CONFIG_KPPTR_SFS_EXT_STRIPE)
+	if(ext_ok)
+		return both_erase(position / 2, size / 2);
+	return int_erase(position, size);
+#elif defined (CONFIG_KPPTR_SFS_EXT_MIRROR)
+	return both_erase(position, size);
+#else
+	return int_erase(position, size);
+#endif
+}
+
 esp_err_t simplefs_api_init(sfs_info_t * partition_info, const char * label){
 	if(label == NULL){
 		ESP_LOGE(ESP_SFS_TAG, "Storage init - name = NULL");
@@ -32,6 +254,27 @@ esp_err_t simplefs_api_init(sfs_info_t * partition_info, const char * label){
 	partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
 	partition_size_B = partition->size;
 
+#ifdef SFS_EXT_FLASH
+	FLASH_info_t ext_info;
+
+	if(FLASH_init(&ext_info) == ESP_OK){
+		uint32_t size_B = MIN(partition_size_B, ext_info.size_B);
+
+		size_B -= size_B % SFS_EXT_ALIGN_B;
+#ifdef CONFIG_KPPTR_SFS_EXT_STRIPE
+		partition_size_B = 2 * size_B;
+		ESP_LOGI(ESP_SFS_TAG, "Striped over internal and external flash: %i kB", partition_size_B / 1024);
+#else
+		partition_size_B = size_B;
+		ESP_LOGI(ESP_SFS_TAG, "Mirrored on external flash: %i kB", partition_size_B / 1024);
+#endif
+		ext_ok = true;
+	} else {
+		// Striped data of an earlier flight is seen only partially - every other packet
+		ESP_LOGE(ESP_SFS_TAG, "External flash not found, internal partition only");
+	}
+#endif
+
 	partition_info->partition_size_B = partition_size_B;
 	partition_info->partition_page_B = SFS_PAGE_SIZE;
 
@@ -55,13 +298,7 @@ esp_err_t IRAM_ATTR simplefs_api_read(uint32_t position, void *buffer, uint32_t
 	}
 
 	// Low level read
-	esp_err_t err = esp_flash_read(partition->flash_chip, buffer, partition->address+position, size);
-
-    if (err) {
-    	ESP_LOGE(ESP_SFS_TAG, "Storage read error = %i", err);
-        return ESP_FAIL;
-    }
-    return 0;
+	return sfs_read(position, buffer, size);
 }
 
 esp_err_t IRAM_ATTR simplefs_api_prog(uint32_t position, void *buffer, uint32_t size) {
@@ -93,13 +330,7 @@ esp_err_t IRAM_ATTR simplefs_api_prog(uint32_t position, void *buffer, uint32_t
 	}
 
 	// Low level write
-	esp_err_t err = esp_flash_write(partition->flash_chip, buffer, partition->address+position, size);
-
-    if (err) {
-    	ESP_LOGE(ESP_SFS_TAG, "Storage write error = %i", err);
-        return ESP_FAIL;
-    }
-    return ESP_OK;
+	return sfs_prog(position, buffer, size);
 }
 
 esp_err_t IRAM_ATTR simplefs_api_erase(uint32_t range_end_B) {
@@ -109,7 +340,7 @@ esp_err_t IRAM_ATTR simplefs_api_erase(uint32_t range_end_B) {
     	range_end_B = partition_size_B;
     }
 
-    uint32_t chunk = 512*1024;	// must be divisible by 4kB (4096B)
+    uint32_t chunk = 512*1024;	// must be divisible by SFS_ERASE_ALIGN_B
     uint32_t N     = 0;
 
     ESP_LOGI(ESP_SFS_TAG, "Erase progress: %i %%", 0);
@@ -118,24 +349,24 @@ esp_err_t IRAM_ATTR simplefs_api_erase(uint32_t range_end_B) {
 
     	for(uint8_t i=0; i<N; i++){
 			uint32_t start = i*chunk;
-			esp_partition_erase_range(partition, start, chunk);
+			sfs_erase(start, chunk);
 			ESP_LOGI(ESP_SFS_TAG, "Erase progress: %i %%", (100*(i+1))/(N+1));
 			vTaskDelay(50);
 		}
     }
 
-    // Format last chunk and make sure that it is aligned to 4kB
+    // Format last chunk and make sure that it is aligned to 4kB (8kB striped)
 	uint32_t last_chunk		   = 0;
 	uint32_t chunk_remainder   = range_end_B % chunk;
-	uint32_t aligned_remainder = range_end_B % 4096;
-	if((chunk_remainder - aligned_remainder + 4096 + N*chunk) < partition_size_B){
-		last_chunk = chunk_remainder - aligned_remainder + 4096;	//Extend erase range
+	uint32_t aligned_remainder = range_end_B % SFS_ERASE_ALIGN_B;
+	if((chunk_remainder - aligned_remainder + SFS_ERASE_ALIGN_B + N*chunk) < partition_size_B){
+		last_chunk = chunk_remainder - aligned_remainder + SFS_ERASE_ALIGN_B;	//Extend erase range
 	}
 	else {
 		last_chunk = chunk_remainder - aligned_remainder;	//Trim erase range
 	}
 
-	esp_partition_erase_range(partition, N*chunk, last_chunk);
+	sfs_erase(N*chunk, last_chunk);
 
     ESP_LOGI(ESP_SFS_TAG, "Erase progress: %i %%", 100);
 
@@ -149,3 +380,12 @@ esp_err_t IRAM_ATTR simplefs_api_erase(uint32_t range_end_B) {
     ESP_LOGI(ESP_SFS_TAG, "Memory erased successfully");
     return 0;
 }
+
+esp_err_t simplefs_api_eraseBlock(uint32_t position, uint32_t size) {
+	if((position > partition_size_B) || (position % SFS_ERASE_ALIGN_B) || (size % SFS_ERASE_ALIGN_B) || (size > (partition_size_B - position))){
+		ESP_LOGE(ESP_SFS_TAG, "Storage erase range not aligned");
+		return ESP_FAIL;
+	}
+
+	return sfs_erase(position, size);
+}
@@ -2,12 +2,15 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_err.h"
 #include "esp_check.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "SimpleFS_driver.h"
 #include "Storage_driver.h"
 
@@ -16,17 +19,27 @@ uint8_t meas_file_lock = 0;
 
 esp_err_t Storage_initFile				();
 
+#if defined(CONFIG_FS_SPIFFS) || defined(CONFIG_FS_LITTLEFS)
+esp_err_t Storage_openFile				();
+esp_err_t Storage_writeBuffer			();
+esp_err_t Storage_commitFile			();
+esp_err_t Storage_writePacket_File		(void * buf, uint16_t len);
+
+static uint8_t  meas_buf[CONFIG_KPPTR_STORAGE_BUFFER_B] __attribute__((aligned(4)));	/*!< Packets not yet in the log file */
+static uint32_t meas_buf_len = 0;
+static uint32_t meas_file_B = 0;		/*!< Log file size - full buffers are written up to aligned offsets */
+static int64_t  meas_commit_us = 0;		/*!< Last commit point */
+#endif
+
 #if defined(CONFIG_FS_SPIFFS)
 esp_err_t Storage_init_Spiffs			();
 esp_err_t Storage_erase_Spiffs			(uint32_t key);
-esp_err_t Storage_writePacket_Spiffs	(void * buf, uint16_t len);
 esp_err_t Storage_readFile_Spiffs		(void * buf);
 size_t    Storage_getFreeMem_Spiffs		(void);
 
 #elif defined(CONFIG_FS_LITTLEFS)
 esp_err_t Storage_init_Littlefs			();
 esp_err_t Storage_erase_Littlefs		(uint32_t key);
-esp_err_t Storage_writePacket_Littlefs	(void * buf, uint16_t len);
 esp_err_t Storage_readFile_Littlefs		(void * buf);
 size_t    Storage_getFreeMem_Littlefs	(void);
 #endif
@@ -173,9 +186,8 @@ esp_err_t Storage_initFile(){
 		ESP_LOGI(TAG, "File not present, formating...");
 		Storage_erase(Storage_data_d.MasterKey);
 
-		f_meas = fopen(Storage_data_d.path, "a+");
+		Storage_openFile();
 		ESP_LOGI(TAG, "File created successfully");
-		//fclose(f_meas);
 
 		ret = ESP_OK;
 	}
@@ -183,9 +195,8 @@ esp_err_t Storage_initFile(){
 		ESP_LOGW(TAG, "File present but empty, formating...");
 
 		Storage_erase(Storage_data_d.MasterKey);
-		f_meas = fopen(Storage_data_d.path, "a+");
+		Storage_openFile();
 		ESP_LOGI(TAG, "File created successfully");
-		//fclose(f_meas);
 
 		ret = ESP_OK;
 	}
@@ -196,6 +207,28 @@ esp_err_t Storage_initFile(){
 
 	return ret;
 }
+
+/*!
+ * @brief Open the log file for the whole logging. Stdio buffering is off, packets are buffered in
+ * `meas_buf` and written at commit points only.
+ * @return `ESP_OK` if opened
+ * @return `ESP_ERR_NOT_FOUND` otherwise.
+ */
+esp_err_t Storage_openFile(){
+	f_meas = fopen(Storage_data_d.path, "a");
+	if(f_meas == NULL){
+		ESP_LOGE(TAG, "Failed to open file for writing");
+		return ESP_ERR_NOT_FOUND;
+	}
+	setvbuf(f_meas, NULL, _IONBF, 0);
+
+	fseek(f_meas, 0L, SEEK_END);
+	meas_file_B    = ftell(f_meas);
+	meas_buf_len   = 0;
+	meas_commit_us = esp_timer_get_time();
+
+	return ESP_OK;
+}
 #endif
 
 
@@ -217,8 +250,11 @@ esp_err_t Storage_erase(uint32_t key){
 #elif defined(CONFIG_FS_LITTLEFS)
         return Storage_erase_Littlefs(key);
 
-#elif defined(CONFIG_FS_SPIFFS)
-    	return SimpleFS_formatMemory(SFS_MAGIC_KEY);
+#elif defined(CONFIG_FS_SIMPLEFS)
+    	if(key != Storage_data_d.MasterKey){
+    		return ESP_FAIL;
+    	}
+    	return SimpleFS_formatMemory(SFS_MAGIC_KEY, SFS_FORMAT_RANGE);
 #endif
 
     return ESP_FAIL;
@@ -269,11 +305,8 @@ esp_err_t Storage_writePacket(void * buf, uint16_t len){
 		return ESP_FAIL;
 	}
 
-#if defined(CONFIG_FS_SPIFFS)
-		res = Storage_writePacket_Spiffs(buf, len);
-
-#elif defined(CONFIG_FS_LITTLEFS)
-		res = Storage_writePacket_Littlefs(buf, len);
+#if defined(CONFIG_FS_SPIFFS) || defined(CONFIG_FS_LITTLEFS)
+		res = Storage_writePacket_File(buf, len);
 
 #elif defined(CONFIG_FS_SIMPLEFS)
 		res = SimpleFS_appendPacket(buf, len);
@@ -283,71 +316,94 @@ esp_err_t Storage_writePacket(void * buf, uint16_t len){
 }
 
 /*!
- * @brief Write packet of given size in spiffs
+ * @brief Append packet to the log file of spiffs or littlefs. The file stays open, packets are collected
+ * in a RAM buffer, which is written when full. Every `CONFIG_KPPTR_STORAGE_COMMIT_MS` the buffer is
+ * written and the file synced (commit) - power failure loses at most data of one commit period.
+ * Sync is the expensive part: littlefs copies the partly filled last block on the next write.
  * @param buff
  * Pointer to a buffer
  * @param len
  * Length of buffer in Bytes
- * @return `ESP_OK` if initialized
- * @return `ESP_ERR_NOT_FOUND` if file is not found
+ * @return `ESP_OK` if packet is buffered
+ * @return `ESP_ERR_NOT_FOUND` if file is not open
+ * @return `ESP_FAIL` if full buffer can not be written, packet is not stored
  */
-#if defined(CONFIG_FS_SPIFFS)
-esp_err_t Storage_writePacket_Spiffs(void * buf, uint16_t len){
+#if defined(CONFIG_FS_SPIFFS) || defined(CONFIG_FS_LITTLEFS)
+esp_err_t Storage_writePacket_File(void * buf, uint16_t len){
+	ESP_RETURN_ON_FALSE(len <= sizeof(meas_buf), ESP_ERR_INVALID_SIZE, TAG, "Packet bigger than write buffer");
 
-    FILE* f = fopen(Storage_data_d.path, "a");
+	if(meas_file_lock)
+		return ESP_OK;
 
-    if(f == NULL){
-    	ESP_LOGE(TAG, "Failed to open file for writing");
+    if(f_meas == NULL){
+        ESP_LOGE(TAG, "Failed to open file for writing");
         return ESP_ERR_NOT_FOUND;
     }
-	
-    if(fwrite(buf, len, 1, f) != 1){
-		ESP_LOGE(TAG,"File write failed");
-		return ESP_FAIL;
-	}
-    
-	if(fclose(f) != 0){
+
+    // Full buffer ends on a buffer aligned file offset, so the writes stay aligned to FS pages
+    uint32_t buf_end = sizeof(meas_buf) - (meas_file_B % sizeof(meas_buf));
+    uint32_t n = MIN(len, buf_end - meas_buf_len);
+
+    memcpy(&meas_buf[meas_buf_len], buf, n);
+    meas_buf_len += n;
+
+    if(meas_buf_len == buf_end){
+    	if(Storage_writeBuffer() != ESP_OK){
+    		meas_buf_len -= n;	// Packet not stored, buffer is retried with the next one
+    		return ESP_FAIL;
+    	}
+    	memcpy(meas_buf, (uint8_t *)buf + n, len - n);
+    	meas_buf_len = len - n;
+    }
+
+    // Time commit point - bounds the data lost on power failure
+    if((esp_timer_get_time() - meas_commit_us) >= (CONFIG_KPPTR_STORAGE_COMMIT_MS * 1000LL)){
+    	if(Storage_commitFile() != ESP_OK){
+    		ESP_LOGE(TAG, "Commit failed, data kept in buffer");
+    	}
+    }
+
+	return ESP_OK;
+}
+
+/*!
+ * @brief Write buffered packets to the log file, without sync.
+ * @return `ESP_OK` if written
+ * @return `ESP_FAIL` otherwise, buffer is kept.
+ */
+esp_err_t Storage_writeBuffer(){
+	if((meas_buf_len == 0) || (f_meas == NULL))
+		return ESP_OK;
+
+	if(fwrite(meas_buf, meas_buf_len, 1, f_meas) != 1){
 		ESP_LOGE(TAG,"File write failed");
 		return ESP_FAIL;
 	}
 
+	meas_file_B += meas_buf_len;
+	meas_buf_len = 0;
+
 	return ESP_OK;
 }
-#endif
 
 /*!
- * @brief Write packet of given size in littlefs
- * @param buff
- * Pointer to a buffer
- * @param len
- * Length of buffer in Bytes
- * @return `ESP_OK` if initialized
- * @return `ESP_ERR_NOT_FOUND` if file is not found
+ * @brief Write buffered packets to the log file and sync it to flash.
+ * @return `ESP_OK` if data is on flash
+ * @return `ESP_FAIL` otherwise.
  */
-#if defined(CONFIG_FS_LITTLEFS)
-esp_err_t Storage_writePacket_Littlefs(void * buf, uint16_t len){
-	ESP_RETURN_ON_FALSE(!(len % CONFIG_LITTLEFS_WRITE_SIZE), ESP_ERR_INVALID_SIZE,
-			TAG, "Wrong packet size. Must be multiple of %i", CONFIG_LITTLEFS_WRITE_SIZE);
+esp_err_t Storage_commitFile(){
+	meas_commit_us = esp_timer_get_time();
 
-    //f_meas = fopen(Storage_data_d.path, "a+");
-
-	if(meas_file_lock)
+	if(f_meas == NULL)
 		return ESP_OK;
 
-    if(f_meas == NULL){
-        ESP_LOGE(TAG, "Failed to open file for writing");
-        return ESP_ERR_NOT_FOUND;
-    }
+	if(Storage_writeBuffer() != ESP_OK)
+		return ESP_FAIL;
 
-    if(fwrite(buf, len, 1, f_meas) != 1){
-		ESP_LOGE(TAG,"File write failed");
+	if(fsync(fileno(f_meas)) != 0){
+		ESP_LOGE(TAG,"File sync failed");
 		return ESP_FAIL;
 	}
-    
-//	if(fclose(f_meas) != 0){
-//		ESP_LOGE(TAG,"File write failed");
-//		return ESP_FAIL;
-//	}
 
 	return ESP_OK;
 }
@@ -355,6 +411,7 @@ esp_err_t Storage_writePacket_Littlefs(void * buf, uint16_t len){
 
 #if defined(CONFIG_FS_SPIFFS) || defined(CONFIG_FS_LITTLEFS)
 esp_err_t Storage_blockMeasFile(){
+	Storage_commitFile();
 	meas_file_lock = 1;
 	if(fclose(f_meas) != 0){
 		ESP_LOGE(TAG,"File write failed");
@@ -365,7 +422,7 @@ esp_err_t Storage_blockMeasFile(){
 }
 
 esp_err_t Storage_unblockMeasFile(){
-	f_meas = fopen(Storage_data_d.path, "a+");
+	Storage_openFile();
 	meas_file_lock = 0;
 
 	return ESP_OK;
@@ -482,13 +539,24 @@ size_t Storage_getFreeMem()
     	return Storage_getFreeMem_Littlefs();
 
 #elif defined(CONFIG_FS_SIMPLEFS)
-    	ESP_LOGE(TAG, "getFreeMem not implemented for SimpleFS!");
-    	return ESP_FAIL;
+    	return SimpleFS_getErasedAhead() / 1024;	// Only erased space can be written without a stall
 #endif
 
      return ESP_FAIL;
 }
 
+/*!
+ * @brief Allow or block erasing ahead of the data in background. Block erase stalls both cores,
+ * so it should be blocked in flight.
+ * @param enable
+ */
+void Storage_setBackgroundErase(bool enable)
+{
+#if defined(CONFIG_FS_SIMPLEFS)
+	SimpleFS_setBackgroundErase(enable);
+#endif
+}
+
 /*!
  * @brief Get amount of free memory from spiifs
  * @return Amount of free memory available in `kB`.
@@ -27,6 +27,7 @@ esp_err_t Storage_erase(uint32_t key);
 esp_err_t Storage_writePacket(void * buf, uint16_t len);
 esp_err_t Storage_readFile(void * buf);
 size_t Storage_getFreeMem(void);
+void Storage_setBackgroundErase(bool enable);
 esp_err_t Storage_blockMeasFile();
 esp_err_t Storage_unblockMeasFile();
 
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "sdkconfig.h"
+#include "BOARD.h"
+#include "Telemetry_driver.h"
+#include "Stream_driver.h"
+
+#define STREAM_UART_PORT	UART_NUM_1
+#define STREAM_UART_TX_BUF	(sizeof(Stream_frame_t) * 16)	// Driver ring buffer, the ISR refills the FIFO from it
+
+static const char *TAG = "Stream";
+
+static TLM_sink_t stream_sink = -1;
+
+static esp_err_t stream_encode(const TLM_sample_t * sample, void * ctx);
+static void stream_task(void *pvParameter);
+
+esp_err_t Stream_init(void){
+	uart_config_t uart_config = {
+		.baud_rate = CONFIG_KPPTR_UART_STREAM_BAUD,
+		.data_bits = UART_DATA_8_BITS,
+		.parity    = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+		.source_clk = UART_SCLK_APB,
+	};
+
+	// Installed from core 0 - the UART ISR stays off the core of the main task
+	if((uart_driver_install(STREAM_UART_PORT, 256, STREAM_UART_TX_BUF, 0, NULL, 0) != ESP_OK) ||
+	   (uart_param_config(STREAM_UART_PORT, &uart_config) != ESP_OK) ||
+	   (uart_set_pin(STREAM_UART_PORT, UART_EXT_OUT, UART_EXT_IN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK)){
+		ESP_LOGE(TAG, "UART init fail");
+		return ESP_FAIL;
+	}
+
+	// Every sample counts - a full queue drops the new one and the host sees the jump of seq
+	TLM_sinkConfig_t sink_config = {
+		.name     = "uart",
+		.rate_hz  = 0,
+		.depth    = STREAM_QUEUE_SIZE,
+		.overflow = TLM_DROP_NEWEST,
+		.encode   = stream_encode,
+	};
+	stream_sink = TLM_addSink(&sink_config);
+	if(stream_sink < 0){
+		ESP_LOGE(TAG, "Failed to register sink");
+		return ESP_FAIL;
+	}
+
+	if(xTaskCreatePinnedToCore(&stream_task, "task_kpptr_stream", 1024*3, NULL, configMAX_PRIORITIES - 6, NULL, 0) != pdPASS){
+		ESP_LOGE(TAG, "Failed to create sender task");
+		return ESP_FAIL;
+	}
+
+	ESP_LOGI(TAG, "Stream ready, %d baud", CONFIG_KPPTR_UART_STREAM_BAUD);
+	return ESP_OK;
+}
+
+static esp_err_t stream_encode(const TLM_sample_t * sample, void * ctx){
+	static Stream_frame_t frame = {
+		.sync = STREAM_SYNC,
+		.type = STREAM_TYPE_DATA,
+		.len  = sizeof(DataPackage_t),
+	};
+
+	frame.seq  = (uint16_t)sample->seq;
+	frame.data = sample->data;
+	frame.crc  = esp_crc16_le(UINT16_MAX, (uint8_t const *)&frame, sizeof(Stream_frame_t) - sizeof(frame.crc));
+
+	// Blocks only this task while the driver ring buffer is full - the publisher sees a full queue instead
+	if(uart_write_bytes(STREAM_UART_PORT, (const char *)&frame, sizeof(Stream_frame_t)) < 0){
+		ESP_LOGW(TAG, "UART write fail");
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+static void stream_task(void *pvParameter){
+	uint32_t dropped_reported = 0;
+	int64_t report_time_us = 0;
+
+	while(1){
+		TLM_service(stream_sink, portMAX_DELAY);
+
+		int64_t now = esp_timer_get_time();
+		uint32_t dropped = TLM_getStats(stream_sink).dropped;
+		if((dropped != dropped_reported) && ((now - report_time_us) > 1000000)){
+			ESP_LOGW(TAG, "%u samples dropped - baudrate too low for the sample rate?", dropped - dropped_reported);
+			dropped_reported = dropped;
+			report_time_us = now;
+		}
+	}
+}
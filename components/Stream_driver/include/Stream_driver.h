@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+#include "DataManager.h"
+
+#define STREAM_QUEUE_SIZE	32		/*!< Samples queued for the sender task - 320 ms at 100 Hz */
+#define STREAM_SYNC			0xA55A	/*!< Frame preamble (little endian: 5A A5) */
+#define STREAM_TYPE_DATA	0x01	/*!< Stream_frame_t::type - DataPackage_t */
+
+/**
+ * @brief Binary UART stream frame: header + one sample + CRC16 of header and payload.
+ * A host resyncs on STREAM_SYNC and confirms with the CRC, a jump of seq is a sample lost on the device.
+ */
+typedef struct __attribute__((__packed__)){
+	uint16_t sync;					/*!< STREAM_SYNC */
+	uint8_t type;					/*!< STREAM_TYPE_DATA */
+	uint8_t len;					/*!< Payload length, sizeof(DataPackage_t) */
+	uint16_t seq;					/*!< Sample counter (TLM_sample_t::seq), also counts samples dropped on a full queue */
+	DataPackage_t data;				/*!< Sample */
+	uint16_t crc;					/*!< CRC16 (esp_crc16_le) of all previous bytes */
+} Stream_frame_t;
+
+/**
+ * @brief Initialize the external UART at CONFIG_KPPTR_UART_STREAM_BAUD, register the stream as a telemetry sink
+ * receiving every sample and start the sender task. Call after TLM_init().
+ * Statistics are the ones of the "uart" sink, see TLM_statsCreateJSON().
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ */
+esp_err_t Stream_init(void);
@@ -1,79 +1,119 @@
 #include <stdio.h>
-//#include "freertos/FreeRTOS.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "LED_driver.h"
 #include "SysMgr.h"
 
+#define SYSMGR_EVT_CHECKOUT		BIT0	// Checkout or arming state changed
+#define SYSMGR_EVT_RECOVERY		BIT1	// Component with a heartbeat fault is alive again
+
 static const char *TAG = "SysMgr";
 
-QueueHandle_t queue_SysMgrCheckout = NULL;
-QueueHandle_t queue_SysMgrArming;
+static EventGroupHandle_t sysmgr_events = NULL;
+static StaticEventGroup_t sysmgr_events_struct;
+static portMUX_TYPE sysmgr_fault_lock = portMUX_INITIALIZER_UNLOCKED;
 
-sysmgr_checkout_status_t 	sysmgr_checkout_status_d;
-sysmgr_arming_state_t		sysmgr_arming_state_d;
+// Written by the components with single stores - valid before SysMgr_init()
+static volatile sysmgr_checkout_status_t sysmgr_checkout_status_d = { .table = {
+		check_void, check_void, check_void, check_void, check_void, check_void, check_void, check_void } };
+static volatile sysmgr_arming_state_t sysmgr_arming_state_d = system_dissarmed;
 
-esp_err_t SysMgr_init(){
-	sysmgr_checkout_status_d.sysmgr  = check_void;
-	sysmgr_checkout_status_d.main 	 = check_void;
-	sysmgr_checkout_status_d.storage = check_void;
-	sysmgr_checkout_status_d.lora 	 = check_void;
-	sysmgr_checkout_status_d.analog  = check_void;
-	sysmgr_checkout_status_d.utils 	 = check_void;
-	sysmgr_checkout_status_d.web 	 = check_void;
-	sysmgr_checkout_status_d.gnss 	 = check_void;
-
-	queue_SysMgrCheckout = xQueueCreate( 100, sizeof( sysmgr_checkout_msg_t ) );
-	if(queue_SysMgrCheckout == 0){
-		sysmgr_checkout_status_d.sysmgr  = check_fail;
-		return ESP_FAIL;
-	}
+static sysmgr_heartbeat_t	sysmgr_heartbeat_d[SYSMGR_CHECKOUT_NUM];
+sysmgr_taskmon_t			sysmgr_taskmon_d[SYSMGR_TASKMON_NUM];
 
-	queue_SysMgrArming 	 = xQueueCreate( 100, sizeof( sysmgr_arming_state_t ) );
-	if(queue_SysMgrArming == 0){
-		sysmgr_checkout_status_d.sysmgr  = check_fail;
+// Component of every monitored task - its heartbeat is the loop start
+static const DRAM_ATTR sysmgr_checkout_component_t taskmon_component[SYSMGR_TASKMON_NUM] = {checkout_main, checkout_storage, checkout_utils, checkout_analog};
+
+// Histogram bin upper edges in percent of the nominal period - execution time fills the low bins, period the ones around 100%
+static const DRAM_ATTR uint16_t taskmon_bin_edge[SYSMGR_TASKMON_BINS] = {10, 25, 50, 90, 110, 150, 200, UINT16_MAX};
+
+esp_err_t SysMgr_init(){
+	sysmgr_events = xEventGroupCreateStatic(&sysmgr_events_struct);
+	if(sysmgr_events == NULL){
+		sysmgr_checkout_status_d.sysmgr = check_fail;
 		return ESP_FAIL;
 	}
 
-	sysmgr_arming_state_d 			 = system_dissarmed;
-	sysmgr_checkout_status_d.sysmgr  = check_ready;
+	sysmgr_checkout_status_d.sysmgr = check_ready;
 	return ESP_OK;
 }
 
 
 esp_err_t SysMgr_checkout(sysmgr_checkout_component_t component, sysmgr_checkout_state_t state){
-	sysmgr_checkout_msg_t tmp;
+	sysmgr_checkout_status_d.table[component] = state;
 
-	tmp.component = component;
-	tmp.state 	  = state;
+	if(sysmgr_events != NULL)
+		xEventGroupSetBits(sysmgr_events, SYSMGR_EVT_CHECKOUT);
 
-	while(queue_SysMgrCheckout == NULL) {}	//wait for SysMgr to init
+	return ESP_OK;
+}
+
+// Fault detection - the lock orders it against the recovery in SysMgr_heartbeat()
+static void SysMgr_heartbeatCheck(sysmgr_checkout_component_t component, uint32_t now){
+	sysmgr_heartbeat_t *hb = &sysmgr_heartbeat_d[component];
+	uint8_t fault = sysmgr_fault_none;
 
-	if(xQueueSend(queue_SysMgrCheckout, (void *)&tmp, 0) != pdTRUE){
-		ESP_LOGE(TAG, "SysMgr Checkout Queue too full to write new Msg!");
+	if((hb->period_us == 0) || (hb->fault != sysmgr_fault_none))
+		return;
+
+	portENTER_CRITICAL(&sysmgr_fault_lock);
+	if((uint32_t)(now - hb->beat_us) > hb->timeout_us){
+		fault = hb->running ? sysmgr_fault_overrun : sysmgr_fault_stall;
+		hb->fault_us = now;
+		hb->fault = fault;
 	}
+	portEXIT_CRITICAL(&sysmgr_fault_lock);
 
-	return ESP_OK;
+	if(fault == sysmgr_fault_overrun){
+		hb->overruns++;
+		ESP_LOGW(TAG, "Component %d - overrun, no heartbeat for %u ms", component, (now - hb->beat_us)/1000);
+	} else if(fault == sysmgr_fault_stall){
+		hb->stalls++;
+		ESP_LOGW(TAG, "Component %d - stall, no heartbeat for %u ms", component, (now - hb->beat_us)/1000);
+	}
 }
 
-esp_err_t SysMgr_update(){
-	sysmgr_checkout_msg_t tmp;
-	while(xQueueReceive(queue_SysMgrCheckout, &tmp, 1)){
-		sysmgr_checkout_status_d.table[tmp.component] = tmp.state;
+esp_err_t SysMgr_update(TickType_t wait){
+	static uint8_t faults_prev = 0;
+	EventBits_t events = 0;
+
+	if(sysmgr_events != NULL){
+		events = xEventGroupWaitBits(sysmgr_events, SYSMGR_EVT_CHECKOUT | SYSMGR_EVT_RECOVERY, pdTRUE, pdFALSE, wait);
+	} else {
+		vTaskDelay(wait);
 	}
 
-	while(xQueueReceive(queue_SysMgrArming, &sysmgr_arming_state_d, 1)) {}
+	uint32_t now = (uint32_t)esp_timer_get_time();
+	for(uint8_t i=0; i<SYSMGR_CHECKOUT_NUM; i++){
+		SysMgr_heartbeatCheck(i, now);
+	}
+
+	if(events & SYSMGR_EVT_RECOVERY){
+		uint8_t recovered = faults_prev & ~SysMgr_getFaults();
+		for(uint8_t i=0; i<SYSMGR_CHECKOUT_NUM; i++){
+			if(recovered & (1 << i))
+				ESP_LOGI(TAG, "Component %d - recovered in %u ms", i, sysmgr_heartbeat_d[i].recovery_last_us/1000);
+		}
+	}
+	faults_prev = SysMgr_getFaults();
 
 	return ESP_OK;
 }
 
 sysmgr_checkout_state_t SysMgr_getCheckoutStatus(){
-	uint8_t components_to_check = sizeof(sysmgr_checkout_status_t) / sizeof(sysmgr_checkout_state_t);
+	uint8_t components_to_check = SYSMGR_CHECKOUT_NUM;
 	uint8_t sum = 0;
 
 	while(components_to_check--){
-		if(sysmgr_checkout_status_d.table[components_to_check] == 0)
+		sysmgr_checkout_state_t state = SysMgr_getComponentState(components_to_check);
+		if(state == 0)
 			return check_fail;
-		sum = sum | sysmgr_checkout_status_d.table[components_to_check];
+		sum = sum | state;
 	}
 
 	if(sum & 0x04)
@@ -88,13 +128,17 @@ sysmgr_checkout_state_t SysMgr_getCheckoutStatus(){
 	return check_fail;
 }
 sysmgr_checkout_state_t SysMgr_getComponentState(sysmgr_checkout_component_t components_to_check){
+	if(sysmgr_heartbeat_d[components_to_check].fault != sysmgr_fault_none)
+		return check_fail;		// Reported ready, but hangs
+
 	return sysmgr_checkout_status_d.table[components_to_check];
 }
 
 esp_err_t SysMgr_setArm(sysmgr_arming_state_t state){
-	if(xQueueSend(queue_SysMgrArming, (void *)&state, 0) != pdTRUE){
-		ESP_LOGE(TAG, "SysMgr Arming Queue too full to write new Msg!");
-	}
+	sysmgr_arming_state_d = state;
+
+	if(sysmgr_events != NULL)
+		xEventGroupSetBits(sysmgr_events, SYSMGR_EVT_CHECKOUT);
 
 	return ESP_OK;
 }
@@ -102,3 +146,122 @@ esp_err_t SysMgr_setArm(sysmgr_arming_state_t state){
 sysmgr_arming_state_t SysMgr_getArm(){
 	return sysmgr_arming_state_d;
 }
+
+//---------------------------------- Heartbeats ---------------------------------
+void SysMgr_heartbeatInit(sysmgr_checkout_component_t component, uint32_t period_ms){
+	sysmgr_heartbeat_t *hb = &sysmgr_heartbeat_d[component];
+	uint32_t timeout_ms = period_ms * SYSMGR_HEARTBEAT_MISSES;
+
+	memset(hb, 0, sizeof(sysmgr_heartbeat_t));
+	hb->beat_us    = (uint32_t)esp_timer_get_time();
+	hb->timeout_us = ((timeout_ms > SYSMGR_HEARTBEAT_MIN_MS) ? timeout_ms : SYSMGR_HEARTBEAT_MIN_MS) * 1000;
+	hb->period_us  = period_ms * 1000;		// Last - enables the check
+}
+
+void IRAM_ATTR SysMgr_heartbeat(sysmgr_checkout_component_t component){
+	sysmgr_heartbeat_t *hb = &sysmgr_heartbeat_d[component];
+	uint32_t now = (uint32_t)esp_timer_get_time();
+
+	hb->beat_us = now;
+	if(hb->fault == sysmgr_fault_none)
+		return;
+
+	// Rare path - alive again after a detected fault
+	portENTER_CRITICAL(&sysmgr_fault_lock);
+	uint32_t recovery = now - hb->fault_us;
+	hb->fault = sysmgr_fault_none;
+	portEXIT_CRITICAL(&sysmgr_fault_lock);
+
+	hb->recovery_last_us = recovery;
+	if(recovery > hb->recovery_max_us)
+		hb->recovery_max_us = recovery;
+	xEventGroupSetBits(sysmgr_events, SYSMGR_EVT_RECOVERY);
+}
+
+const sysmgr_heartbeat_t * SysMgr_getHeartbeat(sysmgr_checkout_component_t component){
+	return &sysmgr_heartbeat_d[component];
+}
+
+uint8_t SysMgr_getFaults(){
+	uint8_t faults = 0;
+
+	for(uint8_t i=0; i<SYSMGR_CHECKOUT_NUM; i++){
+		if(sysmgr_heartbeat_d[i].fault != sysmgr_fault_none)
+			faults |= (1 << i);
+	}
+	return faults;
+}
+
+//---------------------------------- Periodic task monitor ---------------------------------
+static uint8_t IRAM_ATTR SysMgr_taskMonitorBin(uint32_t time_us, uint32_t period_us){
+	uint32_t percent = (uint32_t)(((uint64_t)time_us * 100) / period_us);
+	uint8_t bin = 0;
+
+	while((bin < (SYSMGR_TASKMON_BINS - 1)) && (percent >= taskmon_bin_edge[bin]))
+		bin++;
+
+	return bin;
+}
+
+void SysMgr_taskMonitorInit(sysmgr_taskmon_id_t task, uint32_t period_ms, uint32_t deadline_ms){
+	sysmgr_taskmon_t *mon = &sysmgr_taskmon_d[task];
+
+	memset(mon, 0, sizeof(sysmgr_taskmon_t));
+	mon->period_us   = period_ms * 1000;
+	mon->deadline_us = deadline_ms * 1000;
+	SysMgr_heartbeatInit(taskmon_component[task], period_ms);
+}
+
+void IRAM_ATTR SysMgr_taskMonitorStart(sysmgr_taskmon_id_t task){
+	sysmgr_taskmon_t *mon = &sysmgr_taskmon_d[task];
+	int64_t now = esp_timer_get_time();
+
+	SysMgr_heartbeat(taskmon_component[task]);
+	sysmgr_heartbeat_d[taskmon_component[task]].running = 1;
+	if(mon->release_us == 0){
+		mon->release_us = now;
+		mon->start_us = now;
+		return;
+	}
+
+	uint32_t period = (uint32_t)(now - mon->start_us);
+	mon->period_hist[SysMgr_taskMonitorBin(period, mon->period_us)]++;
+	if(period > mon->period_max_us)
+		mon->period_max_us = period;
+
+	// vTaskDelayUntil() keeps releases on the nominal grid, a late loop is followed by shorter ones
+	// Producer driven loops (storage) run slower than period_us when the log is decimated or the producer stalls -
+	// resync, otherwise the release falls further behind and every later loop counts as a miss
+	mon->release_us += mon->period_us;
+	if((now - mon->release_us) > mon->period_us)
+		mon->release_us = now;
+	mon->start_us = now;
+}
+
+void IRAM_ATTR SysMgr_taskMonitorEnd(sysmgr_taskmon_id_t task){
+	sysmgr_taskmon_t *mon = &sysmgr_taskmon_d[task];
+	int64_t now = esp_timer_get_time();
+
+	sysmgr_heartbeat_d[taskmon_component[task]].running = 0;
+	if(mon->release_us == 0)
+		return;
+
+	uint32_t exec = (uint32_t)(now - mon->start_us);
+	mon->exec_hist[SysMgr_taskMonitorBin(exec, mon->period_us)]++;
+	if(exec > mon->exec_max_us)
+		mon->exec_max_us = exec;
+
+	if((now - mon->release_us) > mon->deadline_us){
+		mon->deadline_miss++;
+		ESP_LOGD(TAG, "Task %d deadline miss - %lld us after release", task, now - mon->release_us);
+	}
+	mon->cycles++;
+}
+
+const sysmgr_taskmon_t * IRAM_ATTR SysMgr_getTaskMonitor(sysmgr_taskmon_id_t task){
+	return &sysmgr_taskmon_d[task];
+}
+
+uint16_t SysMgr_getTaskMonitorBinEdge(uint8_t bin){
+	return taskmon_bin_edge[bin];
+}
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define SYSMGR_TASKMON_BINS		8		/*!< Histogram bins, edges in SysMgr.c (percent of nominal period) */
+#define SYSMGR_HEARTBEAT_MISSES	5		/*!< Heartbeat timeout in expected periods */
+#define SYSMGR_HEARTBEAT_MIN_MS	500		/*!< Shortest heartbeat timeout - a blocking Flash erase stalls both cores for hundreds of ms */
 
 /**
  * @brief Component IDs
@@ -13,7 +20,8 @@ typedef enum{
 	checkout_analog,
 	checkout_utils,
 	checkout_web,
-	checkout_gnss
+	checkout_gnss,
+	SYSMGR_CHECKOUT_NUM
 } sysmgr_checkout_component_t;
 
 
@@ -39,15 +47,6 @@ typedef enum{
 } sysmgr_arming_state_t;
 
 
-/**
- * @brief Combined component ID and state
- *
- */
-typedef struct{
-	sysmgr_checkout_component_t component;
-	sysmgr_checkout_state_t		state;
-} sysmgr_checkout_msg_t;
-
 typedef union{
 	struct{
 		sysmgr_checkout_state_t sysmgr;
@@ -59,10 +58,77 @@ typedef union{
 		sysmgr_checkout_state_t web;
 		sysmgr_checkout_state_t gnss;
 	};
-	sysmgr_checkout_state_t table[8];
+	sysmgr_checkout_state_t table[SYSMGR_CHECKOUT_NUM];
 }sysmgr_checkout_status_t;
 
 
+/**
+ * @brief Monitored periodic tasks
+ *
+ */
+typedef enum{
+	taskmon_main,
+	taskmon_storage,
+	taskmon_utils,
+	taskmon_analog,
+	SYSMGR_TASKMON_NUM
+} sysmgr_taskmon_id_t;
+
+
+/**
+ * @brief Loop timing statistics of one periodic task
+ *
+ * Period is measured between consecutive SysMgr_taskMonitorStart() calls, execution time from
+ * SysMgr_taskMonitorStart() to SysMgr_taskMonitorEnd(). A deadline miss is a loop that ends later
+ * than deadline_us after its release (release times advance by period_us from the first start, a loop
+ * starting more than one period after its release resyncs the release to its start).
+ */
+typedef struct{
+	uint32_t period_us;							/*!< Nominal period */
+	uint32_t deadline_us;						/*!< Release to end of loop limit */
+	int64_t  release_us;						/*!< Release time of the current loop, 0 - not started yet */
+	int64_t  start_us;							/*!< Start time of the current loop */
+	uint32_t cycles;							/*!< Completed loops */
+	uint32_t deadline_miss;						/*!< Loops that ended after their deadline */
+	uint32_t period_max_us;						/*!< Worst case period */
+	uint32_t exec_max_us;						/*!< Worst case execution time */
+	uint32_t period_hist[SYSMGR_TASKMON_BINS];	/*!< Period histogram */
+	uint32_t exec_hist[SYSMGR_TASKMON_BINS];	/*!< Execution time histogram */
+} sysmgr_taskmon_t;
+
+
+/**
+ * @brief Health of a component with a heartbeat
+ *
+ */
+typedef enum{
+	sysmgr_fault_none,
+	sysmgr_fault_stall,		/*!< No heartbeat while waiting - blocked or starved */
+	sysmgr_fault_overrun	/*!< No heartbeat inside the loop body - hung or runaway execution */
+} sysmgr_fault_t;
+
+
+/**
+ * @brief Heartbeat statistics of one component
+ *
+ * A component with a heartbeat is in fault when it did not call SysMgr_heartbeat() (or SysMgr_taskMonitorStart()
+ * of its task) for SYSMGR_HEARTBEAT_MISSES expected periods. The fault is detected by SysMgr_update() and ends
+ * with the next heartbeat. Times are the low 32 bits of esp_timer - single word, read without a lock.
+ */
+typedef struct{
+	uint32_t period_us;							/*!< Expected heartbeat period, 0 - not monitored */
+	uint32_t timeout_us;						/*!< Fault after this long without a heartbeat */
+	volatile uint32_t beat_us;					/*!< Last heartbeat */
+	volatile uint8_t  running;					/*!< Inside the loop body of the task monitor */
+	volatile uint8_t  fault;					/*!< Current ::sysmgr_fault_t */
+	uint32_t fault_us;							/*!< Detection of the current or last fault */
+	uint32_t stalls;							/*!< Stall faults */
+	uint32_t overruns;							/*!< Overrun faults */
+	uint32_t recovery_last_us;					/*!< Fault detection to the next heartbeat, last fault */
+	uint32_t recovery_max_us;					/*!< Worst case recovery */
+} sysmgr_heartbeat_t;
+
+
 /**
 * @brief Initializes system manager component
 * @return esp_err_t
@@ -70,9 +136,87 @@ typedef union{
 *	- ESP_FAIL: Fail
 */
 esp_err_t SysMgr_init();
+
+/**
+* @brief Reports component state - a single store into the state table, wakes SysMgr_update(). Never blocks.
+* @param[in] component Component
+* @param[in] state New state
+* @return esp_err_t ESP_OK
+*/
 esp_err_t SysMgr_checkout(sysmgr_checkout_component_t component, sysmgr_checkout_state_t state);
-esp_err_t SysMgr_update();
+
+/**
+* @brief Waits for a checkout, arming or recovery event, then checks heartbeats of all components
+* @param[in] wait Maximum wait in ticks - heartbeats are checked at least this often
+* @return esp_err_t ESP_OK
+*/
+esp_err_t SysMgr_update(TickType_t wait);
+
+/**
+* @brief Returns combined state of all components, a component in heartbeat fault counts as check_fail
+* @return sysmgr_checkout_state_t
+*/
 sysmgr_checkout_state_t SysMgr_getCheckoutStatus();
 sysmgr_checkout_state_t SysMgr_getComponentState(sysmgr_checkout_component_t components_to_check);
 esp_err_t SysMgr_setArm(sysmgr_arming_state_t state);
 sysmgr_arming_state_t SysMgr_getArm();
+
+/**
+* @brief Starts heartbeat monitoring of a component, call before its task loop
+* @param[in] component Component
+* @param[in] period_ms Expected heartbeat period
+*/
+void SysMgr_heartbeatInit(sysmgr_checkout_component_t component, uint32_t period_ms);
+
+/**
+* @brief Heartbeat of a component - one store, no queue or event traffic unless the component recovers from a fault
+* @param[in] component Component
+*/
+void SysMgr_heartbeat(sysmgr_checkout_component_t component);
+
+/**
+* @brief Returns heartbeat statistics of a component
+* @param[in] component Component
+* @return const sysmgr_heartbeat_t*
+*/
+const sysmgr_heartbeat_t * SysMgr_getHeartbeat(sysmgr_checkout_component_t component);
+
+/**
+* @brief Returns components in heartbeat fault
+* @return uint8_t Bit n set - component n in fault
+*/
+uint8_t SysMgr_getFaults();
+
+/**
+* @brief Sets up timing statistics and the heartbeat of a periodic task, call before the task loop
+* @param[in] task Monitored task
+* @param[in] period_ms Nominal loop period
+* @param[in] deadline_ms Allowed time from loop release to end of loop body
+*/
+void SysMgr_taskMonitorInit(sysmgr_taskmon_id_t task, uint32_t period_ms, uint32_t deadline_ms);
+
+/**
+* @brief Marks start of the loop body and emits the heartbeat of the task, call right after vTaskDelayUntil()
+* @param[in] task Monitored task
+*/
+void SysMgr_taskMonitorStart(sysmgr_taskmon_id_t task);
+
+/**
+* @brief Marks end of the loop body, updates histograms and deadline miss counter
+* @param[in] task Monitored task
+*/
+void SysMgr_taskMonitorEnd(sysmgr_taskmon_id_t task);
+
+/**
+* @brief Returns timing statistics of a periodic task
+* @param[in] task Monitored task
+* @return const sysmgr_taskmon_t*
+*/
+const sysmgr_taskmon_t * SysMgr_getTaskMonitor(sysmgr_taskmon_id_t task);
+
+/**
+* @brief Returns histogram bin upper edge
+* @param[in] bin Bin number
+* @return uint16_t Edge in percent of the nominal period, UINT16_MAX for the last bin
+*/
+uint16_t SysMgr_getTaskMonitorBinEdge(uint8_t bin);
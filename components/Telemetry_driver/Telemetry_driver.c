@@ -1,7 +1,238 @@
 #include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "cJSON.h"
 #include "Telemetry_driver.h"
 
-void func(void)
-{
+#define TLM_PRODUCER_BUFFERS	2		// Sample and envelope of one main loop
 
+typedef struct{
+	TLM_sinkConfig_t config;
+	int64_t period_us;					// 0 - every sample
+	int64_t next_us;					// Time of the next delivery
+	QueueHandle_t queue;				// TLM_sample_t pointers
+	TLM_sinkStats_t stats;
+} tlm_sink_t;
+
+static const char *TAG = "Telemetry";
+
+//--------------- Sample pool ----------------------
+static TLM_sample_t tlm_pool[TLM_POOL_SIZE];
+static QueueHandle_t queue_TLMFree;
+static StaticQueue_t queue_TLMFree_struct;
+static uint8_t queue_TLMFree_buf[ TLM_POOL_SIZE * sizeof(TLM_sample_t *) ];
+static portMUX_TYPE tlm_ref_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t tlm_published = 0;
+static uint32_t tlm_starved = 0;		// TLM_acquire() without a free buffer
+
+//--------------- Sinks ----------------------------
+static tlm_sink_t tlm_sinks[TLM_MAX_SINKS];
+static uint8_t tlm_sinks_num = 0;
+static uint16_t tlm_reserved = TLM_PRODUCER_BUFFERS;	// Buffers the registered sinks and the producer can hold
+
+esp_err_t TLM_init(void){
+	memset(tlm_pool, 0, sizeof(tlm_pool));
+
+	queue_TLMFree = xQueueCreateStatic( TLM_POOL_SIZE,
+							sizeof(TLM_sample_t *),
+							queue_TLMFree_buf,
+							&queue_TLMFree_struct);
+	if(queue_TLMFree == NULL){
+		ESP_LOGE(TAG, "Failed to create queue -> queue_TLMFree");
+		return ESP_FAIL;
+	}
+
+	for(uint16_t i=0; i<TLM_POOL_SIZE; i++){
+		TLM_sample_t * sample = &tlm_pool[i];
+		if(xQueueSend(queue_TLMFree, &sample, 0) != pdTRUE){
+			ESP_LOGE(TAG, "Failed to fill the pool!");
+			return ESP_FAIL;
+		}
+	}
+
+	ESP_LOGI(TAG, "Pool of %u samples ready", TLM_POOL_SIZE);
+	return ESP_OK;
+}
+
+TLM_sink_t TLM_addSink(const TLM_sinkConfig_t * config){
+	if((tlm_sinks_num >= TLM_MAX_SINKS) || (config->depth == 0) || (config->encode == NULL)){
+		ESP_LOGE(TAG, "Sink %s rejected", config->name);
+		return -1;
+	}
+
+	// A full pool would stall the producer - every buffer a sink can hold is reserved up front
+	if((tlm_reserved + config->depth + 1) > TLM_POOL_SIZE){
+		ESP_LOGE(TAG, "Sink %s does not fit in the pool (%u of %u reserved)", config->name, tlm_reserved, TLM_POOL_SIZE);
+		return -1;
+	}
+
+	tlm_sink_t * sink = &tlm_sinks[tlm_sinks_num];
+
+	memset(sink, 0, sizeof(tlm_sink_t));
+	sink->config = *config;
+	sink->period_us = (config->rate_hz > 0) ? (1000000LL / config->rate_hz) : 0;
+	sink->queue = xQueueCreate(config->depth, sizeof(TLM_sample_t *));
+	if(sink->queue == NULL){
+		ESP_LOGE(TAG, "Failed to create queue of sink %s", config->name);
+		return -1;
+	}
+
+	tlm_reserved += config->depth + 1;
+	ESP_LOGI(TAG, "Sink %s: %u Hz, depth %u", config->name, config->rate_hz, config->depth);
+	return tlm_sinks_num++;
+}
+
+TLM_sample_t * IRAM_ATTR TLM_acquire(void){
+	TLM_sample_t * sample = NULL;
+
+	if(xQueueReceive(queue_TLMFree, &sample, 0) != pdTRUE){
+		tlm_starved++;
+		return NULL;
+	}
+
+	sample->refs = 1;
+	return sample;
+}
+
+void IRAM_ATTR TLM_release(TLM_sample_t * sample){
+	uint8_t refs;
+
+	portENTER_CRITICAL(&tlm_ref_lock);
+	refs = --sample->refs;
+	portEXIT_CRITICAL(&tlm_ref_lock);
+
+	if(refs == 0){
+		xQueueSend(queue_TLMFree, &sample, 0);
+	}
+}
+
+static void IRAM_ATTR tlm_ref(TLM_sample_t * sample){
+	portENTER_CRITICAL(&tlm_ref_lock);
+	sample->refs++;
+	portEXIT_CRITICAL(&tlm_ref_lock);
+}
+
+// Rate limit, keeps the phase of the first delivery unless the sink was not due for more than a period
+static bool IRAM_ATTR tlm_due(tlm_sink_t * sink, int64_t time_us){
+	if(sink->period_us == 0)
+		return true;
+
+	if(time_us < sink->next_us)
+		return false;
+
+	sink->next_us += sink->period_us;
+	if(sink->next_us <= time_us)
+		sink->next_us = time_us + sink->period_us;
+	return true;
+}
+
+void IRAM_ATTR TLM_publish(TLM_sample_t * sample, uint32_t sinks){
+	tlm_published++;
+
+	for(uint8_t i=0; i<tlm_sinks_num; i++){
+		tlm_sink_t * sink = &tlm_sinks[i];
+
+		if(((sinks & TLM_SINK_BIT(i)) == 0) || !tlm_due(sink, sample->time_us))
+			continue;
+
+		sink->stats.published++;
+		tlm_ref(sample);
+		if(xQueueSend(sink->queue, &sample, 0) != pdTRUE){
+			TLM_sample_t * dropped = sample;
+
+			if(sink->config.overflow == TLM_DROP_OLDEST){
+				if(xQueueReceive(sink->queue, &dropped, 0) != pdTRUE)
+					dropped = NULL;					// Taken by the sink in the meantime
+				xQueueSend(sink->queue, &sample, 0);	// Single producer - the free slot stays free
+			}
+
+			if(dropped != NULL){
+				sink->stats.dropped++;
+				if(sink->config.on_drop != NULL)
+					sink->config.on_drop(dropped, sink->config.ctx);
+				TLM_release(dropped);
+			}
+		}
+
+		uint8_t depth = sink->config.depth - uxQueueSpacesAvailable(sink->queue);
+		if(depth > sink->stats.depth_max)
+			sink->stats.depth_max = depth;
+	}
+
+	TLM_release(sample);	// Producer reference
+}
+
+esp_err_t TLM_service(TLM_sink_t sink_id, TickType_t wait){
+	TLM_sample_t * sample;
+
+	if((sink_id < 0) || (sink_id >= tlm_sinks_num))
+		return ESP_ERR_INVALID_ARG;
+
+	tlm_sink_t * sink = &tlm_sinks[sink_id];
+	if(xQueueReceive(sink->queue, &sample, wait) != pdTRUE)
+		return ESP_ERR_TIMEOUT;
+
+	esp_err_t status = sink->config.encode(sample, sink->config.ctx);
+	if(status == ESP_OK){
+		sink->stats.delivered++;
+	} else {
+		sink->stats.errors++;
+	}
+
+	TLM_release(sample);
+	return status;
+}
+
+uint16_t TLM_waiting(TLM_sink_t sink_id){
+	if((sink_id < 0) || (sink_id >= tlm_sinks_num))
+		return 0;
+
+	return uxQueueMessagesWaiting(tlm_sinks[sink_id].queue);
+}
+
+TLM_sinkStats_t TLM_getStats(TLM_sink_t sink_id){
+	TLM_sinkStats_t stats;
+
+	memset(&stats, 0, sizeof(stats));
+	if((sink_id < 0) || (sink_id >= tlm_sinks_num))
+		return stats;
+
+	stats = tlm_sinks[sink_id].stats;
+	stats.depth = TLM_waiting(sink_id);
+	return stats;
+}
+
+char * TLM_statsCreateJSON(void){
+	char *string = NULL;
+	cJSON *json = cJSON_CreateObject();
+
+	cJSON_AddNumberToObject(json, "pool", TLM_POOL_SIZE);
+	cJSON_AddNumberToObject(json, "pool_free", uxQueueMessagesWaiting(queue_TLMFree));
+	cJSON_AddNumberToObject(json, "starved", tlm_starved);
+	cJSON_AddNumberToObject(json, "published", tlm_published);
+
+	cJSON *list = cJSON_CreateArray();
+	for(uint8_t i=0; i<tlm_sinks_num; i++){
+		TLM_sinkStats_t stats = TLM_getStats(i);
+		cJSON *sink = cJSON_CreateObject();
+
+		cJSON_AddStringToObject(sink, "name", tlm_sinks[i].config.name);
+		cJSON_AddNumberToObject(sink, "rate_hz", tlm_sinks[i].config.rate_hz);
+		cJSON_AddNumberToObject(sink, "published", stats.published);
+		cJSON_AddNumberToObject(sink, "delivered", stats.delivered);
+		cJSON_AddNumberToObject(sink, "dropped", stats.dropped);
+		cJSON_AddNumberToObject(sink, "errors", stats.errors);
+		cJSON_AddNumberToObject(sink, "depth", stats.depth);
+		cJSON_AddNumberToObject(sink, "depth_max", stats.depth_max);
+		cJSON_AddItemToArray(list, sink);
+	}
+	cJSON_AddItemToObject(json, "sinks", list);
+
+	string = cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return string;
 }
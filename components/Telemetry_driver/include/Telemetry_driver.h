@@ -1 +1,131 @@
-void func(void);
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "DataManager.h"
+
+#define TLM_MAX_SINKS		6
+#define TLM_POOL_SIZE		(DM_STORAGE_DEPTH + 48)		/*!< Sample buffers shared by all sinks, see ::TLM_addSink */
+#define TLM_SINK_BIT(sink)	(((sink) >= 0) ? (1UL << (sink)) : 0)	/*!< Mask of one sink, empty for a failed registration */
+#define TLM_ALL_SINKS		0xFFFFFFFFUL
+
+/**
+ * @brief Reference counted sample buffer. The producer fills it once, every sink gets a pointer to the same buffer
+ * and it returns to the pool when the last sink released it.
+ */
+typedef struct{
+	DataPackage_t data;			/*!< Sample, gap marker or envelope. */
+	int64_t time_us;			/*!< Full time of the sample, DataPackage_t::sys_time is truncated to 32 bits. */
+	uint32_t seq;				/*!< Sample counter, set by the producer - a sink with rate 0 sees consecutive numbers unless it dropped samples. */
+	uint8_t refs;				/*!< Owned by the hub. */
+} TLM_sample_t;
+
+typedef int8_t TLM_sink_t;		/*!< Sink handle, negative - not registered */
+
+/**
+ * @brief What a sink does with a sample published while its queue is full.
+ */
+typedef enum{
+	TLM_DROP_NEWEST,			/*!< Keep the queued samples - a stream, every sample counts. */
+	TLM_DROP_OLDEST,			/*!< Replace the oldest queued sample - latest value (depth 1) or a pre-trigger history. */
+} TLM_overflow_t;
+
+/**
+ * @brief Sink encoder, called by ::TLM_service in the task of the sink for every delivered sample.
+ * @return ESP_OK if the sample was sent, anything else counts as an encoder error.
+ */
+typedef esp_err_t (*TLM_encoder_t)(const TLM_sample_t * sample, void * ctx);
+
+/**
+ * @brief Drop hook, called by the publisher for every sample the sink drops. Must not block.
+ */
+typedef void (*TLM_dropHook_t)(const TLM_sample_t * sample, void * ctx);
+
+typedef struct{
+	const char * name;			/*!< Name in statistics. */
+	uint16_t rate_hz;			/*!< Delivery rate, 0 - every sample published to the sink. */
+	uint8_t depth;				/*!< Samples queued for the sink. */
+	TLM_overflow_t overflow;
+	TLM_encoder_t encode;
+	TLM_dropHook_t on_drop;		/*!< Optional. */
+	void * ctx;					/*!< Passed to encode and on_drop. */
+} TLM_sinkConfig_t;
+
+/**
+ * @brief Per-sink statistics.
+ */
+typedef struct{
+	uint32_t published;			/*!< Samples due for the sink. */
+	uint32_t delivered;			/*!< Samples encoded without error. */
+	uint32_t dropped;			/*!< Samples lost on a full queue. */
+	uint32_t errors;			/*!< Encoder errors. */
+	uint8_t depth;				/*!< Samples waiting. */
+	uint8_t depth_max;			/*!< Highest depth since boot. */
+} TLM_sinkStats_t;
+
+/**
+ * @brief Initialize the sample pool.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ */
+esp_err_t TLM_init(void);
+
+/**
+ * @brief Register a sink. Call before the first ::TLM_publish.
+ * The pool covers the queues of all sinks, one sample in every encoder and two buffers of the producer.
+ * @param[in] config Sink configuration, copied.
+ * @return Sink handle, negative if the sink table is full, the pool is too small or the queue can not be created.
+ */
+TLM_sink_t TLM_addSink(const TLM_sinkConfig_t * config);
+
+/**
+ * @brief Get an empty sample buffer to fill. Never blocks.
+ * @return Buffer with one reference of the producer, NULL if the pool is exhausted.
+ */
+TLM_sample_t * TLM_acquire(void);
+
+/**
+ * @brief Deliver a filled buffer to the selected sinks that are due by their rate. Never blocks.
+ * The producer reference is released, the buffer must not be used afterwards. Single producer.
+ * @param[in] sample Buffer from ::TLM_acquire.
+ * @param sinks ::TLM_SINK_BIT mask of candidate sinks, ::TLM_ALL_SINKS for all.
+ */
+void TLM_publish(TLM_sample_t * sample, uint32_t sinks);
+
+/**
+ * @brief Release a reference, the buffer returns to the pool with the last one.
+ * @param[in] sample Buffer.
+ */
+void TLM_release(TLM_sample_t * sample);
+
+/**
+ * @brief Wait for the next sample of a sink, encode it and release it. Called in a loop by the task of the sink.
+ * @param sink Sink handle.
+ * @param wait Maximum wait for a sample in ticks.
+ * @return
+ *  - ESP_OK: Sample delivered
+ *  - ESP_ERR_TIMEOUT: No sample
+ *  - ESP_ERR_INVALID_ARG: Wrong handle
+ *  - Error of the encoder otherwise
+ */
+esp_err_t TLM_service(TLM_sink_t sink, TickType_t wait);
+
+/**
+ * @brief Samples waiting for a sink.
+ * @param sink Sink handle.
+ * @return uint16_t Queue depth, 0 for a wrong handle.
+ */
+uint16_t TLM_waiting(TLM_sink_t sink);
+
+/**
+ * @brief Get statistics of one sink.
+ * @param sink Sink handle.
+ * @return TLM_sinkStats_t, zeroed for a wrong handle.
+ */
+TLM_sinkStats_t TLM_getStats(TLM_sink_t sink);
+
+/**
+ * @brief Create json string with statistics of all sinks.
+ * @return string* with json, must be freed by caller. NULL on error.
+ */
+char * TLM_statsCreateJSON(void);
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_ipc.h"
+#include "Trace.h"
+
+#if defined (CONFIG_KPPTR_TRACE)
+
+#define TRACE_CORES			portNUM_PROCESSORS
+#define TRACE_CYCLES_US		((double)CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ)
+#define TRACE_TASKS_MAX		16
+#define TRACE_LINE_SIZE		192
+
+/**
+ * @brief Ring of one core. Written only by code running on that core (tasks and ISRs), the slot is
+ * reserved with an atomic increment so preemption between tasks does not need a lock.
+ */
+typedef struct{
+	uint32_t head;									/*!< Events recorded, next slot = head % size */
+	trace_event_t events[CONFIG_KPPTR_TRACE_EVENTS];
+} trace_ring_t;
+
+/**
+ * @brief Cycle counter of a core read together with esp_timer - maps cycles of each core to one timeline.
+ */
+typedef struct{
+	uint32_t ccount;
+	int64_t time_us;
+} trace_sync_t;
+
+static const char *TAG = "Trace";
+
+static const char * const trace_names[TRACE_ID_NUM] = {
+	[TRACE_SENSORS_UPDATE]   = "Sensors_update",
+	[TRACE_MS5607_READ]      = "MS5607_read",
+	[TRACE_LIS331_READ]      = "LIS331_read",
+	[TRACE_LSM6DSO32_READ]   = "LSM6DSO32_read",
+	[TRACE_MMC5983MA_READ]   = "MMC5983MA_read",
+	[TRACE_AHRS_COMPUTE]     = "AHRS_compute",
+	[TRACE_FSD_DETECT]       = "FSD_detect",
+	[TRACE_DM_COLLECT_FLASH] = "DM_collectFlash",
+	[TRACE_STORAGE_WRITE]    = "Storage_writePacket",
+	[TRACE_LORA_SEND]        = "LORA_sendPacketLoRa",
+	[TRACE_FLASH_PROG]       = "esp_flash_write",
+	[TRACE_FLASH_ERASE]      = "esp_partition_erase_range",
+	[TRACE_EXT_FLASH_PROG]   = "FLASH_progStart",
+};
+
+static trace_ring_t trace_ring[TRACE_CORES];
+static volatile bool trace_enabled = true;
+
+void IRAM_ATTR Trace_record(trace_id_t id, uint32_t start){
+	uint32_t end = esp_cpu_get_ccount();
+
+	if(!trace_enabled)
+		return;
+
+	trace_ring_t * ring = &trace_ring[xPortGetCoreID()];
+	uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) % CONFIG_KPPTR_TRACE_EVENTS;
+
+	trace_event_t * ev = &ring->events[slot];
+	ev->start  = start;
+	ev->cycles = end - start;
+	ev->task   = xTaskGetCurrentTaskHandle();
+	ev->id     = id;
+}
+
+static void Trace_sync(void * arg){
+	trace_sync_t * sync = (trace_sync_t *)arg;
+
+	sync->ccount  = esp_cpu_get_ccount();
+	sync->time_us = esp_timer_get_time();
+}
+
+static esp_err_t Trace_exportThreadNames(trace_write_t write, void * ctx, char * line){
+	void * tasks[TRACE_TASKS_MAX];
+	uint8_t tasks_core[TRACE_TASKS_MAX];
+	uint8_t tasks_num = 0;
+
+	for(uint8_t core = 0; core < TRACE_CORES; core++){
+		const trace_ring_t * ring = &trace_ring[core];
+		uint32_t count = (ring->head < CONFIG_KPPTR_TRACE_EVENTS) ? ring->head : CONFIG_KPPTR_TRACE_EVENTS;
+
+		for(uint32_t i = 0; (i < count) && (tasks_num < TRACE_TASKS_MAX); i++){
+			void * task = ring->events[i].task;
+			uint8_t n;
+			for(n = 0; n < tasks_num; n++){
+				if((tasks[n] == task) && (tasks_core[n] == core))
+					break;
+			}
+			if(n == tasks_num){
+				tasks[tasks_num] = task;
+				tasks_core[tasks_num] = core;
+				tasks_num++;
+			}
+		}
+	}
+
+	for(uint8_t n = 0; n < tasks_num; n++){
+		// Tasks are never deleted in this firmware, the handle is still valid
+		int len = snprintf(line, TRACE_LINE_SIZE, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+							tasks_core[n], (unsigned)(uintptr_t)tasks[n], pcTaskGetName((TaskHandle_t)tasks[n]));
+		esp_err_t ret = write(ctx, line, len);
+		if(ret != ESP_OK)
+			return ret;
+	}
+	return ESP_OK;
+}
+
+esp_err_t Trace_exportChrome(trace_write_t write, void * ctx){
+	trace_sync_t sync[TRACE_CORES];
+	char line[TRACE_LINE_SIZE];
+	esp_err_t ret = ESP_OK;
+	int len;
+
+	trace_enabled = false;
+
+	for(uint8_t core = 0; core < TRACE_CORES; core++){
+		if(esp_ipc_call_blocking(core, Trace_sync, &sync[core]) != ESP_OK){
+			ESP_LOGE(TAG, "Cannot read cycle counter of core %u", core);
+			trace_enabled = true;
+			return ESP_FAIL;
+		}
+	}
+
+	len = snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for(uint8_t core = 0; core < TRACE_CORES; core++){
+		len += snprintf(line + len, sizeof(line) - len, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"core %u\"}}",
+						core ? "," : "", core, core);
+	}
+	ret = write(ctx, line, len);
+
+	for(uint8_t core = 0; (core < TRACE_CORES) && (ret == ESP_OK); core++){
+		const trace_ring_t * ring = &trace_ring[core];
+		uint32_t count = (ring->head < CONFIG_KPPTR_TRACE_EVENTS) ? ring->head : CONFIG_KPPTR_TRACE_EVENTS;
+		uint32_t first = ring->head - count;
+
+		for(uint32_t i = 0; (i < count) && (ret == ESP_OK); i++){
+			const trace_event_t * ev = &ring->events[(first + i) % CONFIG_KPPTR_TRACE_EVENTS];
+
+			// Cycles before the sync point, valid for events younger than one counter wrap (~17 s at 240 MHz)
+			double ts = sync[core].time_us - (uint32_t)(sync[core].ccount - ev->start) / TRACE_CYCLES_US;
+
+			len = snprintf(line, sizeof(line), ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+							(ev->id < TRACE_ID_NUM) ? trace_names[ev->id] : "?", core, (unsigned)(uintptr_t)ev->task,
+							ts, ev->cycles / TRACE_CYCLES_US);
+			ret = write(ctx, line, len);
+		}
+	}
+
+	if(ret == ESP_OK)
+		ret = Trace_exportThreadNames(write, ctx, line);
+	if(ret == ESP_OK)
+		ret = write(ctx, "]}", 2);
+
+	trace_enabled = true;
+	return ret;
+}
+
+#endif
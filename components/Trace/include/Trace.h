@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief Traced code sections. Names in Chrome trace are taken from trace_names[] in Trace.c.
+ */
+typedef enum{
+	TRACE_SENSORS_UPDATE,
+	TRACE_MS5607_READ,
+	TRACE_LIS331_READ,
+	TRACE_LSM6DSO32_READ,
+	TRACE_MMC5983MA_READ,
+	TRACE_AHRS_COMPUTE,
+	TRACE_FSD_DETECT,
+	TRACE_DM_COLLECT_FLASH,
+	TRACE_STORAGE_WRITE,
+	TRACE_LORA_SEND,
+	TRACE_FLASH_PROG,
+	TRACE_FLASH_ERASE,
+	TRACE_EXT_FLASH_PROG,
+	TRACE_ID_NUM
+} trace_id_t;
+
+/**
+ * @brief One finished section. Begin and end are both known at the end, so a section is a single
+ * Chrome "complete" event and sections of different tasks on the same core cannot be mismatched.
+ */
+typedef struct{
+	uint32_t start;					/*!< CPU cycle counter at the beginning (per core) */
+	uint32_t cycles;				/*!< Duration in CPU cycles */
+	void * task;					/*!< Task handle, thread in Chrome trace */
+	uint8_t id;						/*!< trace_id_t */
+} trace_event_t;
+
+/**
+ * @brief Output callback of the exporter.
+ * @return ESP_OK to continue, anything else aborts the export.
+ */
+typedef esp_err_t (*trace_write_t)(void * ctx, const char * buf, size_t len);
+
+#if defined (CONFIG_KPPTR_TRACE)
+#include "esp_cpu.h"
+
+/**
+ * @brief Start of a section - stores the cycle counter in a local variable.
+ * @param var Local variable name, passed again to TRACE_END.
+ */
+#define TRACE_BEGIN(var)		uint32_t var = esp_cpu_get_ccount()
+
+/**
+ * @brief End of a section - records it in the ring of the current core.
+ * @param id trace_id_t of the section.
+ * @param var Variable from TRACE_BEGIN.
+ */
+#define TRACE_END(id, var)		Trace_record((id), (var))
+
+void Trace_record(trace_id_t id, uint32_t start);
+
+/**
+ * @brief Writes the content of all rings as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+ * Recording is paused during export.
+ * @param write Output callback, called many times with parts of the document.
+ * @param ctx Passed to the callback.
+ * @return ESP_OK on success, error of the callback otherwise.
+ */
+esp_err_t Trace_exportChrome(trace_write_t write, void * ctx);
+
+#else
+#define TRACE_BEGIN(var)
+#define TRACE_END(id, var)
+#endif
@@ -22,8 +22,15 @@
 
 #include "Preferences.h"
 #include "DataManager.h"
+#include "DataManager_preview.h"
+#include "DataManager_log.h"
 #include "Storage_driver.h"
 #include "SimpleFS_driver.h"
+#include "GroundStation.h"
+#include "FlightSummary.h"
+#include "Telemetry_driver.h"
+#include "Boot.h"
+#include "Trace.h"
 
 #include "Web_driver.h"
 #include "Web_driver_json.h"
@@ -45,6 +52,9 @@ static const char *TAG = "Web_driver";
 #define IS_FILE_EXT(filename, ext) \
 		(strcasecmp(&filename[strlen(filename) - sizeof(ext) + 1], ext) == 0)
 
+/* Records reach the flash at most the main ring buffer depth after sampling - widens time windows */
+#define DOWNLOAD_WRITE_LAG_MS	2000
+
 
 Web_driver_status_t status_web;
 Web_driver_live_t live_web;
@@ -68,6 +78,22 @@ typedef struct rest_server_context {
     char scratch[SCRATCH_BUFSIZE];
 } rest_server_context_t;
 
+/*!
+ * @brief Mount the WWW partition. The server runs without it, only the static pages are missing.
+ * @return `ESP_OK` always - a failed mount is logged
+ */
+esp_err_t Web_mountFS(void){
+	if(esp_spiffs_mounted(conf.partition_label))
+		return ESP_OK;
+
+	esp_err_t ret = esp_vfs_spiffs_register(&conf);
+
+	 if(ret != ESP_OK){
+		ESP_LOGE(TAG, "Failed to mount or format WWW filesystem: %s", esp_err_to_name(ret));
+	 }
+	 return ESP_OK;
+}
+
 /*!
  * @brief Initialize web component by calling init functions for wifi and http server.
  * @return `ESP_OK` if initialized
@@ -78,11 +104,7 @@ esp_err_t Web_init(void){
 	esp_err_t ret = ESP_FAIL;
 
 	const char* base_path = "/www";
-	ret = esp_vfs_spiffs_register(&conf);
-
-	 if(ret != ESP_OK){
-		ESP_LOGE(TAG, "Failed to mount or format WWW filesystem: %s", esp_err_to_name(ret));
-	 }
+	Web_mountFS();
 
 	ret = Web_wifi_init();
 	if(ret == ESP_OK){
@@ -234,6 +256,144 @@ static esp_err_t index_html_get_handler(httpd_req_t *req)
 }
 
 
+/*!
+ * @brief Get the byte range requested by a single "Range: bytes=first-last" header.
+ * Other units and multiple ranges are ignored - the whole file is a valid reply to them.
+ * @param req
+ * HTTP request
+ * @param size
+ * File size
+ * @param[out] start
+ * First byte to send
+ * @param[out] end
+ * Byte after the last one to send
+ * @return `ESP_OK` if a range was requested
+ * @return `ESP_ERR_NOT_FOUND` if the whole file is to be sent
+ * @return `ESP_ERR_INVALID_SIZE` if the range is not satisfiable.
+ */
+static esp_err_t get_range_from_hdr(httpd_req_t *req, uint32_t size, uint32_t *start, uint32_t *end)
+{
+    char hdr[48];
+    char *dash;
+
+    *start = 0;
+    *end   = size;
+
+    if((httpd_req_get_hdr_value_str(req, "Range", hdr, sizeof(hdr)) != ESP_OK)
+    		|| (strncmp(hdr, "bytes=", 6) != 0) || (strchr(hdr, ',') != NULL)
+			|| ((dash = strchr(hdr, '-')) == NULL)){
+    	return ESP_ERR_NOT_FOUND;
+    }
+
+    if(dash == &hdr[6]){
+    	/* Suffix range - last N bytes */
+    	uint32_t suffix = strtoul(dash + 1, NULL, 10);
+    	*start = size - MIN(suffix, size);
+    	if(suffix == 0)
+    		return ESP_ERR_INVALID_SIZE;
+    }
+    else{
+    	*start = strtoul(&hdr[6], NULL, 10);
+    	if(dash[1] != '\0')
+    		*end = MIN(strtoul(dash + 1, NULL, 10) + 1, size);
+    }
+
+    return (*start < *end) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+
+/*!
+ * @brief Set the status and headers of a range reply.
+ * @param req
+ * HTTP request
+ * @param range
+ * Result of get_range_from_hdr()
+ * @param hdr
+ * Content-Range buffer, must be valid until the first chunk is sent
+ * @return `ESP_OK` if the body is to be sent
+ * @return `ESP_FAIL` if the range is not satisfiable - reply is sent.
+ */
+static esp_err_t set_range_hdr(httpd_req_t *req, esp_err_t range, uint32_t start, uint32_t end, uint32_t size, char *hdr, size_t hdr_len)
+{
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+
+    if(range == ESP_ERR_INVALID_SIZE){
+    	snprintf(hdr, hdr_len, "bytes */%u", size);
+    	httpd_resp_set_status(req, "416 Range Not Satisfiable");
+    	httpd_resp_set_hdr(req, "Content-Range", hdr);
+    	httpd_resp_send(req, NULL, 0);
+    	return ESP_FAIL;
+    }
+
+    if(range == ESP_OK){
+    	snprintf(hdr, hdr_len, "bytes %u-%u/%u", start, end - 1, size);
+    	httpd_resp_set_status(req, "206 Partial Content");
+    	httpd_resp_set_hdr(req, "Content-Range", hdr);
+    }
+
+    return ESP_OK;
+}
+
+
+#if !defined(CONFIG_FS_LITTLEFS) && !defined(CONFIG_FS_SPIFFS)
+/*!
+ * @brief Send raw SimpleFS bytes [start, end) as response chunks. Any position can be read, so ranges
+ * are served without reading the data before them.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if sent
+ * @return `ESP_FAIL` otherwise - error reply is sent.
+ */
+static esp_err_t sfs_send_range(httpd_req_t *req, uint32_t start, uint32_t end)
+{
+    char *chunk = ((struct file_server_data *)req->user_ctx)->scratch;
+
+    while(start < end){
+    	int32_t chunksize = SimpleFS_readMemoryLL(start, MIN(end - start, SCRATCH_BUFSIZE), chunk);
+
+    	if((chunksize <= 0) || (httpd_resp_send_chunk(req, chunk, chunksize) != ESP_OK)){
+    		ESP_LOGE(TAG, "File sending failed!");
+    		/* Abort sending file */
+    		httpd_resp_sendstr_chunk(req, NULL);
+    		/* Respond with 500 Internal Server Error */
+    		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
+    		return ESP_FAIL;
+    	}
+    	start += chunksize;
+    }
+
+    return ESP_OK;
+}
+
+/*!
+ * @brief Send the log v2 preamble (header and schema records) as SimpleFS packets, in front of a log
+ * window that does not start at the beginning of the log.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if sent
+ * @return `ESP_FAIL` otherwise - error reply is sent.
+ */
+static esp_err_t sfs_send_preamble(httpd_req_t *req)
+{
+    uint8_t payload[DM_LOG_CHUNK_B];
+    sfs_packet_t *packet = (sfs_packet_t *)((struct file_server_data *)req->user_ctx)->scratch;
+
+    for(uint8_t i=0; DM_logPreamble(i, payload) > 0; i++){
+    	SimpleFS_framePacket(payload, sizeof(payload), packet);
+
+    	if(httpd_resp_send_chunk(req, (const char *)packet, sizeof(sfs_packet_t)) != ESP_OK){
+    		ESP_LOGE(TAG, "File sending failed!");
+    		httpd_resp_sendstr_chunk(req, NULL);
+    		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
+    		return ESP_FAIL;
+    	}
+    }
+
+    return ESP_OK;
+}
+#endif
+
+
 /*!
  * @brief Handler responsible for serving all files to the client.
  * @param req
@@ -272,34 +432,23 @@ static esp_err_t download_get_handler(httpd_req_t *req)
         //Lock write and enable read from memory
         SimpleFS_readMode();
 
-        ESP_LOGI(TAG, "Sending file: %s (%i bytes)...", filename, SimpleFS_getFileSize());
-    	set_content_type_from_file(req, filename);
+        uint32_t size = SimpleFS_getFileSize();
+        uint32_t start, end;
+        char range_hdr[48];
 
-    	/* Retrieve the pointer to scratch buffer for temporary storage */
-    	char *chunk = ((struct file_server_data *)req->user_ctx)->scratch;
-    	size_t chunksize;
+        ESP_LOGI(TAG, "Sending file: %s (%i bytes)...", filename, size);
+    	set_content_type_from_file(req, filename);
 
-    	// Reset read pointer to the beginning of the memory
-    	SimpleFS_resetReadPointer();
+    	/* Data is contiguous from the partition start, a range is read directly at its offset */
+    	if(set_range_hdr(req, get_range_from_hdr(req, size, &start, &end), start, end, size, range_hdr, sizeof(range_hdr)) != ESP_OK){
+    		SimpleFS_writeMode();
+    		return ESP_OK;
+    	}
 
-    	do{
-    		/* Read file in chunks into the scratch buffer */
-    		chunksize = SimpleFS_readMemory(SCRATCH_BUFSIZE, chunk);
-
-    		if (chunksize > 0) {
-    			/* Send the buffer contents as HTTP response chunk */
-    			if (httpd_resp_send_chunk(req, chunk, chunksize) != ESP_OK) {
-    				ESP_LOGE(TAG, "File sending failed!");
-    				/* Abort sending file */
-    				httpd_resp_sendstr_chunk(req, NULL);
-    				/* Respond with 500 Internal Server Error */
-    				httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
-    				return ESP_FAIL;
-    		   }
-    		}
-
-    		/* Keep looping till the whole file is sent */
-    	}while (chunksize != 0);
+    	if(sfs_send_range(req, start, end) != ESP_OK){
+    		SimpleFS_writeMode();
+    		return ESP_FAIL;
+    	}
 
     	ESP_LOGI(TAG, "File sending complete");
 
@@ -331,12 +480,32 @@ static esp_err_t download_get_handler(httpd_req_t *req)
 		ESP_LOGI(TAG, "Sending file: %s (%ld bytes)...", filename, file_stat.st_size);
 		set_content_type_from_file(req, filename);
 
+		uint32_t start, end;
+		char range_hdr[48];
+
+		esp_err_t range = get_range_from_hdr(req, file_stat.st_size, &start, &end);
+
+		if((set_range_hdr(req, range, start, end, file_stat.st_size, range_hdr, sizeof(range_hdr)) != ESP_OK)
+				|| (fseek(fd, start, SEEK_SET) != 0)){
+			fclose(fd);
+#if defined(CONFIG_FS_LITTLEFS) || defined(CONFIG_FS_SPIFFS)
+			if(strstr(filename, "meas.bin") != NULL)
+				Storage_unblockMeasFile();
+#endif
+			if(range == ESP_ERR_INVALID_SIZE)
+				return ESP_OK;		// 416 already sent
+
+			httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to seek file");
+			return ESP_FAIL;
+		}
+
 		/* Retrieve the pointer to scratch buffer for temporary storage */
 		char *chunk = ((struct file_server_data *)req->user_ctx)->scratch;
 		size_t chunksize;
 		do{
 			/* Read file in chunks into the scratch buffer */
-			chunksize = fread(chunk, 1, SCRATCH_BUFSIZE, fd);
+			chunksize = fread(chunk, 1, MIN(end - start, SCRATCH_BUFSIZE), fd);
+			start += chunksize;
 
 			if (chunksize > 0) {
 				/* Send the buffer contents as HTTP response chunk */
@@ -375,6 +544,96 @@ static esp_err_t download_get_handler(httpd_req_t *req)
 }
 
 
+/*!
+ * @brief Handler serving a time window of the log - /download?from_ms=..&to_ms=.. in ms since boot.
+ * The window is found in the SimpleFS seek index, so the reply is a packet aligned superset of the
+ * requested records - the decoder filters them by their own time. X-Log-Offset tells where it starts.
+ * A window after the log start begins with X-Log-Preamble bytes of log v2 header and schema packets.
+ * /download?index=1 returns the index itself (sfs_index_t entries) for seeking with Range requests.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if sent
+ * @return `ESP_FAIL` otherwise.
+ */
+static esp_err_t download_range_get_handler(httpd_req_t *req)
+{
+#if defined(CONFIG_FS_LITTLEFS) || defined(CONFIG_FS_SPIFFS)
+    httpd_resp_send_err(req, HTTPD_501_METHOD_NOT_IMPLEMENTED, "Time index needs SimpleFS");
+    return ESP_FAIL;
+#else
+    char query[64];
+    char value[12];
+    char offset_hdr[12];
+    char preamble_hdr[12];
+    uint32_t preamble_B = 0;
+    uint32_t from_ms = 0;
+    uint32_t to_ms   = UINT32_MAX;
+
+    httpd_resp_set_type(req, "application/octet-stream");
+
+    if(httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK){
+    	if(httpd_query_key_value(query, "index", value, sizeof(value)) == ESP_OK){
+    		sfs_index_t *entries = (sfs_index_t *)((struct file_server_data *)req->user_ctx)->scratch;
+    		uint32_t first = 0;
+    		uint32_t num;
+
+    		while((num = SimpleFS_readIndex(first, entries, SCRATCH_BUFSIZE / sizeof(sfs_index_t))) > 0){
+    			if(httpd_resp_send_chunk(req, (const char *)entries, num * sizeof(sfs_index_t)) != ESP_OK){
+    				httpd_resp_sendstr_chunk(req, NULL);
+    				return ESP_FAIL;
+    			}
+    			first += num;
+    		}
+    		return httpd_resp_send_chunk(req, NULL, 0);
+    	}
+
+    	if(httpd_query_key_value(query, "from_ms", value, sizeof(value)) == ESP_OK)
+    		from_ms = strtoul(value, NULL, 10);
+    	if(httpd_query_key_value(query, "to_ms", value, sizeof(value)) == ESP_OK)
+    		to_ms = strtoul(value, NULL, 10);
+    }
+
+    if(from_ms > to_ms){
+    	httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "from_ms after to_ms");
+    	return ESP_FAIL;
+    }
+
+    SimpleFS_readMode();
+
+    uint32_t start = SimpleFS_findOffset(from_ms, false);
+    uint32_t end   = SimpleFS_findOffset(MIN(to_ms, UINT32_MAX - DOWNLOAD_WRITE_LAG_MS) + DOWNLOAD_WRITE_LAG_MS, true);
+
+    ESP_LOGI(TAG, "Sending log %u-%u ms: %u-%u B", from_ms, to_ms, start, end);
+#if CONFIG_KPPTR_LOG_V2
+    // The window decodes on its own - same record types as in the preamble at the log start
+    if(start > 0){
+    	uint8_t payload[DM_LOG_CHUNK_B];
+    	for(uint8_t i=0; DM_logPreamble(i, payload) > 0; i++)
+    		preamble_B += sizeof(sfs_packet_t);
+    }
+#endif
+    snprintf(offset_hdr, sizeof(offset_hdr), "%u", start);
+    snprintf(preamble_hdr, sizeof(preamble_hdr), "%u", preamble_B);
+    httpd_resp_set_hdr(req, "X-Log-Offset", offset_hdr);
+    httpd_resp_set_hdr(req, "X-Log-Preamble", preamble_hdr);
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"meas.bin\"");
+
+    esp_err_t err = ESP_OK;
+    if(preamble_B > 0)
+    	err = sfs_send_preamble(req);
+    if(err == ESP_OK)
+    	err = sfs_send_range(req, start, MAX(start, end));
+
+    SimpleFS_writeMode();
+
+    if(err != ESP_OK)
+    	return ESP_FAIL;
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+#endif
+}
+
+
 /*!
  * @brief Handler responsible for deleting files.
  * @param req
@@ -624,6 +883,160 @@ esp_err_t jsonLive_get_handler(httpd_req_t *req){
 }
 
 
+/*!
+ * @brief Handler responsible for serving json with flight summary - this flight, or the last one stored.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t jsonSummary_get_handler(httpd_req_t *req){
+	char *string = Summary_createJSON();
+	if(string == NULL){
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot create JSON");
+		return ESP_FAIL;
+	}
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_send(req, string, HTTPD_RESP_USE_STRLEN);
+
+    free(string);
+    return ESP_OK;
+}
+
+/*!
+ * @brief Handler responsible for serving json with telemetry hub statistics - per sink delivered and dropped samples.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t jsonTelemetry_get_handler(httpd_req_t *req){
+	char *string = TLM_statsCreateJSON();
+	if(string == NULL){
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot create JSON");
+		return ESP_FAIL;
+	}
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_send(req, string, HTTPD_RESP_USE_STRLEN);
+
+    free(string);
+    return ESP_OK;
+}
+
+/*!
+ * @brief Handler responsible for serving json with boot metrics - per stage state, attempts and boot-to-ready time.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t jsonBoot_get_handler(httpd_req_t *req){
+	char *string = Boot_statsCreateJSON();
+	if(string == NULL){
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot create JSON");
+		return ESP_FAIL;
+	}
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_send(req, string, HTTPD_RESP_USE_STRLEN);
+
+    free(string);
+    return ESP_OK;
+}
+
+#if defined (CONFIG_KPPTR_GROUND_STATION)
+/*!
+ * @brief Handler responsible for serving json with ground station link statistics and received frames.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t jsonGroundStation_get_handler(httpd_req_t *req){
+	char *string = GS_statsCreateJSON();
+	if(string == NULL){
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot create JSON");
+		return ESP_FAIL;
+	}
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_send(req, string, HTTPD_RESP_USE_STRLEN);
+
+    free(string);
+    return ESP_OK;
+}
+#endif
+
+static esp_err_t http_write_chunk(void * ctx, const char * buf, size_t len){
+	return httpd_resp_send_chunk((httpd_req_t *)ctx, buf, len);
+}
+
+/*!
+ * @brief Handler responsible for serving the flight preview - /json/preview?level=0|1|2 for 1 s, 10 s or 100 s buckets.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t jsonPreview_get_handler(httpd_req_t *req){
+    char query[32];
+    char value[4];
+    uint8_t level = 0;
+
+    if((httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    		&& (httpd_query_key_value(query, "level", value, sizeof(value)) == ESP_OK)){
+    	level = atoi(value);
+    }
+
+    if(level >= DM_PREVIEW_LEVELS){
+    	httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Level out of range");
+    	return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    // Streamed in chunks - no JSON tree of thousands of values in RAM
+    if(DM_previewExport(level, http_write_chunk, req) != ESP_OK){
+    	ESP_LOGE(TAG, "Preview export failed");
+    	return ESP_FAIL;	// Connection is closed, response is incomplete
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+#if defined (CONFIG_KPPTR_TRACE)
+
+/*!
+ * @brief Handler responsible for serving hot path trace as Chrome trace-event JSON.
+ * @param req
+ * HTTP request
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t trace_get_handler(httpd_req_t *req){
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"trace.json\"");
+
+    // Streamed in chunks - the whole document does not fit in RAM
+    if(Trace_exportChrome(http_write_chunk, req) != ESP_OK){
+    	ESP_LOGE(TAG, "Trace export failed");
+    	return ESP_FAIL;	// Connection is closed, response is incomplete
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+#endif
+
 /*!
  * @brief Handler responsible for commands sent through wifi.
  * @param req
@@ -705,7 +1118,7 @@ esp_err_t Web_http_init(const char *base_path){
 
 	httpd_handle_t server = NULL;
 	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-	config.max_uri_handlers = 16;
+	config.max_uri_handlers = 20;
 
 	static struct file_server_data *server_data = NULL;
 	if(server_data){
@@ -762,6 +1175,58 @@ esp_err_t Web_http_init(const char *base_path){
 	};
 	httpd_register_uri_handler(server, &jsonLive_get);
 
+	httpd_uri_t jsonSummary_get = {
+			.uri      = "/json/summary",
+			.method   = HTTP_GET,
+			.handler  = jsonSummary_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &jsonSummary_get);
+
+	httpd_uri_t jsonPreview_get = {
+			.uri      = "/json/preview",
+			.method   = HTTP_GET,
+			.handler  = jsonPreview_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &jsonPreview_get);
+
+	httpd_uri_t jsonTelemetry_get = {
+			.uri      = "/json/telemetry",
+			.method   = HTTP_GET,
+			.handler  = jsonTelemetry_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &jsonTelemetry_get);
+
+	httpd_uri_t jsonBoot_get = {
+			.uri      = "/json/boot",
+			.method   = HTTP_GET,
+			.handler  = jsonBoot_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &jsonBoot_get);
+
+#if defined (CONFIG_KPPTR_GROUND_STATION)
+	httpd_uri_t jsonGroundStation_get = {
+			.uri      = "/gs",
+			.method   = HTTP_GET,
+			.handler  = jsonGroundStation_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &jsonGroundStation_get);
+#endif
+
+#if defined (CONFIG_KPPTR_TRACE)
+	httpd_uri_t trace_get = {
+			.uri      = "/trace",
+			.method   = HTTP_GET,
+			.handler  = trace_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &trace_get);
+#endif
+
 	httpd_uri_t cmd_send = {
 			    .uri      = "/cmd",
 			    .method   = HTTP_POST,
@@ -794,6 +1259,14 @@ esp_err_t Web_http_init(const char *base_path){
 		};
 	httpd_register_uri_handler(server, &file_upload);
 
+	httpd_uri_t log_download = {
+			.uri      = "/download",
+			.method   = HTTP_GET,
+			.handler  = download_range_get_handler,
+			.user_ctx = server_data
+	};
+	httpd_register_uri_handler(server, &log_download);
+
 	httpd_uri_t file_download = {
 			.uri       = "/*",  // Match all URIs of type /path/to/file
 	        .method    = HTTP_GET,
@@ -839,13 +1312,33 @@ esp_err_t Web_wifi_stop(void){
 
 
 /*!
- * @brief Turn off web component by calling deactivation functions for wifi and HTTP server.
- * @return `ESP_OK` if initialized
+ * @brief Turn off web component for the flight. The soft access point is stopped, the HTTP server
+ * stays registered and sleeps without clients.
+ * @return `ESP_OK` if done
  * @return `ESP_FAIL` otherwise.
  */
 esp_err_t Web_off(void){
-	//Web_http_off();
-	return ESP_OK;
+	esp_err_t ret = Web_wifi_stop();
+
+	if(ret == ESP_OK){
+		ESP_LOGI(TAG, "Soft AP stopped");
+	}
+	return ret;
+}
+
+
+/*!
+ * @brief Turn web component on again after Web_off().
+ * @return `ESP_OK` if done
+ * @return `ESP_FAIL` otherwise.
+ */
+esp_err_t Web_on(void){
+	esp_err_t ret = esp_wifi_start();
+
+	if(ret == ESP_OK){
+		ESP_LOGI(TAG, "Soft AP started");
+	}
+	return ret;
 }
 
 
@@ -914,6 +1407,27 @@ esp_err_t Web_status_updateSysMgr(uint32_t timestamp_ms, uint8_t state_system, u
 }
 
 
+esp_err_t Web_status_updateTaskMonitor(sysmgr_taskmon_id_t task, const sysmgr_taskmon_t * monitor){
+    status_web.tasks[task] = *monitor;
+
+    return ESP_OK;
+}
+
+
+esp_err_t Web_status_updateHeartbeat(sysmgr_checkout_component_t component, const sysmgr_heartbeat_t * heartbeat){
+    status_web.heartbeats[component] = *heartbeat;
+
+    return ESP_OK;
+}
+
+
+esp_err_t Web_status_updateStorage(const DM_storageStats_t * stats){
+    status_web.storage = *stats;
+
+    return ESP_OK;
+}
+
+
 esp_err_t Web_status_updateconfig(uint64_t SWversion, uint64_t serialNumber, float drougeAlt, float mainAlt){        //zakładam wykonywanie tego przy okazji odczyty konfiguracji konfiguracji, czyli na starcie i po zmienie konfiguracji
     status_web.software_version = SWversion;        //zmiana z tablicy charów na uint64 w którym zakodujemy wszystkie informacje
     status_web.serial_number = serialNumber;
@@ -924,9 +1438,9 @@ esp_err_t Web_status_updateconfig(uint64_t SWversion, uint64_t serialNumber, flo
 }
 
 
-esp_err_t Web_status_updateGNSS(float lat, float lon, uint8_t fix, uint8_t sats){
-    live_web.gps.latitude  = lat;        // pozmieniane lekko nazwy i dodane pole "sats"
-    live_web.gps.longitude = lon;
+esp_err_t Web_status_updateGNSS(int32_t lat, int32_t lon, uint8_t fix, uint8_t sats){
+    live_web.gps.latitude  = lat / (double)NMEA_COORD_SCALE;        // pozmieniane lekko nazwy i dodane pole "sats"
+    live_web.gps.longitude = lon / (double)NMEA_COORD_SCALE;
     live_web.gps.fix  = fix;
     live_web.gps.sats = sats;
 
@@ -945,7 +1459,7 @@ esp_err_t Web_status_updateADCS(uint8_t flightstate, float rocket_tilt){
 }
 
 
-esp_err_t Web_live_from_DataPackage(DataPackage_t * DataPackage_ptr){
+esp_err_t Web_live_from_DataPackage(const DataPackage_t * DataPackage_ptr){
     Web_driver_live_t     live_web;
 
     live_web.LIS331.ax = DataPackage_ptr->sensors.accHX;
@@ -975,8 +1489,8 @@ esp_err_t Web_live_from_DataPackage(DataPackage_t * DataPackage_ptr){
     live_web.angley = 0.0f;
     live_web.anglez = 0.0f;
     live_web.gps.fix 		= DataPackage_ptr->sensors.gnss_fix >> 6;
-    live_web.gps.latitude 	= DataPackage_ptr->sensors.latitude;
-    live_web.gps.longitude 	= DataPackage_ptr->sensors.longitude;
+    live_web.gps.latitude 	= DataPackage_ptr->sensors.latitude  / (double)NMEA_COORD_SCALE;
+    live_web.gps.longitude 	= DataPackage_ptr->sensors.longitude / (double)NMEA_COORD_SCALE;
     live_web.gps.sats 		= DataPackage_ptr->sensors.gnss_fix & 0x3F;
 
     status_web.flight_state = DataPackage_ptr->flightstate;
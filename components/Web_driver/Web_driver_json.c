@@ -13,6 +13,9 @@
 
 static const char *TAG = "Web_driver_json";
 
+static const char *taskmon_names[SYSMGR_TASKMON_NUM] = {"main", "storage", "utils", "analog"};
+static const char *component_names[SYSMGR_CHECKOUT_NUM] = {"sysmgr", "main", "storage", "lora", "analog", "utils", "web", "gnss"};
+
 /*!
  * @brief Create json string and fill it with status values.
  * @return string* with json
@@ -45,8 +48,69 @@ char* Web_driver_json_statusCreate(Web_driver_status_t status){
 	cJSON_AddNumberToObject(sysMgr, "sysmgr_utils_status", 	 status.sysmgr_utils_status);
 	cJSON_AddNumberToObject(sysMgr, "sysmgr_web_status", 	 status.sysmgr_web_status);
 	cJSON_AddNumberToObject(sysMgr, "sysmgr_arm_state", 	 status.sysmgr_arm_state);
+
+	int bin_edges[SYSMGR_TASKMON_BINS - 1];
+	for(int i=0;i<SYSMGR_TASKMON_BINS - 1;i++){
+		bin_edges[i] = SysMgr_getTaskMonitorBinEdge(i);
+	}
+	cJSON_AddItemToObject(sysMgr, "tasks_bin_edges", cJSON_CreateIntArray(bin_edges, SYSMGR_TASKMON_BINS - 1));
+
+	cJSON *tasks = cJSON_CreateArray();
+	for(int i=0;i<SYSMGR_TASKMON_NUM;i++){
+		cJSON *task = cJSON_CreateObject();
+		int period_hist[SYSMGR_TASKMON_BINS];
+		int exec_hist[SYSMGR_TASKMON_BINS];
+
+		for(int j=0;j<SYSMGR_TASKMON_BINS;j++){
+			period_hist[j] = status.tasks[i].period_hist[j];
+			exec_hist[j]   = status.tasks[i].exec_hist[j];
+		}
+
+		cJSON_AddStringToObject(task, "name", 			taskmon_names[i]);
+		cJSON_AddNumberToObject(task, "period_us", 		status.tasks[i].period_us);
+		cJSON_AddNumberToObject(task, "cycles", 		status.tasks[i].cycles);
+		cJSON_AddNumberToObject(task, "deadline_miss", 	status.tasks[i].deadline_miss);
+		cJSON_AddNumberToObject(task, "period_max_us", 	status.tasks[i].period_max_us);
+		cJSON_AddNumberToObject(task, "exec_max_us", 	status.tasks[i].exec_max_us);
+		cJSON_AddItemToObject  (task, "period_hist", 	cJSON_CreateIntArray(period_hist, SYSMGR_TASKMON_BINS));
+		cJSON_AddItemToObject  (task, "exec_hist", 		cJSON_CreateIntArray(exec_hist, SYSMGR_TASKMON_BINS));
+
+		cJSON_AddItemToArray(tasks, task);
+	}
+	cJSON_AddItemToObject  (sysMgr, "tasks", 				 tasks);
+
+	cJSON *heartbeats = cJSON_CreateArray();
+	for(int i=0;i<SYSMGR_CHECKOUT_NUM;i++){
+		if(status.heartbeats[i].period_us == 0)
+			continue;		// Not monitored
+
+		cJSON *heartbeat = cJSON_CreateObject();
+		cJSON_AddStringToObject(heartbeat, "name", 				component_names[i]);
+		cJSON_AddNumberToObject(heartbeat, "period_us", 		status.heartbeats[i].period_us);
+		cJSON_AddNumberToObject(heartbeat, "timeout_us", 		status.heartbeats[i].timeout_us);
+		cJSON_AddNumberToObject(heartbeat, "fault", 			status.heartbeats[i].fault);
+		cJSON_AddNumberToObject(heartbeat, "stalls", 			status.heartbeats[i].stalls);
+		cJSON_AddNumberToObject(heartbeat, "overruns", 			status.heartbeats[i].overruns);
+		cJSON_AddNumberToObject(heartbeat, "recovery_last_us", 	status.heartbeats[i].recovery_last_us);
+		cJSON_AddNumberToObject(heartbeat, "recovery_max_us", 	status.heartbeats[i].recovery_max_us);
+		cJSON_AddItemToArray(heartbeats, heartbeat);
+	}
+	cJSON_AddItemToObject  (sysMgr, "heartbeats", 			 heartbeats);
 	cJSON_AddItemToObject  (json,   "sysMgr", 			     sysMgr);
 
+	cJSON *storage = cJSON_CreateObject();
+	cJSON_AddNumberToObject(storage, "depth", 			status.storage.depth);
+	cJSON_AddNumberToObject(storage, "depth_max", 		status.storage.depth_max);
+	cJSON_AddNumberToObject(storage, "written", 		status.storage.written);
+	cJSON_AddNumberToObject(storage, "overwritten", 	status.storage.overwritten);
+	cJSON_AddNumberToObject(storage, "dropped", 		status.storage.dropped);
+	cJSON_AddNumberToObject(storage, "gaps", 			status.storage.gaps);
+	cJSON_AddNumberToObject(storage, "bursts", 			status.storage.bursts);
+	cJSON_AddNumberToObject(storage, "decimated", 		status.storage.decimated);
+	cJSON_AddNumberToObject(storage, "envelopes", 		status.storage.envelopes);
+	cJSON_AddNumberToObject(storage, "throughput_Bps", 	status.storage.throughput_Bps);
+	cJSON_AddItemToObject(json, "storage", storage);
+
 	cJSON *sensors = cJSON_CreateObject();
 	cJSON_AddNumberToObject(sensors, "pressure", status.pressure);
 	cJSON_AddNumberToObject(sensors, "rocket_tilt", status.rocket_tilt);
@@ -18,6 +18,12 @@ struct file_server_data {
     char scratch[SCRATCH_BUFSIZE];
 };
 
+/*!
+ * @brief Mount the WWW partition. The server runs without it, only the static pages are missing.
+ * @return `ESP_OK` always - a failed mount is logged
+ */
+esp_err_t Web_mountFS(void);
+
 /*!
  * @brief Initialize web component by calling init functions for wifi and http server.
  * @return `ESP_OK` if initialized
@@ -26,6 +32,7 @@ struct file_server_data {
  */
 esp_err_t Web_init(void);
 esp_err_t Web_off(void);
+esp_err_t Web_on(void);
 
 void Web_status_exchange(Web_driver_status_t EX_status);
 void Web_live_exchange(Web_driver_live_t EX_live);
@@ -35,8 +42,11 @@ esp_err_t Web_status_updateIgniters(uint8_t ign1_fired, uint8_t ign2_fired, uint
 esp_err_t Web_status_updateSysMgr(uint32_t timestamp_ms, uint8_t state_system, uint8_t state_analog, uint8_t state_lora,
 								  uint8_t state_adcs, uint8_t state_storage, uint8_t state_sysmgr, uint8_t state_utils,
 								  uint8_t state_web, uint8_t arm);
+esp_err_t Web_status_updateTaskMonitor(sysmgr_taskmon_id_t task, const sysmgr_taskmon_t * monitor);
+esp_err_t Web_status_updateHeartbeat(sysmgr_checkout_component_t component, const sysmgr_heartbeat_t * heartbeat);
+esp_err_t Web_status_updateStorage(const DM_storageStats_t * stats);
 esp_err_t Web_status_updateconfig(uint64_t SWversion, uint64_t serialNumber, float drougeAlt, float mainAlt); //zakładam wykonywanie tego przy okazji odczyty konfiguracji konfiguracji, czyli na starcie i po zmienie konfiguracji
-esp_err_t Web_status_updateGNSS(float lat, float lon, uint8_t fix, uint8_t sats);
-esp_err_t Web_live_from_DataPackage(DataPackage_t * DataPackage_ptr);
+esp_err_t Web_status_updateGNSS(int32_t lat, int32_t lon, uint8_t fix, uint8_t sats);
+esp_err_t Web_live_from_DataPackage(const DataPackage_t * DataPackage_ptr);
 esp_err_t Web_status_updateADCS(uint8_t flightstate, float rocket_tilt); //ADCS = Attitude Determination and Control System
 
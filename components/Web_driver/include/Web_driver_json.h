@@ -11,6 +11,8 @@
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "esp_event.h"
+#include "SysMgr.h"
+#include "DataManager.h"
 
 /**
 * @brief Struct storing all the status data
@@ -51,6 +53,10 @@ typedef struct{
 	uint8_t	sysmgr_web_status;
 	uint8_t sysmgr_arm_state;
 
+	sysmgr_taskmon_t tasks[SYSMGR_TASKMON_NUM];	/*!< Periodic task loop timing */
+	sysmgr_heartbeat_t heartbeats[SYSMGR_CHECKOUT_NUM];	/*!< Component heartbeats and faults */
+	DM_storageStats_t storage;					/*!< Storage pipeline */
+
 } Web_driver_status_t;
 
 typedef struct{
@@ -102,8 +108,8 @@ typedef struct{
 	} MMC5983MA;
 
 	struct {
-		float latitude;				/*!< Latitude */
-		float longitude;			/*!< Longitude */
+		double latitude;			/*!< Latitude (degrees) */
+		double longitude;			/*!< Longitude (degrees) */
 
 		uint8_t fix;				/*!< GPS fix check */
 		uint8_t sats;				/*!< Number of satellites in view */
@@ -15,6 +15,9 @@ const preferencesData = {
 	key: 12345678, // Replace with your key value
 	lora_freq: 433125,
 	lora_network_mode: true, //true for network, false for exclusive
+	log_ascent_hz: 100,
+	log_descent_hz: 10,
+	log_landed_hz: 1,
 	crc32: 0, // Initialize CRC32 to 0
 };
 
@@ -893,6 +896,9 @@ function updatePreferencesData() {
 	preferencesData.staging_max_tilt = parseFloat(document.getElementById("pref-staging-tilt").value);
 	preferencesData.auto_arming_time_s = parseFloat(document.getElementById("pref-autoarm_delay").value);
 	preferencesData.lora_freq = parseFloat(document.getElementById("pref-lora-frequency").value);
+	preferencesData.log_ascent_hz = parseFloat(document.getElementById("pref-log-ascent").value);
+	preferencesData.log_descent_hz = parseFloat(document.getElementById("pref-log-descent").value);
+	preferencesData.log_landed_hz = parseFloat(document.getElementById("pref-log-landed").value);
 	
 	preferencesData.wifi_pass = document.getElementById("pref-wifi-pass").value;
 	
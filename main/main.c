@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
@@ -22,118 +24,218 @@
 #include "Web_driver.h"
 #include "Preferences.h"
 #include "DataManager.h"
+#include "DataManager_preview.h"
+#include "DataManager_log.h"
+#include "Stream_driver.h"
+#include "Telemetry_driver.h"
 #include "SysMgr.h"
+#include "GroundStation.h"
+#include "Trace.h"
+#include "FlightSummary.h"
+#include "Boot.h"
 
 //----------- Our defines --------------
 #define ESP_CORE_0 0
 #define ESP_CORE_1 1
+#define RF_SUMMARY_EVERY 5		// After landing every 5th telemetry frame is the flight summary
+#define RF_RATE_HZ 1			// LoRa telemetry frames
+#define WEB_RATE_HZ 1			// Live data of the Web GUI
+#define UTILS_INTERVAL_MS 20	// LED, buzzer and igniters
+#define ANALOG_INTERVAL_MS 100	// Vbat and igniter continuity
+#define STORAGE_PRIORITY (configMAX_PRIORITIES - 3)
+#define GOV_LED_DIV 5			// In flight LED and buzzer every 100 ms
+#define GOV_ANALOG_DIV 5		// In flight analog measurement every 500 ms
+#define GOV_STORAGE_PRIORITY (configMAX_PRIORITIES - 2)	// In flight above the WiFi task
+
+/**
+ * @brief Telemetry queue item, the frame type is given by packet_id.
+ */
+typedef union{
+	DataPackageRF_t data;
+	SummaryRF_t summary;
+} FrameRF_t;
 
 static const char *TAG = "KP-PTR";
 
 //----------- Queues etc ---------------
 QueueHandle_t queue_AnalogToMain;
-QueueHandle_t queue_MainToTelemetry;
-QueueHandle_t queue_MainToWeb;
+
+//----------- Telemetry sinks ----------
+static TLM_sink_t sink_flash = -1;
+static TLM_sink_t sink_lora = -1;
+static TLM_sink_t sink_web = -1;
+
+//----------- Boot stages --------------
+static Boot_stage_t boot_sensors = -1;
+static Boot_stage_t boot_gnss = -1;
+static Boot_stage_t boot_ahrs = -1;
+static Boot_stage_t boot_fsd = -1;
+static Boot_stage_t boot_www = -1;
+static Boot_stage_t boot_storage = -1;
+static Boot_stage_t boot_utils = -1;
+static Boot_stage_t boot_analog = -1;
+static Boot_stage_t boot_lora = -1;
+
+//----------- Flight mode governor ----------
+static TaskHandle_t task_storage_handle = NULL;
+static volatile uint8_t gov_led_div = 1;		// LED_srv() every n-th utils loop
+static volatile uint8_t gov_analog_div = 1;		// Analog_update() every n-th analog loop
 
 //----------- Global settings ----------
 Preferences_data_t Preferences_data_d;
 
 // periodic task with timer https://www.esp32.com/viewtopic.php?t=10280
 
+// Envelope of a closed decimation window - produced by the logging policy, stored only
+static void main_publishEnvelope(const DataEnvelope_t * envelope, int64_t time_us, uint32_t seq){
+	TLM_sample_t * sample = TLM_acquire();
+
+	if(sample == NULL){
+		ESP_LOGE(TAG, "Telemetry pool empty!");
+		return;
+	}
+
+	memcpy(&sample->data, envelope, sizeof(DataEnvelope_t));
+	sample->time_us = time_us;
+	sample->seq = seq;
+	TLM_publish(sample, TLM_SINK_BIT(sink_flash));
+}
+
 void task_kpptr_main(void *pvParameter){
 	TickType_t xLastWakeTime = 0;
-	TickType_t prevTickCountRF = 0;
-	TickType_t prevTickCountWeb = 0;
-	DataPackage_t *  DataPackage_ptr = NULL;
-	DataPackage_t DataPackage_d;
-	DataPackageRF_t  DataPackageRF_d;
+	DataEnvelope_t DataEnvelope_d;
+	uint32_t sample_cnt = 0;
 	gps_t gps_d;
 	Analog_meas_t Analog_meas;
 
-	int64_t time_us = esp_timer_get_time();
-
-	esp_err_t status = ESP_FAIL;
-	while(status != ESP_OK){
-		status  = ESP_OK;
-		status |= Sensors_init();
-		status |= GPS_init();
-		status |= AHRS_init(time_us);
-		status |= FSD_init(AHRS_getData());
-
-		if(status != ESP_OK){
-			ESP_LOGW(TAG, "Main task - failed to prepare main task");
-			SysMgr_checkout(checkout_main, check_fail);
-			vTaskDelay(pdMS_TO_TICKS( 1000 ));
-		}
-	}
+	memset(&gps_d, 0, sizeof(gps_d));	// No fix until the first GNSS data
 
+	// GNSS configuration takes seconds - the loop starts without it and takes GNSS data once the stage is ready
+	Boot_wait(BOOT_BIT(boot_sensors) | BOOT_BIT(boot_ahrs) | BOOT_BIT(boot_fsd), portMAX_DELAY);
 	SysMgr_checkout(checkout_main, check_ready);
 	ESP_LOGI(TAG, "Task Main - ready!");
 
+	SysMgr_taskMonitorInit(taskmon_main, 10, 10);
 	xLastWakeTime = xTaskGetTickCount ();
 	while(1){
 		vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS( 10 ));	// Note - for rate > 100Hz change MS5607 settings
+		SysMgr_taskMonitorStart(taskmon_main);
 
 		int64_t time_us = esp_timer_get_time();
 
+		TRACE_BEGIN(t_sensors);
 		Sensors_update();
+		TRACE_END(TRACE_SENSORS_UPDATE, t_sensors);
+
+		TRACE_BEGIN(t_ahrs);
 		AHRS_compute(time_us, Sensors_get());
-		GPS_getData(&gps_d, 0);
-		FSD_detect(time_us/1000);
+		TRACE_END(TRACE_AHRS_COMPUTE, t_ahrs);
 
-		xQueueReceive(queue_AnalogToMain, &Analog_meas, 0);
+		if(Boot_isReady(boot_gnss) && (GPS_getData(&gps_d, 0) > 0)){
+			AHRS_updateGNSS(gps_d.rx_time_us, gps_d.altitude, NAN, gps_d.fix != GPS_FIX_INVALID);
+			DM_logSetUTC(gps_d.rx_time_us, &gps_d);
+		}
 
-		DM_collectFlash(&DataPackage_d, time_us, Sensors_get(), &gps_d, AHRS_getData(), FSD_getState(), NULL, &Analog_meas);
+		TRACE_BEGIN(t_fsd);
+		FSD_detect(time_us/1000);
+		TRACE_END(TRACE_FSD_DETECT, t_fsd);
+
+		Summary_update(time_us, Sensors_get(), &gps_d, AHRS_getData(), FSD_getState());
 
-		if(DM_getFreePointerToMainRB(&DataPackage_ptr) == ESP_OK){
-			if(DataPackage_ptr != NULL){
-				*DataPackage_ptr = DataPackage_d;
-				DM_addToMainRB(&DataPackage_ptr);
+		xQueueReceive(queue_AnalogToMain, &Analog_meas, 0);
 
-			} else {
-				ESP_LOGE(TAG, "Main RB pointer = NULL!");
+		// One buffer per sample, shared by all sinks - each takes it at its own rate
+		TLM_sample_t * sample = TLM_acquire();
+		if(sample != NULL){
+			TRACE_BEGIN(t_dm);
+			DM_collectFlash(&sample->data, time_us, Sensors_get(), &gps_d, AHRS_getData(), FSD_getState(), NULL, &Analog_meas);
+			sample->time_us = time_us;
+			sample->seq = sample_cnt++;
+			TRACE_END(TRACE_DM_COLLECT_FLASH, t_dm);
+
+			// Flash follows the logging policy of the flight phase instead of a fixed rate
+			uint32_t sinks = TLM_ALL_SINKS & ~TLM_SINK_BIT(sink_flash);
+			uint8_t log_action = DM_logDecimate(&sample->data, &DataEnvelope_d);
+			if(log_action & DM_LOG_ENVELOPE){
+				main_publishEnvelope(&DataEnvelope_d, time_us, sample->seq);
+			}
+			if(log_action & DM_LOG_RECORD){
+				sinks |= TLM_SINK_BIT(sink_flash);
 			}
+			TLM_publish(sample, sinks);
 		} else {
-			ESP_LOGE(TAG, "Main RB error!");
-		}
-
-#if defined (RF_BUSY_PIN) && defined (RF_RST_PIN) && defined (SPI_SLAVE_SX1262_PIN)
-		//send data to RF every 1000ms
-		if(((prevTickCountRF + pdMS_TO_TICKS( 1000 )) <= xLastWakeTime)){
-			prevTickCountRF = xLastWakeTime;
-			DM_collectRF(&DataPackageRF_d, time_us, Sensors_get(), &gps_d, AHRS_getData(), FSD_getState(), NULL);
-			xQueueOverwrite(queue_MainToTelemetry, (void *)&DataPackageRF_d); // add to telemetry queue
-		}
-#endif
-
-		//send data to Web every 1000ms
-		if(((prevTickCountWeb + pdMS_TO_TICKS( 1000 )) <= xLastWakeTime)){
-			prevTickCountWeb = xLastWakeTime;
-			xQueueOverwrite(queue_MainToWeb, (void *)DataPackage_ptr); // add to Web queue
+			ESP_LOGE(TAG, "Telemetry pool empty!");
 		}
 
+		SysMgr_taskMonitorEnd(taskmon_main);
 	}
 	vTaskDelete(NULL);
 }
 
 
-void task_kpptr_telemetry(void *pvParameter){
-	DataPackageRF_t DataPackageRF_d;
+#if defined (RF_BUSY_PIN) && defined (RF_RST_PIN) && defined (SPI_SLAVE_SX1262_PIN) && !defined (CONFIG_KPPTR_GROUND_STATION)
+static esp_err_t telemetry_encode(const TLM_sample_t * sample, void * ctx){
+	static uint8_t summary_cnt = 0;
+	FrameRF_t FrameRF_d;
+	uint16_t len;
+
+	if(Summary_isLanded() && ((++summary_cnt % RF_SUMMARY_EVERY) == 0)){
+		Summary_collectRF(&FrameRF_d.summary);
+		len = sizeof(SummaryRF_t);
+	} else {
+		DM_packRF(&FrameRF_d.data, &sample->data, sample->time_us);
+		len = sizeof(DataPackageRF_t);
+	}
 
+	TRACE_BEGIN(t_lora);
+	esp_err_t status = LORA_sendPacketLoRa((uint8_t *)&FrameRF_d, len, LORA_TX_NO_WAIT);
+	TRACE_END(TRACE_LORA_SEND, t_lora);
+	return status;
+}
+#endif
+
+void task_kpptr_telemetry(void *pvParameter){
 
 #if defined (RF_BUSY_PIN) && defined (RF_RST_PIN) && defined (SPI_SLAVE_SX1262_PIN)
-	while(LORA_init() != ESP_OK){
-		ESP_LOGW(TAG, "Telemetry task - failed to prepare Lora");
-		SysMgr_checkout(checkout_lora, check_fail);
-		vTaskDelay(pdMS_TO_TICKS( 1000 ));
-	}
+#if defined (CONFIG_KPPTR_GROUND_STATION)
+	uint8_t rx_buf[LORA_RX_BUFFER_SIZE];
+	uint16_t rx_len = 0;
+	int8_t rssi = 0, snr = 0;
+	TickType_t xLastWakeTime = 0;
 
+	Boot_wait(BOOT_BIT(boot_lora) | BOOT_BIT(boot_utils), portMAX_DELAY);	// Received frames blink the RF LED
 	SysMgr_checkout(checkout_lora, check_ready);
+	SysMgr_heartbeatInit(checkout_lora, 2);
+	xLastWakeTime = xTaskGetTickCount ();
 	while(1){
-		if(xQueueReceive(queue_MainToTelemetry, &DataPackageRF_d, 100)){
-			LORA_sendPacketLoRa((uint8_t *)&DataPackageRF_d, sizeof(DataPackageRF_t), LORA_TX_NO_WAIT);
+		vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS( 2 ));	// Much shorter than airtime of the shortest frame
+		SysMgr_heartbeat(checkout_lora);
+
+		rx_len = sizeof(rx_buf);
+		switch(LORA_receivePacketLoRa(rx_buf, &rx_len, &rssi, &snr)){
+		case ESP_OK:
+			GS_pushFrame(rx_buf, rx_len, rssi, snr, esp_timer_get_time());
+			LED_blinkWS(LED_RF, COLOUR_BLUE, 20, 50, 0, 1);
+			break;
+
+		case ESP_ERR_INVALID_CRC:
+		case ESP_ERR_INVALID_SIZE:
+			GS_reportRxError();
+			break;
+
+		default:
+			break;
 		}
 	}
+#else
+	Boot_wait(BOOT_BIT(boot_lora), portMAX_DELAY);
+	SysMgr_checkout(checkout_lora, check_ready);
+	SysMgr_heartbeatInit(checkout_lora, 1000 / RF_RATE_HZ);
+	while(1){
+		TLM_service(sink_lora, pdMS_TO_TICKS( 1000 / RF_RATE_HZ ));	// Heartbeat also without samples - a stopped producer is not a LoRa fault
+		SysMgr_heartbeat(checkout_lora);
+	}
+#endif
 #else
 	SysMgr_checkout(checkout_lora, check_ready);
 	while(1){
@@ -145,62 +247,95 @@ void task_kpptr_telemetry(void *pvParameter){
 }
 
 
-void task_kpptr_storage(void *pvParameter){
-	TickType_t xLastWakeTime = 0;
-	while(Storage_init() != ESP_OK){
-		ESP_LOGW(TAG, "Storage task - failed to prepare storage");
-		SysMgr_checkout(checkout_storage, check_void);
-		vTaskDelay(pdMS_TO_TICKS( 3000 ));
+static uint32_t storage_error_cnt = 0;
+
+static esp_err_t storage_encode(const TLM_sample_t * sample, void * ctx){
+	esp_err_t write_status = ESP_FAIL;
+
+	SysMgr_taskMonitorStart(taskmon_storage);
+	// After repeated errors retry only every 100th packet, others are dropped and reported as a gap
+	if((storage_error_cnt < 10) || ((storage_error_cnt % 100) == 0)){
+		TRACE_BEGIN(t_storage);
+		write_status = DM_storeRecord(&sample->data, Storage_writePacket);
+		TRACE_END(TRACE_STORAGE_WRITE, t_storage);
+
+		if(write_status != ESP_OK){
+			ESP_LOGE(TAG, "Storage task - packet write fail");
+			storage_error_cnt++;
+		} else {
+			storage_error_cnt = 0;	// Reset error counter if write successful
+		}
+	} else {
+		DM_dropRecord(&sample->data);
+		storage_error_cnt++;
 	}
+	SysMgr_taskMonitorEnd(taskmon_storage);
 
-	DataPackage_t * DataPackage_ptr;
-	uint32_t write_error_cnt = 0;
+	return write_status;
+}
 
-	vTaskDelay(pdMS_TO_TICKS( 2000 ));
+// Storage queue full - before launch every sample, the queue keeps the newest DM_STORAGE_DEPTH as pre-launch history
+static void IRAM_ATTR storage_drop(const TLM_sample_t * sample, void * ctx){
+	DM_overwriteRecord(&sample->data);
+}
+
+void task_kpptr_storage(void *pvParameter){
+	TickType_t xLastWakeTime = 0;
+
+	Boot_wait(BOOT_BIT(boot_storage), portMAX_DELAY);
 	ESP_LOGI(TAG, "Task Storage - ready!");
 	SysMgr_checkout(checkout_storage, check_ready);
 
+	SysMgr_taskMonitorInit(taskmon_storage, 10, 10);	// Paced by main task packets, not by the 2 tick loop
 	xLastWakeTime = xTaskGetTickCount ();
 	while(1){
 		vTaskDelayUntil(&xLastWakeTime, 2);	// Minimum 2 Ticks for 1 loop - avoid blocking Flash memory for too long
+		SysMgr_heartbeat(checkout_storage);	// Task monitor runs only in flight
 
 		if((FSD_getState() >= FLIGHTSTATE_ME_ACCELERATING) && (FSD_getState() < FLIGHTSTATE_SHUTDOWN)){
-			if(DM_getUsedPointerFromMainRB_wait(&DataPackage_ptr) == ESP_OK){	//wait max 100ms for new data
-				if(write_error_cnt < 1000){
-					if(Storage_writePacket((void*)DataPackage_ptr, sizeof(DataPackage_t)) != ESP_OK){
-						ESP_LOGE(TAG, "Storage task - packet write fail");
-						write_error_cnt++;
-					} else {
-						write_error_cnt = 0;	// Reset error counter if write successful
-					}
+			DM_storageStart();
+			uint16_t burst = DM_storageBurstSize(TLM_waiting(sink_flash));	// Above high watermark drain without waiting for next tick
+			while(burst--){
+				if(TLM_service(sink_flash, pdMS_TO_TICKS( 100 )) == ESP_ERR_TIMEOUT){	//wait max 100ms for new data
+					ESP_LOGI(TAG, "Storage timeout");
+					if(storage_error_cnt < 10)
+						DM_storeFlush(Storage_writePacket);	// Idle - write the partial log chunk
+					break;
 				}
-				DM_returnUsedPointerToMainRB(&DataPackage_ptr);
-			} else {
-				ESP_LOGI(TAG, "Storage timeout");
 			}
+		} else if(storage_error_cnt < 10){
+			if(DM_storeFlush(Storage_writePacket) != ESP_OK)	// Last records of the flight, nothing to do once written
+				storage_error_cnt++;
 		}
 	}
 }
 
-void task_kpptr_utils(void *pvParameter){
-	TickType_t xLastWakeTime = 0;
-	uint32_t interval_ms = 20;
-	DataPackage_t DataPackage_d;
-
-	esp_err_t status = ESP_FAIL;
-	while(status != ESP_OK){
-		status  = ESP_OK;
-		status |= LED_init(interval_ms);
-		status |= BUZZER_init();
-		status |= IGN_init();
-
-		if(status != ESP_OK){
-			ESP_LOGW(TAG, "Task Utils - failed to init!");
-			SysMgr_checkout(checkout_utils, check_fail);
-			vTaskDelay(pdMS_TO_TICKS( 1000 ));
+static esp_err_t web_encode(const TLM_sample_t * sample, void * ctx){
+	Web_live_from_DataPackage(&sample->data);
+
+#if defined GNSS_UART
+	// change GNSS component status if fix is OK
+	if(GPS_checkStatus() == ESP_OK){
+		static sysmgr_checkout_state_t gnss_ready_check = check_void;
+		if((gnss_ready_check == check_void)
+				/*&& (DataPackage_ptr->sensors.gnss_fix)*/){
+			gnss_ready_check = check_ready;
+			SysMgr_checkout(checkout_gnss, check_ready);
 		}
+	} else {
+		SysMgr_checkout(checkout_gnss, check_fail);
 	}
+#endif
+
+	return ESP_OK;
+}
 
+void task_kpptr_utils(void *pvParameter){
+	TickType_t xLastWakeTime = 0;
+	uint32_t interval_ms = UTILS_INTERVAL_MS;
+	uint8_t led_cnt = 0;
+
+	Boot_wait(BOOT_BIT(boot_utils), portMAX_DELAY);
 	ESP_LOGI(TAG, "Task Utils - ready!");
 
 #if !defined GNSS_UART
@@ -208,50 +343,44 @@ void task_kpptr_utils(void *pvParameter){
 #endif
 
 	SysMgr_checkout(checkout_utils, check_ready);
+	SysMgr_taskMonitorInit(taskmon_utils, interval_ms, interval_ms);
 	xLastWakeTime = xTaskGetTickCount ();
 	while(1){
 		vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS( interval_ms ));
-		LED_srv();
+		SysMgr_taskMonitorStart(taskmon_utils);
+		if(++led_cnt >= gov_led_div){
+			led_cnt = 0;
+			LED_srv();
+		}
 		IGN_srv(pdTICKS_TO_MS(xTaskGetTickCount ()));
 
-		if(xQueueReceive(queue_MainToWeb, &DataPackage_d, 0)){
-			Web_live_from_DataPackage(&DataPackage_d);
-
-#if defined GNSS_UART
-			// change GNSS component status if fix is OK
-			if(GPS_checkStatus() == ESP_OK){
-				static sysmgr_checkout_state_t gnss_ready_check = check_void;
-				if((gnss_ready_check == check_void)
-						/*&& (DataPackage_ptr->sensors.gnss_fix)*/){
-					gnss_ready_check = check_ready;
-					SysMgr_checkout(checkout_gnss, check_ready);
-				}
-			} else {
-				SysMgr_checkout(checkout_gnss, check_fail);
-			}
-#endif
-
-		}
+		TLM_service(sink_web, 0);
+		SysMgr_taskMonitorEnd(taskmon_utils);
 	}
 	vTaskDelete(NULL);
 }
 
 void task_kpptr_analog(void *pvParameter){
 	TickType_t 				xLastWakeTime = 0;
-	uint32_t 				interval_ms = 100;
+	uint32_t 				interval_ms = ANALOG_INTERVAL_MS;
+	uint8_t 				meas_cnt = 0;
 	sysmgr_checkout_state_t vbat_ok = check_void;
 	Analog_meas_t 			Analog_meas;
 
-	while(Analog_init(100, 0.2f) != ESP_OK){
-		ESP_LOGW(TAG, "Task Analog - failed to init!");
-		SysMgr_checkout(checkout_analog, check_fail);
-		vTaskDelay(pdMS_TO_TICKS( 1000 ));
-	}
+	Boot_wait(BOOT_BIT(boot_analog) | BOOT_BIT(boot_utils), portMAX_DELAY);	// Continuity is shown on the IGN LEDs
 	ESP_LOGI(TAG, "Task Analog - ready!");
 
+	SysMgr_taskMonitorInit(taskmon_analog, interval_ms, interval_ms);
 	xLastWakeTime = xTaskGetTickCount ();
 	while(1){
 		vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS( interval_ms ));
+		SysMgr_taskMonitorStart(taskmon_analog);
+		if(++meas_cnt < gov_analog_div){
+			SysMgr_taskMonitorEnd(taskmon_analog);	// Main task keeps the last measurement
+			continue;
+		}
+		meas_cnt = 0;
+
 		Analog_update(&Analog_meas);
 		Web_status_updateAnalog(Analog_meas.vbat_mV/1000.0f,
 								Analog_getIGNstate(&Analog_meas, 0), Analog_getIGNstate(&Analog_meas, 1),
@@ -267,17 +396,69 @@ void task_kpptr_analog(void *pvParameter){
 		}
 
 		xQueueOverwrite(queue_AnalogToMain, (void *)&Analog_meas);
+		SysMgr_taskMonitorEnd(taskmon_analog);
 	}
 	vTaskDelete(NULL);
 }
 
+#if defined (CONFIG_KPPTR_FLIGHT_GOVERNOR)
+/*
+ * From liftoff to the end of the main chute descent the storage task competes on core 0 only with the
+ * telemetry. WiFi is stopped, LED, buzzer and analog run slower and storage gets a higher priority.
+ * Deadline misses and flash drops of the flight are logged at landing - compare with the governor off.
+ */
+static void main_governor(flightstate_t state){
+	static bool flight = false;
+	static uint32_t main_miss = 0;
+	static uint32_t storage_miss = 0;
+	static uint32_t flash_dropped = 0;
+	bool in_flight = (state >= FLIGHTSTATE_ME_ACCELERATING) && (state <= FLIGHTSTATE_MAINSHUTE_FALL);
+
+	if(in_flight == flight)
+		return;
+	flight = in_flight;
+
+	if(flight){
+		main_miss 	  = SysMgr_getTaskMonitor(taskmon_main)->deadline_miss;
+		storage_miss  = SysMgr_getTaskMonitor(taskmon_storage)->deadline_miss;
+		flash_dropped = TLM_getStats(sink_flash).dropped;
+
+		vTaskPrioritySet(task_storage_handle, GOV_STORAGE_PRIORITY);
+		gov_analog_div = GOV_ANALOG_DIV;
+		gov_led_div = GOV_LED_DIV;
+		LED_setInterval(UTILS_INTERVAL_MS * GOV_LED_DIV);
+#if defined (CONFIG_KPPTR_FLIGHT_WEB_OFF)
+		Web_off();
+#endif
+		ESP_LOGI(TAG, "Governor - flight mode");
+	} else {
+#if defined (CONFIG_KPPTR_FLIGHT_WEB_OFF)
+		Web_on();
+#endif
+		LED_setInterval(UTILS_INTERVAL_MS);
+		gov_led_div = 1;
+		gov_analog_div = 1;
+		vTaskPrioritySet(task_storage_handle, STORAGE_PRIORITY);
+
+		ESP_LOGI(TAG, "Governor - flight: %u main / %u storage deadline misses, %u samples dropped",
+				SysMgr_getTaskMonitor(taskmon_main)->deadline_miss - main_miss,
+				SysMgr_getTaskMonitor(taskmon_storage)->deadline_miss - storage_miss,
+				TLM_getStats(sink_flash).dropped - flash_dropped);
+	}
+}
+#endif
+
 void task_kpptr_sysmgr(void *pvParameter){
 	int64_t ready_to_arm_time = 0;
 	ESP_LOGI(TAG, "SysMgr ready");
 	SysMgr_checkout(checkout_sysmgr, check_ready);
+	Boot_wait(BOOT_BIT(boot_utils), portMAX_DELAY);	// Status LEDs
 
 	while(1){
-		SysMgr_update();	//Process new messages
+		SysMgr_update(pdMS_TO_TICKS( 100 ));	// Wakes on a state change, heartbeats checked at least at 10Hz
+#if defined (CONFIG_KPPTR_FLIGHT_GOVERNOR)
+		main_governor(FSD_getState());
+#endif
 
 		switch(SysMgr_getCheckoutStatus()){
 		case check_ready:
@@ -318,8 +499,20 @@ void task_kpptr_sysmgr(void *pvParameter){
 												SysMgr_getComponentState(checkout_storage), SysMgr_getComponentState(checkout_sysmgr),
 												SysMgr_getComponentState(checkout_utils), 	SysMgr_getComponentState(checkout_web),
 												SysMgr_getArm());
+		for(uint8_t i=0; i<SYSMGR_TASKMON_NUM; i++){
+			Web_status_updateTaskMonitor(i, SysMgr_getTaskMonitor(i));
+		}
+		for(uint8_t i=0; i<SYSMGR_CHECKOUT_NUM; i++){
+			Web_status_updateHeartbeat(i, SysMgr_getHeartbeat(i));
+		}
+		DM_storageStats_t storage_stats = DM_getStorageStats();
+		Web_status_updateStorage(&storage_stats);
+		Storage_setBackgroundErase(FSD_checkArmed() == DISARMED);		// Block erase stalls both cores - not in flight
+		Summary_persist();
+		DM_previewPersist(FSD_getState());
 
 		//--------------- Autoarming ----------------------------
+#if !defined (CONFIG_KPPTR_GROUND_STATION)
 		if(FSD_checkArmed() == DISARMED){
 			if(SysMgr_getCheckoutStatus() == check_ready){
 				if(ready_to_arm_time == 0){
@@ -334,42 +527,201 @@ void task_kpptr_sysmgr(void *pvParameter){
 				}
 			}
 		}
+#endif
+	}
+}
+
+//----------- Boot stages --------------
+// A failed attempt shows on the checkout of the task waiting for the stage, until a retry succeeds
+static esp_err_t boot_checkout(esp_err_t status, sysmgr_checkout_component_t component, sysmgr_checkout_state_t fail_state){
+	if(status != ESP_OK)
+		SysMgr_checkout(component, fail_state);
+	return status;
+}
+
+static esp_err_t boot_sensors_init(void * ctx){
+	return boot_checkout(Sensors_init(), checkout_main, check_fail);
+}
 
+static esp_err_t boot_gnss_init(void * ctx){
+	return boot_checkout(GPS_init(), checkout_gnss, check_fail);
+}
+
+static esp_err_t boot_ahrs_init(void * ctx){
+	return boot_checkout(AHRS_init(esp_timer_get_time()), checkout_main, check_fail);
+}
+
+static esp_err_t boot_fsd_init(void * ctx){
+	return boot_checkout(FSD_init(AHRS_getData()), checkout_main, check_fail);
+}
+
+static esp_err_t boot_www_init(void * ctx){
+	return Web_mountFS();
+}
+
+static esp_err_t boot_storage_init(void * ctx){
+	return boot_checkout(Storage_init(), checkout_storage, check_void);
+}
 
-		vTaskDelay(pdMS_TO_TICKS( 100 ));	// Limit loop rate to max 10Hz
+static esp_err_t boot_utils_init(void * ctx){
+	esp_err_t status = ESP_OK;
+
+	status |= LED_init(UTILS_INTERVAL_MS);
+	status |= BUZZER_init();
+	status |= IGN_init();
+	return boot_checkout(status, checkout_utils, check_fail);
+}
+
+static esp_err_t boot_analog_init(void * ctx){
+	return boot_checkout(Analog_init(100, 0.2f), checkout_analog, check_fail);
+}
+
+#if defined (RF_BUSY_PIN) && defined (RF_RST_PIN) && defined (SPI_SLAVE_SX1262_PIN)
+static esp_err_t boot_lora_init(void * ctx){
+	static bool radio_ready = false;		// Retry only the steps that failed
+	esp_err_t status = ESP_OK;
+
+	if(!radio_ready){
+		status = LORA_init();
+		radio_ready = (status == ESP_OK);
 	}
+
+#if defined (CONFIG_KPPTR_GROUND_STATION)
+	if(status == ESP_OK)
+		status = GS_init();					// Skips the parts done by a previous attempt
+	if(status == ESP_OK)
+		status = LORA_startReceiveLoRa();
+#endif
+	return boot_checkout(status, checkout_lora, check_fail);
 }
+#endif
+
+static esp_err_t boot_web_init(void * ctx){
+	esp_err_t status = Web_init();
+
+	if(status == ESP_OK)
+		SysMgr_checkout(checkout_web, check_ready);
+	return status;
+}
+
+/*
+ * Every stage initializes in its own task as soon as its dependencies are ready, the application tasks
+ * wait only for the stages they use. Boot-to-ready time of every stage is logged and served on /json/boot.
+ */
+static void main_boot(void){
+	Boot_init();
+
+	Boot_stageConfig_t sensors_cfg = { .name = "sensors", .init = boot_sensors_init, .retry_ms = 100, .core = ESP_CORE_1 };
+	boot_sensors = Boot_addStage(&sensors_cfg);
+
+	// Receiver start-up and configuration delays, in parallel with the sensors
+	Boot_stageConfig_t gnss_cfg = { .name = "gnss", .init = boot_gnss_init, .retry_ms = 100, .core = ESP_CORE_1 };
+	boot_gnss = Boot_addStage(&gnss_cfg);
+
+	Boot_stageConfig_t ahrs_cfg = { .name = "ahrs", .init = boot_ahrs_init, .depends = BOOT_BIT(boot_sensors), .retry_ms = 100, .core = ESP_CORE_1 };
+	boot_ahrs = Boot_addStage(&ahrs_cfg);
+
+	Boot_stageConfig_t fsd_cfg = { .name = "fsd", .init = boot_fsd_init, .depends = BOOT_BIT(boot_ahrs), .retry_ms = 100, .core = ESP_CORE_1 };
+	boot_fsd = Boot_addStage(&fsd_cfg);
 
+	// VFS registration is not thread safe - WWW partition first, then the log filesystem
+	Boot_stageConfig_t www_cfg = { .name = "www", .init = boot_www_init, .retry_ms = 0, .core = ESP_CORE_0 };
+	boot_www = Boot_addStage(&www_cfg);
+
+	Boot_stageConfig_t storage_cfg = { .name = "storage", .init = boot_storage_init, .depends = BOOT_BIT(boot_www), .retry_ms = 100, .core = ESP_CORE_0 };
+	boot_storage = Boot_addStage(&storage_cfg);
+
+	Boot_stageConfig_t utils_cfg = { .name = "utils", .init = boot_utils_init, .retry_ms = 100, .core = ESP_CORE_0 };
+	boot_utils = Boot_addStage(&utils_cfg);
+
+	Boot_stageConfig_t analog_cfg = { .name = "analog", .init = boot_analog_init, .retry_ms = 100, .core = ESP_CORE_0 };
+	boot_analog = Boot_addStage(&analog_cfg);
+
+#if defined (RF_BUSY_PIN) && defined (RF_RST_PIN) && defined (SPI_SLAVE_SX1262_PIN)
+	Boot_stageConfig_t lora_cfg = { .name = "lora", .init = boot_lora_init, .retry_ms = 100, .core = ESP_CORE_0 };
+	boot_lora = Boot_addStage(&lora_cfg);
+#endif
+
+	// Independent of the log - the server comes up with a flight on flash or during pre-erase. Web_init() can not be repeated.
+	Boot_stageConfig_t web_cfg = { .name = "web", .init = boot_web_init, .depends = BOOT_BIT(boot_www), .retry_ms = 0, .core = ESP_CORE_0 };
+	Boot_addStage(&web_cfg);
+
+	if(Boot_start() != ESP_OK)
+		ESP_LOGE(TAG, "Boot sequence not started");
+}
 
 void app_main(void)
 {
     nvs_flash_init();
     SysMgr_init();
-    if(Web_init() == ESP_OK){
-    	SysMgr_checkout(checkout_web, check_ready);
-    }
 	Preferences_init(&Preferences_data_d);
+    Summary_init();
+    DM_previewInit();
     SPI_init();
     DM_init();
 
+    //----- Telemetry sinks --------
+    TLM_init();
+    TLM_sinkConfig_t sink_flash_cfg = {
+        .name     = "flash",
+        .rate_hz  = 0,						// Logging policy, see task_kpptr_main
+        .depth    = DM_STORAGE_DEPTH,
+        .overflow = TLM_DROP_OLDEST,
+        .encode   = storage_encode,
+        .on_drop  = storage_drop,
+    };
+    sink_flash = TLM_addSink(&sink_flash_cfg);
+
+    TLM_sinkConfig_t sink_web_cfg = {
+        .name     = "web",
+        .rate_hz  = WEB_RATE_HZ,
+        .depth    = 1,
+        .overflow = TLM_DROP_OLDEST,
+        .encode   = web_encode,
+    };
+    sink_web = TLM_addSink(&sink_web_cfg);
+
+#if defined (RF_BUSY_PIN) && defined (RF_RST_PIN) && defined (SPI_SLAVE_SX1262_PIN) && !defined (CONFIG_KPPTR_GROUND_STATION)
+    TLM_sinkConfig_t sink_lora_cfg = {
+        .name     = "lora",
+        .rate_hz  = RF_RATE_HZ,
+        .depth    = 1,
+        .overflow = TLM_DROP_OLDEST,
+        .encode   = telemetry_encode,
+    };
+    sink_lora = TLM_addSink(&sink_lora_cfg);
+#endif
+
+#if defined (CONFIG_KPPTR_UART_STREAM)
+    if(Stream_init() != ESP_OK){
+        ESP_LOGE(TAG, "External UART stream not available");
+    }
+#endif
+
+    DM_logPolicy_t log_policy = {
+        .ascent_hz  = Preferences_data_d.log_ascent_hz,
+        .descent_hz = Preferences_data_d.log_descent_hz,
+        .landed_hz  = Preferences_data_d.log_landed_hz,
+    };
+    DM_setLogPolicy(&log_policy);
+
     //-----
     Web_status_updateconfig(0, 12345, Preferences_get().drouge_alt, Preferences_get().main_alt);
 
     //----- Create queues ----------
     queue_AnalogToMain    = xQueueCreate( 1, sizeof( Analog_meas_t ) );
-    queue_MainToTelemetry = xQueueCreate( 1, sizeof( DataPackageRF_t ) );
-    queue_MainToWeb 	  = xQueueCreate( 1, sizeof( DataPackage_t ) );
 
     //----- Check queues -----------
     if(queue_AnalogToMain == 0)
     	ESP_LOGE(TAG, "Failed to create queue -> queue_AnalogToMain");
 
+    main_boot();
+
     xTaskCreatePinnedToCore(&task_kpptr_sysmgr, 	"task_kpptr_sysmgr", 	1024*4, NULL, configMAX_PRIORITIES - 10, NULL, ESP_CORE_0);
     xTaskCreatePinnedToCore(&task_kpptr_utils, 		"task_kpptr_utils", 	1024*4, NULL, configMAX_PRIORITIES - 14, NULL, ESP_CORE_0);
     xTaskCreatePinnedToCore(&task_kpptr_analog, 	"task_kpptr_analog", 	1024*4, NULL, configMAX_PRIORITIES - 13, NULL, ESP_CORE_0);
-    xTaskCreatePinnedToCore(&task_kpptr_storage,	"task_kpptr_storage",   1024*4, NULL, configMAX_PRIORITIES - 3,  NULL, ESP_CORE_0);
+    xTaskCreatePinnedToCore(&task_kpptr_storage,	"task_kpptr_storage",   1024*4, NULL, STORAGE_PRIORITY,  &task_storage_handle, ESP_CORE_0);
     xTaskCreatePinnedToCore(&task_kpptr_telemetry,	"task_kpptr_telemetry", 1024*4, NULL, configMAX_PRIORITIES - 4,  NULL, ESP_CORE_0);
-    vTaskDelay(pdMS_TO_TICKS( 40 ));
     xTaskCreatePinnedToCore(&task_kpptr_main,		"task_kpptr_main",      1024*4, NULL, configMAX_PRIORITIES - 1,  NULL, ESP_CORE_1);
 
     while (true) {
@@ -0,0 +1,460 @@
+/*
+ * Host benchmark of the logging file systems - SimpleFS and LittleFS on the NOR flash simulator.
+ *
+ * Build (from repository root):
+ *   cc -O2 -std=gnu11 -DLFS_NO_DEBUG -DLFS_NO_WARN -DLFS_NO_ERROR -Itools/nor_sim -Itools/nor_sim/stubs \
+ *      -Icomponents/SimpleFS_driver/include -Icomponents/esp_littlefs/src/littlefs \
+ *      tools/fs_bench/fs_bench.c tools/nor_sim/nor_sim.c tools/nor_sim/sim_rtos.c \
+ *      components/SimpleFS_driver/SimpleFS_driver.c components/esp_littlefs/src/littlefs/lfs.c \
+ *      components/esp_littlefs/src/littlefs/lfs_util.c -o fs_bench
+ *
+ * Usage:
+ *   fs_bench [-r rate_Hz]... [-t log_s] [-c cycles] [-s seed] [--max]
+ *
+ * Every backend logs 114 B records (sizeof(DataPackage_t)) at each rate (default 100 and 500 Hz) into
+ * an empty storage partition of the default partition table, with power cut at a random time of the
+ * logging in every cycle. After the cut the file system is mounted again and the records are checked.
+ * LittleFS uses the configuration of sdkconfig (128 B read/prog, 4 kB cache, 128 B lookahead) and is
+ * run with a sync after every record (CONFIG_LITTLEFS_FLUSH_FILE_EVERY_WRITE), every 1 s and through
+ * the buffered writer of Storage_driver.c (4 kB buffer aligned to the file, sync every 1 s).
+ *
+ * SPIFFS is not included - it is part of ESP-IDF, there is no copy of it in this tree to build on host.
+ *
+ * Reported per backend and rate:
+ *   flash B/rec  - bytes programmed per record, metadata and padding included
+ *   ops/s        - flash reads + page programs + erases per second of logging
+ *   lat avg/max  - append latency from the record due time, sync and erase stalls included
+ *   late         - records appended more than one period after their due time
+ *   mount max    - mount after power cut, with the file opened for append
+ *   lost max     - records confirmed by the append call but missing after the cut
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "nor_sim.h"
+#include "SimpleFS_driver.h"
+#include "lfs.h"
+
+#define PARTITION_B			0xDF0000	// storage in partitions.csv
+#define RECORD_B			114			// sizeof(DataPackage_t)
+#define MAX_RATES			8
+#define SYNC_ALWAYS			0
+
+typedef struct __attribute__((__packed__)){
+	uint32_t seq;
+	uint8_t  fill[RECORD_B - 4];
+} record_t;
+
+typedef struct {
+	const char *name;
+	uint32_t sync_ms;			/*!< Commit period, SYNC_ALWAYS - after every record */
+	esp_err_t (*prepare)(void);	/*!< Format and mount before logging - not measured */
+	esp_err_t (*append)(const record_t *r);
+	esp_err_t (*sync)(void);
+	esp_err_t (*mount)(void);	/*!< Mount after power cut, ready to append */
+	int64_t   (*check)(void);	/*!< Returns number of valid records in sequence or -1 */
+} backend_t;
+
+typedef struct {
+	uint32_t acked;
+	uint64_t log_us;
+	uint64_t lat_sum_us;
+	uint32_t lat_max_us;
+	uint32_t late;
+	uint64_t ops;
+	uint64_t prog_B;
+	uint64_t mount_us;
+	int64_t  recovered;
+	bool     failed;			/*!< Append error before the power cut */
+} cycle_t;
+
+static uint32_t log_s = 30;
+
+static void fill_record(record_t *r, uint32_t seq){
+	r->seq = seq;
+	for(uint32_t i=0; i<sizeof(r->fill); i++){
+		r->fill[i] = (uint8_t)(seq * 31 + i);
+	}
+}
+
+static bool valid_record(const record_t *r, uint32_t seq){
+	record_t ref;
+
+	fill_record(&ref, seq);
+	return memcmp(r, &ref, sizeof(record_t)) == 0;
+}
+
+//---------------------------------- SimpleFS ---------------------------------
+static esp_err_t sfs_prepare(void){
+	while(SimpleFS_init("storage") != ESP_OK){
+		sim_rtos_runUntil(nor_sim_time_us() + 3000000);
+	}
+	SimpleFS_setBackgroundErase(false);		// Armed
+	return ESP_OK;
+}
+
+static esp_err_t sfs_append(const record_t *r){
+	return SimpleFS_appendPacket((void *)r, sizeof(record_t));
+}
+
+static esp_err_t sfs_sync(void){
+	return ESP_OK;		// Every packet is programmed directly
+}
+
+static esp_err_t sfs_mount(void){
+	SimpleFS_init("storage");	// Fails with data present, the data end is found anyway
+	return ESP_OK;
+}
+
+static int64_t sfs_check(void){
+	static uint8_t buf[SFS_MAX_CHUNK_SIZE_B];
+	uint32_t size  = SimpleFS_getFileSize();
+	uint32_t done  = 0;
+	int64_t  valid = 0;
+
+	SimpleFS_resetReadPointer();
+	while(done < size){
+		int32_t len = SimpleFS_readMemory(SFS_MAX_CHUNK_SIZE_B, buf);
+		if(len <= 0){
+			break;
+		}
+		for(int32_t pos=0; pos<len; pos+=sizeof(sfs_packet_t)){
+			if(valid_record((record_t *)((sfs_packet_t *)&buf[pos])->payload, valid)){
+				valid++;
+			}
+		}
+		done += len;
+	}
+	return valid;
+}
+
+//---------------------------------- LittleFS ---------------------------------
+static int lfs_bd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size){
+	return (nor_sim_read(block * c->block_size + off, buffer, size) == ESP_OK) ? LFS_ERR_OK : LFS_ERR_IO;
+}
+
+static int lfs_bd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size){
+	return (nor_sim_prog(block * c->block_size + off, buffer, size) == ESP_OK) ? LFS_ERR_OK : LFS_ERR_IO;
+}
+
+static int lfs_bd_erase(const struct lfs_config *c, lfs_block_t block){
+	return (nor_sim_erase(block * c->block_size, c->block_size) == ESP_OK) ? LFS_ERR_OK : LFS_ERR_IO;
+}
+
+static int lfs_bd_sync(const struct lfs_config *c){
+	(void)c;
+	return LFS_ERR_OK;
+}
+
+// sdkconfig: CONFIG_LITTLEFS_READ_SIZE, _WRITE_SIZE, _BLOCK_SIZE, _CACHE_SIZE, _LOOKAHEAD_SIZE, _BLOCK_CYCLES
+static const struct lfs_config lfs_cfg = {
+	.read 			= lfs_bd_read,
+	.prog 			= lfs_bd_prog,
+	.erase 			= lfs_bd_erase,
+	.sync 			= lfs_bd_sync,
+	.read_size 		= 128,
+	.prog_size 		= 128,
+	.block_size 	= 4096,
+	.block_count 	= PARTITION_B / 4096,
+	.cache_size 	= 4096,
+	.lookahead_size = 128,
+	.block_cycles 	= -1,
+};
+
+static lfs_t lfs;
+static lfs_file_t lfs_meas;
+
+static esp_err_t lfs_open(void){
+	if(lfs_mount(&lfs, &lfs_cfg) != LFS_ERR_OK){
+		return ESP_FAIL;
+	}
+	if(lfs_file_open(&lfs, &lfs_meas, "meas.bin", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) != LFS_ERR_OK){
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t lfs_prepare(void){
+	if(lfs_format(&lfs, &lfs_cfg) != LFS_ERR_OK){
+		return ESP_FAIL;
+	}
+	return lfs_open();
+}
+
+static esp_err_t lfs_append(const record_t *r){
+	return (lfs_file_write(&lfs, &lfs_meas, r, sizeof(record_t)) == sizeof(record_t)) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t lfs_sync(void){
+	return (lfs_file_sync(&lfs, &lfs_meas) == LFS_ERR_OK) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t lfs_remount(void){
+	return lfs_open();
+}
+
+static int64_t lfs_check(void){
+	lfs_file_t f;
+	record_t r;
+	int64_t valid = 0;
+
+	if(lfs_file_open(&lfs, &f, "meas.bin", LFS_O_RDONLY) != LFS_ERR_OK){
+		return -1;
+	}
+	while(lfs_file_read(&lfs, &f, &r, sizeof(r)) == sizeof(r)){
+		if(!valid_record(&r, valid)){
+			break;
+		}
+		valid++;
+	}
+	lfs_file_close(&lfs, &f);
+
+	return valid;
+}
+
+//---------------------------------- Storage_writePacket_File() on LittleFS ---------------------------------
+#define WRITER_BUF_B		4096		// CONFIG_KPPTR_STORAGE_BUFFER_B
+#define WRITER_COMMIT_US	1000000		// CONFIG_KPPTR_STORAGE_COMMIT_MS
+
+static uint8_t  writer_buf[WRITER_BUF_B];
+static uint32_t writer_len;
+static uint32_t writer_file_B;
+static uint64_t writer_commit_us;
+
+static esp_err_t writer_write(void){
+	if(writer_len == 0){
+		return ESP_OK;
+	}
+	if(lfs_file_write(&lfs, &lfs_meas, writer_buf, writer_len) != (lfs_ssize_t)writer_len){
+		return ESP_FAIL;
+	}
+
+	writer_file_B += writer_len;
+	writer_len = 0;
+	return ESP_OK;
+}
+
+static esp_err_t writer_commit(void){
+	writer_commit_us = nor_sim_time_us();
+
+	if(writer_write() != ESP_OK){
+		return ESP_FAIL;
+	}
+	return (lfs_file_sync(&lfs, &lfs_meas) == LFS_ERR_OK) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t writer_prepare(void){
+	writer_len = 0;
+	writer_file_B = 0;
+	writer_commit_us = nor_sim_time_us();
+	return lfs_prepare();
+}
+
+static esp_err_t writer_append(const record_t *r){
+	uint32_t buf_end = WRITER_BUF_B - (writer_file_B % WRITER_BUF_B);
+	uint32_t n = sizeof(record_t);
+
+	if(n > (buf_end - writer_len)){
+		n = buf_end - writer_len;
+	}
+	memcpy(&writer_buf[writer_len], r, n);
+	writer_len += n;
+
+	if(writer_len == buf_end){
+		if(writer_write() != ESP_OK){
+			writer_len -= n;
+			return ESP_FAIL;
+		}
+		memcpy(writer_buf, (const uint8_t *)r + n, sizeof(record_t) - n);
+		writer_len = sizeof(record_t) - n;
+	}
+
+	if((nor_sim_time_us() - writer_commit_us) >= WRITER_COMMIT_US){
+		writer_commit();
+	}
+	return ESP_OK;
+}
+
+static esp_err_t writer_sync(void){
+	return ESP_OK;		// Commit points are inside the writer
+}
+
+static const backend_t backends[] = {
+	{ "SimpleFS",      SYNC_ALWAYS, sfs_prepare, sfs_append, sfs_sync, sfs_mount,   sfs_check },
+	{ "LittleFS sync", SYNC_ALWAYS, lfs_prepare, lfs_append, lfs_sync, lfs_remount, lfs_check },
+	{ "LittleFS 1 s",  1000,        lfs_prepare, lfs_append, lfs_sync, lfs_remount, lfs_check },
+	{ "LittleFS buf",  SYNC_ALWAYS, writer_prepare, writer_append, writer_sync, lfs_remount, lfs_check },
+};
+
+//---------------------------------- Run ---------------------------------
+static const backend_t *backend;
+static uint32_t rate_hz;
+static double cut_at;			// Part of the logging time
+
+static void boot_log(cycle_t *c){
+	if(backend->prepare() != ESP_OK){
+		c->failed = true;
+		return;
+	}
+
+	const nor_sim_stats_t *st = nor_sim_getStats();
+	uint64_t ops0   = st->reads + st->progs + st->erases_sector + st->erases_block;
+	uint64_t prog_B = st->prog_B;
+	uint64_t period = 1000000 / rate_hz;
+	uint64_t start  = nor_sim_time_us();
+	uint64_t synced = start;
+
+	nor_sim_powerCut(start + cut_at * log_s * 1000000.0);
+
+	for(uint32_t seq=0; seq<(log_s * rate_hz); seq++){
+		uint64_t due = start + seq * period;
+		record_t r;
+
+		sim_rtos_runUntil(due);
+		if(!nor_sim_isPowered()){
+			break;
+		}
+
+		fill_record(&r, seq);
+		esp_err_t err = backend->append(&r);
+		if((err == ESP_OK) && ((backend->sync_ms == SYNC_ALWAYS) || ((nor_sim_time_us() - synced) >= backend->sync_ms * 1000ULL))){
+			err = backend->sync();
+			synced = nor_sim_time_us();
+		}
+		if(!nor_sim_isPowered()){
+			break;		// Not confirmed to the caller
+		}
+		if(err != ESP_OK){
+			c->failed = true;
+			break;
+		}
+
+		uint32_t lat = nor_sim_time_us() - due;
+		c->acked++;
+		c->lat_sum_us += lat;
+		if(lat > c->lat_max_us){
+			c->lat_max_us = lat;
+		}
+		if(lat > period){
+			c->late++;
+		}
+	}
+
+	c->log_us = nor_sim_time_us() - start;
+	c->ops    = st->reads + st->progs + st->erases_sector + st->erases_block - ops0;
+	c->prog_B = st->prog_B - prog_B;
+}
+
+static void boot_recover(cycle_t *c){
+	uint64_t t0 = nor_sim_time_us();
+
+	if(backend->mount() != ESP_OK){
+		c->recovered = -1;
+		return;
+	}
+	c->mount_us  = nor_sim_time_us() - t0;
+	c->recovered = backend->check();
+}
+
+/* One boot in a forked process - SimpleFS keeps its state in file-static variables */
+static void run_boot(void (*boot)(cycle_t *), cycle_t *c){
+	pid_t pid = fork();
+
+	if(pid == 0){
+		boot(c);
+		_exit(0);
+	} else if(pid > 0){
+		waitpid(pid, NULL, 0);
+	} else {
+		perror("fork");
+		exit(1);
+	}
+	nor_sim_powerOn();
+}
+
+int main(int argc, char **argv){
+	uint32_t rates[MAX_RATES] = {100, 500};
+	int rate_num = 0;
+	int cycles = 10;
+	uint64_t seed = 1;
+	const nor_sim_timing_t *timing = &nor_sim_timing_typ;
+
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "-r") && (i + 1 < argc) && (rate_num < MAX_RATES))	rates[rate_num++] = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-t") && (i + 1 < argc))						log_s = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-c") && (i + 1 < argc))						cycles = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && (i + 1 < argc))						seed = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "--max"))										timing = &nor_sim_timing_max;
+		else {
+			fprintf(stderr, "usage: %s [-r rate_Hz]... [-t log_s] [-c cycles] [-s seed] [--max]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(rate_num == 0)
+		rate_num = 2;
+
+	if((cycles < 1) || (log_s == 0) || (nor_sim_init(PARTITION_B, timing, seed) != ESP_OK)){
+		fprintf(stderr, "invalid configuration\n");
+		return 2;
+	}
+
+	cycle_t *res = mmap(NULL, sizeof(cycle_t) * cycles, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(res == MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+
+	printf("%u kB partition, %s flash timing, %u B records, %u s logging, %d power cuts per run\n", PARTITION_B / 1024,
+			(timing == &nor_sim_timing_max) ? "maximum" : "typical", RECORD_B, log_s, cycles);
+	printf("%-14s %5s  %11s %7s  %15s %6s  %9s %8s %6s\n", "backend", "Hz", "flash B/rec", "ops/s", "lat avg/max[ms]",
+			"late", "mount[ms]", "lost max", "errors");
+
+	for(size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++){
+		for(int ri = 0; ri < rate_num; ri++){
+			uint64_t acked = 0, log_us = 0, lat_sum = 0, ops = 0, prog_B = 0, mount_max = 0;
+			uint32_t lat_max = 0, late = 0, errors = 0;
+			int64_t lost_max = 0;
+			uint64_t rng = seed * 1000003ULL + ri;
+
+			backend = &backends[b];
+			rate_hz = rates[ri];
+			memset(res, 0, sizeof(cycle_t) * cycles);
+
+			for(int i = 0; i < cycles; i++){
+				cycle_t *c = &res[i];
+
+				rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+				cut_at = 0.1 + 0.9 * ((rng >> 11) * (1.0 / 9007199254740992.0));
+
+				nor_sim_fill(0xFF);		// Empty partition, like after the erase command
+				run_boot(boot_log, c);
+				run_boot(boot_recover, c);
+
+				acked += c->acked;
+				log_us += c->log_us;
+				lat_sum += c->lat_sum_us;
+				ops += c->ops;
+				prog_B += c->prog_B;
+				late += c->late;
+				if(c->lat_max_us > lat_max)
+					lat_max = c->lat_max_us;
+				if(c->mount_us > mount_max)
+					mount_max = c->mount_us;
+				if(c->failed || (c->recovered < 0))
+					errors++;
+				else if((int64_t)c->acked - c->recovered > lost_max)
+					lost_max = (int64_t)c->acked - c->recovered;
+			}
+
+			printf("%-14s %5u  %11.1f %7.0f  %6.2f / %6.1f %6u  %9.1f %8lld %6u\n", backend->name, rate_hz,
+					acked ? (double)prog_B / acked : 0.0, log_us ? ops * 1e6 / log_us : 0.0,
+					acked ? lat_sum * 1e-3 / acked : 0.0, lat_max * 1e-3, late, mount_max * 1e-3, (long long)lost_max, errors);
+		}
+	}
+
+	return 0;
+}
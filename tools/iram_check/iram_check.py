@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Lists flash resident code and constant data reachable from the main loop hot path.
+
+Runs after every build when CONFIG_KPPTR_HOT_PATH_IN_IRAM is set (see CMakeLists.txt). Manual use:
+  python tools/iram_check/iram_check.py --objdump xtensa-esp32s3-elf-objdump build/KP-PTR_firmware.elf
+
+Walks direct calls (call0/4/8/12 and jumps out of a function) and function addresses loaded from literal
+pools, starting at the roots. Calls through pointers filled at run time are not visible. A literal pointing
+into DROM is reported as flash constant data of the function that loads it. Cold functions matching
+--stop (init, logging, assert) are neither followed nor reported - a stall there does not matter.
+"""
+
+import argparse
+import bisect
+import fnmatch
+import re
+import struct
+import subprocess
+import sys
+
+# ESP32-S3 cache mapped address ranges
+IROM = (0x42000000, 0x44000000)
+DROM = (0x3C000000, 0x3E000000)
+IRAM = (0x40370000, 0x403E0000)
+
+DEFAULT_ROOTS = ["task_kpptr_main"]
+DEFAULT_STOP = ["*_init", "esp_log_*", "__assert_func", "abort", "vTaskDelete"]
+
+RE_FUNC = re.compile(r"^([0-9a-f]{8}) <([^>]+)>:$")
+RE_INSN = re.compile(r"^\s*([0-9a-f]+):\s+(\S+)\s*(.*)$")
+RE_TARGET = re.compile(r"([0-9a-f]{8}) <([^>+]+)(\+0x[0-9a-f]+)?>")
+RE_SYM = re.compile(r"^([0-9a-f]{8}) (.{7}) (\S+)\s+([0-9a-f]{8}) (.+)$")
+
+
+def in_range(addr, rng):
+	return rng[0] <= addr < rng[1]
+
+
+class Elf:
+	"""Minimal ELF32 little endian reader - just enough to fetch literal pool words."""
+
+	def __init__(self, path):
+		with open(path, "rb") as f:
+			self.data = f.read()
+		shoff, = struct.unpack_from("<I", self.data, 0x20)
+		shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+		self.sections = []
+		for i in range(shnum):
+			sh = struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize)
+			sh_type, sh_addr, sh_offset, sh_size = sh[1], sh[3], sh[4], sh[5]
+			if sh_type == 1 and sh_addr != 0:		# SHT_PROGBITS
+				self.sections.append((sh_addr, sh_addr + sh_size, sh_offset))
+
+	def word(self, addr):
+		for start, end, offset in self.sections:
+			if start <= addr and addr + 4 <= end:
+				return struct.unpack_from("<I", self.data, offset + addr - start)[0]
+		return None
+
+
+def run(cmd):
+	return subprocess.run(cmd, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+
+def load_symbols(objdump, elf):
+	"""Returns (sorted addresses, [(addr, size, name, is_func)]) of all defined symbols with a size."""
+	syms = []
+	for line in run([objdump, "-t", elf]).splitlines():
+		m = RE_SYM.match(line)
+		if m and int(m.group(4), 16) > 0:
+			syms.append((int(m.group(1), 16), int(m.group(4), 16), m.group(5).strip(), "F" in m.group(2)))
+	syms.sort()
+	return [s[0] for s in syms], syms
+
+
+def symbol_at(index, addr):
+	addrs, syms = index
+	i = bisect.bisect_right(addrs, addr) - 1
+	if i >= 0 and addr < syms[i][0] + syms[i][1]:
+		return syms[i]
+	return None
+
+
+def load_code(objdump, elf, image):
+	"""Returns {function: (address, {callees}, {flash constant addresses})}."""
+	funcs = {}
+	name = None
+	for line in run([objdump, "-d", "--no-show-raw-insn", elf]).splitlines():
+		m = RE_FUNC.match(line)
+		if m:
+			name = m.group(2)
+			funcs[name] = (int(m.group(1), 16), set(), set())
+			continue
+		m = RE_INSN.match(line)
+		if not m or name is None:
+			continue
+		op, args = m.group(2), m.group(3)
+		t = RE_TARGET.search(args)
+		if op.startswith("call") and not op.startswith("callx") and t:
+			funcs[name][1].add(t.group(2))
+		elif op == "j" and t and t.group(2) != name:
+			funcs[name][1].add(t.group(2))
+		elif op == "l32r" and t:
+			value = image.word(int(t.group(1), 16))
+			if value is None:
+				continue
+			if in_range(value, IROM) or in_range(value, IRAM):
+				funcs[name][1].add(value)	# Address taken, probably called through a pointer
+			elif in_range(value, DROM):
+				funcs[name][2].add(value)
+	return funcs
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("elf")
+	parser.add_argument("--objdump", default="xtensa-esp32s3-elf-objdump")
+	parser.add_argument("--root", action="append", help="hot path entry (default: %s)" % " ".join(DEFAULT_ROOTS))
+	parser.add_argument("--stop", action="append", help="cold function pattern (default: %s)" % " ".join(DEFAULT_STOP))
+	parser.add_argument("--strict", action="store_true", help="exit with error if anything is reported")
+	args = parser.parse_args()
+
+	roots = args.root or DEFAULT_ROOTS
+	stop = args.stop or DEFAULT_STOP
+	image = Elf(args.elf)
+	index = load_symbols(args.objdump, args.elf)
+	funcs = load_code(args.objdump, args.elf, image)
+	by_addr = {v[0]: k for k, v in funcs.items()}
+
+	parent = {r: None for r in roots if r in funcs}
+	queue = list(parent)
+	flash_code, flash_data = [], []
+	while queue:
+		name = queue.pop(0)
+		addr, callees, consts = funcs[name]
+		if in_range(addr, IROM):
+			flash_code.append(name)
+		for c in sorted(consts):
+			sym = symbol_at(index, c)
+			flash_data.append((name, sym[2] if sym else "0x%08x" % c))
+		for callee in callees:
+			if isinstance(callee, int):
+				callee = by_addr.get(callee)
+			if callee is None or callee not in funcs or callee in parent:
+				continue
+			if any(fnmatch.fnmatchcase(callee, p) for p in stop):
+				continue
+			parent[callee] = name
+			queue.append(callee)
+
+	def path(name):
+		chain = []
+		while name is not None:
+			chain.append(name)
+			name = parent[name]
+		return " <- ".join(chain)
+
+	for name in flash_code:
+		print("iram_check: code in flash: %s" % path(name))
+	for name, const in flash_data:
+		print("iram_check: data in flash: %s used by %s" % (const, path(name)))
+	print("iram_check: %d functions reachable from %s, %d in flash, %d flash constant references"
+		  % (len(parent), ", ".join(roots), len(flash_code), len(flash_data)))
+
+	return 1 if (args.strict and (flash_code or flash_data)) else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
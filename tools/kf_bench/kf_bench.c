@@ -0,0 +1,187 @@
+/*
+ * Host benchmark for the vertical altitude/velocity filter (AHRS_driver/KF_AltitudeAscent.c).
+ *
+ * Build (from repository root):
+ *   cc -O2 -std=c11 -Icomponents/AHRS_driver/include tools/kf_bench/kf_bench.c \
+ *      components/AHRS_driver/KF_AltitudeAscent.c -o kf_bench -lm
+ *
+ * Usage:
+ *   kf_bench [gnss_latency_ms]
+ *
+ * Simulates a boost/coast flight at 100 Hz with a barometric bias bump around Mach 1 and GNSS altitude
+ * at 5 Hz delivered with a fixed latency. Prints altitude/velocity errors for baro only, GNSS fused at
+ * receive time and GNSS fused at time of validity, then the per-step cost of the filter.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "KF_AltitudeAscent.h"
+
+#define RATE_HZ			100
+#define FLIGHT_S		40
+#define GNSS_PERIOD_MS	200
+
+#define Q_ACCEL			1.0f
+#define R_BARO			0.1f
+#define Q_BIAS			0.0003f
+#define R_GNSS_ALT		25.0f
+#define R_GNSS_VEL		0.25f
+
+typedef enum {
+	MODE_BARO,			// Baro only - original filter
+	MODE_GNSS_NOW,		// GNSS fused as if it was valid at receive time
+	MODE_GNSS_DELAYED,	// GNSS fused at time of validity
+} sim_mode_t;
+
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+static double rnd_uniform(void){
+	rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double rnd_normal(void){
+	return sqrt(-2.0 * log(rnd_uniform())) * cos(6.283185307179586 * rnd_uniform());
+}
+
+static double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//---------------------------------- Flight model ---------------------------------
+typedef struct {
+	double h[FLIGHT_S * RATE_HZ];
+	double v[FLIGHT_S * RATE_HZ];
+	double a[FLIGHT_S * RATE_HZ];
+} trajectory_t;
+
+static trajectory_t traj;
+
+static void simulate_trajectory(void){
+	double h = 0.0, v = 0.0;
+	double dt = 1.0 / RATE_HZ;
+
+	for(int i = 0; i < FLIGHT_S * RATE_HZ; i++){
+		double t = i * dt;
+		double thrust = (t < 3.0) ? 110.0 : 0.0;
+		double drag = 0.0004 * v * fabs(v);
+		double a = thrust - 9.81 - drag;
+
+		traj.h[i] = h;
+		traj.v[i] = v;
+		traj.a[i] = a;
+
+		h += v * dt + 0.5 * a * dt * dt;
+		v += a * dt;
+	}
+}
+
+/* Static pressure error around Mach 1 plus scale error of the standard atmosphere */
+static double baro_bias(double h, double v){
+	double mach_err = 40.0 * exp(-pow((v - 330.0) / 40.0, 2));
+	return mach_err + 0.02 * h;
+}
+
+//---------------------------------- Run ---------------------------------
+static void run(sim_mode_t mode, int latency_ms, double *rms_h, double *max_h, double *rms_v){
+	float dt = 1.0f / RATE_HZ;
+	float h_est = 0.0f, v_est = 0.0f;
+	double sum_h = 0.0, sum_v = 0.0, worst = 0.0;
+	int latency_steps = latency_ms * RATE_HZ / 1000;
+
+	// GNSS fixes, each delivered latency_steps after its epoch
+	static float gnss_alt[FLIGHT_S * RATE_HZ];
+	int gnss_period = GNSS_PERIOD_MS * RATE_HZ / 1000;
+
+	rng_state = 0x853c49e6748fea9bULL;
+	AHRS_kalmanAltitudeAscent_init(Q_ACCEL, R_BARO, Q_BIAS, R_GNSS_ALT, R_GNSS_VEL);
+
+	for(int i = 0; i < FLIGHT_S * RATE_HZ; i++){
+		int64_t time_us = (int64_t)i * 1000000 / RATE_HZ;
+		float acc = traj.a[i] + 0.3 * rnd_normal() + 0.05;
+		float baro = traj.h[i] + baro_bias(traj.h[i], traj.v[i]) + 0.5 * rnd_normal();
+
+		AHRS_kalmanAltitudeAscent_step(time_us, dt, baro, acc, &h_est, &v_est);
+
+		if((i % gnss_period) == 0)
+			gnss_alt[i] = traj.h[i] + 3.0 * rnd_normal();
+
+		int fix = i - latency_steps;
+		if((mode != MODE_BARO) && (fix >= 0) && ((fix % gnss_period) == 0)){
+			int64_t meas_time_us = (mode == MODE_GNSS_DELAYED) ? (int64_t)fix * 1000000 / RATE_HZ : time_us;
+			AHRS_kalmanAltitudeAscent_delayedUpdate(meas_time_us, gnss_alt[fix], NAN, &h_est, &v_est);
+		}
+
+		double err_h = h_est - traj.h[i];
+		double err_v = v_est - traj.v[i];
+		sum_h += err_h * err_h;
+		sum_v += err_v * err_v;
+		if(fabs(err_h) > worst)
+			worst = fabs(err_h);
+	}
+
+	*rms_h = sqrt(sum_h / (FLIGHT_S * RATE_HZ));
+	*rms_v = sqrt(sum_v / (FLIGHT_S * RATE_HZ));
+	*max_h = worst;
+}
+
+//---------------------------------- Timing ---------------------------------
+static void timing(void){
+	const int steps = 1000000;
+	float h, v;
+	volatile float sink = 0.0f;
+
+	AHRS_kalmanAltitudeAscent_init(Q_ACCEL, R_BARO, Q_BIAS, R_GNSS_ALT, R_GNSS_VEL);
+	double t0 = now_s();
+	for(int i = 0; i < steps; i++){
+		AHRS_kalmanAltitudeAscent_step((int64_t)i * 10000, 0.01f, 0.01f * i, 0.1f, &h, &v);
+		sink += h;
+	}
+	double t_step = (now_s() - t0) / steps;
+
+	// Worst case - measurement at the oldest history entry, full replay
+	const int updates = 100000;
+	t0 = now_s();
+	for(int i = 0; i < updates; i++){
+		int64_t newest = (int64_t)(steps + i) * 10000;
+		AHRS_kalmanAltitudeAscent_step(newest, 0.01f, 0.01f * i, 0.1f, &h, &v);
+		AHRS_kalmanAltitudeAscent_delayedUpdate(newest - (KF_HISTORY_SIZE - 1) * 10000, 0.01f * i, NAN, &h, &v);
+		sink += h;
+	}
+	double t_replay = (now_s() - t0) / updates - t_step;
+
+	printf("cost: step %.0f ns, delayed update with %d step replay %.0f ns\n",
+			t_step * 1e9, KF_HISTORY_SIZE - 1, t_replay * 1e9);
+	printf("      per 10 ms cycle: %.2f%% (step), %.2f%% (step + worst case replay)\n",
+			100.0 * t_step / 0.01, 100.0 * (t_step + t_replay) / 0.01);
+	printf("      history %zu B, filter %zu B\n", sizeof(((KF_AltitudeAscent_t *)0)->history), sizeof(KF_AltitudeAscent_t));
+	(void)sink;
+}
+
+int main(int argc, char **argv){
+	int latency_ms = (argc > 1) ? atoi(argv[1]) : 100;
+	static const char *names[] = {"baro only", "GNSS at rx time", "GNSS delayed"};
+
+	simulate_trajectory();
+
+	double apogee = 0.0;
+	for(int i = 0; i < FLIGHT_S * RATE_HZ; i++)
+		apogee = fmax(apogee, traj.h[i]);
+
+	printf("GNSS %d ms period, %d ms latency, apogee %.0f m\n", GNSS_PERIOD_MS, latency_ms, apogee);
+	for(sim_mode_t mode = MODE_BARO; mode <= MODE_GNSS_DELAYED; mode++){
+		double rms_h, max_h, rms_v;
+		run(mode, latency_ms, &rms_h, &max_h, &rms_v);
+		printf("%-16s altitude RMS %6.2f m, max %6.2f m, velocity RMS %5.2f m/s\n", names[mode], rms_h, max_h, rms_v);
+	}
+
+	timing();
+	return 0;
+}
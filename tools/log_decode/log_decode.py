@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+Decodes a log in format v2 (see components/DataManager/include/DataManager_log.h) into one CSV per record type.
+
+  python tools/log_decode/log_decode.py meas.bin -o flight/
+
+Takes meas.bin as downloaded from the device - raw SimpleFS packets (0xAA55 header, 122 B payload, CRC16, packets
+with a bad CRC are skipped) or the record stream of the LittleFS / SPIFFS backends. A time window from
+/download?from_ms=..&to_ms=.. starts with its own header and schema packets and decodes the same way. Record types are read from the SCHEMA records of the
+stream, the decoder knows only the framing and the time records. Every row gets the monotonic time of its
+sample and, once the stream has a GNSS anchor, UTC from the latest anchor. Unknown tags are skipped and counted.
+"""
+
+import argparse
+import csv
+import datetime
+import os
+import re
+import struct
+import sys
+
+CHUNK_B = 122
+SFS_PACKET_B = 128
+SFS_PRE = 0xAA55
+
+TAG_PAD = 0x00
+TAG_HEADER = 0x01
+TAG_SCHEMA = 0x02
+TAG_TIME = 0x03
+TAG_TIME_DELTA = 0x04
+TAG_UTC = 0x05
+
+RE_CODE = re.compile(r"(\d*)([bBhHiIqQf])")
+
+
+class Schema:
+	"""One record type - "name:format:field,field,..." with an optional count before a format code."""
+
+	def __init__(self, text):
+		self.name, fmt, fields = text.split(":", 2)
+		self.codes = [(int(n) if n else 1, c) for n, c in RE_CODE.findall(fmt)]
+		self.fields = fields.split(",")
+		self.struct = struct.Struct("<" + "".join("%d%s" % (n, c) for n, c in self.codes))
+		self.columns = []
+		for (n, _), name in zip(self.codes, self.fields):
+			self.columns += [name] if n == 1 else ["%s_%d" % (name, i) for i in range(n)]
+
+	def decode(self, payload):
+		# Fields appended by a newer writer are skipped, missing fields of an older one stay empty
+		if len(payload) < self.struct.size:
+			known = []
+			size = 0
+			for n, c in self.codes:
+				step = struct.calcsize("<%d%s" % (n, c))
+				if size + step > len(payload):
+					break
+				known += struct.unpack_from("<%d%s" % (n, c), payload, size)
+				size += step
+			return known + [""] * (len(self.columns) - len(known))
+		return list(self.struct.unpack_from(payload))
+
+
+def crc16(data):
+	"""esp_crc16_le(UINT16_MAX, ...) - CRC-16/CCITT, reflected, inverted in and out."""
+	crc = 0
+	for b in data:
+		crc ^= b
+		for _ in range(8):
+			crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+	return crc ^ 0xFFFF
+
+
+def chunks(data, stats):
+	"""Yields the chunks of a SimpleFS image, or the whole file of a file backend. Packets with a bad CRC are skipped."""
+	if len(data) >= 4 and struct.unpack_from("<H", data)[0] == SFS_PRE:
+		for pos in range(0, len(data) - SFS_PACKET_B + 1, SFS_PACKET_B):
+			if struct.unpack_from("<H", data, pos)[0] != SFS_PRE:
+				break			# Erased flash, end of the log
+			# header.packet_len is the packet size in words - the payload is always the full CHUNK_B
+			packet = data[pos:pos + SFS_PACKET_B]
+			if struct.unpack_from("<H", packet, SFS_PACKET_B - 2)[0] != crc16(packet[:-2]):
+				stats["crc_errors"] += 1
+				continue
+			yield packet[4:4 + CHUNK_B]
+	else:
+		yield data
+
+
+def decode(data, output):
+	"""Writes one CSV per record type into output. Returns the rows per record type, unknown tags and the CRC errors."""
+	os.makedirs(output, exist_ok=True)
+
+	schemas = {}
+	writers = {}
+	files = []
+	counts = {}
+	unknown = {}
+	stats = {"crc_errors": 0}
+	time_us = None
+	anchor = None
+
+	def row(tag, payload):
+		schema = schemas[tag]
+		if tag not in writers:
+			f = open(os.path.join(output, schema.name + ".csv"), "w", newline="")
+			files.append(f)
+			writers[tag] = csv.writer(f)
+			writers[tag].writerow(["time_us", "utc"] + schema.columns)
+		utc = ""
+		if anchor is not None and time_us is not None:
+			utc_us = anchor[1] + time_us - anchor[0]
+			utc = datetime.datetime.fromtimestamp(utc_us / 1e6, datetime.timezone.utc).isoformat(timespec="microseconds")
+		writers[tag].writerow(["" if time_us is None else time_us, utc] + schema.decode(payload))
+		counts[schema.name] = counts.get(schema.name, 0) + 1
+
+	for chunk in chunks(data, stats):
+		in_sync = False			# Records before the first full time of a chunk belong to no known sample
+		pos = 0
+		while pos + 2 <= len(chunk):
+			tag, length = chunk[pos], chunk[pos + 1]
+			if tag == TAG_PAD:
+				break
+			payload = chunk[pos + 2:pos + 2 + length]
+			pos += 2 + length
+			if len(payload) < length:
+				print("Truncated record 0x%02x" % tag, file=sys.stderr)
+				break
+
+			if tag == TAG_HEADER:
+				magic, version, device_id, rate = struct.unpack_from("<4sBHH", payload)
+				print("%s v%d, device %d, %d Hz" % (magic.decode(errors="replace"), version, device_id, rate))
+				continue
+			if tag == TAG_SCHEMA:
+				schemas[payload[0]] = Schema(payload[1:].decode())
+				continue
+			if tag == TAG_TIME:
+				time_us = struct.unpack_from("<Q", payload)[0]
+				in_sync = True
+				continue
+			if tag == TAG_TIME_DELTA:
+				if in_sync:
+					time_us += struct.unpack_from("<I", payload)[0]
+				continue
+			if tag == TAG_UTC:
+				anchor = struct.unpack_from("<Qq", payload)
+
+			if tag in schemas:
+				row(tag, payload)
+			else:
+				unknown[tag] = unknown.get(tag, 0) + 1
+
+	for f in files:
+		f.close()
+	return counts, unknown, stats["crc_errors"]
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("log", help="meas.bin")
+	parser.add_argument("-o", "--output", default=".", help="output directory (default: current)")
+	args = parser.parse_args()
+
+	with open(args.log, "rb") as f:
+		data = f.read()
+
+	counts, unknown, crc_errors = decode(data, args.output)
+	for name, n in sorted(counts.items()):
+		print("%-12s %8d" % (name, n))
+	for tag, n in sorted(unknown.items()):
+		print("unknown 0x%02x %6d" % (tag, n))
+	if crc_errors:
+		print("CRC errors   %8d packets skipped" % crc_errors)
+
+
+if __name__ == "__main__":
+	main()
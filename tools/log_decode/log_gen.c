@@ -0,0 +1,143 @@
+/*
+ * Writes a log v2 through the firmware encoder (DataManager_log.c) and SimpleFS on the NOR flash simulator, and
+ * cuts a time window out of it the way /download?from_ms=..&to_ms=.. does - test input of log_decode.py.
+ *
+ * Build (from repository root):
+ *   cc -O2 -std=gnu11 -Itools/log_decode/stubs -Itools/nor_sim -Itools/nor_sim/stubs \
+ *      $(find components -maxdepth 2 -name include | sed 's/^/-I/') -Itools/sil/stubs \
+ *      tools/log_decode/log_gen.c tools/nor_sim/nor_sim.c tools/nor_sim/sim_rtos.c \
+ *      components/SimpleFS_driver/SimpleFS_driver.c components/DataManager/DataManager_log.c -o log_gen -lm
+ *
+ * Usage:
+ *   log_gen <image.bin> <window.bin> [-t log_s] [--from ms] [--to ms]
+ *
+ * image.bin is the log as read from the partition start, window.bin the reply of the web server - log v2
+ * preamble packets, then the packets of the window. Samples run at 100 Hz, their pressure is the sample
+ * number, so a decoder can check every sample is there. Prints the samples and the time span of both files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+#include "nor_sim.h"
+#include "SimpleFS_driver.h"
+#include "DataManager_log.h"
+
+#define PARTITION_MB		2
+#define RATE_HZ				100
+#define WRITE_LAG_MS		2000		// DOWNLOAD_WRITE_LAG_MS of Web_driver.c
+
+static esp_err_t sfs_write(void * buf, uint16_t len){
+	return SimpleFS_appendPacket(buf, len);
+}
+
+static void fill_sample(DataPackage_t *p, uint32_t n){
+	memset(p, 0, sizeof(DataPackage_t));
+	p->sys_time = (uint32_t)nor_sim_time_us();
+	p->sensors.accZ = 1.0f;
+	p->sensors.gyroX = (n % 50) * 0.1f;
+	p->sensors.pressure = (float)n;
+	p->sensors.temp = 20;
+	p->ahrs.altitude_kalman = n * 0.5f;
+	p->flightstate = (n < RATE_HZ) ? 1 : 2;
+	p->vbat_mV = 8000 - (n / RATE_HZ);
+	p->vbat_min_mV = p->vbat_mV - 10;
+}
+
+static int write_file(const char *path, const void *buf, size_t len){
+	FILE *f = fopen(path, "wb");
+
+	if((f == NULL) || (fwrite(buf, 1, len, f) != len)){
+		perror(path);
+		return -1;
+	}
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv){
+	uint32_t log_s = 60;
+	uint32_t from_ms = 20000;
+	uint32_t to_ms = 30000;
+
+	if(argc < 3){
+		fprintf(stderr, "usage: %s <image.bin> <window.bin> [-t log_s] [--from ms] [--to ms]\n", argv[0]);
+		return 2;
+	}
+	for(int i = 3; i < argc; i++){
+		if(!strcmp(argv[i], "-t") && (i + 1 < argc))			log_s = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--from") && (i + 1 < argc))	from_ms = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--to") && (i + 1 < argc))		to_ms = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	if(nor_sim_init(PARTITION_MB * 1024 * 1024, &nor_sim_timing_typ, 1) != ESP_OK)
+		return 1;
+	nor_sim_fill(0xFF);
+	SimpleFS_init("storage");
+	if(SimpleFS_formatMemory(SFS_MAGIC_KEY, SFS_FORMAT_ALL) != ESP_OK){
+		fprintf(stderr, "format failed\n");
+		return 1;
+	}
+	SimpleFS_setBackgroundErase(false);
+
+	//----- Log through the firmware encoder ------
+	uint64_t start_us = nor_sim_time_us();
+	uint32_t samples = log_s * RATE_HZ;
+	uint32_t flushed = 0;
+	DataPackage_t package;
+	gps_t gps = { .valid = true, .date = { .year = 26, .month = 10, .day = 19 }, .tim = { .hour = 12 } };
+
+	for(uint32_t n = 0; n < samples; n++){
+		uint64_t due = start_us + (uint64_t)n * 1000000 / RATE_HZ;
+		if(nor_sim_time_us() < due)
+			nor_sim_advance(due - nor_sim_time_us());
+
+		if((n % (RATE_HZ / 5)) == 0){
+			gps.tim.second = (n / RATE_HZ) % 60;
+			gps.tim.minute = (n / RATE_HZ) / 60;
+			DM_logSetUTC(nor_sim_time_us(), &gps);
+		}
+
+		fill_sample(&package, n);
+		if(DM_logEncode(&package, sfs_write, &flushed) != ESP_OK){
+			fprintf(stderr, "write failed at sample %u\n", n);
+			return 1;
+		}
+	}
+	if(DM_logFlush(sfs_write, &flushed) != ESP_OK)
+		return 1;
+
+	uint32_t size = SimpleFS_getFileSize();
+	if(write_file(argv[1], nor_sim_memory(), size) != 0)
+		return 1;
+
+	//----- Window as served by download_range_get_handler ------
+	uint32_t from = SimpleFS_findOffset(from_ms, false);
+	uint32_t to   = SimpleFS_findOffset(to_ms + WRITE_LAG_MS, true);
+	uint8_t *window = malloc(size + 16 * sizeof(sfs_packet_t));
+	uint8_t payload[DM_LOG_CHUNK_B];
+	uint32_t len = 0;
+
+	for(uint8_t i = 0; (from > 0) && (DM_logPreamble(i, payload) > 0); i++){
+		SimpleFS_framePacket(payload, sizeof(payload), (sfs_packet_t *)&window[len]);
+		len += sizeof(sfs_packet_t);
+	}
+	uint32_t preamble = len;
+	memcpy(&window[len], nor_sim_memory() + from, MAX(from, to) - from);
+	len += MAX(from, to) - from;
+	if(write_file(argv[2], window, len) != 0)
+		return 1;
+	free(window);
+
+	printf("image:  %u samples, %u B, log time %llu-%llu ms\n", samples, size,
+			(unsigned long long)start_us / 1000, (unsigned long long)(start_us / 1000 + (samples - 1) * 1000 / RATE_HZ));
+	printf("window: %u-%u ms, offset %u-%u, preamble %u B, %u B\n", from_ms, to_ms, from, to, preamble, len);
+
+	return 0;
+}
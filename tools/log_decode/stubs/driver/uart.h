@@ -0,0 +1,6 @@
+#pragma once
+/* Host stub */
+typedef int uart_port_t;
+typedef int uart_word_length_t;
+typedef int uart_parity_t;
+typedef int uart_stop_bits_t;
@@ -0,0 +1,4 @@
+#pragma once
+/* Host stub */
+#include <stdint.h>
+#include <stdbool.h>
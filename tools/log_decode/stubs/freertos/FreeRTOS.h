@@ -0,0 +1,10 @@
+#pragma once
+/* Host stub - the flash simulator scheduler plus the types the DataManager headers use */
+#include_next "freertos/FreeRTOS.h"
+
+typedef void * QueueHandle_t;
+typedef int portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED	0
+#define portENTER_CRITICAL(mux)			do { (void)(mux); } while(0)
+#define portEXIT_CRITICAL(mux)			do { (void)(mux); } while(0)
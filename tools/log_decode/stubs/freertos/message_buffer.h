@@ -0,0 +1,5 @@
+#pragma once
+/* Host stub */
+#include "freertos/FreeRTOS.h"
+
+typedef void * MessageBufferHandle_t;
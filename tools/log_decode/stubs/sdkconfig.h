@@ -0,0 +1,7 @@
+#pragma once
+/* Host configuration for the log generator */
+#include_next "sdkconfig.h"
+#define CONFIG_BOARD_PTR_MEGA_VER_1_REV_0	1
+#define CONFIG_KPPTR_MEAS_RATE_HZ			100
+#define CONFIG_KPPTR_RF_DEVICE_ID			1024
+#define CONFIG_KPPTR_LOG_V2					1
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Decodes logs written by the firmware encoder and SimpleFS (tools/log_decode/log_gen.c, built here with cc).
+
+  python tools/log_decode/test_log_decode.py
+"""
+
+import csv
+import glob
+import os
+import subprocess
+import tempfile
+import unittest
+
+import log_decode
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+LOG_S = 60
+FROM_MS = 20000
+TO_MS = 30000
+
+
+def column(path, name):
+	with open(path, newline="") as f:
+		return [row[name] for row in csv.DictReader(f)]
+
+
+class LogDecodeTest(unittest.TestCase):
+	@classmethod
+	def setUpClass(cls):
+		cls.tmp = tempfile.TemporaryDirectory()
+		gen = os.path.join(cls.tmp.name, "log_gen")
+		includes = ["-I" + d for d in sorted(glob.glob(os.path.join(ROOT, "components", "*", "include")))]
+		subprocess.run(["cc", "-O2", "-std=gnu11", "-Itools/log_decode/stubs", "-Itools/nor_sim", "-Itools/nor_sim/stubs"]
+				+ includes + ["-Itools/sil/stubs",
+				"tools/log_decode/log_gen.c", "tools/nor_sim/nor_sim.c", "tools/nor_sim/sim_rtos.c",
+				"components/SimpleFS_driver/SimpleFS_driver.c", "components/DataManager/DataManager_log.c",
+				"-o", gen, "-lm"], cwd=ROOT, check=True)
+
+		cls.image = os.path.join(cls.tmp.name, "image.bin")
+		cls.window = os.path.join(cls.tmp.name, "window.bin")
+		subprocess.run([gen, cls.image, cls.window, "-t", str(LOG_S), "--from", str(FROM_MS), "--to", str(TO_MS)],
+				check=True, stdout=subprocess.DEVNULL)
+
+	@classmethod
+	def tearDownClass(cls):
+		cls.tmp.cleanup()
+
+	def decode(self, path, name, corrupt=None):
+		with open(path, "rb") as f:
+			data = bytearray(f.read())
+		if corrupt is not None:
+			data[corrupt] ^= 0xFF
+		out = os.path.join(self.tmp.name, name)
+		counts, unknown, crc_errors = log_decode.decode(bytes(data), out)
+		return out, counts, unknown, crc_errors
+
+	def test_image(self):
+		out, counts, unknown, crc_errors = self.decode(self.image, "image")
+
+		self.assertEqual(unknown, {})
+		self.assertEqual(crc_errors, 0)
+		self.assertEqual(counts["baro"], LOG_S * 100)
+		self.assertEqual([float(p) for p in column(os.path.join(out, "baro.csv"), "pressure")],
+				[float(n) for n in range(LOG_S * 100)])
+		self.assertTrue(column(os.path.join(out, "baro.csv"), "utc")[-1])
+
+	def test_window(self):
+		out, counts, unknown, crc_errors = self.decode(self.window, "window")
+
+		self.assertEqual(unknown, {})
+		self.assertEqual(crc_errors, 0)
+		pressure = [int(float(p)) for p in column(os.path.join(out, "baro.csv"), "pressure")]
+		time_ms = [int(t) // 1000 for t in column(os.path.join(out, "baro.csv"), "time_us")]
+		self.assertEqual(pressure, list(range(pressure[0], pressure[0] + len(pressure))))
+		self.assertLessEqual(time_ms[0], FROM_MS)
+		self.assertGreaterEqual(time_ms[-1], TO_MS)
+		self.assertLess(len(pressure), LOG_S * 100)
+
+	def test_crc(self):
+		# Payload byte of the 10th packet - its samples are dropped, the rest decodes
+		out, counts, unknown, crc_errors = self.decode(self.image, "crc", corrupt=10 * 128 + 40)
+
+		self.assertEqual(crc_errors, 1)
+		self.assertEqual(unknown, {})
+		self.assertGreater(counts["baro"], LOG_S * 100 - 10)
+		self.assertLess(counts["baro"], LOG_S * 100)
+
+
+if __name__ == "__main__":
+	unittest.main()
@@ -0,0 +1,237 @@
+/*
+ * Host fuzz and throughput benchmark for the GNSS_driver NMEA parser.
+ *
+ * Build (from repository root):
+ *   cc -O2 -std=c11 -Icomponents/GNSS_driver/include tools/nmea_bench/nmea_bench.c \
+ *      components/GNSS_driver/nmea_parser.c -o nmea_bench -lm
+ * Fuzzing build (recommended for --fuzz):
+ *   cc -O1 -g -std=c11 -fsanitize=address,undefined -Icomponents/GNSS_driver/include \
+ *      tools/nmea_bench/nmea_bench.c components/GNSS_driver/nmea_parser.c -o nmea_fuzz -lm
+ *
+ * Usage:
+ *   nmea_bench <file.nmea> [repeats]        throughput + coordinate accuracy check
+ *   nmea_bench --fuzz <file.nmea> [cases]    mutate recorded NMEA and feed in random chunks
+ *
+ * tools/nmea_bench/sample.nmea is a short GGA/RMC/GSV/TXT log in the format of our receiver,
+ * logs recorded by the flight computer (raw UART dump) can be passed instead.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "nmea_parser.h"
+
+#define ALL_STATEMENTS ((1 << STATEMENT_GGA) | (1 << STATEMENT_RMC) | (1 << STATEMENT_GSV))
+
+static uint8_t *load_file(const char *path, size_t *len){
+	FILE *f = fopen(path, "rb");
+	if(f == NULL){
+		perror(path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *buf = malloc(*len);
+	if(fread(buf, 1, *len, f) != *len){
+		fclose(f);
+		free(buf);
+		return NULL;
+	}
+	fclose(f);
+	return buf;
+}
+
+static double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//---------------------------------- Reference ---------------------------------
+/* Double precision reference for the GGA coordinates, used to check fixed-point conversion */
+static double ref_lat, ref_lon;
+static double max_err_deg = 0.0;
+static uint32_t checked = 0;
+
+static double ref_coord(const char *field, char hemi){
+	double v = strtod(field, NULL);
+	int deg = (int)(v / 100);
+	double res = deg + (v - deg * 100) / 60.0;
+	return (hemi == 'S' || hemi == 'W') ? -res : res;
+}
+
+static void ref_parse_gga(const char *line){
+	char tmp[128];
+	char *fields[16] = {0};
+	int n = 0;
+	strncpy(tmp, line, sizeof(tmp) - 1);
+	tmp[sizeof(tmp) - 1] = 0;
+	for(char *s = tmp; s && n < 16; n++){
+		fields[n] = s;
+		s = strchr(s, ',');
+		if(s) *s++ = 0;
+	}
+	if(n > 5 && fields[2][0] && fields[4][0]){
+		ref_lat = ref_coord(fields[2], fields[3][0]);
+		ref_lon = ref_coord(fields[4], fields[5][0]);
+	}
+}
+
+static void check_cb(const gps_t *gps, void *ctx){
+	(void)ctx;
+	double lat = gps->latitude  / (double)NMEA_COORD_SCALE;
+	double lon = gps->longitude / (double)NMEA_COORD_SCALE;
+	double e = fmax(fabs(lat - ref_lat), fabs(lon - ref_lon));
+	if(e > max_err_deg)
+		max_err_deg = e;
+	checked++;
+}
+
+//---------------------------------- Benchmark ---------------------------------
+static int bench(const uint8_t *data, size_t len, int repeats){
+	static nmea_parser_t parser;
+
+	// Accuracy: feed line by line and compare every GGA with the double reference
+	nmea_parser_reset(&parser, 1 << STATEMENT_GGA, check_cb, NULL);
+	const uint8_t *line = data;
+	for(size_t i = 0; i < len; i++){
+		if(data[i] == '\n'){
+			if(strncmp((const char *)line + 3, "GGA", 3) == 0)
+				ref_parse_gga((const char *)line);
+			nmea_parser_feed(&parser, line, &data[i] - line + 1);
+			line = &data[i + 1];
+		}
+	}
+	printf("accuracy: %u fixes, max error %.3g deg (%.3f mm)\n", checked, max_err_deg, max_err_deg * 111.32e6);
+
+	// Throughput: whole buffer in UART sized chunks
+	nmea_parser_reset(&parser, ALL_STATEMENTS, NULL, NULL);
+	double t0 = now_s();
+	for(int r = 0; r < repeats; r++){
+		for(size_t pos = 0; pos < len; pos += 512){
+			size_t chunk = (len - pos) < 512 ? (len - pos) : 512;
+			nmea_parser_feed(&parser, data + pos, chunk);
+		}
+	}
+	double dt = now_s() - t0;
+	double bytes = (double)len * repeats;
+
+	printf("throughput: %.1f MB/s, %.0f ns/byte, %.2f Msentences/s\n", bytes / dt / 1e6, dt / bytes * 1e9,
+			parser.sentences_ok / dt / 1e6);
+	printf("sentences: ok %u, crc error %u, unknown %u, broken %u, updates %u\n", parser.sentences_ok,
+			parser.sentences_crc_err, parser.sentences_unknown, parser.sentences_overflow, parser.updates);
+
+	return (parser.sentences_crc_err == 0) && (max_err_deg < 1e-6) ? 0 : 1;
+}
+
+//---------------------------------- Fuzz ---------------------------------
+static void mutate(uint8_t *buf, size_t len){
+	int n = 1 + rand() % 8;
+	for(int i = 0; i < n; i++){
+		size_t pos = rand() % len;
+		switch(rand() % 5){
+		case 0: buf[pos] ^= 1 << (rand() % 8);					break;	// bit flip
+		case 1: buf[pos] = rand() & 0xFF;						break;	// random byte
+		case 2: buf[pos] = ",*$\r\n.-"[rand() % 7];				break;	// separators
+		case 3: buf[pos] = '0' + rand() % 10;					break;	// digits (long numbers)
+		case 4: memset(&buf[pos], '9', (len - pos) < 32 ? (len - pos) : 32);	break;
+		}
+	}
+}
+
+/* Over-long numeric field with a valid checksum - random mutations almost never keep the checksum */
+static int fuzz_overlong(void){
+	static nmea_parser_t parser;
+	const char *body = "GNGGA,123000.000,521378270000.0,N,02100.7337,E,1,8,0.9,110.5,M,34.5,M,,";
+	char line[128];
+	uint8_t crc = 0;
+
+	for(const char *s = body; *s; s++)
+		crc ^= (uint8_t)*s;
+	int n = snprintf(line, sizeof(line), "$%s*%02X\r\n", body, crc);
+
+	nmea_parser_reset(&parser, 1 << STATEMENT_GGA, NULL, NULL);
+	nmea_parser_feed(&parser, (const uint8_t *)line, n);
+	if(parser.sentences_ok != 0 || parser.sentences_overflow != 1 || nmea_parser_get(&parser)->latitude != 0){
+		printf("FAIL: over-long field accepted: %s", line);
+		return 1;
+	}
+	return 0;
+}
+
+static int fuzz(const uint8_t *data, size_t len, long cases){
+	static nmea_parser_t whole, split;
+	uint8_t *buf;
+	srand(12345);
+
+	if(fuzz_overlong() != 0)
+		return 1;
+
+	buf = malloc(len);
+
+	for(long c = 0; c < cases; c++){
+		size_t part_len = 1 + rand() % (len < 2048 ? len : 2048);
+		size_t start = rand() % (len - part_len + 1);
+		memcpy(buf, data + start, part_len);
+		mutate(buf, part_len);
+
+		// Same input fed at once and in random chunks must give identical results
+		nmea_parser_reset(&whole, ALL_STATEMENTS | (1 << STATEMENT_GSA) | (1 << STATEMENT_GLL) | (1 << STATEMENT_VTG), NULL, NULL);
+		nmea_parser_reset(&split, ALL_STATEMENTS | (1 << STATEMENT_GSA) | (1 << STATEMENT_GLL) | (1 << STATEMENT_VTG), NULL, NULL);
+		nmea_parser_feed(&whole, buf, part_len);
+		for(size_t pos = 0; pos < part_len; ){
+			size_t chunk = 1 + rand() % 17;
+			if(chunk > part_len - pos)
+				chunk = part_len - pos;
+			nmea_parser_feed(&split, buf + pos, chunk);
+			pos += chunk;
+		}
+
+		const gps_t *a = nmea_parser_get(&whole);
+		const gps_t *b = nmea_parser_get(&split);
+		if(memcmp(a, b, sizeof(gps_t)) != 0 || whole.sentences_ok != split.sentences_ok){
+			printf("FAIL: case %ld differs between whole and split feed\n", c);
+			free(buf);
+			return 1;
+		}
+		if(a->latitude > 90L * NMEA_COORD_SCALE + NMEA_COORD_SCALE || a->latitude < -91L * NMEA_COORD_SCALE ||
+		   a->longitude > 181L * NMEA_COORD_SCALE || a->longitude < -181L * NMEA_COORD_SCALE){
+			// Out of range values are possible for corrupted sentences with valid checksum, just report them
+			if(c < 10)
+				printf("note: case %ld out of range coordinate %d %d\n", c, a->latitude, a->longitude);
+		}
+	}
+
+	printf("fuzz: %ld cases OK\n", cases);
+	free(buf);
+	return 0;
+}
+
+int main(int argc, char **argv){
+	size_t len = 0;
+	uint8_t *data;
+	int ret;
+
+	if(argc >= 3 && strcmp(argv[1], "--fuzz") == 0){
+		data = load_file(argv[2], &len);
+		if(data == NULL || len == 0)
+			return 2;
+		ret = fuzz(data, len, argc > 3 ? atol(argv[3]) : 100000);
+	} else if(argc >= 2){
+		data = load_file(argv[1], &len);
+		if(data == NULL || len == 0)
+			return 2;
+		ret = bench(data, len, argc > 2 ? atoi(argv[2]) : 1000);
+	} else {
+		printf("usage: %s <file.nmea> [repeats] | --fuzz <file.nmea> [cases]\n", argv[0]);
+		return 2;
+	}
+
+	free(data);
+	return ret;
+}
@@ -0,0 +1,355 @@
+/*
+ * Host NOR flash simulator - flash model and sfs_api.h backend. See nor_sim.h.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+#include "nor_sim.h"
+#include "sfs_api.h"
+#include "freertos/task.h"
+
+#define OP_DONE		65536UL		// Completed part of an operation, fixed point
+
+typedef struct {
+	uint32_t size_B;
+	nor_sim_timing_t timing;
+	uint64_t time_us;
+	uint64_t cut_us;			// Scheduled power cut, UINT64_MAX - none
+	bool powered;
+	uint64_t rng;
+	nor_sim_stats_t stats;
+	uint16_t *sector_prog_end;	// Programmed part of every sector since its erase
+	uint8_t *mem;
+} nor_sim_t;
+
+const nor_sim_timing_t nor_sim_timing_typ = {
+	.cmd_us 		 = 20,
+	.read_MBps 		 = 20,
+	.prog_page_us 	 = 400,
+	.erase_sector_us = 45000,
+	.erase_block_us  = 150000,
+};
+
+const nor_sim_timing_t nor_sim_timing_max = {
+	.cmd_us 		 = 50,
+	.read_MBps 		 = 10,
+	.prog_page_us 	 = 3000,
+	.erase_sector_us = 400000,
+	.erase_block_us  = 2000000,
+};
+
+bool nor_sim_verbose = false;
+static nor_sim_t *sim = NULL;
+
+static uint32_t rnd(void){
+	sim->rng ^= sim->rng << 13;
+	sim->rng ^= sim->rng >> 7;
+	sim->rng ^= sim->rng << 17;
+	return (uint32_t)(sim->rng >> 32);
+}
+
+esp_err_t nor_sim_init(uint32_t size_B, const nor_sim_timing_t *timing, uint64_t seed){
+	if((size_B == 0) || (size_B % NOR_SIM_BLOCK_B) || (timing == NULL)){
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	uint32_t sectors = size_B / NOR_SIM_SECTOR_B;
+	size_t   total   = sizeof(nor_sim_t) + sectors * sizeof(uint16_t) + size_B;
+
+	if(sim != NULL){
+		munmap(sim, sizeof(nor_sim_t) + (sim->size_B / NOR_SIM_SECTOR_B) * sizeof(uint16_t) + sim->size_B);
+	}
+
+	sim = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(sim == MAP_FAILED){
+		sim = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+
+	memset(sim, 0, sizeof(nor_sim_t));
+	sim->size_B 		 = size_B;
+	sim->timing 		 = *timing;
+	sim->cut_us 		 = UINT64_MAX;
+	sim->powered 		 = true;
+	sim->rng 			 = seed | 1;
+	sim->sector_prog_end = (uint16_t *)(sim + 1);
+	sim->mem 			 = (uint8_t *)(sim->sector_prog_end + sectors);
+	nor_sim_fill(0xFF);
+
+	return ESP_OK;
+}
+
+/* Fill without NOR rules - factory state or an image from a board */
+void nor_sim_fill(uint8_t value){
+	memset(sim->mem, value, sim->size_B);
+	memset(sim->sector_prog_end, 0, (sim->size_B / NOR_SIM_SECTOR_B) * sizeof(uint16_t));
+}
+
+uint32_t nor_sim_size(void){
+	return sim->size_B;
+}
+
+uint8_t * nor_sim_memory(void){
+	return sim->mem;
+}
+
+uint64_t nor_sim_time_us(void){
+	return sim->time_us;
+}
+
+void nor_sim_advance(uint64_t us){
+	if(sim->powered && ((sim->time_us + us) >= sim->cut_us)){
+		sim->powered = false;
+	}
+	sim->time_us += us;
+}
+
+void nor_sim_powerCut(uint64_t at_us){
+	sim->cut_us = at_us;
+	if(at_us <= sim->time_us){
+		sim->powered = false;
+	}
+}
+
+void nor_sim_powerOn(void){
+	sim->powered = true;
+	sim->cut_us  = UINT64_MAX;
+}
+
+bool nor_sim_isPowered(void){
+	return sim->powered;
+}
+
+const nor_sim_stats_t * nor_sim_getStats(void){
+	return &sim->stats;
+}
+
+/*
+ * Runs the clock over one operation. Returns its completed part in 1/OP_DONE - less than OP_DONE if
+ * power was cut in the middle.
+ */
+static uint32_t op_run(uint32_t duration_us){
+	sim->stats.busy_us += duration_us;
+
+	if((sim->time_us + duration_us) < sim->cut_us){
+		sim->time_us += duration_us;
+		return OP_DONE;
+	}
+
+	uint32_t done = ((sim->cut_us - sim->time_us) * OP_DONE) / duration_us;
+	sim->time_us  = sim->cut_us;
+	sim->powered  = false;
+	sim->stats.torn++;
+
+	return done;
+}
+
+static bool op_check(uint32_t addr, uint32_t len){
+	if(!sim->powered){
+		sim->stats.err_power++;
+		return false;
+	}
+	if((len == 0) || (addr >= sim->size_B) || (len > (sim->size_B - addr))){
+		sim->stats.err_align++;
+		return false;
+	}
+	return true;
+}
+
+esp_err_t nor_sim_read(uint32_t addr, void *buf, uint32_t len){
+	if(!op_check(addr, len)){
+		return ESP_FAIL;
+	}
+
+	sim->stats.reads++;
+	sim->stats.read_B += len;
+	if(op_run(sim->timing.cmd_us + len / sim->timing.read_MBps) != OP_DONE){
+		return ESP_FAIL;
+	}
+
+	memcpy(buf, &sim->mem[addr], len);
+	return ESP_OK;
+}
+
+/* One page program - the data must not cross the page end, a real chip wraps to the page start */
+static esp_err_t prog_page(uint32_t addr, const uint8_t *data, uint32_t len){
+	uint32_t sector = addr / NOR_SIM_SECTOR_B;
+	uint32_t offset = addr % NOR_SIM_SECTOR_B;
+
+	if(((addr % NOR_SIM_PAGE_B) + len) > NOR_SIM_PAGE_B){
+		sim->stats.err_align++;
+		return ESP_FAIL;
+	}
+
+	if(offset < sim->sector_prog_end[sector]){
+		sim->stats.err_order++;
+	}
+	if(offset + len > sim->sector_prog_end[sector]){
+		sim->sector_prog_end[sector] = offset + len;
+	}
+
+	for(uint32_t i=0; i<len; i++){
+		if(data[i] & ~sim->mem[addr + i]){
+			sim->stats.err_bits++;
+			break;
+		}
+	}
+
+	uint32_t duration = sim->timing.cmd_us + (sim->timing.prog_page_us * len) / NOR_SIM_PAGE_B;
+	uint32_t done     = (op_run(duration) * (uint64_t)len) / OP_DONE;
+
+	sim->stats.progs++;
+	sim->stats.prog_B += len;
+	if(duration > sim->stats.prog_max_us){
+		sim->stats.prog_max_us = duration;
+	}
+
+	for(uint32_t i=0; i<done; i++){
+		sim->mem[addr + i] &= data[i];
+	}
+
+	if(done < len){
+		sim->mem[addr + done] &= data[done] | rnd();	// Byte in progress - some bits programmed
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/* Program of any length, split at page ends the same way esp_flash_write() does */
+esp_err_t nor_sim_prog(uint32_t addr, const void *buf, uint32_t len){
+	const uint8_t *data = buf;
+
+	if(!op_check(addr, len)){
+		return ESP_FAIL;
+	}
+
+	while(len > 0){
+		uint32_t chunk = NOR_SIM_PAGE_B - (addr % NOR_SIM_PAGE_B);
+		if(chunk > len){
+			chunk = len;
+		}
+
+		if(prog_page(addr, data, chunk) != ESP_OK){
+			return ESP_FAIL;
+		}
+
+		addr += chunk;
+		data += chunk;
+		len  -= chunk;
+	}
+	return ESP_OK;
+}
+
+/* One sector or block - a torn erase leaves the rest with random bits still programmed */
+static esp_err_t erase_unit(uint32_t addr, uint32_t len, uint32_t duration){
+	uint32_t done = (op_run(duration) * (uint64_t)len) / OP_DONE;
+
+	if(duration > sim->stats.erase_max_us){
+		sim->stats.erase_max_us = duration;
+	}
+
+	memset(&sim->mem[addr], 0xFF, done);
+	for(uint32_t i=done; i<len; i++){
+		sim->mem[addr + i] |= rnd();
+	}
+	memset(&sim->sector_prog_end[addr / NOR_SIM_SECTOR_B], 0, (len / NOR_SIM_SECTOR_B) * sizeof(uint16_t));
+
+	return (done == len) ? ESP_OK : ESP_FAIL;
+}
+
+/* Erase of 4 kB aligned range - 64 kB block erase where the range allows it */
+esp_err_t nor_sim_erase(uint32_t addr, uint32_t len){
+	if(!op_check(addr, len)){
+		return ESP_FAIL;
+	}
+
+	if((addr % NOR_SIM_SECTOR_B) || (len % NOR_SIM_SECTOR_B)){
+		sim->stats.err_align++;
+		return ESP_FAIL;
+	}
+
+	while(len > 0){
+		esp_err_t err;
+
+		if(((addr % NOR_SIM_BLOCK_B) == 0) && (len >= NOR_SIM_BLOCK_B)){
+			sim->stats.erases_block++;
+			err = erase_unit(addr, NOR_SIM_BLOCK_B, sim->timing.cmd_us + sim->timing.erase_block_us);
+			addr += NOR_SIM_BLOCK_B;
+			len  -= NOR_SIM_BLOCK_B;
+		} else {
+			sim->stats.erases_sector++;
+			err = erase_unit(addr, NOR_SIM_SECTOR_B, sim->timing.cmd_us + sim->timing.erase_sector_us);
+			addr += NOR_SIM_SECTOR_B;
+			len  -= NOR_SIM_SECTOR_B;
+		}
+
+		if(err != ESP_OK){
+			return err;
+		}
+	}
+	return ESP_OK;
+}
+
+//---------------------------------- sfs_api.h backend ---------------------------------
+// Argument checks follow components/SimpleFS_driver/sfs_api.c
+
+#define SFS_PAGE_SIZE 	256
+#define SFS_CHUNK_SIZE 	64
+
+esp_err_t simplefs_api_init(sfs_info_t * partition_info, const char * label){
+	if((label == NULL) || (sim == NULL)){
+		return ESP_FAIL;
+	}
+
+	partition_info->partition_size_B = sim->size_B;
+	partition_info->partition_page_B = SFS_PAGE_SIZE;
+
+	return ESP_OK;
+}
+
+esp_err_t simplefs_api_read(uint32_t position, void *buffer, uint32_t size){
+	if((position > sim->size_B) || (buffer == NULL) || (size == 0) || (size > (sim->size_B - position))){
+		return ESP_FAIL;
+	}
+
+	return nor_sim_read(position, buffer, size);
+}
+
+esp_err_t simplefs_api_prog(uint32_t position, void *buffer, uint32_t size){
+	if((position > sim->size_B) || (position % SFS_CHUNK_SIZE) || (buffer == NULL)
+			|| (size == 0) || (size > (sim->size_B - position)) || (size % SFS_CHUNK_SIZE)){
+		return ESP_FAIL;
+	}
+
+	return nor_sim_prog(position, buffer, size);
+}
+
+esp_err_t simplefs_api_erase(uint32_t range_end_B){
+	const uint32_t chunk = 512*1024;
+
+	if((range_end_B == 0) || (range_end_B > sim->size_B)){
+		range_end_B = sim->size_B;
+	}
+
+	// Rounded up to 4 kB like the last chunk of sfs_api.c
+	range_end_B = (range_end_B + NOR_SIM_SECTOR_B - 1) & ~(NOR_SIM_SECTOR_B - 1);
+
+	for(uint32_t start=0; start<range_end_B; start+=chunk){
+		uint32_t len = ((range_end_B - start) < chunk) ? (range_end_B - start) : chunk;
+
+		if(nor_sim_erase(start, len) != ESP_OK){
+			return ESP_FAIL;
+		}
+		vTaskDelay(50);
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t simplefs_api_eraseBlock(uint32_t position, uint32_t size){
+	if((position > sim->size_B) || (position % 4096) || (size % 4096) || (size > (sim->size_B - position))){
+		return ESP_FAIL;
+	}
+
+	return nor_sim_erase(position, size);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * Host NOR flash simulator.
+ *
+ * Replaces sfs_api.c (simplefs_api_*) on host and offers the raw device to other file systems. Enforces
+ * NOR rules - a program can only clear bits and must stay inside one 256 B page, erase works on 4 kB
+ * sectors / 64 kB blocks - and counts every violation. A program below an already programmed offset
+ * of the same sector is reported as out of order. Every operation advances a simulated clock by the
+ * latency of the timing model, power can be cut at any simulated time, which tears the operation in
+ * progress.
+ *
+ * Flash contents, clock and statistics live in shared memory, so they survive fork() - a forked
+ * process is one boot of the firmware, the next fork sees the flash as the last one left it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define NOR_SIM_PAGE_B		256
+#define NOR_SIM_SECTOR_B	4096
+#define NOR_SIM_BLOCK_B		65536
+
+/**
+ * @brief Operation latencies.
+ */
+typedef struct {
+	uint32_t cmd_us;			/*!< Command overhead of every operation (driver, SPI, status polling) */
+	uint32_t read_MBps;			/*!< Read throughput */
+	uint32_t prog_page_us;		/*!< Program of a full page, shorter programs scale down */
+	uint32_t erase_sector_us;	/*!< 4 kB sector erase */
+	uint32_t erase_block_us;	/*!< 64 kB block erase */
+} nor_sim_timing_t;
+
+extern const nor_sim_timing_t nor_sim_timing_typ;	/*!< W25Q256JV typical */
+extern const nor_sim_timing_t nor_sim_timing_max;	/*!< W25Q256JV maximum */
+
+/**
+ * @brief Operation counters and rule violations. Reset only by nor_sim_init().
+ */
+typedef struct {
+	uint64_t reads;
+	uint64_t read_B;
+	uint64_t progs;				/*!< Page programs */
+	uint64_t prog_B;
+	uint64_t erases_sector;
+	uint64_t erases_block;
+	uint64_t busy_us;			/*!< Time the chip was busy */
+	uint32_t prog_max_us;
+	uint32_t erase_max_us;
+	uint32_t err_bits;			/*!< Programs that needed a 0 -> 1 transition */
+	uint32_t err_align;			/*!< Page crossing programs, unaligned erases, out of range accesses */
+	uint32_t err_order;			/*!< Programs below the programmed part of a sector */
+	uint32_t err_power;			/*!< Operations without power */
+	uint32_t torn;				/*!< Operations torn by a power cut */
+} nor_sim_stats_t;
+
+extern bool nor_sim_verbose;	/*!< Print firmware errors and warnings to stderr */
+
+esp_err_t nor_sim_init(uint32_t size_B, const nor_sim_timing_t *timing, uint64_t seed);
+void      nor_sim_fill(uint8_t value);
+uint32_t  nor_sim_size(void);
+uint8_t * nor_sim_memory(void);
+
+esp_err_t nor_sim_read (uint32_t addr, void *buf, uint32_t len);
+esp_err_t nor_sim_prog (uint32_t addr, const void *buf, uint32_t len);
+esp_err_t nor_sim_erase(uint32_t addr, uint32_t len);
+
+uint64_t  nor_sim_time_us(void);
+void      nor_sim_advance(uint64_t us);
+
+void      nor_sim_powerCut(uint64_t at_us);
+void      nor_sim_powerOn(void);
+bool      nor_sim_isPowered(void);
+
+const nor_sim_stats_t * nor_sim_getStats(void);
+
+//---------------------------------- sim_rtos.c ---------------------------------
+void      sim_rtos_runUntil(uint64_t time_us);
@@ -0,0 +1,313 @@
+/*
+ * SimpleFS on the NOR flash simulator - boot-to-ready time, logging throughput and power cut recovery.
+ *
+ * Build (from repository root):
+ *   cc -O2 -std=gnu11 -Itools/nor_sim -Itools/nor_sim/stubs -Icomponents/SimpleFS_driver/include \
+ *      tools/nor_sim/sfs_sim.c tools/nor_sim/nor_sim.c tools/nor_sim/sim_rtos.c \
+ *      components/SimpleFS_driver/SimpleFS_driver.c -o sfs_sim
+ *
+ * Usage:
+ *   sfs_sim [-m size_MB] [-r rate_Hz] [-t log_s] [-c cycles] [-s seed] [--cut] [--blank] [--max] [-v]
+ *
+ * SimpleFS keeps its state in file-static variables, so every boot of the firmware runs in its own
+ * forked process while the flash image is shared. One cycle is:
+ *   boot with the previous flight in memory, erase command (Storage_erase - SFS_FORMAT_RANGE), storage
+ *   init retried every 3 s like the storage task does until the erased window is ready, logging of
+ *   114 B records with background erase blocked (armed), then reboot, data end search and check of
+ *   every recovered record.
+ * With --cut power is cut at a random time of every cycle, from the erase command to the end of
+ * logging. Exit code is 1 if an acknowledged record is lost or a NOR rule was broken.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "nor_sim.h"
+#include "esp_crc.h"
+#include "SimpleFS_driver.h"
+
+#define RECORD_B			114			// sizeof(DataPackage_t)
+#define INIT_RETRY_US		3000000		// Storage task retry period
+#define OLD_FLIGHT_FILL		75			// Part of the partition used by the previous flight [%]
+
+typedef struct __attribute__((__packed__)){
+	uint32_t seq;
+	uint32_t time_ms;
+	uint8_t  fill[RECORD_B - 8];
+} record_t;
+
+typedef struct {
+	// Boot 1 - erase and logging
+	uint64_t ready_us;			/*!< Erase command to storage ready, 0 - not reached */
+	uint32_t erased_kB;			/*!< Erased window when logging started */
+	uint32_t acked;				/*!< Records confirmed by SimpleFS_appendPacket() */
+	uint32_t last_seq;			/*!< Sequence number of the last confirmed record */
+	uint32_t rejected;			/*!< Erased window full */
+	uint32_t failed;
+	uint64_t log_us;
+	uint64_t lat_sum_us;
+	uint32_t lat_max_us;		/*!< Append latency from the record due time, stalls included */
+	uint32_t late;				/*!< Records appended later than one period after due time */
+	uint64_t progs;
+	uint64_t prog_B;
+	// Boot 2 - recovery
+	bool     mounted;
+	uint64_t mount_us;			/*!< SimpleFS_init() with the data end search */
+	uint32_t data_kB;
+	uint32_t recovered;			/*!< Valid records with sequence number up to last_seq */
+	uint32_t torn;				/*!< Packets with bad CRC */
+	uint32_t order;				/*!< Valid records out of sequence */
+} cycle_t;
+
+static uint32_t rate_hz = 100;
+static uint32_t log_s = 60;
+static bool power_cuts = false;
+static uint64_t rng;
+
+static double rnd_uniform(void){
+	rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+	return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static void fill_record(record_t *r, uint32_t seq){
+	r->seq = seq;
+	r->time_ms = nor_sim_time_us() / 1000;
+	for(uint32_t i=0; i<sizeof(r->fill); i++){
+		r->fill[i] = (uint8_t)(seq * 31 + i);
+	}
+}
+
+/* Previous flight written directly to the image - valid packets over the first part of the partition */
+static void old_flight(void){
+	uint8_t *mem = nor_sim_memory();
+	uint32_t end = ((uint64_t)nor_sim_size() * OLD_FLIGHT_FILL / 100) / sizeof(sfs_packet_t) * sizeof(sfs_packet_t);
+
+	nor_sim_fill(0xFF);
+	for(uint32_t pos=0; pos<end; pos+=sizeof(sfs_packet_t)){
+		sfs_packet_t *p = (sfs_packet_t *)&mem[pos];
+		memset(p, 0, sizeof(sfs_packet_t));
+		fill_record((record_t *)p->payload, pos / sizeof(sfs_packet_t));
+		p->header.pre = SFS_HEADER_PRE;
+		p->header.packet_len = sizeof(sfs_packet_t) / sizeof(uint32_t);
+		p->CRC16 = esp_crc16_le(UINT16_MAX, (uint8_t *)p, sizeof(sfs_packet_t) - sizeof(p->CRC16));
+	}
+}
+
+static void boot_log(cycle_t *c){
+	SimpleFS_init("storage");	// Fails - previous flight in memory
+
+	uint64_t cmd = nor_sim_time_us();
+	if(power_cuts){
+		nor_sim_powerCut(cmd + rnd_uniform() * (30 + log_s) * 1000000.0);
+	}
+
+	if(SimpleFS_formatMemory(SFS_MAGIC_KEY, SFS_FORMAT_RANGE) != ESP_OK){
+		return;
+	}
+	while(SimpleFS_init("storage") != ESP_OK){
+		sim_rtos_runUntil(nor_sim_time_us() + INIT_RETRY_US);
+		if(!nor_sim_isPowered()){
+			return;
+		}
+	}
+	c->ready_us  = nor_sim_time_us() - cmd;
+	c->erased_kB = SimpleFS_getErasedAhead() / 1024;
+
+	// Armed - background erase blocked like in main.c
+	SimpleFS_setBackgroundErase(false);
+
+	const nor_sim_stats_t *st = nor_sim_getStats();
+	uint64_t progs  = st->progs;
+	uint64_t prog_B = st->prog_B;
+	uint64_t start  = nor_sim_time_us();
+	uint64_t period = 1000000 / rate_hz;
+
+	for(uint32_t seq=0; seq<(log_s * rate_hz); seq++){
+		uint64_t due = start + seq * period;
+		record_t r;
+
+		sim_rtos_runUntil(due);
+		if(!nor_sim_isPowered()){
+			break;
+		}
+
+		uint64_t t0 = nor_sim_time_us();
+		fill_record(&r, seq);
+		esp_err_t err = SimpleFS_appendPacket(&r, sizeof(r));
+		if(!nor_sim_isPowered()){
+			break;		// Torn write is never acknowledged
+		}
+
+		uint32_t lat = nor_sim_time_us() - due;
+		c->lat_sum_us += lat;
+		if(lat > c->lat_max_us){
+			c->lat_max_us = lat;
+		}
+		if(t0 > (due + period)){
+			c->late++;
+		}
+
+		if(err == ESP_OK){
+			c->acked++;
+			c->last_seq = seq;
+		} else if(err == ESP_ERR_NO_MEM){
+			c->rejected++;
+		} else {
+			c->failed++;
+		}
+	}
+
+	c->log_us = nor_sim_time_us() - start;
+	c->progs  = st->progs - progs;
+	c->prog_B = st->prog_B - prog_B;
+}
+
+static void boot_recover(cycle_t *c){
+	uint64_t t0 = nor_sim_time_us();
+
+	SimpleFS_init("storage");	// Fails if data present, data end is known anyway
+	c->mount_us = nor_sim_time_us() - t0;
+	c->mounted  = true;
+
+	uint32_t size = SimpleFS_getFileSize();
+	uint32_t done = 0;
+	int64_t  prev = -1;
+	static uint8_t buf[SFS_MAX_CHUNK_SIZE_B];
+
+	c->data_kB = size / 1024;
+	SimpleFS_resetReadPointer();
+	while(done < size){
+		int32_t len = SimpleFS_readMemory(SFS_MAX_CHUNK_SIZE_B, buf);
+		if(len <= 0){
+			break;
+		}
+
+		for(int32_t pos=0; pos<len; pos+=sizeof(sfs_packet_t)){
+			sfs_packet_t *p = (sfs_packet_t *)&buf[pos];
+			record_t *r = (record_t *)p->payload;
+
+			if(p->CRC16 != esp_crc16_le(UINT16_MAX, (uint8_t *)p, sizeof(sfs_packet_t) - sizeof(p->CRC16))){
+				c->torn++;
+				continue;
+			}
+			if((int64_t)r->seq <= prev){
+				c->order++;
+			}
+			prev = r->seq;
+			if(r->seq <= c->last_seq){
+				c->recovered++;
+			}
+		}
+		done += len;
+	}
+}
+
+static void run_boot(void (*boot)(cycle_t *), cycle_t *c){
+	pid_t pid = fork();
+
+	if(pid == 0){
+		boot(c);
+		_exit(0);
+	} else if(pid > 0){
+		waitpid(pid, NULL, 0);
+	} else {
+		perror("fork");
+		exit(1);
+	}
+	nor_sim_powerOn();
+}
+
+static void boot_formatAll(cycle_t *c){
+	uint64_t t0 = nor_sim_time_us();
+
+	SimpleFS_init("storage");
+	SimpleFS_formatMemory(SFS_MAGIC_KEY, SFS_FORMAT_ALL);
+	c->ready_us = nor_sim_time_us() - t0;
+}
+
+int main(int argc, char **argv){
+	uint32_t size_MB = 32;
+	int cycles = 5;
+	uint64_t seed = 1;
+	bool blank = false;
+	const nor_sim_timing_t *timing = &nor_sim_timing_typ;
+
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "-m") && (i + 1 < argc))			size_MB = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-r") && (i + 1 < argc))		rate_hz = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-t") && (i + 1 < argc))		log_s = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-c") && (i + 1 < argc))		cycles = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && (i + 1 < argc))		seed = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "--cut"))						power_cuts = true;
+		else if(!strcmp(argv[i], "--blank"))					blank = true;
+		else if(!strcmp(argv[i], "--max"))						timing = &nor_sim_timing_max;
+		else if(!strcmp(argv[i], "-v"))							nor_sim_verbose = true;
+		else {
+			fprintf(stderr, "usage: %s [-m size_MB] [-r rate_Hz] [-t log_s] [-c cycles] [-s seed] [--cut] [--blank] [--max] [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if((size_MB == 0) || (rate_hz == 0) || (cycles < 1) || (nor_sim_init(size_MB * 1024 * 1024, timing, seed) != ESP_OK)){
+		fprintf(stderr, "invalid configuration\n");
+		return 2;
+	}
+
+	cycle_t *res = mmap(NULL, sizeof(cycle_t) * (cycles + 1), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(res == MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	memset(res, 0, sizeof(cycle_t) * (cycles + 1));
+
+	// Reference - blocking full format used before the erased window
+	run_boot(boot_formatAll, &res[cycles]);
+
+	if(blank)
+		nor_sim_fill(0xFF);
+	else
+		old_flight();
+
+	printf("SimpleFS: %u MB %s flash, %u B records at %u Hz for %u s, %d cycles%s\n", size_MB, blank ? "blank" : "used",
+			RECORD_B, rate_hz, log_s, cycles, power_cuts ? " with power cuts" : "");
+	printf("cycle  ready[s] window[kB]  acked rejected failed  lat avg/max[ms] late  mount[ms] data[kB] recovered torn lost\n");
+
+	int lost_total = 0;
+	for(int i = 0; i < cycles; i++){
+		cycle_t *c = &res[i];
+
+		rng = seed * 1000003ULL + i;
+		run_boot(boot_log, c);
+		run_boot(boot_recover, c);
+
+		int lost = (int)c->acked - (int)c->recovered;
+		lost_total += (lost > 0) ? lost : 0;
+		lost_total += c->order;
+
+		printf("%5d  %8.2f %10u %6u %8u %6u  %6.2f / %6.2f %5u  %9.2f %8u %9u %4u %4d\n", i, c->ready_us * 1e-6, c->erased_kB,
+				c->acked, c->rejected, c->failed, c->acked ? c->lat_sum_us * 1e-3 / (c->acked + c->rejected + c->failed) : 0.0,
+				c->lat_max_us * 1e-3, c->late, c->mount_us * 1e-3, c->data_kB, c->recovered, c->torn, lost);
+	}
+
+	const nor_sim_stats_t *st = nor_sim_getStats();
+	const cycle_t *c0 = &res[0];
+
+	printf("\nfull format (SFS_FORMAT_ALL): %.1f s\n", res[cycles].ready_us * 1e-6);
+	if(c0->acked && c0->log_us){
+		printf("logging: %.0f B of flash per record, %.0f page programs/s, %.1f kB/s\n", (double)c0->prog_B / c0->acked,
+				c0->progs * 1e6 / c0->log_us, c0->prog_B * 1e3 / c0->log_us);
+	}
+	printf("flash: %llu reads, %llu page programs, %llu sector and %llu block erases, longest program %.2f ms, erase %.0f ms\n",
+			(unsigned long long)st->reads, (unsigned long long)st->progs, (unsigned long long)st->erases_sector,
+			(unsigned long long)st->erases_block, st->prog_max_us * 1e-3, st->erase_max_us * 1e-3);
+	printf("NOR rules: %u bit set, %u alignment, %u out of order, %u without power, %u torn operations\n",
+			st->err_bits, st->err_align, st->err_order, st->err_power, st->torn);
+
+	bool fail = (lost_total > 0) || st->err_bits || st->err_align || st->err_order;
+	printf("%s\n", fail ? "FAIL" : "OK");
+
+	return fail ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Host replacement of the FreeRTOS calls used by the storage code.
+ *
+ * Tasks are stepped cooperatively on the simulated flash clock, which keeps every run deterministic.
+ * A task loop must reach vTaskDelay() at the end of every iteration without holding a lock - the
+ * delay jumps back to sim_rtos_runUntil() and the next step calls the task function again, which
+ * continues with the next iteration. Outside a task vTaskDelay() just advances the clock.
+ */
+
+#include <setjmp.h>
+#include "nor_sim.h"
+#include "freertos/task.h"
+
+#define SIM_RTOS_TASKS	4
+
+typedef struct {
+	TaskFunction_t fn;
+	void *param;
+	uint64_t wake_us;
+} sim_task_t;
+
+static sim_task_t tasks[SIM_RTOS_TASKS];
+static uint8_t task_num = 0;
+static int8_t current = -1;
+static jmp_buf yield_env;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+		UBaseType_t prio, TaskHandle_t *handle, BaseType_t core){
+	(void)name; (void)stack; (void)prio; (void)handle; (void)core;
+
+	if(task_num >= SIM_RTOS_TASKS){
+		return pdFALSE;
+	}
+
+	tasks[task_num].fn 		= fn;
+	tasks[task_num].param 	= param;
+	tasks[task_num].wake_us = nor_sim_time_us();
+	task_num++;
+
+	return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks){
+	if(current >= 0){
+		tasks[current].wake_us = nor_sim_time_us() + (uint64_t)ticks * 1000;
+		longjmp(yield_env, 1);
+	}
+
+	nor_sim_advance((uint64_t)ticks * 1000);
+}
+
+/* Runs due tasks until the clock reaches time_us. Flash operations of a task can push the clock past it. */
+void sim_rtos_runUntil(uint64_t time_us){
+	while(nor_sim_isPowered()){
+		int8_t next = -1;
+
+		for(uint8_t i=0; i<task_num; i++){
+			if((tasks[i].wake_us <= time_us) && ((next < 0) || (tasks[i].wake_us < tasks[next].wake_us))){
+				next = i;
+			}
+		}
+		if(next < 0){
+			break;
+		}
+
+		if(tasks[next].wake_us > nor_sim_time_us()){
+			nor_sim_advance(tasks[next].wake_us - nor_sim_time_us());
+		}
+
+		current = next;
+		if(setjmp(yield_env) == 0){
+			tasks[next].fn(tasks[next].param);
+		}
+		current = -1;
+	}
+
+	if(nor_sim_time_us() < time_us){
+		nor_sim_advance(time_us - nor_sim_time_us());
+	}
+}
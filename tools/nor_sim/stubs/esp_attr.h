@@ -0,0 +1,5 @@
+#pragma once
+/* Host stub */
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
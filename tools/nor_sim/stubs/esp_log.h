@@ -0,0 +1,12 @@
+#pragma once
+/* Host stub - errors and warnings only with nor_sim_verbose, power cuts make plenty of them */
+#include "esp_err.h"
+
+extern bool nor_sim_verbose;
+
+#define NOR_SIM_LOG(tag, fmt, ...)	do { if(nor_sim_verbose) fprintf(stderr, "%s: " fmt "\n", tag, ##__VA_ARGS__); } while(0)
+#define ESP_LOGE(tag, fmt, ...)		NOR_SIM_LOG(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)		NOR_SIM_LOG(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, ...)			do { (void)(tag); } while(0)
+#define ESP_LOGD(tag, ...)			do { (void)(tag); } while(0)
+#define ESP_LOGV(tag, ...)			do { (void)(tag); } while(0)
@@ -0,0 +1,9 @@
+#pragma once
+/* Host stub - simulated flash clock, see nor_sim.h */
+#include <stdint.h>
+
+uint64_t nor_sim_time_us(void);
+
+static inline int64_t esp_timer_get_time(void){
+	return (int64_t)nor_sim_time_us();
+}
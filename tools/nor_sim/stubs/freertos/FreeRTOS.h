@@ -0,0 +1,20 @@
+#pragma once
+/* Host stub - tasks are stepped cooperatively by sim_rtos.c */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_attr.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void * TaskHandle_t;
+typedef void * SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE				1
+#define pdFALSE				0
+#define pdPASS				pdTRUE
+#define portMAX_DELAY		UINT32_MAX
+#define tskIDLE_PRIORITY	0
+#define pdMS_TO_TICKS(ms)	((TickType_t)(ms))		/* CONFIG_FREERTOS_HZ = 1000 */
@@ -0,0 +1,7 @@
+#pragma once
+/* Host stub - single threaded, a mutex is never contended */
+#include "freertos/FreeRTOS.h"
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)					{ static int mutex; return &mutex; }
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t t)	{ (void)m; (void)t; return pdTRUE; }
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t m)				{ (void)m; return pdTRUE; }
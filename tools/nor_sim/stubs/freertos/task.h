@@ -0,0 +1,7 @@
+#pragma once
+/* Host stub */
+#include "freertos/FreeRTOS.h"
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+		UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
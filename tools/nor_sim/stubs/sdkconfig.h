@@ -0,0 +1,6 @@
+#pragma once
+/* Host configuration for the flash simulator */
+#define CONFIG_FS_SIMPLEFS					1
+#ifndef CONFIG_KPPTR_SFS_READY_ERASED_KB
+#define CONFIG_KPPTR_SFS_READY_ERASED_KB	8192
+#endif
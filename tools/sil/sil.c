@@ -0,0 +1,362 @@
+/*
+ * Software-in-the-loop flight simulator with Monte Carlo runs.
+ *
+ * The flight algorithms (AHRS_driver, KF_AltitudeAscent, FlightStateDetector) are compiled unchanged
+ * against host stubs of the ESP-IDF headers (tools/sil/stubs) and driven by a 6-DOF model of a high
+ * power rocket: thrust curve, Mach dependent drag, wind with turbulence, rail launch, pad handling
+ * shocks, drogue/main deployment (closed loop - triggered by the detected flight state) and landing.
+ * Sensors_t is synthesised with noise, bias, scale error, quantization and saturation.
+ *
+ * The firmware keeps its state in file-static variables, so every flight runs in its own forked
+ * process; up to -j processes run at the same time (default: all host cores).
+ *
+ * Build (from repository root):
+ *   cc -O2 -std=gnu11 -Itools/sil -Itools/sil/stubs -Icomponents/AHRS_driver/include \
+ *      -Icomponents/FlightStateDetector/include -Icomponents/Sensors/include -Icomponents/BOARD/include \
+ *      -Icomponents/SPI_driver/include -Icomponents/LIS331_driver/include -Icomponents/LSM6DSO32_driver/include \
+ *      -Icomponents/MMC5983MA_driver/include -Icomponents/MS5607_driver/include \
+ *      tools/sil/sil.c tools/sil/sil_model.c tools/sil/sil_sensors.c \
+ *      components/AHRS_driver/AHRS_driver.c components/AHRS_driver/quaternion.c \
+ *      components/AHRS_driver/KF_AltitudeAscent.c components/FlightStateDetector/FlightStateDetector.c \
+ *      -o sil -lm
+ *
+ * Usage:
+ *   sil [-n flights] [-s seed] [-j jobs] [--no-gnss]      Monte Carlo statistics
+ *   sil --csv <flight> [-s seed] [--no-gnss] > f.csv       trace of a single flight
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sil.h"
+#include "AHRS_driver.h"
+#include "FlightStateDetector.h"
+
+#define SIL_ARM_TIME_S			5.0		// Auto-arming after power-up
+#define SIL_MAIN_ALTITUDE		200.0	// FSD main chute altitude
+#define SIL_GNSS_PERIOD_S		0.2
+#define SIL_GNSS_LATENCY_S		(CONFIG_KPPTR_GNSS_LATENCY_MS / 1000.0)
+#define SIL_GNSS_ALTITUDE		250.0	// Launch site altitude (GNSS only)
+#define SIL_LANDED_TIMEOUT_S	15.0	// Keep running after touchdown
+
+#define STATES_NUM				(FLIGHTSTATE_SHUTDOWN + 1)
+
+static const char * state_names[STATES_NUM] = {
+	"STARTUP", "PREFLIGHT", "ME_ACCELERATING", "FREEFLIGHT", "FREEFALL",
+	"DRAGCHUTE_FALL", "MAINSHUTE_FALL", "LANDING", "SHUTDOWN"
+};
+
+/* Physical event each detected state is compared with */
+static const char * event_names[STATES_NUM] = {
+	NULL, NULL, "liftoff", "burnout", "apogee", "apogee", "main altitude", "touchdown", NULL
+};
+
+/* Detection this much before the event is a false trigger [s]. Main altitude is a threshold on the estimate,
+ * 2 s under drogue is ~50 m of altitude error - earlier than that is not estimation noise any more. */
+static const double false_margin[STATES_NUM] = {
+	0.0, 0.0, 0.05, 0.05, 0.05, 0.05, 2.0, 0.05, 0.0
+};
+
+typedef struct {
+	double truth[STATES_NUM];		/*!< Event time, <0 did not happen */
+	double detect[STATES_NUM];		/*!< First entry to the state, <0 never */
+	double apogee;					/*!< True apogee [m] */
+	double apogee_est;				/*!< AHRS altitude at apogee detection [m] */
+	double max_mach;
+	double impact_speed;			/*!< Vertical speed at touchdown [m/s] */
+	double gnss_bias;				/*!< Estimated baro bias at apogee [m] */
+	uint8_t done;
+} sil_result_t;
+
+static bool use_gnss = true;
+
+//---------------------------------- Single flight ---------------------------------
+static void run_flight(uint64_t seed, sil_result_t *r, FILE *csv){
+	sil_rng_t rng;
+	sil_params_t p;
+	sil_sensor_err_t err;
+	sil_state_t s;
+	Sensors_t sensors;
+
+	rng_seed(&rng, seed);
+	sil_params_random(&p, &rng);
+	sil_sensors_random(&err, &rng);
+	sil_state_init(&s, &p);
+
+	memset(&sensors, 0, sizeof(sensors));
+	sensors.ref_press = 100930.0f;		// Same as Sensors_init()
+	sil_sensors_bind(&sensors, &err);
+
+	AHRS_init(0);
+	FSD_init(AHRS_getData());
+
+	memset(r, 0, sizeof(sil_result_t));
+	for(int i = 0; i < STATES_NUM; i++){
+		r->truth[i] = -1.0;
+		r->detect[i] = -1.0;
+	}
+
+	double dt = 1.0 / SIL_RATE_HZ;
+	double gnss_next = 0.0;
+	double gnss_alt = 0.0, gnss_epoch = -1.0;
+	flightstate_t prev_state = FSD_getState();
+	bool armed = false;
+
+	if(csv != NULL)
+		fprintf(csv, "t,state,h,vz,acc_up,mach,drogue,main,est_h,est_vz,est_acc_up,tilt,baro_h,baro_bias,acc_x,press\n");
+
+	for(long k = 1; k < (long)SIL_MAX_TIME_S * SIL_RATE_HZ; k++){
+		for(int i = 0; i < SIL_SUBSTEPS; i++)
+			sil_step(&s, &p, &rng, dt / SIL_SUBSTEPS);
+
+		double t = s.t;
+		int64_t time_us = (int64_t)llround(t * 1e6);
+
+		//------ Truth events ------
+		if((r->truth[FLIGHTSTATE_ME_ACCELERATING] < 0) && (v3_norm(s.vel) > 0.0))
+			r->truth[FLIGHTSTATE_ME_ACCELERATING] = t;
+		if((r->truth[FLIGHTSTATE_FREEFLIGHT] < 0) && (t >= s.ignition_time + p.burn_time))
+			r->truth[FLIGHTSTATE_FREEFLIGHT] = t;
+		if((r->truth[FLIGHTSTATE_FREEFLIGHT] >= 0) && (r->truth[FLIGHTSTATE_FREEFALL] < 0) && (s.vel.z < 0.0)){
+			r->truth[FLIGHTSTATE_FREEFALL] = t;
+			r->truth[FLIGHTSTATE_DRAGCHUTE_FALL] = t;
+			r->apogee = s.pos.z;
+		}
+		if((r->truth[FLIGHTSTATE_FREEFALL] >= 0) && (r->truth[FLIGHTSTATE_MAINSHUTE_FALL] < 0) && (s.pos.z < SIL_MAIN_ALTITUDE))
+			r->truth[FLIGHTSTATE_MAINSHUTE_FALL] = t;
+		if((r->truth[FLIGHTSTATE_LANDING] < 0) && s.landed){
+			r->truth[FLIGHTSTATE_LANDING] = t;
+			r->impact_speed = -s.vel.z;
+		}
+		if(s.mach > r->max_mach)
+			r->max_mach = s.mach;
+		if(!s.landed)
+			r->impact_speed = -s.vel.z;
+
+		//------ Firmware main loop ------
+		sil_sensors_sample(&sensors, &s, &p, &err, &rng);
+		AHRS_compute(time_us, &sensors);
+
+		if(use_gnss){
+			// Fix epoch every period, delivered after the receiver latency
+			if(t >= gnss_next){
+				gnss_next += SIL_GNSS_PERIOD_S;
+				gnss_epoch = t;
+				gnss_alt = SIL_GNSS_ALTITUDE + s.pos.z + 3.0 * rng_normal(&rng);
+			}
+			if((gnss_epoch >= 0.0) && (t >= gnss_epoch + SIL_GNSS_LATENCY_S)){
+				AHRS_updateGNSS(time_us, gnss_alt, NAN, true);
+				gnss_epoch = -1.0;
+			}
+		}
+
+		if(!armed && (t >= SIL_ARM_TIME_S)){
+			armed = true;
+			FSD_arming();
+		}
+		FSD_detect(time_us / 1000);
+
+		flightstate_t state = FSD_getState();
+		if(state != prev_state){
+			if(r->detect[state] < 0)
+				r->detect[state] = t;
+			if(state == FLIGHTSTATE_FREEFALL){
+				r->apogee_est = AHRS_getData()->altitude;
+				r->gnss_bias = AHRS_getData()->baro_bias;
+			}
+			prev_state = state;
+		}
+
+		//------ Recovery outputs ------
+		if((state >= FLIGHTSTATE_DRAGCHUTE_FALL) && (s.drogue_time < 0))
+			s.drogue_time = t;
+		if((state >= FLIGHTSTATE_MAINSHUTE_FALL) && (s.main_time < 0))
+			s.main_time = t;
+
+		if(csv != NULL){
+			AHRS_t *a = AHRS_getData();
+			fprintf(csv, "%.2f,%d,%.2f,%.2f,%.2f,%.3f,%d,%d,%.2f,%.2f,%.2f,%.1f,%.2f,%.2f,%.3f,%.0f\n",
+					t, state, s.pos.z, s.vel.z, s.acc.z, s.mach, s.drogue_time >= 0, s.main_time >= 0,
+					a->altitude, a->ascent_rate, a->acc_up, a->orientation.euler.tilt, a->altitudeP, a->baro_bias,
+					sensors.LSM6DSO32.accX, sensors.MS5607.press);
+		}
+
+		if(s.landed && (t > r->truth[FLIGHTSTATE_LANDING] + SIL_LANDED_TIMEOUT_S))
+			break;
+	}
+
+	r->done = 1;
+}
+
+//---------------------------------- Statistics ---------------------------------
+static bool is_false(const sil_result_t *r, int st){
+	return (r->detect[st] >= 0) && ((r->truth[st] < 0) || (r->detect[st] < r->truth[st] - false_margin[st]));
+}
+
+static int cmp_double(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double pct){
+	if(n == 0)
+		return NAN;
+	int i = (int)ceil(pct / 100.0 * n) - 1;
+	return sorted[i < 0 ? 0 : i];
+}
+
+static void report(const sil_result_t *res, int n){
+	double *lat = malloc(sizeof(double) * n);
+	int completed = 0;
+
+	for(int i = 0; i < n; i++)
+		completed += res[i].done;
+
+	printf("\n%d/%d flights completed\n\n", completed, n);
+	printf("%-16s %-14s %6s %6s %6s %8s %8s %8s %8s %8s %8s\n",
+			"state", "event", "ok", "missed", "false", "earliest", "mean", "p50", "p95", "p99", "max");
+	printf("%-16s %-14s %6s %6s %6s %8s %8s %8s %8s %8s %8s\n", "", "", "", "", "", "[ms]", "[ms]", "[ms]", "[ms]", "[ms]", "[ms]");
+
+	for(int st = FLIGHTSTATE_ME_ACCELERATING; st <= FLIGHTSTATE_LANDING; st++){
+		int ok = 0, missed = 0, false_trig = 0;
+		double sum = 0.0, earliest = NAN;
+
+		for(int i = 0; i < n; i++){
+			const sil_result_t *r = &res[i];
+			if(!r->done)
+				continue;
+
+			if(r->detect[st] < 0){
+				if(r->truth[st] >= 0)
+					missed++;
+			} else if(is_false(r, st)){
+				false_trig++;
+				if((r->truth[st] >= 0) && !(earliest <= (r->detect[st] - r->truth[st]) * 1000.0))
+					earliest = (r->detect[st] - r->truth[st]) * 1000.0;
+			} else {
+				lat[ok] = (r->detect[st] - r->truth[st]) * 1000.0;
+				sum += lat[ok];
+				ok++;
+			}
+		}
+
+		qsort(lat, ok, sizeof(double), cmp_double);
+		printf("%-16s %-14s %6d %6d %6d %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f\n", state_names[st], event_names[st],
+				ok, missed, false_trig, earliest, ok ? sum / ok : NAN,
+				percentile(lat, ok, 50), percentile(lat, ok, 95), percentile(lat, ok, 99), percentile(lat, ok, 100));
+	}
+
+	// Apogee estimate and landing
+	int n_apo = 0, ballistic = 0;
+	double apo_err = 0.0, apo_max = 0.0, mach_max = 0.0, apo_true_max = 0.0;
+	for(int i = 0; i < n; i++){
+		const sil_result_t *r = &res[i];
+		if(!r->done)
+			continue;
+		if(r->detect[FLIGHTSTATE_FREEFALL] >= 0){
+			double e = fabs(r->apogee_est - r->apogee);
+			apo_err += e;
+			apo_max = fmax(apo_max, e);
+			n_apo++;
+		}
+		if(r->impact_speed > 20.0)
+			ballistic++;
+		mach_max = fmax(mach_max, r->max_mach);
+		apo_true_max = fmax(apo_true_max, r->apogee);
+	}
+
+	printf("\napogee: max %.0f m, max Mach %.2f, altitude estimate error at detection mean %.1f m, max %.1f m\n",
+			apo_true_max, mach_max, n_apo ? apo_err / n_apo : NAN, apo_max);
+	printf("landing: %d flights hit the ground faster than 20 m/s\n", ballistic);
+	free(lat);
+}
+
+//---------------------------------- Main ---------------------------------
+int main(int argc, char **argv){
+	int flights = 1000;
+	int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t seed = 1;
+	long csv_flight = -1;
+
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "-n") && (i + 1 < argc))			flights = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-j") && (i + 1 < argc))		jobs = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && (i + 1 < argc))		seed = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "--csv") && (i + 1 < argc))	csv_flight = atol(argv[++i]);
+		else if(!strcmp(argv[i], "--no-gnss"))					use_gnss = false;
+		else {
+			fprintf(stderr, "usage: %s [-n flights] [-s seed] [-j jobs] [--no-gnss] | --csv <flight>\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if(csv_flight >= 0){
+		sil_result_t r;
+		run_flight(seed * 1000003ULL + csv_flight, &r, stdout);
+		return 0;
+	}
+
+	if(jobs < 1)
+		jobs = 1;
+
+	// Results are written by the forked children directly to shared memory
+	sil_result_t *res = mmap(NULL, sizeof(sil_result_t) * flights, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(res == MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	memset(res, 0, sizeof(sil_result_t) * flights);
+
+	fprintf(stderr, "SIL: %d flights on %d processes, seed %llu, GNSS %s\n", flights, jobs, (unsigned long long)seed, use_gnss ? "on" : "off");
+
+	int running = 0, started = 0, finished = 0;
+	while(finished < flights){
+		while((running < jobs) && (started < flights)){
+			pid_t pid = fork();
+			if(pid == 0){
+				run_flight(seed * 1000003ULL + started, &res[started], NULL);
+				_exit(0);
+			} else if(pid < 0){
+				perror("fork");
+				break;
+			}
+			started++;
+			running++;
+		}
+
+		int status;
+		if(wait(&status) > 0){
+			running--;
+			finished++;
+			if((finished % 100) == 0)
+				fprintf(stderr, "\r%d/%d", finished, flights);
+		} else if(running == 0){
+			break;
+		}
+	}
+	fprintf(stderr, "\n");
+
+	report(res, flights);
+
+	// Flights worth a look - earliest false trigger of each state
+	printf("\n");
+	for(int st = FLIGHTSTATE_ME_ACCELERATING; st <= FLIGHTSTATE_LANDING; st++){
+		int worst = -1;
+		for(int i = 0; i < flights; i++){
+			const sil_result_t *r = &res[i];
+			if(r->done && is_false(r, st) && (r->truth[st] >= 0)
+					&& ((worst < 0) || (r->detect[st] - r->truth[st] < res[worst].detect[st] - res[worst].truth[st])))
+				worst = i;
+		}
+		if(worst >= 0)
+			printf("earliest false %s: --csv %d (%.2f s, %s at %.2f s)\n", state_names[st], worst,
+					res[worst].detect[st], event_names[st], res[worst].truth[st]);
+	}
+
+	munmap(res, sizeof(sil_result_t) * flights);
+	return 0;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+/*
+ * Software-in-the-loop simulator - shared types.
+ *
+ * World frame: ENU, origin at the launch pad, z up. Body frame: the Sensors_t frame after axes
+ * translation - x along the rocket axis towards the nose, y/z lateral.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "Sensors.h"
+
+#define SIL_RATE_HZ			100		/*!< Firmware loop rate (main task) */
+#define SIL_SUBSTEPS		10		/*!< Physics steps per firmware step */
+#define SIL_MAX_TIME_S		900		/*!< Hard stop of one flight */
+#define SIL_GRAVITY			9.80665
+
+//---------------------------------- Math ---------------------------------
+typedef struct { double x, y, z; } vec3_t;
+typedef struct { double w, x, y, z; } quat_t;
+
+static inline vec3_t v3(double x, double y, double z)			{ vec3_t r = {x, y, z}; return r; }
+static inline vec3_t v3_add(vec3_t a, vec3_t b)					{ return v3(a.x + b.x, a.y + b.y, a.z + b.z); }
+static inline vec3_t v3_sub(vec3_t a, vec3_t b)					{ return v3(a.x - b.x, a.y - b.y, a.z - b.z); }
+static inline vec3_t v3_scale(vec3_t a, double s)				{ return v3(a.x * s, a.y * s, a.z * s); }
+static inline double v3_dot(vec3_t a, vec3_t b)					{ return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline vec3_t v3_cross(vec3_t a, vec3_t b)				{ return v3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+static inline double v3_norm(vec3_t a)							{ return sqrt(v3_dot(a, a)); }
+
+vec3_t quat_rotate(quat_t q, vec3_t v);		/*!< body -> world */
+vec3_t quat_rotate_inv(quat_t q, vec3_t v);	/*!< world -> body */
+quat_t quat_integrate(quat_t q, vec3_t w_body, double dt);
+
+//---------------------------------- Random ---------------------------------
+typedef struct { uint64_t state; } sil_rng_t;
+
+void   rng_seed(sil_rng_t *rng, uint64_t seed);
+double rng_uniform(sil_rng_t *rng);								/*!< (0, 1) */
+double rng_range(sil_rng_t *rng, double min, double max);
+double rng_normal(sil_rng_t *rng);
+
+//---------------------------------- Vehicle and environment ---------------------------------
+/**
+ * @brief Randomized flight parameters, drawn once per flight.
+ */
+typedef struct {
+	// Motor
+	double impulse;				/*!< Total impulse [Ns] */
+	double burn_time;			/*!< Burn time [s] */
+	double prop_mass;			/*!< Propellant mass [kg] */
+	// Vehicle
+	double dry_mass;			/*!< Mass without propellant [kg] */
+	double diameter;			/*!< Body diameter [m] */
+	double length;				/*!< Body length [m] */
+	double cd;					/*!< Subsonic drag coefficient */
+	double cna;					/*!< Normal force coefficient slope [1/rad] */
+	double static_margin;		/*!< CP behind CG [m] */
+	double fin_cant_torque;		/*!< Roll torque from fin misalignment [Nm at 100 m/s] */
+	// Recovery
+	double drogue_cda;			/*!< Drogue Cd*A [m^2] */
+	double main_cda;			/*!< Main Cd*A [m^2] */
+	double chute_delay;			/*!< Ejection to full inflation [s] */
+	// Launch
+	double rail_length;			/*!< [m] */
+	double rail_elevation;		/*!< From horizontal [rad] */
+	double rail_azimuth;		/*!< [rad] */
+	double pad_time;			/*!< Time on pad before ignition [s] */
+	uint8_t pad_knocks;			/*!< Number of handling shocks on pad */
+	// Atmosphere
+	double ground_pressure;		/*!< [Pa] */
+	double ground_temp;			/*!< [K] */
+	double wind_speed;			/*!< At 10 m [m/s] */
+	double wind_dir;			/*!< [rad] */
+	double gust_sigma;			/*!< Turbulence intensity [m/s] */
+	double baro_mach_error;		/*!< Static port pressure coefficient error peak around Mach 1 */
+} sil_params_t;
+
+/**
+ * @brief Per-flight sensor error model (constant biases and scale factors).
+ */
+typedef struct {
+	vec3_t acc_bias;			/*!< [g] */
+	vec3_t acc_scale;			/*!< 1 + error */
+	vec3_t gyro_bias;			/*!< [dps] */
+	vec3_t gyro_drift;			/*!< Bias random walk state [dps] */
+	vec3_t hg_bias;				/*!< High-g accelerometer bias [g] */
+	vec3_t mag_bias;			/*!< [G] */
+	double baro_bias;			/*!< [Pa] */
+	vec3_t gyro_raw;			/*!< Last gyro sample before offset removal [dps] */
+	vec3_t gyro_offset;			/*!< Estimated by Sensors_calibrateGyro() [dps] */
+	bool gyro_calibrated;		/*!< First calibration call copies the raw sample */
+	float  baro_last;			/*!< MS5607 conversion is one cycle behind */
+} sil_sensor_err_t;
+
+/**
+ * @brief Vehicle state (truth).
+ */
+typedef struct {
+	double t;					/*!< Time from simulation start [s] */
+	vec3_t pos;					/*!< ENU [m] */
+	vec3_t vel;					/*!< ENU [m/s] */
+	quat_t att;					/*!< body -> world */
+	vec3_t omega;				/*!< Body rates [rad/s] */
+	vec3_t acc;					/*!< ENU kinematic acceleration [m/s^2] */
+	vec3_t specific_force;		/*!< Body frame, what an accelerometer measures [m/s^2] */
+	vec3_t wind;				/*!< ENU [m/s] */
+	vec3_t gust;				/*!< Turbulence state [m/s] */
+	double mach;
+	double dyn_pressure;		/*!< [Pa] */
+	double pressure;			/*!< Static pressure at the vehicle [Pa] */
+
+	double ignition_time;
+	double knock_until;			/*!< End of current pad shock */
+	vec3_t knock;				/*!< Current pad shock acceleration [m/s^2] */
+	double drogue_time;			/*!< Ejection time, <0 not deployed */
+	double main_time;			/*!< Ejection time, <0 not deployed */
+	bool on_rail;
+	bool landed;
+} sil_state_t;
+
+void sil_params_random(sil_params_t *p, sil_rng_t *rng);
+void sil_state_init(sil_state_t *s, const sil_params_t *p);
+void sil_step(sil_state_t *s, const sil_params_t *p, sil_rng_t *rng, double dt);
+double sil_thrust(const sil_params_t *p, double t_burn);
+double sil_air_pressure(const sil_params_t *p, double h);
+
+void sil_sensors_random(sil_sensor_err_t *e, sil_rng_t *rng);
+void sil_sensors_sample(Sensors_t *out, const sil_state_t *s, const sil_params_t *p, sil_sensor_err_t *e, sil_rng_t *rng);
+void sil_sensors_bind(Sensors_t *sensors, sil_sensor_err_t *e);
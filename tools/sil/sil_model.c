@@ -0,0 +1,298 @@
+/*
+ * Software-in-the-loop simulator - 6-DOF vehicle, motor, atmosphere, wind and recovery model.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "sil.h"
+
+#define AIR_R			287.05
+#define AIR_GAMMA		1.4
+#define LAPSE_RATE		0.0065
+#define GUST_TAU		2.0		// Turbulence correlation time [s]
+
+//---------------------------------- Math ---------------------------------
+static quat_t quat_mul(quat_t a, quat_t b){
+	quat_t r = {
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+	};
+	return r;
+}
+
+vec3_t quat_rotate(quat_t q, vec3_t v){
+	quat_t p = {0.0, v.x, v.y, v.z};
+	quat_t c = {q.w, -q.x, -q.y, -q.z};
+	quat_t r = quat_mul(quat_mul(q, p), c);
+	return v3(r.x, r.y, r.z);
+}
+
+vec3_t quat_rotate_inv(quat_t q, vec3_t v){
+	quat_t c = {q.w, -q.x, -q.y, -q.z};
+	return quat_rotate(c, v);
+}
+
+quat_t quat_integrate(quat_t q, vec3_t w, double dt){
+	quat_t dq = {0.0, w.x, w.y, w.z};
+	quat_t d = quat_mul(q, dq);
+	q.w += 0.5 * d.w * dt;
+	q.x += 0.5 * d.x * dt;
+	q.y += 0.5 * d.y * dt;
+	q.z += 0.5 * d.z * dt;
+
+	double n = 1.0 / sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+	q.w *= n;	q.x *= n;	q.y *= n;	q.z *= n;
+	return q;
+}
+
+//---------------------------------- Random ---------------------------------
+void rng_seed(sil_rng_t *rng, uint64_t seed){
+	rng->state = seed * 0x9E3779B97F4A7C15ULL + 0x853c49e6748fea9bULL;
+	rng_uniform(rng);
+}
+
+double rng_uniform(sil_rng_t *rng){
+	rng->state = rng->state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return ((rng->state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+double rng_range(sil_rng_t *rng, double min, double max){
+	return min + (max - min) * rng_uniform(rng);
+}
+
+double rng_normal(sil_rng_t *rng){
+	return sqrt(-2.0 * log(rng_uniform(rng))) * cos(6.283185307179586 * rng_uniform(rng));
+}
+
+//---------------------------------- Parameters ---------------------------------
+void sil_params_random(sil_params_t *p, sil_rng_t *rng){
+	memset(p, 0, sizeof(sil_params_t));
+
+	// High power rocket, 54 mm motor class - nominal apogee ~1.5-3 km
+	p->impulse        = rng_range(rng, 1200.0, 2600.0);
+	p->burn_time      = rng_range(rng, 1.8, 4.0);
+	p->prop_mass      = p->impulse / rng_range(rng, 1800.0, 2000.0);	// Isp ~190 s
+
+	p->dry_mass       = rng_range(rng, 2.8, 4.0);
+	p->diameter       = 0.066;
+	p->length         = rng_range(rng, 1.5, 1.9);
+	p->cd             = rng_range(rng, 0.40, 0.55);
+	p->cna            = rng_range(rng, 9.0, 12.0);
+	p->static_margin  = p->diameter * rng_range(rng, 1.0, 2.5);
+	p->fin_cant_torque = rng_normal(rng) * 0.02;
+
+	p->drogue_cda     = rng_range(rng, 0.08, 0.15);
+	p->main_cda       = rng_range(rng, 0.9, 1.4);
+	p->chute_delay    = rng_range(rng, 0.4, 1.2);
+
+	p->rail_length    = rng_range(rng, 2.0, 4.0);
+	p->rail_elevation = (90.0 - rng_range(rng, 0.0, 8.0)) * M_PI / 180.0;
+	p->rail_azimuth   = rng_range(rng, 0.0, 2.0 * M_PI);
+	p->pad_time       = rng_range(rng, 20.0, 60.0);
+	p->pad_knocks     = (uint8_t)rng_range(rng, 0.0, 6.0);
+
+	p->ground_pressure = rng_range(rng, 95000.0, 103000.0);
+	p->ground_temp     = rng_range(rng, 263.0, 308.0);
+	p->wind_speed      = rng_range(rng, 0.0, 10.0);
+	p->wind_dir        = rng_range(rng, 0.0, 2.0 * M_PI);
+	p->gust_sigma      = rng_range(rng, 0.2, 0.25 * p->wind_speed + 0.5);
+	p->baro_mach_error = rng_range(rng, 0.0, 0.03);
+}
+
+//---------------------------------- Models ---------------------------------
+double sil_thrust(const sil_params_t *p, double t_burn){
+	// Normalized thrust curve - ignition spike, regressive plateau, tail-off. Area = 0.986
+	static const double curve_t[] = {0.0, 0.02, 0.15, 0.85, 1.0};
+	static const double curve_f[] = {0.0, 1.40, 1.15, 0.95, 0.0};
+	double x = t_burn / p->burn_time;
+
+	if((x <= 0.0) || (x >= 1.0))
+		return 0.0;
+
+	for(int i = 1; i < 5; i++){
+		if(x <= curve_t[i]){
+			double k = (x - curve_t[i - 1]) / (curve_t[i] - curve_t[i - 1]);
+			double f = curve_f[i - 1] + k * (curve_f[i] - curve_f[i - 1]);
+			return f * p->impulse / p->burn_time / 0.986;
+		}
+	}
+	return 0.0;
+}
+
+static double air_temp(const sil_params_t *p, double h){
+	return p->ground_temp - LAPSE_RATE * h;
+}
+
+double sil_air_pressure(const sil_params_t *p, double h){
+	return p->ground_pressure * pow(air_temp(p, h) / p->ground_temp, SIL_GRAVITY / (AIR_R * LAPSE_RATE));
+}
+
+static double drag_coef(const sil_params_t *p, double mach){
+	// Transonic drag rise
+	return p->cd * (1.0 + 0.8 * exp(-pow((mach - 1.05) / 0.2, 2))) * (mach > 1.05 ? 1.0 - 0.15 * (mach - 1.05) : 1.0);
+}
+
+static double chute_inflation(double t, double t_eject, double delay){
+	if((t_eject < 0.0) || (t < t_eject))
+		return 0.0;
+	double x = (t - t_eject) / delay;
+	return (x >= 1.0) ? 1.0 : x * x;
+}
+
+static vec3_t rail_direction(const sil_params_t *p){
+	return v3(cos(p->rail_elevation) * sin(p->rail_azimuth),
+			  cos(p->rail_elevation) * cos(p->rail_azimuth),
+			  sin(p->rail_elevation));
+}
+
+void sil_state_init(sil_state_t *s, const sil_params_t *p){
+	memset(s, 0, sizeof(sil_state_t));
+
+	// Attitude - body x along the rail
+	vec3_t x = v3(1.0, 0.0, 0.0);
+	vec3_t d = rail_direction(p);
+	vec3_t axis = v3_cross(x, d);
+	double n = v3_norm(axis);
+	double angle = acos(fmin(1.0, v3_dot(x, d)));
+	axis = v3_scale(axis, 1.0 / n);
+	s->att.w = cos(angle / 2);
+	s->att.x = axis.x * sin(angle / 2);
+	s->att.y = axis.y * sin(angle / 2);
+	s->att.z = axis.z * sin(angle / 2);
+
+	s->ignition_time = p->pad_time;
+	s->drogue_time = -1.0;
+	s->main_time = -1.0;
+	s->on_rail = true;
+	s->pressure = p->ground_pressure;
+	s->specific_force = quat_rotate_inv(s->att, v3(0.0, 0.0, SIL_GRAVITY));
+}
+
+void sil_step(sil_state_t *s, const sil_params_t *p, sil_rng_t *rng, double dt){
+	s->t += dt;
+	double h = fmax(s->pos.z, 0.0);
+
+	// Atmosphere and wind - power law profile plus first order Gauss-Markov turbulence
+	double temp = air_temp(p, h);
+	double rho = sil_air_pressure(p, h) / (AIR_R * temp);
+	double sound = sqrt(AIR_GAMMA * AIR_R * temp);
+	double wind = p->wind_speed * pow(fmax(h, 1.0) / 10.0, 1.0 / 7.0);
+	double gust_k = sqrt(2.0 * dt / GUST_TAU) * p->gust_sigma;
+	s->gust.x += -s->gust.x * dt / GUST_TAU + gust_k * rng_normal(rng);
+	s->gust.y += -s->gust.y * dt / GUST_TAU + gust_k * rng_normal(rng);
+	s->gust.z += -s->gust.z * dt / GUST_TAU + 0.3 * gust_k * rng_normal(rng);
+	s->wind = v3_add(v3(wind * sin(p->wind_dir), wind * cos(p->wind_dir), 0.0), s->gust);
+	s->pressure = sil_air_pressure(p, h);
+
+	if(s->landed){
+		s->vel = v3(0.0, 0.0, 0.0);
+		s->omega = v3(0.0, 0.0, 0.0);
+		s->acc = v3(0.0, 0.0, 0.0);
+		s->mach = 0.0;
+		s->dyn_pressure = 0.0;
+		s->specific_force = quat_rotate_inv(s->att, v3(0.0, 0.0, SIL_GRAVITY));
+		return;
+	}
+
+	// Mass properties
+	double t_burn = s->t - s->ignition_time;
+	double burned = fmin(fmax(t_burn / p->burn_time, 0.0), 1.0);
+	double mass = p->dry_mass + p->prop_mass * (1.0 - burned);
+	double i_lat = mass * p->length * p->length / 12.0;
+	double i_ax = mass * p->diameter * p->diameter / 8.0;
+	double area = M_PI * p->diameter * p->diameter / 4.0;
+
+	// Aerodynamics
+	vec3_t v_rel = v3_sub(s->vel, s->wind);
+	double speed = v3_norm(v_rel);
+	double q = 0.5 * rho * speed * speed;
+	s->mach = speed / sound;
+	s->dyn_pressure = q;
+
+	vec3_t force = quat_rotate(s->att, v3(sil_thrust(p, t_burn), 0.0, 0.0));
+	vec3_t moment = v3(0.0, 0.0, 0.0);
+
+	if(speed > 0.5){
+		force = v3_add(force, v3_scale(v_rel, -q * area * drag_coef(p, s->mach) / speed));
+
+		// Normal force at CP and damping, body frame
+		vec3_t vb = quat_rotate_inv(s->att, v_rel);
+		double fy = -q * area * p->cna * vb.y / speed;
+		double fz = -q * area * p->cna * vb.z / speed;
+		force = v3_add(force, quat_rotate(s->att, v3(0.0, fy, fz)));
+
+		double damp = 0.5 * rho * speed * area * p->length * p->length;
+		moment.x = p->fin_cant_torque * pow(speed / 100.0, 2) - 0.5 * damp * p->diameter * s->omega.x;
+		moment.y = p->static_margin * fz - damp * s->omega.y;
+		moment.z = -p->static_margin * fy - damp * s->omega.z;
+	}
+
+	// Recovery - chutes attached at the nose, pendulum dynamics come from the moment arm
+	double cda = p->drogue_cda * chute_inflation(s->t, s->drogue_time, p->chute_delay)
+			   + p->main_cda * chute_inflation(s->t, s->main_time, p->chute_delay);
+	if(cda > 0.0){
+		vec3_t r_att = v3(0.5 * p->length, 0.0, 0.0);
+		vec3_t v_att = v3_sub(v3_add(s->vel, quat_rotate(s->att, v3_cross(s->omega, r_att))), s->wind);
+		vec3_t f_chute = v3_scale(v_att, -0.5 * rho * v3_norm(v_att) * cda);
+		force = v3_add(force, f_chute);
+		moment = v3_add(moment, v3_cross(r_att, quat_rotate_inv(s->att, f_chute)));
+		moment = v3_sub(moment, v3(0.0, 0.5 * i_lat * s->omega.y, 0.5 * i_lat * s->omega.z));
+	}
+
+	vec3_t acc_ng = v3_scale(force, 1.0 / mass);		// non-gravitational acceleration
+	vec3_t gravity = v3(0.0, 0.0, -SIL_GRAVITY);
+
+	if(s->on_rail){
+		// Constrained to the rail until the vehicle leaves it, held by the rail when thrust < weight
+		vec3_t d = rail_direction(p);
+		double a_along = v3_dot(v3_add(acc_ng, gravity), d);
+		if((a_along < 0.0) && (v3_dot(s->vel, d) <= 0.0))
+			a_along = 0.0;
+
+		s->acc = v3_scale(d, a_along);
+		s->vel = v3_add(s->vel, v3_scale(s->acc, dt));
+		s->pos = v3_add(s->pos, v3_scale(s->vel, dt));
+		s->omega = v3(0.0, 0.0, 0.0);
+
+		// Rail reaction cancels everything not along the rail
+		acc_ng = v3_sub(s->acc, gravity);
+
+		// Handling shocks before ignition
+		if(s->t < s->ignition_time){
+			if(s->t >= s->knock_until){
+				s->knock = v3(0.0, 0.0, 0.0);
+				if(rng_uniform(rng) < p->pad_knocks * dt / p->pad_time){
+					vec3_t dir = v3(rng_normal(rng), rng_normal(rng), 2.0 * rng_normal(rng));
+					s->knock = v3_scale(dir, rng_range(rng, 1.0, 4.0) * SIL_GRAVITY / v3_norm(dir));
+					s->knock_until = s->t + rng_range(rng, 0.01, 0.05);
+				}
+			}
+			acc_ng = v3_add(acc_ng, s->knock);
+		}
+
+		if(v3_norm(s->pos) >= p->rail_length)
+			s->on_rail = false;
+	} else {
+		s->acc = v3_add(acc_ng, gravity);
+		s->vel = v3_add(s->vel, v3_scale(s->acc, dt));
+		s->pos = v3_add(s->pos, v3_scale(s->vel, dt));
+
+		// Euler equations, diagonal inertia
+		vec3_t w = s->omega;
+		vec3_t iw = v3(i_ax * w.x, i_lat * w.y, i_lat * w.z);
+		vec3_t gyro = v3_cross(w, iw);
+		s->omega.x += (moment.x - gyro.x) / i_ax * dt;
+		s->omega.y += (moment.y - gyro.y) / i_lat * dt;
+		s->omega.z += (moment.z - gyro.z) / i_lat * dt;
+		s->att = quat_integrate(s->att, s->omega, dt);
+
+		if((s->pos.z <= 0.0) && (s->vel.z < 0.0)){
+			s->pos.z = 0.0;
+			s->landed = true;
+		}
+	}
+
+	s->specific_force = quat_rotate_inv(s->att, acc_ng);
+}
@@ -0,0 +1,121 @@
+/*
+ * Software-in-the-loop simulator - Sensors_t synthesis.
+ *
+ * Replaces the Sensors component on host: noise, bias, scale factor, quantization and saturation
+ * of every sensor, plus Sensors_UpdateReferencePressure()/Sensors_calibrateGyro() used by FSD.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "sil.h"
+
+// LSM6DSO32 - 32 g / 2000 dps full scale, 16 bit
+#define LSM_ACC_RANGE_G		32.0
+#define LSM_ACC_LSB_G		(LSM_ACC_RANGE_G / 32768.0)
+#define LSM_ACC_NOISE_G		0.004
+#define LSM_GYRO_RANGE_DPS	2000.0
+#define LSM_GYRO_LSB_DPS	0.07
+#define LSM_GYRO_NOISE_DPS	0.1
+#define LSM_GYRO_DRIFT_DPS	0.002		// Bias random walk per sample
+// H3LIS331 - 100 g full scale, 12 bit
+#define LIS_RANGE_G			100.0
+#define LIS_LSB_G			(LIS_RANGE_G / 2048.0)
+#define LIS_NOISE_G			0.08
+// MMC5983MA - 8 G full scale
+#define MMC_RANGE_G			8.0
+#define MMC_NOISE_G			0.0005
+// MS5607 - 10..1200 mbar, 0.01 mbar resolution
+#define MS_MIN_PA			1000.0
+#define MS_MAX_PA			120000.0
+#define MS_LSB_PA			1.0
+#define MS_NOISE_PA			3.0
+
+static Sensors_t * sensors_bound;
+static sil_sensor_err_t * err_bound;
+
+static double quantize(double v, double lsb, double range){
+	v = round(v / lsb) * lsb;
+	if(v > range)
+		return range;
+	if(v < -range)
+		return -range;
+	return v;
+}
+
+static vec3_t rnd_vec(sil_rng_t *rng, double sigma){
+	return v3(sigma * rng_normal(rng), sigma * rng_normal(rng), sigma * rng_normal(rng));
+}
+
+void sil_sensors_random(sil_sensor_err_t *e, sil_rng_t *rng){
+	memset(e, 0, sizeof(sil_sensor_err_t));
+
+	e->acc_bias   = rnd_vec(rng, 0.02);
+	e->acc_scale  = v3_add(v3(1.0, 1.0, 1.0), rnd_vec(rng, 0.005));
+	e->gyro_bias  = rnd_vec(rng, 1.0);
+	e->hg_bias    = rnd_vec(rng, 0.5);
+	e->mag_bias   = rnd_vec(rng, 0.05);
+	e->baro_bias  = 50.0 * rng_normal(rng);
+}
+
+void sil_sensors_sample(Sensors_t *out, const sil_state_t *s, const sil_params_t *p, sil_sensor_err_t *e, sil_rng_t *rng){
+	vec3_t f = v3_scale(s->specific_force, 1.0 / SIL_GRAVITY);		// [g]
+
+	//------ LSM6DSO32 ------
+	out->LSM6DSO32.accX = quantize(f.x * e->acc_scale.x + e->acc_bias.x + LSM_ACC_NOISE_G * rng_normal(rng), LSM_ACC_LSB_G, LSM_ACC_RANGE_G);
+	out->LSM6DSO32.accY = quantize(f.y * e->acc_scale.y + e->acc_bias.y + LSM_ACC_NOISE_G * rng_normal(rng), LSM_ACC_LSB_G, LSM_ACC_RANGE_G);
+	out->LSM6DSO32.accZ = quantize(f.z * e->acc_scale.z + e->acc_bias.z + LSM_ACC_NOISE_G * rng_normal(rng), LSM_ACC_LSB_G, LSM_ACC_RANGE_G);
+
+	e->gyro_drift = v3_add(e->gyro_drift, rnd_vec(rng, LSM_GYRO_DRIFT_DPS));
+	vec3_t w = v3_scale(s->omega, 180.0 / M_PI);
+	e->gyro_raw.x = quantize(w.x + e->gyro_bias.x + e->gyro_drift.x + LSM_GYRO_NOISE_DPS * rng_normal(rng), LSM_GYRO_LSB_DPS, LSM_GYRO_RANGE_DPS);
+	e->gyro_raw.y = quantize(w.y + e->gyro_bias.y + e->gyro_drift.y + LSM_GYRO_NOISE_DPS * rng_normal(rng), LSM_GYRO_LSB_DPS, LSM_GYRO_RANGE_DPS);
+	e->gyro_raw.z = quantize(w.z + e->gyro_bias.z + e->gyro_drift.z + LSM_GYRO_NOISE_DPS * rng_normal(rng), LSM_GYRO_LSB_DPS, LSM_GYRO_RANGE_DPS);
+	out->LSM6DSO32.gyroX = e->gyro_raw.x - e->gyro_offset.x;
+	out->LSM6DSO32.gyroY = e->gyro_raw.y - e->gyro_offset.y;
+	out->LSM6DSO32.gyroZ = e->gyro_raw.z - e->gyro_offset.z;
+	out->LSM6DSO32.temp  = 25.0f;
+
+	//------ H3LIS331 ------
+	out->LIS331.accX = quantize(f.x + e->hg_bias.x + LIS_NOISE_G * rng_normal(rng), LIS_LSB_G, LIS_RANGE_G);
+	out->LIS331.accY = quantize(f.y + e->hg_bias.y + LIS_NOISE_G * rng_normal(rng), LIS_LSB_G, LIS_RANGE_G);
+	out->LIS331.accZ = quantize(f.z + e->hg_bias.z + LIS_NOISE_G * rng_normal(rng), LIS_LSB_G, LIS_RANGE_G);
+
+	//------ MMC5983MA - earth field north and down (central Europe) ------
+	vec3_t mag = v3_add(quat_rotate_inv(s->att, v3(0.0, 0.19, -0.46)), e->mag_bias);
+	out->MMC5983MA.magX = quantize(mag.x + MMC_NOISE_G * rng_normal(rng), 1.0 / 16384.0, MMC_RANGE_G);
+	out->MMC5983MA.magY = quantize(mag.y + MMC_NOISE_G * rng_normal(rng), 1.0 / 16384.0, MMC_RANGE_G);
+	out->MMC5983MA.magZ = quantize(mag.z + MMC_NOISE_G * rng_normal(rng), 1.0 / 16384.0, MMC_RANGE_G);
+
+	//------ MS5607 - static port error grows with dynamic pressure, jumps around Mach 1 ------
+	double port_err = -s->dyn_pressure * (0.002 + p->baro_mach_error * exp(-pow((s->mach - 1.0) / 0.12, 2)));
+	double press = s->pressure + port_err + e->baro_bias + MS_NOISE_PA * rng_normal(rng);
+	press = fmin(fmax(round(press / MS_LSB_PA) * MS_LSB_PA, MS_MIN_PA), MS_MAX_PA);
+	out->MS5607.press = (e->baro_last > 0.0f) ? e->baro_last : press;
+	out->MS5607.temp  = 25.0f;
+	e->baro_last = press;
+}
+
+void sil_sensors_bind(Sensors_t *sensors, sil_sensor_err_t *e){
+	sensors_bound = sensors;
+	err_bound = e;
+}
+
+//---------------------------------- Sensors component replacement ---------------------------------
+esp_err_t Sensors_UpdateReferencePressure(){
+	sensors_bound->ref_press = 0.005f*sensors_bound->MS5607.press + 0.995f*(sensors_bound->ref_press);
+
+	return ESP_OK;
+}
+
+esp_err_t Sensors_calibrateGyro(float gain){
+	sil_sensor_err_t *e = err_bound;
+
+	if(e->gyro_calibrated == false){
+		e->gyro_calibrated = true;
+		e->gyro_offset = e->gyro_raw;
+		return ESP_OK;
+	}
+
+	e->gyro_offset = v3_add(v3_scale(e->gyro_raw, gain), v3_scale(e->gyro_offset, 1.0 - gain));
+	return ESP_OK;
+}
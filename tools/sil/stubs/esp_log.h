@@ -0,0 +1,9 @@
+#pragma once
+/* Host stub - logs are dropped, SIL runs thousands of flights */
+#include "esp_err.h"
+
+#define ESP_LOGE(tag, ...)	do { (void)(tag); } while(0)
+#define ESP_LOGW(tag, ...)	do { (void)(tag); } while(0)
+#define ESP_LOGI(tag, ...)	do { (void)(tag); } while(0)
+#define ESP_LOGD(tag, ...)	do { (void)(tag); } while(0)
+#define ESP_LOGV(tag, ...)	do { (void)(tag); } while(0)
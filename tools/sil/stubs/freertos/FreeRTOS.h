@@ -0,0 +1,3 @@
+#pragma once
+/* Host stub */
+#include <stdint.h>
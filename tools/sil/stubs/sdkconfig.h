@@ -0,0 +1,8 @@
+#pragma once
+/* Host configuration for SIL - board with all flight sensors */
+#define CONFIG_BOARD_PTR_MEGA_VER_1_REV_0	1
+#define CONFIG_KPPTR_MEAS_RATE_HZ			100
+#define CONFIG_KPPTR_GNSS_LATENCY_MS		100
+#ifndef CONFIG_KPPTR_APOGEE_LEAD_MS
+#define CONFIG_KPPTR_APOGEE_LEAD_MS			0
+#endif
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""
+Captures and decodes the live sample stream of the external UART (CONFIG_KPPTR_UART_STREAM) into CSV.
+
+  python tools/stream_capture/stream_capture.py /dev/ttyUSB0 -b 2000000 -o static_fire.csv --raw static_fire.bin
+  python tools/stream_capture/stream_capture.py --file static_fire.bin -o static_fire.csv
+
+Frames are Stream_frame_t (components/Stream_driver/include/Stream_driver.h): sync 5A A5, type, len, seq,
+DataPackage_t, CRC16. The decoder resyncs on the preamble and accepts a frame only with a valid CRC. Jumps of
+seq are samples lost on the device (queue full - baudrate too low), they are reported as they happen and in
+the summary. Reading a port needs pyserial. Stop with Ctrl+C.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+SYNC = b"\x5A\xA5"
+HEADER = struct.Struct("<HBBH")
+TYPE_DATA = 0x01
+
+# DataPackage_t without deadline_miss - its length (SYSMGR_TASKMON_NUM) follows from the frame length
+DATA_FIELDS = [
+	("sys_time", "I"),
+	("accX", "f"), ("accY", "f"), ("accZ", "f"),
+	("gyroX", "f"), ("gyroY", "f"), ("gyroZ", "f"),
+	("magX", "f"), ("magY", "f"), ("magZ", "f"),
+	("accHX", "f"), ("accHY", "f"), ("accHZ", "f"),
+	("pressure", "f"), ("temp", "b"),
+	("latitude", "i"), ("longitude", "i"), ("altitude_gnss", "f"), ("gnss_fix", "b"),
+	("altitude_press", "f"), ("altitude_kalman", "f"), ("ascent_rate_kalman", "f"), ("tilt", "B"),
+	("q0", "f"), ("q1", "f"), ("q2", "f"), ("q3", "f"),
+	("flightstate", "B"), ("ign", "B"), ("vbat_mV", "H"), ("vbat_min_mV", "H"),
+	("servo_1", "b"), ("servo_2", "b"), ("servo_3", "b"), ("servo_4", "b"), ("servo_en", "B"),
+]
+DATA = struct.Struct("<" + "".join(c for _, c in DATA_FIELDS))
+
+
+def crc16(data):
+	"""esp_crc16_le(UINT16_MAX, ...) - CRC-16/CCITT, reflected, inverted in and out."""
+	crc = 0
+	for b in data:
+		crc ^= b
+		for _ in range(8):
+			crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+	return crc ^ 0xFFFF
+
+
+class Decoder:
+	def __init__(self, out):
+		self.buf = bytearray()
+		self.out = out
+		self.header_written = False
+		self.frames = 0
+		self.crc_errors = 0
+		self.lost = 0
+		self.seq = None
+
+	def feed(self, data):
+		self.buf += data
+		while True:
+			pos = self.buf.find(SYNC)
+			if pos < 0:
+				del self.buf[:-1]
+				return
+			del self.buf[:pos]
+			if len(self.buf) < HEADER.size:
+				return
+			_, ftype, length, seq = HEADER.unpack_from(self.buf)
+			size = HEADER.size + length + 2
+			if len(self.buf) < size:
+				return
+			crc, = struct.unpack_from("<H", self.buf, size - 2)
+			if crc != crc16(self.buf[:size - 2]) or ftype != TYPE_DATA or length < DATA.size:
+				self.crc_errors += 1
+				del self.buf[:1]		# False preamble or damaged frame - search again after it
+				continue
+			self.frame(seq, bytes(self.buf[HEADER.size:size - 2]))
+			del self.buf[:size]
+
+	def frame(self, seq, payload):
+		if self.seq is not None and seq != ((self.seq + 1) & 0xFFFF):
+			gap = (seq - self.seq - 1) & 0xFFFF
+			self.lost += gap
+			print("seq %d: %d samples lost" % (seq, gap), file=sys.stderr)
+		self.seq = seq
+		self.frames += 1
+
+		deadline = list(payload[DATA.size:])
+		if not self.header_written:
+			self.out.writerow(["seq"] + [n for n, _ in DATA_FIELDS] + ["deadline_miss_%d" % i for i in range(len(deadline))])
+			self.header_written = True
+		self.out.writerow([seq] + list(DATA.unpack_from(payload)) + deadline)
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument("port", nargs="?", help="serial port")
+	parser.add_argument("-b", "--baud", type=int, default=2000000, help="baudrate (default: 2000000)")
+	parser.add_argument("-f", "--file", help="decode a raw capture instead of a port")
+	parser.add_argument("-o", "--output", default="stream.csv", help="CSV output (default: stream.csv)")
+	parser.add_argument("--raw", help="also save the raw bytes of the port")
+	args = parser.parse_args()
+
+	if not args.port and not args.file:
+		parser.error("port or --file required")
+
+	with open(args.output, "w", newline="") as f:
+		decoder = Decoder(csv.writer(f))
+		if args.file:
+			with open(args.file, "rb") as src:
+				decoder.feed(src.read())
+		else:
+			import serial
+			raw = open(args.raw, "wb") if args.raw else None
+			with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+				try:
+					while True:
+						data = port.read(4096)
+						if raw:
+							raw.write(data)
+						decoder.feed(data)
+				except KeyboardInterrupt:
+					pass
+			if raw:
+				raw.close()
+
+	print("%d frames, %d lost, %d CRC errors" % (decoder.frames, decoder.lost, decoder.crc_errors))
+
+
+if __name__ == "__main__":
+	main()